@@ -9,18 +9,13 @@ import ts3api
 GREETING_MESSAGE = "Welcome to the channel! 👋"
 ENABLE_GREETER = True
 
-def on_client_move(server_id, client_id, old_channel, new_channel):
+# ignore_self is evaluated in the plugin, so our own moves never reach Python
+@ts3api.on("client_move", ignore_self=True)
+def greet(server_id, client_id, old_channel, new_channel):
     """Greet users who join our channel"""
     if not ENABLE_GREETER:
         return
     
-    # Get our own client ID
-    my_id = ts3api.get_client_id(server_id)
-    
-    # Don't greet ourselves
-    if client_id == my_id:
-        return
-    
     # Get the client's name
     client_name = ts3api.get_client_name(server_id, client_id)
     
@@ -4,33 +4,30 @@ Example script for logging ham radio call signs from chat
 """
 
 import ts3api
-import re
 
-# Regular expression for call signs (basic pattern)
-CALLSIGN_PATTERN = r'\b[A-Z]{1,2}\d[A-Z]{1,4}\b'
+# Call signs are found by the plugin's native scanner; on_trigger only runs on hits
+CALLSIGN_TRIGGER = ts3api.add_pattern("callsign")
 
-# Store call signs (in production, save to file)
-callsigns = set()
+# The plugin itself records every call sign to its QSO log (once per UTC day),
+# so nothing needs to be stored here and nothing is lost on reload.
 
-def on_text_message(server_id, target_mode, to_id, from_id, from_name, from_uid, message):
-    """Extract and log call signs from messages"""
+def on_trigger(server_id, trigger_id, match, message_info):
+    """Announce call signs found in messages"""
+    if trigger_id != CALLSIGN_TRIGGER:
+        return
     
-    # Find call signs in message
-    matches = re.findall(CALLSIGN_PATTERN, message.upper())
-    
-    for callsign in matches:
-        if callsign not in callsigns:
-            callsigns.add(callsign)
-            ts3api.log(f"New call sign detected: {callsign} (from {from_name})", 0)
+    ts3api.log(f"Call sign heard: {match.upper()} (from {message_info['from_name']})", 0)
 
 def on_command(server_id, command, args):
-    """Handle /tspy callsigns command"""
+    """Handle /tspy callsigns [export] command"""
     if command == "callsigns":
-        if not callsigns:
+        if args == "export":
+            count = ts3api.qso_export_adif()
+            ts3api.print_message(server_id, f"Exported {count} call signs to ADIF")
+        elif ts3api.qso_count() == 0:
             ts3api.print_message(server_id, "No call signs logged yet")
         else:
-            count = len(callsigns)
-            signs = ", ".join(sorted(callsigns))
-            ts3api.print_message(server_id, f"Logged {count} call signs: {signs}")
+            signs = ", ".join(call for call, when, heard_from in ts3api.qso_recent(20))
+            ts3api.print_message(server_id, f"Logged {ts3api.qso_count()} call signs, latest: {signs}")
 
 ts3api.log("Call Sign Logger script loaded", 0)
@@ -23,10 +23,14 @@ def on_client_move(server_id, client_id, old_channel, new_channel):
 def on_text_message(server_id, target_mode, to_id, from_id, from_name, from_uid, message):
     """Called when a text message is received"""
     ts3api.log(f"Message from {from_name}: {message}", 0)
-    
-    # Auto-respond to greetings
-    if "hello" in message.lower() or "hi" in message.lower():
-        ts3api.send_channel_message(server_id, f"Hi {from_name}! 👋 (auto-reply from Python)")
+
+# Greetings are matched natively; on_trigger only runs when one is found
+GREETINGS = {ts3api.add_trigger("hello"), ts3api.add_trigger("hi")}
+
+def on_trigger(server_id, trigger_id, match, message_info):
+    """Called when a registered keyword or pattern appears in a message"""
+    if trigger_id in GREETINGS:
+        ts3api.send_channel_message(server_id, f"Hi {message_info['from_name']}! 👋 (auto-reply from Python)")
 
 def on_command(server_id, command, args):
     """Called when a plugin command is executed"""
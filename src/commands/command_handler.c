@@ -5,33 +5,76 @@
  * @version 1.2.0
  */
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "command_handler.h"
 #include "core/plugin_main.h"
+#include "core/plugin_config.h"
+#include "ham/qso_log.h"
+#include "python/python_codecache.h"
 #include "python/python_engine.h"
+#include "python/python_errors.h"
+#include "python/python_events.h"
+#include "python/python_gc.h"
+#include "python/python_interpreters.h"
+#include "python/python_loop.h"
+#include "python/python_memory.h"
+#include "python/python_outbound.h"
+#include "python/python_pool.h"
+#include "python/python_preload.h"
+#include "python/python_profile.h"
+#include "python/python_requests.h"
+#include "python/python_store.h"
+#include "python/python_strings.h"
+#include "python/python_subscriptions.h"
+#include "python/python_timers.h"
+#include "python/python_triggers.h"
+#include "utils/arena.h"
 #include "utils/logging.h"
 #include "utils/string_utils.h"
+#include "utils/trace.h"
 
 typedef enum {
     CMD_NONE = 0,
     CMD_HELP,
     CMD_STATUS,
     CMD_INFO,
-    CMD_PYTHON
+    CMD_PYTHON,
+    CMD_TRACE,
+    CMD_QSO,
+    CMD_STATS,
+    CMD_CONFIG
 } CommandType;
 
-static CommandType parse_command(const char* command, char** param1, char** param2)
+/* Format a line of any length into the command's scratch arena */
+static const char* scratch_printf(const char* format, ...)
 {
-    char buf[COMMAND_BUFSIZE];
+    va_list args;
+    const char* text;
+
+    va_start(args, format);
+    text = arena_vprintf(arena_thread(), format, args);
+    va_end(args);
+    return text != NULL ? text : "(out of memory)";
+}
+
+/* Parameters point into a copy in the scratch arena, valid until the command returns */
+static CommandType parse_command(const char* command, char** param1, char** param2, char** param3)
+{
+    char* buf;
     char* token;
     char* context = NULL;
     CommandType cmd = CMD_NONE;
     int tokenIndex = 0;
 
-    safe_strcpy(buf, COMMAND_BUFSIZE, command);
+    buf = arena_strdup(arena_thread(), command);
+    if (buf == NULL) {
+        return CMD_NONE;
+    }
 
 #ifdef _WIN32
     token = strtok_s(buf, " ", &context);
@@ -49,11 +92,21 @@ static CommandType parse_command(const char* command, char** param1, char** para
                 cmd = CMD_INFO;
             } else if (strcmp(token, "python") == 0 || strcmp(token, "py") == 0) {
                 cmd = CMD_PYTHON;
+            } else if (strcmp(token, "trace") == 0) {
+                cmd = CMD_TRACE;
+            } else if (strcmp(token, "qso") == 0) {
+                cmd = CMD_QSO;
+            } else if (strcmp(token, "stats") == 0) {
+                cmd = CMD_STATS;
+            } else if (strcmp(token, "config") == 0) {
+                cmd = CMD_CONFIG;
             }
         } else if (tokenIndex == 1 && param1 != NULL) {
             *param1 = token;
         } else if (tokenIndex == 2 && param2 != NULL) {
             *param2 = token;
+        } else if (tokenIndex == 3 && param3 != NULL) {
+            *param3 = token;
         }
 
 #ifdef _WIN32
@@ -77,18 +130,41 @@ static int handle_help_command(uint64 serverConnectionHandlerID)
     log_info("  /tspy help           - Show this help message");
     log_info("  /tspy status         - Show plugin status");
     log_info("  /tspy info           - Show plugin information");
-    log_info("  /tspy python status  - Show Python engine status");
-    log_info("  /tspy python load <script> - Load a Python script");
+    log_info("  /tspy python status  - Show Python engine status and memory per script");
+    log_info("  /tspy python load <script> [interpreter] - Load a Python script, optionally isolated");
     log_info("  /tspy python reload  - Reload all Python scripts");
+    log_info("  /tspy python unload <script> - Unload a Python script");
+    log_info("  /tspy python list    - List loaded scripts");
+    log_info("  /tspy python bench [folder] - Time compiling against cached loads");
+    log_info("  /tspy trace start [spans] - Start recording a performance trace");
+    log_info("  /tspy trace stop [file]   - Stop tracing and write Chrome trace JSON");
+    log_info("  /tspy qso [recent]        - Show callsigns logged from chat");
+    log_info("  /tspy qso export [file]   - Export the callsign log as ADIF");
+    log_info("  /tspy stats          - Show timer, task, message and store stats");
+    log_info("  /tspy config [reload] - Show settings or reload %s", CONFIG_FILENAME);
 
     if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
         ts3Functions->printMessageToCurrentTab("TsPy Plugin Commands:");
         ts3Functions->printMessageToCurrentTab("  /tspy help           - Show this help message");
         ts3Functions->printMessageToCurrentTab("  /tspy status         - Show plugin status");
         ts3Functions->printMessageToCurrentTab("  /tspy info           - Show plugin information");
-        ts3Functions->printMessageToCurrentTab("  /tspy python status  - Show Python engine status");
-        ts3Functions->printMessageToCurrentTab("  /tspy python load <script> - Load a Python script");
+        ts3Functions->printMessageToCurrentTab("  /tspy python status  - Show Python engine status and memory per script");
+        ts3Functions->printMessageToCurrentTab("  /tspy python load <script> [interpreter] - Load a Python script, optionally isolated");
         ts3Functions->printMessageToCurrentTab("  /tspy python reload  - Reload all Python scripts");
+        ts3Functions->printMessageToCurrentTab("  /tspy python unload <script> - Unload a Python script");
+        ts3Functions->printMessageToCurrentTab("  /tspy python list    - List loaded scripts");
+        ts3Functions->printMessageToCurrentTab("  /tspy python bench [folder] - Time compiling against cached loads");
+        ts3Functions->printMessageToCurrentTab("  /tspy python poolbench [connections] [events] - Time handlers inline against the handler pool");
+        ts3Functions->printMessageToCurrentTab("  /tspy python strbench [names] [lookups] - Time decoding nicknames against the string cache");
+        ts3Functions->printMessageToCurrentTab("  /tspy python shards  - Show handler pool queues per connection and lane");
+        ts3Functions->printMessageToCurrentTab("  /tspy python profile <start [hz]|stop [file]> - Sample script code and write flame graph stacks");
+        ts3Functions->printMessageToCurrentTab("  /tspy python errors [id|clear] - List recent Python errors or show one's traceback");
+        ts3Functions->printMessageToCurrentTab("  /tspy trace start [spans] - Start recording a performance trace");
+        ts3Functions->printMessageToCurrentTab("  /tspy trace stop [file]   - Stop tracing and write Chrome trace JSON");
+        ts3Functions->printMessageToCurrentTab("  /tspy qso [recent]        - Show callsigns logged from chat");
+        ts3Functions->printMessageToCurrentTab("  /tspy qso export [file]   - Export the callsign log as ADIF");
+        ts3Functions->printMessageToCurrentTab("  /tspy stats          - Show timer, task, message and store stats");
+        ts3Functions->printMessageToCurrentTab("  /tspy config [reload] - Show settings or reload " CONFIG_FILENAME);
     }
 
     return 0;
@@ -135,11 +211,11 @@ static int handle_info_command(uint64 serverConnectionHandlerID)
     return 0;
 }
 
-static int handle_python_command(uint64 serverConnectionHandlerID, const char* subcommand, const char* param)
+static int handle_python_command(uint64 serverConnectionHandlerID, const char* subcommand, const char* param,
+                                 const char* interpreter)
 {
     struct TS3Functions* ts3Functions = get_ts3_functions();
     char message[512];
-    char script_path[512];
     
     if (!python_engine_is_initialized()) {
         snprintf(message, sizeof(message), "Python engine is not initialized");
@@ -153,7 +229,7 @@ static int handle_python_command(uint64 serverConnectionHandlerID, const char* s
     }
     
     if (subcommand == NULL) {
-        snprintf(message, sizeof(message), "Usage: /tspy python <status|load|reload>");
+        snprintf(message, sizeof(message), "Usage: /tspy python <status|load|unload|list|reload|bench|poolbench|strbench|shards|profile|errors>");
         log_warning("%s", message);
         
         if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
@@ -178,6 +254,34 @@ static int handle_python_command(uint64 serverConnectionHandlerID, const char* s
                 ts3Functions->printMessageToCurrentTab("No errors");
             }
         }
+
+        /* Per-script memory, unattributed first */
+        if (!python_memory_enabled()) {
+            snprintf(message, sizeof(message), "Memory accounting: off ([memory] accounting = 1 turns it on at the next start)");
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+        } else {
+            MemoryUsage usage[MEMORY_MAX_SCRIPTS];
+            size_t count;
+            size_t i;
+
+            python_memory_enforce();
+            count = python_memory_get_usage(usage, MEMORY_MAX_SCRIPTS);
+            for (i = 0; i < count; i++) {
+                snprintf(message, sizeof(message), "Memory of %.*s: %.1f MB live, %.1f MB peak%s",
+                         (int)sizeof(usage[i].script),
+                         usage[i].script[0] != '\0' ? usage[i].script : "engine and shared modules",
+                         usage[i].liveBytes / (1024.0 * 1024.0), usage[i].peakBytes / (1024.0 * 1024.0),
+                         usage[i].disabled ? " (unloaded at its hard limit)"
+                                           : usage[i].overSoftLimit ? " (over its soft limit)" : "");
+                log_info("%s", message);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(message);
+                }
+            }
+        }
         return 0;
     }
     
@@ -207,48 +311,389 @@ static int handle_python_command(uint64 serverConnectionHandlerID, const char* s
         }
         
         /* Add .py extension if not present */
-        char script_name[256];
-        if (strstr(param, ".py") == NULL) {
-            snprintf(script_name, sizeof(script_name), "%s.py", param);
-        } else {
-            safe_strcpy(script_name, sizeof(script_name), param);
-        }
+        const char* script_name = strstr(param, ".py") == NULL ? scratch_printf("%s.py", param) : param;
+        const char* line;
         
         /* Build full path: scripts_path/script_name */
 #ifdef _WIN32
-        snprintf(script_path, sizeof(script_path), "%s\\%s", scripts_path, script_name);
+        const char* script_path = scratch_printf("%s\\%s", scripts_path, script_name);
 #else
-        snprintf(script_path, sizeof(script_path), "%s/%s", scripts_path, script_name);
+        const char* script_path = scratch_printf("%s/%s", scripts_path, script_name);
 #endif
         
-        snprintf(message, sizeof(message), "Loading Python script: %s", script_name);
-        log_info("%s", message);
+        if (interpreter != NULL) {
+            line = scratch_printf("Loading Python script: %s (interpreter %s)", script_name, interpreter);
+        } else {
+            line = scratch_printf("Loading Python script: %s", script_name);
+        }
+        log_info("%s", line);
         
         if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
-            ts3Functions->printMessageToCurrentTab(message);
+            ts3Functions->printMessageToCurrentTab(line);
         }
         
-        if (python_engine_load_script(script_path) == 0) {
-            snprintf(message, sizeof(message), "Successfully loaded: %s", script_name);
-            log_info("%s", message);
+        if (python_engine_load_script_in(script_path, interpreter) == 0) {
+            line = scratch_printf("Successfully loaded: %s", script_name);
+            log_info("%s", line);
             
             if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
-                ts3Functions->printMessageToCurrentTab(message);
+                ts3Functions->printMessageToCurrentTab(line);
             }
             return 0;
         } else {
             const char* error = python_engine_get_error();
-            snprintf(message, sizeof(message), "Failed to load %s: %s", 
-                     script_name, error ? error : "Unknown error");
-            log_error("%s", message);
+            line = scratch_printf("Failed to load %s: %s", script_name, error ? error : "Unknown error");
+            log_error("%s", line);
             
             if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
-                ts3Functions->printMessageToCurrentTab(message);
+                ts3Functions->printMessageToCurrentTab(line);
             }
             return 1;
         }
     }
     
+    /* Handle python unload <script> */
+    if (strcmp(subcommand, "unload") == 0) {
+        const char* line;
+
+        if (param == NULL || strlen(param) == 0) {
+            line = "Usage: /tspy python unload <script_name>";
+        } else if (python_engine_unload_script(param) == 0) {
+            line = scratch_printf("Unloaded: %s", param);
+        } else {
+            const char* error = python_engine_get_error();
+            line = scratch_printf("Failed to unload %s: %s", param, error ? error : "Unknown error");
+        }
+        log_info("%s", line);
+        
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(line);
+        }
+        return 0;
+    }
+    
+    /* Handle python list */
+    if (strcmp(subcommand, "list") == 0) {
+        size_t count = python_engine_get_script_count();
+        size_t i;
+        
+        snprintf(message, sizeof(message), "Loaded scripts: %zu", count);
+        log_info("%s", message);
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+            for (i = 0; i < count; i++) {
+                char name[SCRIPT_NAME_BUFSIZE];
+
+                /* Scripts may be unloaded meanwhile; the rest of the list just ends early */
+                if (python_engine_get_script_name(i, name, sizeof(name)) != 0) {
+                    break;
+                }
+                snprintf(message, sizeof(message), "  %s (%d handlers, %d triggers)",
+                         name, python_engine_get_script_handler_count(name),
+                         python_triggers_count_for_script(name));
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+        }
+        
+        /* Isolated interpreters and their scripts */
+        {
+            InterpreterInfo interpreters[INTERPRETER_MAX];
+            char names[64][SCRIPT_NAME_BUFSIZE];
+            size_t interpreterCount = python_interpreters_list(interpreters, INTERPRETER_MAX);
+            size_t j;
+            
+            for (i = 0; i < interpreterCount; i++) {
+                size_t nameCount = python_interpreters_scripts(interpreters[i].name, names, 64);
+                
+                snprintf(message, sizeof(message), "Interpreter %.*s: %zu scripts, %zu events queued",
+                         (int)sizeof(interpreters[i].name), interpreters[i].name,
+                         interpreters[i].scripts, interpreters[i].queued);
+                log_info("%s", message);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(message);
+                    for (j = 0; j < nameCount; j++) {
+                        snprintf(message, sizeof(message), "  %s", names[j]);
+                        ts3Functions->printMessageToCurrentTab(message);
+                    }
+                }
+            }
+        }
+        return 0;
+    }
+    
+    /* Handle python bench [folder] */
+    if (strcmp(subcommand, "bench") == 0) {
+        CodeCacheBenchmark bench;
+        const char* folder = param != NULL && strlen(param) > 0 ? param : python_engine_get_scripts_path();
+
+        if (python_codecache_benchmark(folder, 5, &bench) != 0) {
+            snprintf(message, sizeof(message), "Cannot read folder: %s", folder);
+        } else if (bench.scripts == 0) {
+            snprintf(message, sizeof(message), "No scripts to measure in %s", folder);
+        } else {
+            snprintf(message, sizeof(message),
+                     "%zu scripts (%.0f KiB): compiling %.2f ms, from cache file %.2f ms, from memory %.2f ms",
+                     bench.scripts, bench.sourceBytes / 1024.0, bench.compileNs / 1e6, bench.unmarshalNs / 1e6,
+                     bench.memoryNs / 1e6);
+        }
+        log_info("%s", message);
+
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+        return 0;
+    }
+    
+    /* Handle python poolbench [connections] [events] */
+    if (strcmp(subcommand, "poolbench") == 0) {
+        PoolBenchmark bench;
+        unsigned int connections = param != NULL && strlen(param) > 0 ? (unsigned int)strtoul(param, NULL, 10) : 4;
+        size_t events = interpreter != NULL ? (size_t)strtoul(interpreter, NULL, 10) : 2000;
+
+        if (python_pool_benchmark(connections, events, &bench) != 0) {
+            snprintf(message, sizeof(message), "Usage: /tspy python poolbench [connections 1-64] [events]");
+        } else {
+            snprintf(message, sizeof(message),
+                     "%zu events from %u connections: inline %.1f ms (%.0f/s), %u threads%s %.1f ms (%.0f/s), %.2fx",
+                     bench.events, bench.connections, bench.inlineNs / 1e6,
+                     bench.inlineNs > 0 ? bench.events * 1e9 / bench.inlineNs : 0.0, bench.threads,
+                     bench.freeThreaded ? " without a GIL" : " with the GIL", bench.poolNs / 1e6,
+                     bench.poolNs > 0 ? bench.events * 1e9 / bench.poolNs : 0.0,
+                     bench.poolNs > 0 ? (double)bench.inlineNs / (double)bench.poolNs : 0.0);
+        }
+        log_info("%s", message);
+
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+        return 0;
+    }
+    
+    /* Handle python strbench [names] [lookups] */
+    if (strcmp(subcommand, "strbench") == 0) {
+        StringCacheBenchmark bench;
+        size_t names = param != NULL && strlen(param) > 0 ? (size_t)strtoul(param, NULL, 10) : 200;
+        size_t lookups = interpreter != NULL ? (size_t)strtoul(interpreter, NULL, 10) : 100000;
+
+        if (python_strings_benchmark(names, lookups, &bench) != 0) {
+            snprintf(message, sizeof(message), "Usage: /tspy python strbench [names 1-%d] [lookups]",
+                     64 * STRING_CACHE_ENTRIES);
+        } else {
+            snprintf(message, sizeof(message),
+                     "%zu strings from %zu names: decoded %.1f ms (%zu objects), cached %.1f ms (%llu objects, "
+                     "%llu evictions, %.1f KB not allocated), %.2fx",
+                     bench.lookups, bench.names, bench.decodeNs / 1e6, bench.lookups, bench.cacheNs / 1e6,
+                     (unsigned long long)bench.decodes, (unsigned long long)bench.evictions, bench.savedBytes / 1024.0,
+                     bench.cacheNs > 0 ? (double)bench.decodeNs / (double)bench.cacheNs : 0.0);
+        }
+        log_info("%s", message);
+
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+        return 0;
+    }
+    
+    /* Handle python shards */
+    if (strcmp(subcommand, "shards") == 0) {
+        PoolShardStats shards[32];
+        size_t count = python_pool_get_shards(shards, 32);
+        size_t i;
+
+        if (count == 0) {
+            snprintf(message, sizeof(message), "No handler pool shards (handlers run on the client thread or saw no events)");
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+            return 0;
+        }
+        for (i = 0; i < count; i++) {
+            char name[32];
+
+            if (shards[i].lane == SUBSCRIPTION_LANE_CONNECTION) {
+                snprintf(name, sizeof(name), "Server %llu", (unsigned long long)shards[i].connection);
+            } else {
+                snprintf(name, sizeof(name), "Lane %08x", shards[i].lane);
+            }
+            snprintf(message, sizeof(message),
+                     "%s (worker %u): %zu queued (max %zu), %llu handled up to #%llu, %llu dropped, "
+                     "latency %.2f ms avg / %.2f ms max",
+                     name, shards[i].home, shards[i].queued, shards[i].maxQueued,
+                     (unsigned long long)shards[i].handled, (unsigned long long)shards[i].sequence,
+                     (unsigned long long)shards[i].dropped,
+                     shards[i].handled > 0 ? shards[i].latencyNs / 1e6 / (double)shards[i].handled : 0.0,
+                     shards[i].maxLatencyNs / 1e6);
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+        }
+        return 0;
+    }
+    
+    /* Handle python profile [start [hz]|stop [file]|status] */
+    if (strcmp(subcommand, "profile") == 0) {
+        ProfileStats profile;
+        char profile_path[PATH_BUFSIZE];
+        size_t i;
+
+        if (param != NULL && strcmp(param, "start") == 0) {
+            unsigned int hz = interpreter != NULL ? (unsigned int)strtoul(interpreter, NULL, 10) : 0;
+            int result = python_profile_start(hz);
+
+            if (result == 0) {
+                python_profile_get_stats(&profile);
+                snprintf(message, sizeof(message), "Profiling started at %u Hz", profile.hz);
+            } else if (result > 0) {
+                snprintf(message, sizeof(message), "The profiler is already running");
+            } else {
+                snprintf(message, sizeof(message), "The profiler could not be started (see log)");
+            }
+        } else if (param != NULL && strcmp(param, "stop") == 0) {
+            long stacks;
+
+            if (interpreter != NULL && strlen(interpreter) > 0) {
+                safe_strcpy(profile_path, sizeof(profile_path), interpreter);
+            } else {
+                join_path(profile_path, sizeof(profile_path), get_config_path(), "tspy_profile.txt");
+            }
+            if (!python_profile_is_running()) {
+                snprintf(message, sizeof(message), "The profiler is not running");
+            } else if ((stacks = python_profile_stop(profile_path, &profile)) < 0) {
+                const char* line = scratch_printf("Failed to write profile: %s", profile_path);
+
+                log_error("%s", line);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(line);
+                }
+                return 1;
+            } else {
+                /* Paths can fill the message buffer, so these lines are formatted in the arena */
+                const char* line = scratch_printf(
+                    "Profile written (%llu samples in %.1f s, %ld stacks, sampler held the GIL %.2f%% of the time): %s",
+                    (unsigned long long)profile.samples, profile.elapsedNs / 1e9, stacks,
+                    profile.elapsedNs > 0 ? profile.gilHeldNs * 100.0 / (double)profile.elapsedNs : 0.0,
+                    profile_path);
+
+                log_info("%s", line);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(line);
+                }
+                /* Where the samples ended, to point at the slow function without a flame graph */
+                for (i = 0; i < profile.hotspots; i++) {
+                    snprintf(message, sizeof(message), "  %5.1f%%  %s",
+                             profile.samples > 0 ? profile.top[i].samples * 100.0 / (double)profile.samples : 0.0,
+                             profile.top[i].function);
+                    log_info("%s", message);
+                    if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                        ts3Functions->printMessageToCurrentTab(message);
+                    }
+                }
+                return 0;
+            }
+        } else if (param == NULL || strcmp(param, "status") == 0) {
+            python_profile_get_stats(&profile);
+            if (!profile.running) {
+                snprintf(message, sizeof(message), "Profiler: stopped");
+            } else {
+                snprintf(message, sizeof(message),
+                         "Profiler: %u Hz for %.1f s, %llu samples in %llu of %llu ticks (%llu truncated), %zu nodes, "
+                         "GIL held %.2f%% / waited %.1f ms",
+                         profile.hz, profile.elapsedNs / 1e9, (unsigned long long)profile.samples,
+                         (unsigned long long)profile.busyTicks, (unsigned long long)profile.ticks,
+                         (unsigned long long)profile.truncated, profile.nodes,
+                         profile.elapsedNs > 0 ? profile.gilHeldNs * 100.0 / (double)profile.elapsedNs : 0.0,
+                         profile.gilWaitNs / 1e6);
+            }
+        } else {
+            snprintf(message, sizeof(message), "Usage: /tspy python profile <start [hz]|stop [file]|status>");
+        }
+        log_info("%s", message);
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+        return 0;
+    }
+
+    /* Handle python errors [id|clear] */
+    if (strcmp(subcommand, "errors") == 0) {
+        ErrorInfo errors[10];
+        size_t count;
+        size_t i;
+
+        if (param != NULL && strcmp(param, "clear") == 0) {
+            python_errors_clear();
+            snprintf(message, sizeof(message), "Python errors cleared");
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+            return 0;
+        }
+
+        if (param != NULL && strlen(param) > 0) {
+            char traceback[4096];
+            uint64_t id = strtoull(param[0] == '#' ? param + 1 : param, NULL, 10);
+            char* line;
+            char* next;
+
+            if (python_errors_traceback(id, traceback, sizeof(traceback)) != 0) {
+                snprintf(message, sizeof(message), "No Python error #%s (only the last %d are kept)", param,
+                         ERROR_RING_SIZE);
+                log_warning("%s", message);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(message);
+                }
+                return 1;
+            }
+            for (line = traceback; *line != '\0'; line = next) {
+                next = strchr(line, '\n');
+                if (next != NULL) {
+                    *next++ = '\0';
+                } else {
+                    next = line + strlen(line);
+                }
+                log_info("%s", line);
+                if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                    ts3Functions->printMessageToCurrentTab(line);
+                }
+            }
+            return 0;
+        }
+
+        count = python_errors_list(errors, 10);
+        if (count == 0) {
+            snprintf(message, sizeof(message), "No Python errors recorded");
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+            return 0;
+        }
+        for (i = 0; i < count; i++) {
+            char when[32];
+            char repeats[32] = "";
+            time_t last = (time_t)errors[i].lastTime;
+            struct tm* local = localtime(&last);
+
+            if (local == NULL || strftime(when, sizeof(when), "%H:%M:%S", local) == 0) {
+                safe_strcpy(when, sizeof(when), "?");
+            }
+            if (errors[i].count > 1) {
+                snprintf(repeats, sizeof(repeats), " x%llu", (unsigned long long)errors[i].count);
+            }
+            snprintf(message, sizeof(message), "#%llu %s%s %s.%s: %s: %s", (unsigned long long)errors[i].id, when,
+                     repeats, errors[i].script[0] != '\0' ? errors[i].script : "<unowned>", errors[i].handler,
+                     errors[i].type, errors[i].message);
+            log_info("%s", message);
+            if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+                ts3Functions->printMessageToCurrentTab(message);
+            }
+        }
+        return 0;
+    }
+    
     /* Handle python reload */
     if (strcmp(subcommand, "reload") == 0) {
         snprintf(message, sizeof(message), "Reloading all Python scripts...");
@@ -268,12 +713,12 @@ static int handle_python_command(uint64 serverConnectionHandlerID, const char* s
             return 0;
         } else {
             const char* error = python_engine_get_error();
-            snprintf(message, sizeof(message), "Failed to reload scripts: %s", 
-                     error ? error : "Unknown error");
-            log_error("%s", message);
+            const char* line = scratch_printf("Failed to reload scripts: %s", error ? error : "Unknown error");
+
+            log_error("%s", line);
             
             if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
-                ts3Functions->printMessageToCurrentTab(message);
+                ts3Functions->printMessageToCurrentTab(line);
             }
             return 1;
         }
@@ -285,16 +730,341 @@ static int handle_python_command(uint64 serverConnectionHandlerID, const char* s
     
     if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
         ts3Functions->printMessageToCurrentTab(message);
-        ts3Functions->printMessageToCurrentTab("Available: status, load, reload");
+        ts3Functions->printMessageToCurrentTab("Available: status, load, unload, list, reload, bench");
     }
     
     return 1;
 }
 
+static int handle_trace_command(uint64 serverConnectionHandlerID, const char* subcommand, const char* param)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    char message[PATH_BUFSIZE + 64];
+    char trace_path[PATH_BUFSIZE];
+
+    (void)serverConnectionHandlerID; /* May be used in future */
+
+    if (subcommand == NULL) {
+        snprintf(message, sizeof(message), "Usage: /tspy trace <start|stop|status>");
+    } else if (strcmp(subcommand, "start") == 0) {
+        size_t capacity = param != NULL ? (size_t)strtoul(param, NULL, 10) : get_config()->traceCapacity;
+        if (trace_start(capacity) == 0) {
+            snprintf(message, sizeof(message), "Tracing started");
+        } else {
+            snprintf(message, sizeof(message), "Tracing is already running");
+        }
+    } else if (strcmp(subcommand, "stop") == 0) {
+        if (param != NULL && strlen(param) > 0) {
+            safe_strcpy(trace_path, sizeof(trace_path), param);
+        } else {
+            join_path(trace_path, sizeof(trace_path), get_config_path(), "tspy_trace.json");
+        }
+
+        if (!trace_is_enabled()) {
+            snprintf(message, sizeof(message), "Tracing is not running");
+        } else {
+            long spans = trace_stop(trace_path);
+            if (spans >= 0) {
+                snprintf(message, sizeof(message), "Trace written (%ld spans): %s", spans, trace_path);
+            } else {
+                snprintf(message, sizeof(message), "Failed to write trace, still tracing: %s", trace_path);
+            }
+        }
+    } else if (strcmp(subcommand, "status") == 0) {
+        snprintf(message, sizeof(message), "Tracing: %s", trace_is_enabled() ? "running" : "stopped");
+    } else {
+        snprintf(message, sizeof(message), "Unknown trace command: %s", subcommand);
+    }
+
+    log_info("%s", message);
+    if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+        ts3Functions->printMessageToCurrentTab(message);
+    }
+
+    return 0;
+}
+
+static int handle_qso_command(uint64 serverConnectionHandlerID, const char* subcommand, const char* param)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    char message[PATH_BUFSIZE + 64];
+    char adif_path[PATH_BUFSIZE];
+    QsoRecord recent[10];
+    size_t count = 0;
+    size_t i;
+
+    (void)serverConnectionHandlerID; /* May be used in future */
+
+    if (!qso_log_is_open()) {
+        snprintf(message, sizeof(message), "Callsign log is not available");
+    } else if (subcommand == NULL || strcmp(subcommand, "status") == 0) {
+        snprintf(message, sizeof(message), "Callsign log: %zu records in %s", qso_log_count(), qso_log_get_path());
+    } else if (strcmp(subcommand, "recent") == 0) {
+        count = qso_log_recent(recent, sizeof(recent) / sizeof(recent[0]));
+        snprintf(message, sizeof(message), "Last %zu of %zu logged callsigns:", count, qso_log_count());
+    } else if (strcmp(subcommand, "export") == 0) {
+        long written;
+        if (param != NULL && strlen(param) > 0) {
+            safe_strcpy(adif_path, sizeof(adif_path), param);
+        } else {
+            join_path(adif_path, sizeof(adif_path), get_config_path(), "tspy_qso.adi");
+        }
+        written = qso_log_export_adif(adif_path);
+        if (written >= 0) {
+            snprintf(message, sizeof(message), "Exported %ld records: %s", written, adif_path);
+        } else {
+            snprintf(message, sizeof(message), "Failed to export: %s", adif_path);
+        }
+    } else {
+        snprintf(message, sizeof(message), "Usage: /tspy qso [status|recent|export [file]]");
+    }
+
+    log_info("%s", message);
+    if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+        ts3Functions->printMessageToCurrentTab(message);
+        for (i = 0; i < count; i++) {
+            snprintf(message, sizeof(message), "  %s (from %s)", recent[i].call, recent[i].heardFrom);
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+    }
+
+    return 0;
+}
+
+static int handle_stats_command(uint64 serverConnectionHandlerID)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    char timers[256];
+    char tasks[256];
+    char requests[256];
+    char outbound[256];
+    char store[256];
+    char code[256];
+    char strings[256];
+    char startup[256];
+    char isolated[256];
+    char handlers[256];
+    char errors[256];
+    char collector[256];
+    TimerStats stats;
+    LoopStats loop;
+    RequestStats pending;
+    OutboundStats queue;
+    KvStoreStats kv;
+    CodeCacheStats cache;
+    StringCacheStats names;
+    StartupStats boot;
+    InterpreterInfo interpreters[INTERPRETER_MAX];
+    PoolStats pool;
+    ErrorStats failures;
+    GcStats gc;
+    uint64_t collections;
+    size_t interpreterCount;
+    size_t scripts = 0;
+    size_t queued = 0;
+    uint64_t handled = 0;
+    uint64_t dropped = 0;
+    size_t i;
+
+    (void)serverConnectionHandlerID; /* May be used in future */
+
+    python_timers_get_stats(&stats);
+    snprintf(timers, sizeof(timers),
+             "Timers: %zu active, %llu scheduled, %llu fired in %llu batches (largest %zu, max lag %.1f ms)",
+             stats.active, (unsigned long long)stats.scheduled, (unsigned long long)stats.fired,
+             (unsigned long long)stats.batches, stats.maxBatch, stats.maxLagUs / 1000.0);
+
+    python_loop_get_stats(&loop);
+    snprintf(tasks, sizeof(tasks), "Tasks: %zu running, %llu started after %llu wake-ups, %llu failed",
+             loop.tasks, (unsigned long long)loop.submitted, (unsigned long long)loop.wakeups,
+             (unsigned long long)loop.failed);
+
+    python_requests_get_stats(&pending);
+    snprintf(requests, sizeof(requests), "Requests: %zu in flight, %llu sent, %llu answered, %llu timed out",
+             pending.inFlight, (unsigned long long)pending.sent, (unsigned long long)pending.completed,
+             (unsigned long long)pending.timedOut);
+
+    python_outbound_get_stats(&queue);
+    snprintf(outbound, sizeof(outbound), "Outbound: %zu queued, %llu messages sent in %llu requests, %llu rate-limit waits",
+             queue.queued, (unsigned long long)queue.messages, (unsigned long long)queue.requests,
+             (unsigned long long)queue.throttled);
+
+    if (python_store_get_stats(&kv) == 0) {
+        snprintf(store, sizeof(store),
+                 "Store: %zu keys, %.1f MiB log (%.0f%% live), %llu writes in %llu commits, %llu compactions",
+                 kv.keys, kv.logBytes / (1024.0 * 1024.0),
+                 kv.logBytes > 0 ? 100.0 * (double)kv.liveBytes / (double)kv.logBytes : 100.0,
+                 (unsigned long long)kv.writes, (unsigned long long)kv.commits,
+                 (unsigned long long)kv.compactions);
+    } else {
+        snprintf(store, sizeof(store), "Store: not available");
+    }
+
+    python_codecache_get_stats(&cache);
+    snprintf(code, sizeof(code), "Code cache: %zu scripts, %llu loads from memory, %llu from cache files, %llu compiled",
+             cache.entries, (unsigned long long)cache.memoryHits, (unsigned long long)cache.diskHits,
+             (unsigned long long)cache.compiles);
+
+    python_strings_get_stats(&names);
+    snprintf(strings, sizeof(strings),
+             "Strings: %zu cached, %llu of %llu lookups hit (%.1f KB not allocated), %llu decoded, %llu evicted, "
+             "%llu invalidated", names.entries, (unsigned long long)names.hits, (unsigned long long)names.lookups,
+             names.savedBytes / 1024.0, (unsigned long long)names.decodes, (unsigned long long)names.evictions,
+             (unsigned long long)names.invalidations);
+
+    python_preload_get_stats(&boot);
+    snprintf(startup, sizeof(startup),
+             "Startup: %zu of %zu scripts ready in %.1f ms (read %.1f ms on %u threads, compile %.1f ms, run %.1f ms)",
+             boot.loaded, boot.scripts, boot.totalNs / 1e6, boot.readNs / 1e6, boot.threads, boot.compileNs / 1e6,
+             boot.runNs / 1e6);
+
+    interpreterCount = python_interpreters_list(interpreters, INTERPRETER_MAX);
+    for (i = 0; i < interpreterCount; i++) {
+        scripts += interpreters[i].scripts;
+        queued += interpreters[i].queued;
+        handled += interpreters[i].handled;
+        dropped += interpreters[i].dropped;
+    }
+    if (python_interpreters_supported()) {
+        snprintf(isolated, sizeof(isolated),
+                 "Interpreters: %zu isolated with %zu scripts, %zu events queued, %llu handled, %llu dropped",
+                 interpreterCount, scripts, queued, (unsigned long long)handled, (unsigned long long)dropped);
+    } else {
+        snprintf(isolated, sizeof(isolated), "Interpreters: isolated interpreters need Python 3.12 or newer");
+    }
+
+    python_pool_get_stats(&pool);
+    if (pool.threads > 0) {
+        snprintf(handlers, sizeof(handlers),
+                 "Handlers: %u threads%s, %zu shards, %zu events queued, %llu handled in %llu batches "
+                 "(%llu stolen), %llu dropped", pool.threads, pool.freeThreaded ? " without a GIL" : "",
+                 pool.shards, pool.queued, (unsigned long long)pool.handled, (unsigned long long)pool.batches,
+                 (unsigned long long)pool.steals, (unsigned long long)pool.dropped);
+    } else {
+        snprintf(handlers, sizeof(handlers), "Handlers: run on the client thread%s",
+                 pool.freeThreaded ? " (free-threaded Python)" : "");
+    }
+
+    python_gc_get_stats(&gc);
+    /* Freezing runs a full collection, timed like the others */
+    collections = gc.idle + gc.forced + gc.automatic + gc.freezes;
+    snprintf(collector, sizeof(collector),
+             "GC: %s, %llu idle + %llu forced + %llu automatic collections, pause %.2f ms avg / %.2f ms max "
+             "(automatic %.2f ms max), %zu objects frozen in %llu freezes",
+             gc.scheduled ? "in idle windows" : "left to Python", (unsigned long long)gc.idle,
+             (unsigned long long)gc.forced, (unsigned long long)gc.automatic,
+             collections > 0 ? gc.pauseNs / 1e6 / (double)collections : 0.0, gc.maxPauseNs / 1e6,
+             gc.maxAutomaticPauseNs / 1e6, gc.frozen, (unsigned long long)gc.freezes);
+
+    python_errors_get_stats(&failures);
+    snprintf(errors, sizeof(errors), "Errors: %zu kept, %llu raised (%llu repeats, %llu not logged)",
+             failures.records, (unsigned long long)failures.captured, (unsigned long long)failures.repeats,
+             (unsigned long long)failures.suppressed);
+
+    log_info("%s", startup);
+    log_info("%s", handlers);
+    log_info("%s", timers);
+    log_info("%s", tasks);
+    log_info("%s", requests);
+    log_info("%s", outbound);
+    log_info("%s", store);
+    log_info("%s", code);
+    log_info("%s", strings);
+    log_info("%s", isolated);
+    log_info("%s", collector);
+    log_info("%s", errors);
+    if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+        ts3Functions->printMessageToCurrentTab(startup);
+        ts3Functions->printMessageToCurrentTab(handlers);
+        ts3Functions->printMessageToCurrentTab(timers);
+        ts3Functions->printMessageToCurrentTab(tasks);
+        ts3Functions->printMessageToCurrentTab(requests);
+        ts3Functions->printMessageToCurrentTab(outbound);
+        ts3Functions->printMessageToCurrentTab(store);
+        ts3Functions->printMessageToCurrentTab(code);
+        ts3Functions->printMessageToCurrentTab(strings);
+        ts3Functions->printMessageToCurrentTab(isolated);
+        ts3Functions->printMessageToCurrentTab(collector);
+        ts3Functions->printMessageToCurrentTab(errors);
+    }
+
+    return 0;
+}
+
+static int handle_config_command(uint64 serverConnectionHandlerID, const char* subcommand)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    const PluginConfig* config;
+    char settings[1024];
+    char path[PATH_BUFSIZE];
+    char message[PATH_BUFSIZE + 64];
+    char* line;
+    char* next;
+
+    (void)serverConnectionHandlerID; /* May be used in future */
+
+    if (subcommand != NULL && strcmp(subcommand, "reload") == 0) {
+        load_config();
+    } else if (subcommand != NULL) {
+        snprintf(message, sizeof(message), "Usage: /tspy config [reload]");
+        log_info("%s", message);
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+        return 0;
+    }
+
+    /* One snapshot, so the lines are consistent even if a reload races */
+    config = get_config();
+    join_path(path, sizeof(path), get_config_path(), CONFIG_FILENAME);
+    snprintf(message, sizeof(message), "Settings (version %u) from %s:", config->version, path);
+    format_config(config, settings, sizeof(settings));
+
+    log_info("%s", message);
+    if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+        ts3Functions->printMessageToCurrentTab(message);
+    }
+    for (line = settings; line != NULL; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        snprintf(message, sizeof(message), "  %.*s", (int)(sizeof(message) - 3), line);
+        log_info("%s", message);
+        if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+            ts3Functions->printMessageToCurrentTab(message);
+        }
+    }
+
+    return 0;
+}
+
+static int dispatch_script_command(uint64 serverConnectionHandlerID, const char* command)
+{
+    const char* args = strchr(command, ' ');
+    size_t len = args != NULL ? (size_t)(args - command) : strlen(command);
+    char* name = (char*)arena_alloc(arena_thread(), len + 1);
+
+    if (name == NULL) {
+        log_error("Out of memory dispatching command");
+        return 1;
+    }
+    memcpy(name, command, len);
+    name[len] = '\0';
+
+    while (args != NULL && *args == ' ') {
+        args++;
+    }
+
+    python_event_on_command(serverConnectionHandlerID, name, args != NULL ? args : "");
+    return 0;
+}
+
 int process_command(uint64 serverConnectionHandlerID, const char* command)
 {
     char* param1 = NULL;
     char* param2 = NULL;
+    char* param3 = NULL;
     CommandType cmd;
 
     if (command == NULL) {
@@ -303,7 +1073,7 @@ int process_command(uint64 serverConnectionHandlerID, const char* command)
 
     log_debug("Processing command: %s", command);
 
-    cmd = parse_command(command, &param1, &param2);
+    cmd = parse_command(command, &param1, &param2, &param3);
 
     switch (cmd) {
         case CMD_HELP:
@@ -313,9 +1083,25 @@ int process_command(uint64 serverConnectionHandlerID, const char* command)
         case CMD_INFO:
             return handle_info_command(serverConnectionHandlerID);
         case CMD_PYTHON:
-            return handle_python_command(serverConnectionHandlerID, param1, param2);
+            return handle_python_command(serverConnectionHandlerID, param1, param2, param3);
+        case CMD_TRACE:
+            return handle_trace_command(serverConnectionHandlerID, param1, param2);
+        case CMD_QSO:
+            return handle_qso_command(serverConnectionHandlerID, param1, param2);
+        case CMD_STATS:
+            return handle_stats_command(serverConnectionHandlerID);
+        case CMD_CONFIG:
+            return handle_config_command(serverConnectionHandlerID, param1);
         case CMD_NONE:
         default:
+            /* Let scripts implement their own commands via on_command */
+            if (python_engine_is_initialized()) {
+                size_t handlerCount = 0;
+                python_engine_get_handlers(PYTHON_EVENT_COMMAND, &handlerCount);
+                if (handlerCount > 0 || python_interpreters_count() > 0) {
+                    return dispatch_script_command(serverConnectionHandlerID, command);
+                }
+            }
             log_warning("Unknown command: %s", command);
             return 1;
     }
@@ -3,20 +3,402 @@
  * @brief Plugin configuration implementation
  * @author TeamSpeak Systems GmbH
  * @version 1.2.0
+ *
+ * Snapshots are published RCU-style: a load builds a complete PluginConfig,
+ * then swaps the current pointer. Replaced snapshots are kept until
+ * cleanup_plugin_config() instead of tracking readers, since a reload only
+ * happens when someone saves the file.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "plugin_config.h"
 #include "plugin_main.h"
+#include "python/python_gc.h"
+#include "python/python_outbound.h"
+#include "python/python_requests.h"
+#include "utils/file_watch.h"
+#include "utils/kv_store.h"
 #include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
 
-static char g_configPath[PATH_BUFSIZE] = {0};
+#define CONFIG_MAX_FILE    (64 * 1024)
+#define CONFIG_SECTION_MAX 32
+
+typedef enum {
+    SETTING_LEVEL,
+    SETTING_UINT,
+    SETTING_DOUBLE
+} SettingType;
+
+typedef struct ConfigSetting {
+    const char* section;
+    const char* key;
+    SettingType type;
+    size_t      offset;
+    double      min;
+    double      max;
+    const char* comment;
+} ConfigSetting;
+
+/* A published snapshot and the one it replaced */
+typedef struct ConfigSnapshot {
+    PluginConfig           config;
+    struct ConfigSnapshot* older;
+} ConfigSnapshot;
+
+static const PluginConfig g_defaults = {
+    0,
+    LOG_LEVEL_DEBUG,
+    TRACE_DEFAULT_CAPACITY,
+    OUTBOUND_DEFAULT_RATE,
+    OUTBOUND_DEFAULT_BURST,
+    REQUEST_DEFAULT_TIMEOUT,
+    KV_STORE_COMMIT_MS,
+    1,
+    0,
+    GC_DEFAULT_THRESHOLD,
+    GC_DEFAULT_IDLE_MS,
+    GC_DEFAULT_MAX_INTERVAL_MS,
+    0,
+    0,
+    0
+};
+
+/* Grouped by section, in the order save_config() writes them */
+static const ConfigSetting g_settings[] = {
+    {"logging", "level", SETTING_LEVEL, offsetof(PluginConfig, logLevel), 0.0, 0.0,
+     "Lowest level logged: debug, info, warning or error"},
+    {"scripts", "auto_reload", SETTING_UINT, offsetof(PluginConfig, autoReload), 0.0, 1.0,
+     "1 to reload a loaded script as soon as its file is saved, 0 to reload by command only"},
+    {"scripts", "handler_threads", SETTING_UINT, offsetof(PluginConfig, handlerThreads), 0.0, 16.0,
+     "Threads running event handlers; 0 for 4 on free-threaded Python and none (the client thread) otherwise"},
+    {"trace", "capacity", SETTING_UINT, offsetof(PluginConfig, traceCapacity), 1024.0, 16777216.0,
+     "Spans kept by /tspy trace start when no count is given"},
+    {"outbound", "rate", SETTING_DOUBLE, offsetof(PluginConfig, outboundRate), 0.1, 1000.0,
+     "Chat messages sent per second per server"},
+    {"outbound", "burst", SETTING_DOUBLE, offsetof(PluginConfig, outboundBurst), 1.0, 1000.0,
+     "Messages sent back to back before the rate applies"},
+    {"requests", "timeout", SETTING_DOUBLE, offsetof(PluginConfig, requestTimeout), 0.1, 3600.0,
+     "Default seconds before an awaited call raises TimeoutError"},
+    {"store", "commit_ms", SETTING_UINT, offsetof(PluginConfig, storeCommitMs), 0.0, 1000.0,
+     "Milliseconds ts3api.store writes are collected into one flush"},
+    {"gc", "threshold", SETTING_UINT, offsetof(PluginConfig, gcThreshold), 0.0, 10000000.0,
+     "Allocations before Python collects by itself; 0 to collect only in idle windows"},
+    {"gc", "idle_ms", SETTING_UINT, offsetof(PluginConfig, gcIdleMs), 0.0, 60000.0,
+     "Milliseconds without events before garbage is collected; 0 to leave collection to Python"},
+    {"gc", "max_interval_ms", SETTING_UINT, offsetof(PluginConfig, gcMaxIntervalMs), 10.0, 3600000.0,
+     "Longest time between collections when events never pause"},
+    {"memory", "accounting", SETTING_UINT, offsetof(PluginConfig, memoryAccounting), 0.0, 1.0,
+     "1 to count Python memory per script (takes effect when the plugin starts)"},
+    {"memory", "soft_limit_mb", SETTING_UINT, offsetof(PluginConfig, memorySoftLimitMb), 0.0, 65536.0,
+     "Megabytes a script may hold before a warning is logged; 0 for no limit"},
+    {"memory", "hard_limit_mb", SETTING_UINT, offsetof(PluginConfig, memoryHardLimitMb), 0.0, 65536.0,
+     "Megabytes a script may hold before it is unloaded; 0 for no limit"}
+};
+
+#define SETTING_COUNT (sizeof(g_settings) / sizeof(g_settings[0]))
+
+/* Indexed by LogLevel */
+static const char* const g_levelNames[] = {"debug", "info", "warning", "error"};
+
+static char           g_configPath[PATH_BUFSIZE] = {0};
+static char           g_filePath[PATH_BUFSIZE] = {0};
+static void* volatile g_current = NULL;      /* ConfigSnapshot*, NULL means defaults */
+static ConfigSnapshot* g_snapshots = NULL;   /* Every published snapshot, newest first */
+static Mutex          g_lock;                /* Serializes loads and listener changes */
+static ConfigListener g_listeners[CONFIG_MAX_LISTENERS];
+static int            g_listenerCount = 0;
+static FileWatch*     g_watch = NULL;
+static int            g_initialized = 0;
+
+/* ========================================================================
+ * Settings table
+ * ======================================================================== */
+
+static const void* setting_field(const PluginConfig* config, const ConfigSetting* setting)
+{
+    return (const char*)config + setting->offset;
+}
+
+static const ConfigSetting* find_setting(const char* section, const char* key)
+{
+    size_t i;
+
+    for (i = 0; i < SETTING_COUNT; i++) {
+        if (strcmp(g_settings[i].section, section) == 0 && strcmp(g_settings[i].key, key) == 0) {
+            return &g_settings[i];
+        }
+    }
+    return NULL;
+}
+
+static int setting_equal(const ConfigSetting* setting, const PluginConfig* a, const PluginConfig* b)
+{
+    const void* left = setting_field(a, setting);
+    const void* right = setting_field(b, setting);
+
+    switch (setting->type) {
+        case SETTING_LEVEL:
+            return *(const LogLevel*)left == *(const LogLevel*)right;
+        case SETTING_UINT:
+            return *(const unsigned int*)left == *(const unsigned int*)right;
+        case SETTING_DOUBLE:
+        default:
+            return *(const double*)left == *(const double*)right;
+    }
+}
+
+static void format_value(char* dest, size_t destSize, const ConfigSetting* setting, const PluginConfig* config)
+{
+    const void* field = setting_field(config, setting);
+
+    switch (setting->type) {
+        case SETTING_LEVEL: {
+            LogLevel level = *(const LogLevel*)field;
+            safe_strcpy(dest, destSize, (unsigned int)level < 4 ? g_levelNames[level] : "debug");
+            break;
+        }
+        case SETTING_UINT:
+            snprintf(dest, destSize, "%u", *(const unsigned int*)field);
+            break;
+        case SETTING_DOUBLE:
+        default:
+            snprintf(dest, destSize, "%g", *(const double*)field);
+            break;
+    }
+}
+
+static int parse_value(const ConfigSetting* setting, const char* text, PluginConfig* config)
+{
+    void* field = (char*)config + setting->offset;
+    double number;
+    char* end;
+    int i;
+
+    if (setting->type == SETTING_LEVEL) {
+        for (i = 0; i < 4; i++) {
+            if (strcmp(text, g_levelNames[i]) == 0) {
+                *(LogLevel*)field = (LogLevel)i;
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    errno = 0;
+    number = strtod(text, &end);
+    if (end == text || *end != '\0' || errno != 0 || !(number >= setting->min && number <= setting->max)) {
+        return -1;
+    }
+    if (setting->type == SETTING_UINT) {
+        if (number != (double)(unsigned int)number) {
+            return -1;
+        }
+        *(unsigned int*)field = (unsigned int)number;
+    } else {
+        *(double*)field = number;
+    }
+    return 0;
+}
+
+/* ========================================================================
+ * Parsing
+ * ======================================================================== */
+
+static char* trim(char* text)
+{
+    char* end;
+
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+/* Comments start with # or ; at the beginning of a line or after whitespace */
+static void strip_comment(char* line)
+{
+    char* cursor;
+
+    for (cursor = line; *cursor != '\0'; cursor++) {
+        if ((*cursor == '#' || *cursor == ';') && (cursor == line || cursor[-1] == ' ' || cursor[-1] == '\t')) {
+            *cursor = '\0';
+            return;
+        }
+    }
+}
+
+/* Applies every valid line to config; returns the number of bad lines */
+static int parse_config(char* text, PluginConfig* config)
+{
+    char section[CONFIG_SECTION_MAX] = "";
+    char* cursor = text;
+    int line = 0;
+    int errors = 0;
+
+    /* Windows editors like to add a byte order mark */
+    if (strncmp(cursor, "\xEF\xBB\xBF", 3) == 0) {
+        cursor += 3;
+    }
+
+    while (cursor != NULL && *cursor != '\0') {
+        const ConfigSetting* setting;
+        char* next = strchr(cursor, '\n');
+        char* content;
+        char* equals;
+        char* value;
+
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line++;
+        content = cursor;
+        cursor = next;
+
+        strip_comment(content);
+        content = trim(content);
+        if (*content == '\0') {
+            continue;
+        }
+
+        if (*content == '[') {
+            char* close = strchr(content, ']');
+            if (close == NULL || close[1] != '\0') {
+                log_warning("%s:%d: malformed section header", g_filePath, line);
+                errors++;
+                continue;
+            }
+            *close = '\0';
+            safe_strcpy(section, sizeof(section), trim(content + 1));
+            continue;
+        }
+
+        equals = strchr(content, '=');
+        if (equals == NULL) {
+            log_warning("%s:%d: expected key = value", g_filePath, line);
+            errors++;
+            continue;
+        }
+        *equals = '\0';
+        value = trim(equals + 1);
+        content = trim(content);
+
+        setting = find_setting(section, content);
+        if (setting == NULL) {
+            log_warning("%s:%d: unknown setting %s.%s", g_filePath, line, section, content);
+            errors++;
+        } else if (parse_value(setting, value, config) != 0) {
+            log_warning("%s:%d: invalid value for %s.%s: %s", g_filePath, line, section, content, value);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+static char* read_file(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    char* text;
+    size_t length;
+
+    if (file == NULL) {
+        return NULL;
+    }
+    text = (char*)malloc(CONFIG_MAX_FILE + 1);
+    if (text == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    length = fread(text, 1, CONFIG_MAX_FILE + 1, file);
+    fclose(file);
+
+    if (length > CONFIG_MAX_FILE) {
+        log_warning("%s is larger than %d bytes", path, CONFIG_MAX_FILE);
+        free(text);
+        return NULL;
+    }
+    text[length] = '\0';
+    return text;
+}
+
+/* ========================================================================
+ * Publishing
+ * ======================================================================== */
+
+/* Caller holds g_lock */
+static void publish(const PluginConfig* config)
+{
+    const PluginConfig* previous = get_config();
+    ConfigSnapshot* snapshot;
+    size_t i;
+    int changed = 0;
+    int listener;
+
+    for (i = 0; i < SETTING_COUNT; i++) {
+        if (!setting_equal(&g_settings[i], config, previous)) {
+            changed = 1;
+            break;
+        }
+    }
+    /* Saving the file unchanged, or a second event for one save */
+    if (!changed) {
+        return;
+    }
+
+    snapshot = (ConfigSnapshot*)malloc(sizeof(ConfigSnapshot));
+    if (snapshot == NULL) {
+        log_error("Out of memory applying the configuration");
+        return;
+    }
+    snapshot->config = *config;
+    snapshot->config.version = previous->version + 1;
+    snapshot->older = g_snapshots;
+    g_snapshots = snapshot;
+    atomic_ptr_store(&g_current, snapshot);
+
+    for (i = 0; i < SETTING_COUNT; i++) {
+        char before[32];
+        char after[32];
+
+        if (setting_equal(&g_settings[i], config, previous)) {
+            continue;
+        }
+        format_value(before, sizeof(before), &g_settings[i], previous);
+        format_value(after, sizeof(after), &g_settings[i], config);
+        log_info("Config: %s.%s %s -> %s", g_settings[i].section, g_settings[i].key, before, after);
+    }
+
+    for (listener = 0; listener < g_listenerCount; listener++) {
+        g_listeners[listener](&snapshot->config, previous);
+    }
+}
+
+static void on_config_file_changed(void* context, const char* name)
+{
+    (void)context; /* Unused parameter */
+    (void)name;    /* Unused parameter */
+
+    load_config();
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
 
 bool init_plugin_config(const char* configPath)
 {
+    FILE* existing;
+
     if (configPath == NULL) {
         log_error("Config path is NULL");
         return false;
@@ -24,33 +406,188 @@ bool init_plugin_config(const char* configPath)
 
     strncpy(g_configPath, configPath, PATH_BUFSIZE - 1);
     g_configPath[PATH_BUFSIZE - 1] = '\0';
+    join_path(g_filePath, sizeof(g_filePath), g_configPath, CONFIG_FILENAME);
 
     log_info("Config path set to: %s", g_configPath);
-    
-    /* Load configuration if exists */
-    load_config();
-    
+
+    mutex_init(&g_lock);
+    g_initialized = 1;
+
+    /* Load configuration, or write the defaults as a starting point */
+    existing = fopen(g_filePath, "rb");
+    if (existing != NULL) {
+        fclose(existing);
+        load_config();
+    } else if (save_config()) {
+        log_info("Created %s with default settings", g_filePath);
+    }
+
+    g_watch = file_watch_start(g_filePath, on_config_file_changed, NULL);
+    if (g_watch == NULL) {
+        log_warning("Changes to %s need /tspy config reload", g_filePath);
+    }
+
     return true;
 }
 
 void cleanup_plugin_config(void)
 {
-    /* Save configuration before cleanup */
-    save_config();
-    
+    /* The file is edited by hand; it is not rewritten on exit */
+    file_watch_stop(g_watch);
+    g_watch = NULL;
+
+    /* Every other thread has stopped, so no reader holds a snapshot */
+    atomic_ptr_store(&g_current, NULL);
+    while (g_snapshots != NULL) {
+        ConfigSnapshot* older = g_snapshots->older;
+        free(g_snapshots);
+        g_snapshots = older;
+    }
+
+    if (g_initialized) {
+        g_listenerCount = 0;
+        mutex_destroy(&g_lock);
+        g_initialized = 0;
+    }
+
     memset(g_configPath, 0, sizeof(g_configPath));
+    memset(g_filePath, 0, sizeof(g_filePath));
+}
+
+const char* get_config_path(void)
+{
+    return g_configPath;
+}
+
+const PluginConfig* get_config(void)
+{
+    const ConfigSnapshot* snapshot = (const ConfigSnapshot*)atomic_ptr_load(&g_current);
+
+    return snapshot != NULL ? &snapshot->config : &g_defaults;
 }
 
 bool load_config(void)
 {
-    /* TODO: Implement configuration loading */
-    log_info("Loading configuration...");
-    return true;
+    PluginConfig config = g_defaults;
+    char* text;
+    int errors;
+
+    if (!g_initialized) {
+        return false;
+    }
+
+    mutex_lock(&g_lock);
+    text = read_file(g_filePath);
+    if (text == NULL) {
+        mutex_unlock(&g_lock);
+        log_warning("Cannot read %s; keeping the current settings", g_filePath);
+        return false;
+    }
+
+    /* Settings missing from the file fall back to their defaults */
+    TRACE_BEGIN(span);
+    errors = parse_config(text, &config);
+    free(text);
+    publish(&config);
+    TRACE_END(span, "config", "load");
+    mutex_unlock(&g_lock);
+
+    if (errors > 0) {
+        log_warning("%s: %d line(s) ignored", g_filePath, errors);
+    }
+    return errors == 0;
 }
 
 bool save_config(void)
 {
-    /* TODO: Implement configuration saving */
-    log_info("Saving configuration...");
+    const PluginConfig* config = get_config();
+    const char* section = "";
+    FILE* file;
+    size_t i;
+
+    if (g_filePath[0] == '\0') {
+        return false;
+    }
+
+    file = fopen(g_filePath, "w");
+    if (file == NULL) {
+        log_error("Failed to write %s", g_filePath);
+        return false;
+    }
+
+    fprintf(file, "# TsPy settings. Changes apply as soon as the file is saved.\n");
+    for (i = 0; i < SETTING_COUNT; i++) {
+        char value[32];
+
+        if (strcmp(g_settings[i].section, section) != 0) {
+            section = g_settings[i].section;
+            fprintf(file, "\n[%s]\n", section);
+        }
+        format_value(value, sizeof(value), &g_settings[i], config);
+        fprintf(file, "# %s\n%s = %s\n", g_settings[i].comment, g_settings[i].key, value);
+    }
+
+    if (fclose(file) != 0) {
+        log_error("Failed to write %s", g_filePath);
+        return false;
+    }
     return true;
 }
+
+bool add_config_listener(ConfigListener listener)
+{
+    bool added = false;
+
+    if (!g_initialized || listener == NULL) {
+        return false;
+    }
+
+    mutex_lock(&g_lock);
+    if (g_listenerCount < CONFIG_MAX_LISTENERS) {
+        g_listeners[g_listenerCount++] = listener;
+        added = true;
+    }
+    mutex_unlock(&g_lock);
+    return added;
+}
+
+void remove_config_listener(ConfigListener listener)
+{
+    int i;
+
+    if (!g_initialized) {
+        return;
+    }
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_listenerCount; i++) {
+        if (g_listeners[i] == listener) {
+            g_listeners[i] = g_listeners[--g_listenerCount];
+            break;
+        }
+    }
+    mutex_unlock(&g_lock);
+}
+
+int format_config(const PluginConfig* config, char* dest, size_t destSize)
+{
+    size_t used = 0;
+    size_t i;
+
+    if (destSize > 0) {
+        dest[0] = '\0';
+    }
+    for (i = 0; i < SETTING_COUNT && used < destSize; i++) {
+        char value[32];
+        int written;
+
+        format_value(value, sizeof(value), &g_settings[i], config);
+        written = snprintf(dest + used, destSize - used, "%s%s.%s = %s", i > 0 ? "\n" : "",
+                           g_settings[i].section, g_settings[i].key, value);
+        if (written < 0) {
+            break;
+        }
+        used += (size_t)written;
+    }
+    return (int)SETTING_COUNT;
+}
@@ -3,17 +3,65 @@
  * @brief Plugin configuration management
  * @author TeamSpeak Systems GmbH
  * @version 1.4.0
+ *
+ * Settings live in tspy.ini in the TeamSpeak config directory. Each load
+ * parses the file into a new immutable PluginConfig and publishes it with a
+ * single pointer swap, so readers on any thread call get_config() without
+ * locking. The file is watched and reloaded when it is saved.
  */
 
 #ifndef PLUGIN_CONFIG_H
 #define PLUGIN_CONFIG_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#include "utils/logging.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Settings file name inside the config directory
+ */
+#define CONFIG_FILENAME "tspy.ini"
+
+/**
+ * @brief Most listeners add_config_listener() accepts
+ */
+#define CONFIG_MAX_LISTENERS 16
+
+/**
+ * @brief One immutable snapshot of the settings
+ */
+typedef struct PluginConfig {
+    unsigned int version;        /* 0 for built-in defaults, then one per change */
+    LogLevel     logLevel;       /* [logging] level: messages below it are dropped */
+    unsigned int traceCapacity;  /* [trace] capacity: spans kept by /tspy trace start */
+    double       outboundRate;   /* [outbound] rate: messages per second per server */
+    double       outboundBurst;  /* [outbound] burst: messages sent back to back */
+    double       requestTimeout; /* [requests] timeout: default seconds for awaitable calls */
+    unsigned int storeCommitMs;  /* [store] commit_ms: group commit window */
+    unsigned int autoReload;     /* [scripts] auto_reload: reload loaded scripts when saved */
+    unsigned int handlerThreads; /* [scripts] handler_threads: event handler workers, 0 for automatic */
+    unsigned int gcThreshold;    /* [gc] threshold: gen0 threshold while scheduling, 0 for no automatic collection */
+    unsigned int gcIdleMs;       /* [gc] idle_ms: quiet time before a collection, 0 to leave it to Python */
+    unsigned int gcMaxIntervalMs; /* [gc] max_interval_ms: longest time between collections */
+    unsigned int memoryAccounting;  /* [memory] accounting: count memory per script, read at engine start */
+    unsigned int memorySoftLimitMb; /* [memory] soft_limit_mb: log a script above it, 0 for no limit */
+    unsigned int memoryHardLimitMb; /* [memory] hard_limit_mb: unload a script above it, 0 for no limit */
+} PluginConfig;
+
+/**
+ * @brief Called after a changed configuration was published
+ * @param config New snapshot
+ * @param previous Snapshot it replaced
+ * @note Runs on the thread that reloaded (the file watcher or a command) with
+ *       reloads serialized; must not load the config or change listeners
+ */
+typedef void (*ConfigListener)(const PluginConfig* config, const PluginConfig* previous);
+
 /**
  * @brief Initialize plugin configuration
  * @param configPath Path to configuration directory
@@ -27,17 +75,53 @@ bool init_plugin_config(const char* configPath);
 void cleanup_plugin_config(void);
 
 /**
- * @brief Load configuration from file
- * @return true on success, false on failure
+ * @brief Get the TeamSpeak configuration directory
+ * @return Configuration path (empty before init_plugin_config)
+ */
+const char* get_config_path(void);
+
+/**
+ * @brief Current settings, without locking
+ * @return Snapshot, never NULL; stays valid until cleanup_plugin_config()
+ * @note Read it once per operation to see consistent values
+ */
+const PluginConfig* get_config(void);
+
+/**
+ * @brief Load configuration from file and publish it if it changed
+ * @return true on success, false if the file is missing or had errors
+ *         (valid settings are still applied, the rest use defaults)
  */
 bool load_config(void);
 
 /**
- * @brief Save configuration to file
+ * @brief Save the current configuration to file
  * @return true on success, false on failure
  */
 bool save_config(void);
 
+/**
+ * @brief Get notified of configuration changes
+ * @param listener Callback
+ * @return true on success, false if full or not initialized
+ */
+bool add_config_listener(ConfigListener listener);
+
+/**
+ * @brief Stop notifications; no call to listener is running when this returns
+ * @param listener Callback passed to add_config_listener()
+ */
+void remove_config_listener(ConfigListener listener);
+
+/**
+ * @brief Format a snapshot as one "section.key = value" line per setting
+ * @param config Snapshot
+ * @param dest Destination buffer
+ * @param destSize Size of dest
+ * @return Number of settings
+ */
+int format_config(const PluginConfig* config, char* dest, size_t destSize);
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,12 +19,18 @@
 #include "plugin_main.h"
 #include "plugin_config.h"
 #include "commands/command_handler.h"
+#include "ham/qso_log.h"
 #include "ui/menu_handler.h"
 #include "ui/hotkey_handler.h"
 #include "python/python_engine.h"
 #include "python/python_events.h"
+#include "python/python_preload.h"
+#include "python/python_requests.h"
+#include "python/python_strings.h"
+#include "utils/arena.h"
 #include "utils/logging.h"
 #include "utils/string_utils.h"
+#include "utils/trace.h"
 
 /* ========================================================================
  * Required Plugin Functions
@@ -82,6 +88,9 @@ int ts3plugin_init(void)
 
     log_info("Initializing plugin...");
 
+    /* Callbacks on this thread keep their scratch arena until ts3plugin_shutdown frees it */
+    arena_thread_attach();
+
     /* Query paths from client */
     ts3Functions->getAppPath(appPath, PATH_BUFSIZE);
     ts3Functions->getResourcesPath(resourcesPath, PATH_BUFSIZE);
@@ -99,6 +108,15 @@ int ts3plugin_init(void)
         return 1;
     }
 
+    /* Open the callsign log (non-fatal: chat scanning is simply skipped) */
+    {
+        char qso_path[PATH_BUFSIZE];
+        join_path(qso_path, sizeof(qso_path), configPath, "tspy_qso.log");
+        if (qso_log_open(qso_path) != 0) {
+            log_warning("Callsign logging disabled");
+        }
+    }
+
     /* Initialize Python engine with safer configuration */
     log_info("Attempting to initialize Python engine (safe mode)...");
     
@@ -113,23 +131,8 @@ int ts3plugin_init(void)
             log_warning("Failed to initialize Python event dispatcher");
         }
         
-        /* Try to load default initialization script */
-        char default_script[PATH_BUFSIZE];
-#ifdef _WIN32
-        _snprintf_s(default_script, sizeof(default_script), _TRUNCATE, "%s\\scripts\\tspy_init.py", pluginPath);
-#else
-        snprintf(default_script, sizeof(default_script), "%s/scripts/tspy_init.py", pluginPath);
-#endif
-        
-        log_info("Looking for auto-load script: %s", default_script);
-        
-        /* Load the default script if it exists (non-fatal if missing) */
-        if (python_engine_load_script(default_script) == 0) {
-            log_info("Auto-loaded: tspy_init.py");
-        } else {
-            log_info("tspy_init.py not found or failed to load (this is OK)");
-            log_info("Use /tspy python load <script> to load scripts manually");
-        }
+        /* Load the startup scripts (non-fatal if there are none or some fail) */
+        python_preload_run(python_engine_get_scripts_path());
     } else {
         log_warning("Python engine initialization failed: %s", 
                     python_engine_get_error() ? python_engine_get_error() : "Unknown error");
@@ -152,7 +155,10 @@ void ts3plugin_shutdown(void)
         python_engine_shutdown();
     }
     
+    qso_log_close();
     cleanup_plugin_config();
+    trace_shutdown();
+    arena_thread_free();
     
     /* Cleanup plugin resources */
     if (get_plugin_id() != NULL) {
@@ -190,7 +196,17 @@ const char* ts3plugin_commandKeyword(void)
 
 int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command)
 {
-    return process_command(serverConnectionHandlerID, command);
+    ArenaMark mark;
+    int result;
+    TRACE_BEGIN(span);
+
+    /* Scratch strings of the command are given back when it returns */
+    mark = arena_begin();
+    result = process_command(serverConnectionHandlerID, command);
+    arena_end(mark);
+
+    TRACE_END(span, "event", "processCommand");
+    return result;
 }
 
 void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID)
@@ -240,34 +256,56 @@ void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys)
 void ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, 
                                    unsigned int error, const char* returnCode, const char* extraMessage)
 {
-    (void)returnCode;
+    TRACE_BEGIN(span);
+
     (void)extraMessage;
     
-    log_info("EVENT CALLBACK: Server error: server=%llu, error=%u, msg=%s", 
-             (unsigned long long)serverConnectionHandlerID, error, 
-             errorMessage ? errorMessage : "none");
+    /* Answers to awaited script requests are routine, not worth an info line */
+    if (python_requests_complete(returnCode, error)) {
+        log_debug("EVENT CALLBACK: Request %s answered: server=%llu, error=%u",
+                  returnCode, (unsigned long long)serverConnectionHandlerID, error);
+    } else {
+        log_info("EVENT CALLBACK: Server error: server=%llu, error=%u, msg=%s", 
+                 (unsigned long long)serverConnectionHandlerID, error, 
+                 errorMessage ? errorMessage : "none");
+    }
+
+    TRACE_END(span, "event", "onServerErrorEvent");
 }
 
 void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber)
 {
+    TRACE_BEGIN(span);
+
     log_info("EVENT CALLBACK: Connect status changed: server=%llu, status=%d, error=%u", 
               (unsigned long long)serverConnectionHandlerID, newStatus, errorNumber);
     
     /* Dispatch to Python event handlers */
     python_event_on_connect_status_changed(serverConnectionHandlerID, newStatus, errorNumber);
+
+    TRACE_END(span, "event", "onConnectStatusChangeEvent");
 }
 
 void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, 
                                   uint64 oldChannelID, uint64 newChannelID, 
                                   int visibility, const char* moveMessage)
 {
+    TRACE_BEGIN(span);
+
     log_info("EVENT CALLBACK: Client move: server=%llu, client=%d, old=%llu, new=%llu", 
               (unsigned long long)serverConnectionHandlerID, clientID, 
               (unsigned long long)oldChannelID, (unsigned long long)newChannelID);
     
+    /* A client that left the server no longer needs its cached nickname */
+    if (newChannelID == 0) {
+        python_strings_invalidate_client(serverConnectionHandlerID, clientID);
+    }
+    
     /* Dispatch to Python event handlers */
     python_event_on_client_move(serverConnectionHandlerID, clientID, oldChannelID, 
                                 newChannelID, visibility, moveMessage);
+
+    TRACE_END(span, "event", "onClientMoveEvent");
 }
 
 void ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetMode,
@@ -275,21 +313,33 @@ void ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID target
                                    const char* fromUniqueIdentifier, const char* message, 
                                    int ffIgnored)
 {
+    ArenaMark mark;
+    TRACE_BEGIN(span);
+
     (void)ffIgnored; /* Unused */
+    mark = arena_begin();
     
     log_info("EVENT CALLBACK: Text message: server=%llu, from=%s, message=%s", 
               (unsigned long long)serverConnectionHandlerID, 
               fromName ? fromName : "unknown", 
               message ? message : "");
     
-    /* Dispatch to Python event handlers */
+    /* Native callsign log and trigger scan first, then the regular Python event handlers */
+    qso_log_scan_message(fromName, message);
+    python_event_on_text_triggers(serverConnectionHandlerID, targetMode, toID, fromID,
+                                  fromName, fromUniqueIdentifier, message);
     python_event_on_text_message(serverConnectionHandlerID, targetMode, toID, fromID, 
                                  fromName, fromUniqueIdentifier, message);
+    arena_end(mark);
+
+    TRACE_END(span, "event", "onTextMessageEvent");
 }
 
 void ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int status, 
                                         int isReceivedWhisper, anyID clientID)
 {
+    TRACE_BEGIN(span);
+
     (void)isReceivedWhisper;
     
     log_info("EVENT CALLBACK: Talk status: server=%llu, client=%d, status=%d", 
@@ -297,6 +347,8 @@ void ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int sta
     
     /* Dispatch to Python event handlers */
     python_event_on_talk_status_change(serverConnectionHandlerID, status, isReceivedWhisper, clientID);
+
+    TRACE_END(span, "event", "onTalkStatusChangeEvent");
 }
 
 void ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID)
@@ -306,3 +358,18 @@ void ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channe
              (unsigned long long)channelID,
              (unsigned long long)channelParentID);
 }
+
+void ts3plugin_onUpdateClientEvent(uint64 serverConnectionHandlerID, anyID clientID, anyID invokerID,
+                                   const char* invokerName, const char* invokerUniqueIdentifier)
+{
+    TRACE_BEGIN(span);
+
+    (void)invokerID;               /* Unused */
+    (void)invokerName;             /* Unused */
+    (void)invokerUniqueIdentifier; /* Unused */
+
+    /* The nickname may have changed; the old one goes first when the string cache is full */
+    python_strings_invalidate_client(serverConnectionHandlerID, clientID);
+
+    TRACE_END(span, "event", "onUpdateClientEvent");
+}
@@ -55,6 +55,7 @@ PLUGINS_EXPORTDLL void        ts3plugin_onTextMessageEvent(uint64 serverConnecti
 PLUGINS_EXPORTDLL void        ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage);
 PLUGINS_EXPORTDLL void        ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int status, int isReceivedWhisper, anyID clientID);
 PLUGINS_EXPORTDLL void        ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID);
+PLUGINS_EXPORTDLL void        ts3plugin_onUpdateClientEvent(uint64 serverConnectionHandlerID, anyID clientID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier);
 
 #ifdef __cplusplus
 }
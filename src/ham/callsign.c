@@ -0,0 +1,258 @@
+/**
+ * @file callsign.c
+ * @brief Amateur radio callsign recognition implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include <string.h>
+
+#include "callsign.h"
+
+#define CALLSIGN_MAX_PARTS 3
+
+/* Portable and operating designators accepted after the home callsign */
+static const char* const g_suffix_designators[] = {
+    "P", "M", "MM", "AM", "A", "B", "QRP", "QRPP", "LH", "LGT", NULL
+};
+
+static char to_upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+static int is_letter(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int has_lower(const char* text, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        if (text[i] >= 'a' && text[i] <= 'z') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Bytes that extend a token; non-ASCII bytes glue to words so "ÜK1ABC" is skipped */
+static int is_token_byte(unsigned char c)
+{
+    return is_letter((char)c) || is_digit((char)c) || c == '/' || c == '_' || c >= 0x80;
+}
+
+/* Prefixes the ITU has not allocated to any country: Q (Q codes), 0 and 1 */
+static int is_allocated_prefix(const char* text)
+{
+    char first = to_upper(text[0]);
+    return first != 'Q' && first != '0' && first != '1';
+}
+
+/* prefix ([A-Z]{1,2} | [A-Z][0-9] | [0-9][A-Z]{1,2}), one digit, 1-4 letters */
+static int is_home_call(const char* text, size_t length)
+{
+    static const size_t prefix_lengths[] = {1, 2, 3};
+    size_t i;
+
+    if (length < 4 || length > 8 || !is_allocated_prefix(text)) {
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(prefix_lengths) / sizeof(prefix_lengths[0]); i++) {
+        size_t prefix = prefix_lengths[i];
+        size_t j;
+        int valid;
+
+        if (prefix + 2 > length) {
+            break;
+        }
+
+        /* Prefix shape */
+        if (prefix == 1) {
+            valid = is_letter(text[0]);
+        } else if (prefix == 2) {
+            valid = (is_letter(text[0]) && (is_letter(text[1]) || is_digit(text[1])))
+                 || (is_digit(text[0]) && is_letter(text[1]));
+        } else {
+            valid = is_digit(text[0]) && is_letter(text[1]) && is_letter(text[2]);
+        }
+        if (!valid || !is_digit(text[prefix])) {
+            continue;
+        }
+
+        /* Suffix: one to four letters */
+        for (j = prefix + 1; j < length && is_letter(text[j]); j++) {
+        }
+        if (j == length && length - prefix - 1 >= 1 && length - prefix - 1 <= 4) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Prefix designator before the home call, e.g. "DL", "EA8", "VP2E" */
+static int is_prefix_designator(const char* text, size_t length)
+{
+    size_t i;
+    int letters = 0;
+
+    if (length < 1 || length > 4 || !is_allocated_prefix(text)) {
+        return 0;
+    }
+    for (i = 0; i < length; i++) {
+        if (is_letter(text[i])) {
+            letters++;
+        } else if (!is_digit(text[i])) {
+            return 0;
+        }
+    }
+    return letters > 0;
+}
+
+static int is_suffix_designator(const char* text, size_t length)
+{
+    size_t i;
+
+    if (length == 1 && is_digit(text[0])) {
+        return 1; /* Call area, e.g. W1AW/4 */
+    }
+    for (i = 0; g_suffix_designators[i] != NULL; i++) {
+        const char* designator = g_suffix_designators[i];
+        size_t j;
+
+        if (strlen(designator) != length) {
+            continue;
+        }
+        for (j = 0; j < length && to_upper(text[j]) == designator[j]; j++) {
+        }
+        if (j == length) {
+            return 1;
+        }
+    }
+    /* Operating abroad, e.g. PA3XYZ/KH6 */
+    return is_prefix_designator(text, length);
+}
+
+static void copy_upper(char* dest, const char* src, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        dest[i] = to_upper(src[i]);
+    }
+    dest[length] = '\0';
+}
+
+/* Parse a token; home_span receives the offset and length of the home call within it */
+static int parse_token(const char* token, size_t length, Callsign* result, size_t home_span[2])
+{
+    const char* parts[CALLSIGN_MAX_PARTS];
+    size_t lengths[CALLSIGN_MAX_PARTS];
+    size_t count = 0;
+    size_t start = 0;
+    size_t home = CALLSIGN_MAX_PARTS;
+    size_t i;
+
+    if (token == NULL || length == 0 || length >= CALLSIGN_BUFSIZE) {
+        return 0;
+    }
+
+    /* Split on '/' */
+    for (i = 0; i <= length; i++) {
+        if (i == length || token[i] == '/') {
+            if (count == CALLSIGN_MAX_PARTS || i == start) {
+                return 0;
+            }
+            parts[count] = token + start;
+            lengths[count] = i - start;
+            count++;
+            start = i + 1;
+        }
+    }
+
+    /* The home call is the longest part with callsign structure */
+    for (i = 0; i < count; i++) {
+        if (is_home_call(parts[i], lengths[i]) && (home == CALLSIGN_MAX_PARTS || lengths[i] > lengths[home])) {
+            home = i;
+        }
+    }
+    if (home == CALLSIGN_MAX_PARTS || home > 1) {
+        return 0;
+    }
+
+    /* At most one designator on each side */
+    if (home == 1 && !is_prefix_designator(parts[0], lengths[0])) {
+        return 0;
+    }
+    if (home + 1 < count && (home + 2 < count || !is_suffix_designator(parts[home + 1], lengths[home + 1]))) {
+        return 0;
+    }
+
+    if (result != NULL) {
+        result->start = 0;
+        result->length = length;
+        copy_upper(result->call, token, length);
+        copy_upper(result->base, parts[home], lengths[home]);
+    }
+    if (home_span != NULL) {
+        home_span[0] = (size_t)(parts[home] - token);
+        home_span[1] = lengths[home];
+    }
+    return 1;
+}
+
+int callsign_parse(const char* token, size_t length, Callsign* result)
+{
+    return parse_token(token, length, result, NULL);
+}
+
+size_t callsign_scan(const char* text, size_t length, Callsign* results, size_t maxResults)
+{
+    size_t home[2];
+    size_t count = 0;
+    size_t i = 0;
+
+    if (text == NULL || results == NULL) {
+        return 0;
+    }
+
+    while (i < length && count < maxResults) {
+        size_t start;
+        size_t end;
+
+        if (!is_token_byte((unsigned char)text[i])) {
+            i++;
+            continue;
+        }
+
+        start = i;
+        while (i < length && is_token_byte((unsigned char)text[i])) {
+            i++;
+        }
+
+        /* A slash at either edge is punctuation, not a designator separator */
+        end = i;
+        while (start < end && text[start] == '/') {
+            start++;
+        }
+        while (end > start && text[end - 1] == '/') {
+            end--;
+        }
+
+        /* In running text only upper-case home calls count: "b2b" or "w3c" are words */
+        if (end > start && parse_token(text + start, end - start, &results[count], home)
+            && !has_lower(text + start + home[0], home[1])) {
+            results[count].start = start;
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file callsign.h
+ * @brief Amateur radio callsign recognition
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Recognises callsigns following the ITU structure (prefix, one digit,
+ * suffix of up to four letters), with optional prefix designators such as
+ * "DL/" and portable suffixes such as "/P", "/M", "/MM" or "/QRP".
+ */
+
+#ifndef CALLSIGN_H
+#define CALLSIGN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Buffer size for a callsign including designators
+ */
+#define CALLSIGN_BUFSIZE 24
+
+/**
+ * @brief A callsign found in text
+ */
+typedef struct Callsign {
+    size_t start;                  /* Byte offset in the scanned text */
+    size_t length;                 /* Bytes covered in the scanned text */
+    char   call[CALLSIGN_BUFSIZE]; /* Upper-case, with designators, e.g. "DL/PA3XYZ/P" */
+    char   base[CALLSIGN_BUFSIZE]; /* Upper-case home callsign, e.g. "PA3XYZ" */
+} Callsign;
+
+/**
+ * @brief Parse a single token as a callsign
+ * @param token Token text (case-insensitive)
+ * @param length Token length in bytes
+ * @param result Filled on success (start is 0), may be NULL
+ * @return 1 if the token is a callsign, 0 otherwise
+ */
+int callsign_parse(const char* token, size_t length, Callsign* result);
+
+/**
+ * @brief Find all callsigns in a text
+ * @param text UTF-8 text as written (not case-folded)
+ * @param length Text length in bytes
+ * @param results Output array
+ * @param maxResults Capacity of results
+ * @return Number of callsigns written
+ * @note Unlike callsign_parse, the home call must be in upper case, so words
+ *       shaped like callsigns ("b2b", "mp3s") are not matched; designators
+ *       may be in either case ("PA3XYZ/p")
+ */
+size_t callsign_scan(const char* text, size_t length, Callsign* results, size_t maxResults);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALLSIGN_H */
@@ -0,0 +1,574 @@
+/**
+ * @file qso_log.c
+ * @brief Callsign log store implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * File layout: the 8-byte magic "TSPYQSO1", then records of
+ *   u8  payload length
+ *   u32 timestamp (little-endian)
+ *   u8  callsign length, callsign bytes
+ *   u8  nickname length, nickname bytes
+ *   u32 CRC-32 of the length byte and payload (little-endian)
+ */
+
+#if !defined(_WIN32)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "qso_log.h"
+#include "core/plugin_main.h"
+#include "utils/crc32.h"
+#include "utils/hash.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+
+#define QSO_MAGIC        "TSPYQSO1"
+#define QSO_MAGIC_SIZE   8
+#define QSO_RECORD_MAX   (1 + 4 + 1 + (CALLSIGN_BUFSIZE - 1) + 1 + (QSO_NAME_BUFSIZE - 1) + 4)
+#define QSO_IO_BUFSIZE   65536
+#define QSO_SCAN_MAX     8
+#define SECONDS_PER_DAY  86400u
+
+static FILE*     g_file = NULL;
+static char      g_path[PATH_BUFSIZE] = {0};
+static long      g_end = 0;            /* Offset after the last good record */
+static size_t    g_count = 0;
+
+/* Open-addressing set of (callsign, day) hashes; 0 marks an empty slot */
+static uint64_t* g_index = NULL;
+static size_t    g_index_capacity = 0;
+static size_t    g_index_count = 0;
+
+static QsoRecord g_recent[QSO_RECENT_COUNT];
+static size_t    g_recent_next = 0;
+static size_t    g_recent_count = 0;
+
+/* Created on first use: 0 = not yet, 1 = being created, 2 = ready */
+static Mutex            g_lock;
+static volatile int32_t g_lock_state = 0;
+
+static void lock(void)
+{
+    if (atomic32_load(&g_lock_state) != 2) {
+        if (atomic32_cas(&g_lock_state, 0, 1)) {
+            mutex_init(&g_lock);
+            atomic32_store(&g_lock_state, 2);
+        } else {
+            while (atomic32_load(&g_lock_state) != 2) {
+                thread_sleep_ms(1);
+            }
+        }
+    }
+    mutex_lock(&g_lock);
+}
+
+static void unlock(void)
+{
+    mutex_unlock(&g_lock);
+}
+
+static uint64_t record_key(const char* call, uint32_t timestamp)
+{
+    uint32_t day = timestamp / SECONDS_PER_DAY;
+    uint64_t hash = hash_fnv1a64(HASH_FNV1A64_INIT, call, strlen(call));
+
+    hash = hash_mix64(hash_fnv1a64(hash, &day, sizeof(day)));
+    return hash != 0 ? hash : 1;
+}
+
+static size_t index_slot(uint64_t key)
+{
+    size_t mask = g_index_capacity - 1;
+    size_t slot = (size_t)key & mask;
+
+    while (g_index[slot] != 0 && g_index[slot] != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int index_contains(uint64_t key)
+{
+    return g_index_capacity > 0 && g_index[index_slot(key)] == key;
+}
+
+static int index_insert(uint64_t key)
+{
+    size_t slot;
+
+    /* Keep the load factor at or below one half */
+    if ((g_index_count + 1) * 2 > g_index_capacity) {
+        size_t capacity = g_index_capacity > 0 ? g_index_capacity * 2 : 1024;
+        uint64_t* old = g_index;
+        size_t oldCapacity = g_index_capacity;
+        size_t i;
+
+        g_index = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+        if (g_index == NULL) {
+            g_index = old;
+            return -1;
+        }
+        g_index_capacity = capacity;
+        for (i = 0; i < oldCapacity; i++) {
+            if (old[i] != 0) {
+                g_index[index_slot(old[i])] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    slot = index_slot(key);
+    if (g_index[slot] == 0) {
+        g_index[slot] = key;
+        g_index_count++;
+    }
+    return 0;
+}
+
+static void remember(const QsoRecord* record)
+{
+    g_recent[g_recent_next] = *record;
+    g_recent_next = (g_recent_next + 1) % QSO_RECENT_COUNT;
+    if (g_recent_count < QSO_RECENT_COUNT) {
+        g_recent_count++;
+    }
+}
+
+static void put_u32(unsigned char* out, uint32_t value)
+{
+    out[0] = (unsigned char)(value & 0xFF);
+    out[1] = (unsigned char)((value >> 8) & 0xFF);
+    out[2] = (unsigned char)((value >> 16) & 0xFF);
+    out[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+static uint32_t get_u32(const unsigned char* in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+/* Serialise a record; returns its size in bytes */
+static size_t encode_record(const QsoRecord* record, unsigned char* out)
+{
+    size_t callLength = strlen(record->call);
+    size_t nameLength = strlen(record->heardFrom);
+    size_t payload = 4 + 1 + callLength + 1 + nameLength;
+    unsigned char* p = out;
+
+    *p++ = (unsigned char)payload;
+    put_u32(p, record->timestamp);
+    p += 4;
+    *p++ = (unsigned char)callLength;
+    memcpy(p, record->call, callLength);
+    p += callLength;
+    *p++ = (unsigned char)nameLength;
+    memcpy(p, record->heardFrom, nameLength);
+    p += nameLength;
+    put_u32(p, crc32_update(0, out, 1 + payload));
+
+    return 1 + payload + 4;
+}
+
+/* Read the next record: 1 on success, 0 at a clean end of file, -1 if incomplete or corrupt */
+static int read_record(FILE* fp, QsoRecord* record, long* size)
+{
+    unsigned char buffer[QSO_RECORD_MAX];
+    size_t payload;
+    size_t callLength;
+    size_t nameLength;
+    int c = fgetc(fp);
+
+    if (c == EOF) {
+        return 0;
+    }
+
+    buffer[0] = (unsigned char)c;
+    payload = buffer[0];
+    if (payload < 6 || 1 + payload + 4 > sizeof(buffer) || fread(buffer + 1, 1, payload + 4, fp) != payload + 4) {
+        return -1;
+    }
+    if (crc32_update(0, buffer, 1 + payload) != get_u32(buffer + 1 + payload)) {
+        return -1;
+    }
+
+    callLength = buffer[5];
+    if (6 + callLength >= 1 + payload || callLength >= CALLSIGN_BUFSIZE) {
+        return -1;
+    }
+    nameLength = buffer[6 + callLength];
+    if (7 + callLength + nameLength != 1 + payload || nameLength >= QSO_NAME_BUFSIZE) {
+        return -1;
+    }
+
+    record->timestamp = get_u32(buffer + 1);
+    memcpy(record->call, buffer + 6, callLength);
+    record->call[callLength] = '\0';
+    memcpy(record->heardFrom, buffer + 7 + callLength, nameLength);
+    record->heardFrom[nameLength] = '\0';
+
+    *size = (long)(1 + payload + 4);
+    return 1;
+}
+
+static int truncate_file(FILE* fp, long length)
+{
+    fflush(fp);
+#ifdef _WIN32
+    return _chsize_s(_fileno(fp), length) == 0 ? 0 : -1;
+#else
+    return ftruncate(fileno(fp), (off_t)length);
+#endif
+}
+
+static void reset_state(void)
+{
+    free(g_index);
+    g_index = NULL;
+    g_index_capacity = 0;
+    g_index_count = 0;
+    g_count = 0;
+    g_end = 0;
+    g_recent_next = 0;
+    g_recent_count = 0;
+}
+
+static void close_log(void)
+{
+    if (g_file != NULL) {
+        fclose(g_file);
+        g_file = NULL;
+    }
+    g_path[0] = '\0';
+    reset_state();
+}
+
+static int open_log(const char* path)
+{
+    char magic[QSO_MAGIC_SIZE];
+    QsoRecord record;
+    long size;
+    int status;
+
+    close_log();
+
+    g_file = fopen(path, "r+b");
+    if (g_file == NULL) {
+        g_file = fopen(path, "w+b");
+    }
+    if (g_file == NULL) {
+        log_error("Failed to open QSO log: %s", path);
+        return -1;
+    }
+    setvbuf(g_file, NULL, _IOFBF, QSO_IO_BUFSIZE);
+
+    /* New (or header-less) file: write the header */
+    if (fread(magic, 1, QSO_MAGIC_SIZE, g_file) != QSO_MAGIC_SIZE) {
+        if (truncate_file(g_file, 0) != 0 || fseek(g_file, 0, SEEK_SET) != 0
+            || fwrite(QSO_MAGIC, 1, QSO_MAGIC_SIZE, g_file) != QSO_MAGIC_SIZE || fflush(g_file) != 0) {
+            log_error("Failed to initialise QSO log: %s", path);
+            fclose(g_file);
+            g_file = NULL;
+            return -1;
+        }
+    } else if (memcmp(magic, QSO_MAGIC, QSO_MAGIC_SIZE) != 0) {
+        log_error("Not a TsPy QSO log, leaving it untouched: %s", path);
+        fclose(g_file);
+        g_file = NULL;
+        return -1;
+    }
+
+    /* Verify every record and rebuild the index */
+    g_end = QSO_MAGIC_SIZE;
+    fseek(g_file, g_end, SEEK_SET);
+    while ((status = read_record(g_file, &record, &size)) == 1) {
+        if (index_insert(record_key(record.call, record.timestamp)) != 0) {
+            log_error("Out of memory indexing QSO log");
+            break;
+        }
+        remember(&record);
+        g_count++;
+        g_end += size;
+    }
+
+    if (status < 0) {
+        fseek(g_file, 0, SEEK_END);
+        log_warning("QSO log ends with an incomplete record; discarding %ld bytes", ftell(g_file) - g_end);
+        if (truncate_file(g_file, g_end) != 0) {
+            log_error("Failed to repair QSO log: %s", path);
+            fclose(g_file);
+            g_file = NULL;
+            reset_state();
+            return -1;
+        }
+    }
+
+    /* Switching from reading to writing requires a seek */
+    fseek(g_file, g_end, SEEK_SET);
+    safe_strcpy(g_path, sizeof(g_path), path);
+
+    log_info("QSO log opened: %s (%zu records)", path, g_count);
+    return 0;
+}
+
+int qso_log_open(const char* path)
+{
+    int result;
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    lock();
+    result = open_log(path);
+    unlock();
+    return result;
+}
+
+void qso_log_close(void)
+{
+    lock();
+    close_log();
+    unlock();
+}
+
+int qso_log_is_open(void)
+{
+    int open;
+
+    lock();
+    open = g_file != NULL;
+    unlock();
+    return open;
+}
+
+const char* qso_log_get_path(void)
+{
+    return g_path;
+}
+
+static int add_record(const char* call, const char* heardFrom, uint32_t timestamp)
+{
+    unsigned char buffer[QSO_RECORD_MAX];
+    QsoRecord record;
+    uint64_t key;
+    size_t size;
+
+    if (g_file == NULL || call == NULL || call[0] == '\0' || strlen(call) >= CALLSIGN_BUFSIZE) {
+        return -1;
+    }
+
+    key = record_key(call, timestamp);
+    if (index_contains(key)) {
+        return 0;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp = timestamp;
+    safe_strcpy(record.call, sizeof(record.call), call);
+    safe_strcpy(record.heardFrom, sizeof(record.heardFrom), heardFrom != NULL ? heardFrom : "");
+
+    /* One write and a flush per record; a crash can at most tear this record */
+    size = encode_record(&record, buffer);
+    if (fwrite(buffer, 1, size, g_file) != size || fflush(g_file) != 0) {
+        log_error("Failed to append to QSO log: %s", g_path);
+        truncate_file(g_file, g_end);
+        fseek(g_file, g_end, SEEK_SET);
+        return -1;
+    }
+
+    g_end += (long)size;
+    g_count++;
+    remember(&record);
+    if (index_insert(key) != 0) {
+        log_warning("QSO log index is out of memory; duplicates may be logged");
+    }
+    return 1;
+}
+
+int qso_log_add(const char* call, const char* heardFrom, uint32_t timestamp)
+{
+    int result;
+
+    lock();
+    result = add_record(call, heardFrom, timestamp);
+    unlock();
+    return result;
+}
+
+size_t qso_log_scan_message(const char* heardFrom, const char* message)
+{
+    Callsign calls[QSO_SCAN_MAX];
+    uint32_t now = (uint32_t)time(NULL);
+    size_t count;
+    size_t added = 0;
+    size_t i;
+
+    if (message == NULL) {
+        return 0;
+    }
+
+    count = callsign_scan(message, strlen(message), calls, QSO_SCAN_MAX);
+    if (count == 0) {
+        return 0;
+    }
+
+    lock();
+    for (i = 0; i < count; i++) {
+        if (add_record(calls[i].call, heardFrom, now) == 1) {
+            log_info("QSO log: %s (heard from %s)", calls[i].call, heardFrom != NULL ? heardFrom : "unknown");
+            added++;
+        }
+    }
+    unlock();
+    return added;
+}
+
+size_t qso_log_count(void)
+{
+    size_t count;
+
+    lock();
+    count = g_count;
+    unlock();
+    return count;
+}
+
+int qso_log_contains(const char* call, uint32_t timestamp)
+{
+    int found;
+
+    if (call == NULL) {
+        return 0;
+    }
+    lock();
+    found = index_contains(record_key(call, timestamp));
+    unlock();
+    return found;
+}
+
+size_t qso_log_recent(QsoRecord* records, size_t maxRecords)
+{
+    size_t i;
+
+    if (records == NULL) {
+        return 0;
+    }
+    lock();
+    for (i = 0; i < maxRecords && i < g_recent_count; i++) {
+        records[i] = g_recent[(g_recent_next + QSO_RECENT_COUNT - 1 - i) % QSO_RECENT_COUNT];
+    }
+    unlock();
+    return i;
+}
+
+static void write_adif_field(FILE* fp, const char* name, const char* value)
+{
+    fprintf(fp, "<%s:%zu>%s ", name, strlen(value), value);
+}
+
+/* Runs unlocked: reads the log up to end, which add_record only ever appends past */
+static long export_adif(const char* logPath, long end, const char* path)
+{
+    char comment[QSO_NAME_BUFSIZE + 32];
+    char date[16];
+    char timeOn[16];
+    QsoRecord record;
+    FILE* in;
+    FILE* out;
+    long size;
+    long written = 0;
+    size_t i;
+
+    /* Read the log through a second handle so appends are not disturbed */
+    in = fopen(logPath, "rb");
+    if (in == NULL) {
+        log_error("Failed to read QSO log: %s", logPath);
+        return -1;
+    }
+    out = fopen(path, "w");
+    if (out == NULL) {
+        log_error("Failed to open ADIF output: %s", path);
+        fclose(in);
+        return -1;
+    }
+    setvbuf(in, NULL, _IOFBF, QSO_IO_BUFSIZE);
+    setvbuf(out, NULL, _IOFBF, QSO_IO_BUFSIZE);
+
+    fputs("TsPy QSO log export\n", out);
+    write_adif_field(out, "ADIF_VER", "3.1.4");
+    write_adif_field(out, "PROGRAMID", "TsPy");
+    fputs("<EOH>\n", out);
+
+    /* One record in memory at a time, whatever the log size */
+    fseek(in, QSO_MAGIC_SIZE, SEEK_SET);
+    while (ftell(in) < end && read_record(in, &record, &size) == 1) {
+        time_t when = (time_t)record.timestamp;
+        struct tm utc;
+
+#ifdef _WIN32
+        gmtime_s(&utc, &when);
+#else
+        gmtime_r(&when, &utc);
+#endif
+        strftime(date, sizeof(date), "%Y%m%d", &utc);
+        strftime(timeOn, sizeof(timeOn), "%H%M%S", &utc);
+
+        /* ADI files are ASCII-only */
+        snprintf(comment, sizeof(comment), "Heard from %s on TeamSpeak", record.heardFrom);
+        for (i = 0; comment[i] != '\0'; i++) {
+            if ((unsigned char)comment[i] >= 0x80 || comment[i] == '<' || comment[i] == '>') {
+                comment[i] = '?';
+            }
+        }
+
+        write_adif_field(out, "CALL", record.call);
+        write_adif_field(out, "QSO_DATE", date);
+        write_adif_field(out, "TIME_ON", timeOn);
+        write_adif_field(out, "COMMENT", comment);
+        fputs("<EOR>\n", out);
+        written++;
+    }
+
+    fclose(in);
+    if (fclose(out) != 0) {
+        log_error("Failed to write ADIF output: %s", path);
+        return -1;
+    }
+
+    log_info("Exported %ld QSO records to %s", written, path);
+    return written;
+}
+
+long qso_log_export_adif(const char* path)
+{
+    char logPath[PATH_BUFSIZE];
+    long end;
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    /* Snapshot the end of the log so logging is not held up by the export */
+    lock();
+    if (g_file == NULL || fflush(g_file) != 0) {
+        unlock();
+        return -1;
+    }
+    end = g_end;
+    safe_strcpy(logPath, sizeof(logPath), g_path);
+    unlock();
+
+    return export_adif(logPath, end, path);
+}
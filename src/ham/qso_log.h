@@ -0,0 +1,119 @@
+/**
+ * @file qso_log.h
+ * @brief Append-only, de-duplicated log of callsigns heard in chat
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Every callsign seen in a text message is recorded once per UTC day. The
+ * log file is a header followed by length-prefixed, CRC-protected records,
+ * each flushed as it is appended; an incomplete record left by a crash is
+ * detected and cut off on the next open. Duplicates are rejected through an
+ * in-memory hash index rebuilt while the file is verified. All functions are
+ * serialised by an internal lock, so scripts may call them from any thread.
+ */
+
+#ifndef QSO_LOG_H
+#define QSO_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "callsign.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Buffer size for the nickname a callsign was heard from
+ */
+#define QSO_NAME_BUFSIZE 128
+
+/**
+ * @brief Number of most recent records kept in memory
+ */
+#define QSO_RECENT_COUNT 32
+
+/**
+ * @brief One log entry
+ */
+typedef struct QsoRecord {
+    uint32_t timestamp;                 /* UTC seconds since 1970 */
+    char     call[CALLSIGN_BUFSIZE];
+    char     heardFrom[QSO_NAME_BUFSIZE];
+} QsoRecord;
+
+/**
+ * @brief Open (or create) the log and rebuild the duplicate index
+ * @param path Log file path
+ * @return 0 on success, -1 on failure
+ */
+int qso_log_open(const char* path);
+
+/**
+ * @brief Close the log
+ */
+void qso_log_close(void);
+
+/**
+ * @brief Check whether the log is open
+ * @return 1 if open, 0 otherwise
+ */
+int qso_log_is_open(void);
+
+/**
+ * @brief Get the log file path
+ * @return Path, empty if not open
+ */
+const char* qso_log_get_path(void);
+
+/**
+ * @brief Append a callsign unless it was already logged that UTC day
+ * @param call Upper-case callsign
+ * @param heardFrom Nickname of the sender, may be NULL
+ * @param timestamp UTC seconds since 1970
+ * @return 1 if appended, 0 if a duplicate, -1 on failure
+ */
+int qso_log_add(const char* call, const char* heardFrom, uint32_t timestamp);
+
+/**
+ * @brief Extract callsigns from a chat message and log new ones
+ * @param heardFrom Nickname of the sender
+ * @param message Message text
+ * @return Number of records appended
+ */
+size_t qso_log_scan_message(const char* heardFrom, const char* message);
+
+/**
+ * @brief Number of records in the log
+ * @return Record count
+ */
+size_t qso_log_count(void);
+
+/**
+ * @brief Check whether a callsign was logged on a given UTC day
+ * @param call Upper-case callsign
+ * @param timestamp Any time on that day
+ * @return 1 if logged, 0 otherwise
+ */
+int qso_log_contains(const char* call, uint32_t timestamp);
+
+/**
+ * @brief Copy the most recent records, newest first
+ * @param records Output array
+ * @param maxRecords Capacity of records
+ * @return Number of records copied (at most QSO_RECENT_COUNT)
+ */
+size_t qso_log_recent(QsoRecord* records, size_t maxRecords);
+
+/**
+ * @brief Stream the whole log to an ADIF file
+ * @param path Output path
+ * @return Number of records written, or -1 on failure
+ */
+long qso_log_export_adif(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QSO_LOG_H */
@@ -18,12 +18,42 @@
 
 #define PY_SSIZE_T_CLEAN
 
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
 #include "python_api.h"
+#include "python_engine.h"
+#include "python_errors.h"
+#include "python_event_object.h"
+#include "python_loop.h"
+#include "python_outbound.h"
+#include "python_requests.h"
+#include "python_store.h"
+#include "python_strings.h"
+#include "python_subscriptions.h"
+#include "python_timers.h"
+#include "python_triggers.h"
 #include "core/plugin_main.h"
+#include "core/plugin_config.h"
+#include "ham/qso_log.h"
+#include "utils/string_utils.h"
 #include "utils/logging.h"
+#include "utils/trace.h"
 
 /* Python API functions */
 
+/* Functions that share state with the main interpreter refuse to run in an isolated one */
+static int require_main_interpreter(const char* name)
+{
+    if (python_engine_in_main_interpreter()) {
+        return 1;
+    }
+    PyErr_Format(PyExc_RuntimeError, "ts3api.%s is not available in an isolated interpreter", name);
+    return 0;
+}
+
 static PyObject* py_ts_print_message(PyObject* self, PyObject* args)
 {
     uint64 serverConnectionHandlerID;
@@ -38,7 +68,9 @@ static PyObject* py_ts_print_message(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->printMessageToCurrentTab != NULL) {
+        TRACE_BEGIN(span);
         ts3Functions->printMessageToCurrentTab(message);
+        TRACE_END(span, "ts3api", "print_message");
     }
 
     Py_RETURN_NONE;
@@ -57,7 +89,10 @@ static PyObject* py_ts_get_client_id(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->getClientID != NULL) {
-        if (ts3Functions->getClientID(serverConnectionHandlerID, &clientID) == ERROR_ok) {
+        TRACE_BEGIN(span);
+        unsigned int error = ts3Functions->getClientID(serverConnectionHandlerID, &clientID);
+        TRACE_END(span, "ts3api", "get_client_id");
+        if (error == ERROR_ok) {
             return PyLong_FromLong(clientID);
         }
     }
@@ -80,8 +115,11 @@ static PyObject* py_ts_get_client_name(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->getClientVariableAsString != NULL) {
-        if (ts3Functions->getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_NICKNAME, &name) == ERROR_ok) {
-            result = PyUnicode_FromString(name ? name : "");
+        TRACE_BEGIN(span);
+        unsigned int error = ts3Functions->getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_NICKNAME, &name);
+        TRACE_END(span, "ts3api", "get_client_name");
+        if (error == ERROR_ok) {
+            result = python_strings_get(name, STRING_OWNER(serverConnectionHandlerID, clientID));
             if (name != NULL) {
                 ts3Functions->freeMemory(name);
             }
@@ -92,53 +130,533 @@ static PyObject* py_ts_get_client_name(PyObject* self, PyObject* args)
     Py_RETURN_NONE;
 }
 
-static PyObject* py_ts_send_channel_message(PyObject* self, PyObject* args)
+/* Track a request so it can be awaited; returns None (and an empty returnCode) without an event loop */
+static PyObject* begin_request(double timeout, char* returnCode, size_t size)
+{
+    returnCode[0] = '\0';
+    if (python_loop_get() == NULL) {
+        Py_RETURN_NONE;
+    }
+    return python_requests_begin(timeout, returnCode, size);
+}
+
+/* Settle a tracked request the client refused before it reached the server */
+static void end_request(const char* returnCode, unsigned int result)
+{
+    if (result != ERROR_ok && returnCode[0] != '\0') {
+        python_requests_fail(returnCode, result);
+    }
+}
+
+static PyObject* send_text_message(PyObject* args, PyObject* kwargs, int targetMode)
 {
+    static char* kwlist[] = {"server", "message", "timeout", "bulk", NULL};
     uint64 serverConnectionHandlerID;
     const char* message;
-    uint64 targetChannelID = 0; /* 0 = current channel */
-    const char* returnCode = NULL;
+    double timeout = get_config()->requestTimeout;
+    int bulk = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Ks|$dp", kwlist,
+                                     &serverConnectionHandlerID, &message, &timeout, &bulk)) {
+        return NULL;
+    }
+
+    return python_outbound_send(serverConnectionHandlerID, targetMode, message, timeout,
+                                bulk ? OUTBOUND_BULK : OUTBOUND_REPLY);
+}
+
+static PyObject* py_ts_send_channel_message(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    (void)self; /* Unused parameter */
+
+    return send_text_message(args, kwargs, TextMessageTarget_CHANNEL);
+}
+
+static PyObject* py_ts_send_server_message(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    (void)self; /* Unused parameter */
+
+    return send_text_message(args, kwargs, TextMessageTarget_SERVER);
+}
+
+static PyObject* py_ts_send_queue_length(PyObject* self, PyObject* args)
+{
+    uint64 serverConnectionHandlerID = 0;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "|K", &serverConnectionHandlerID)) {
+        return NULL;
+    }
+
+    return PyLong_FromSize_t(python_outbound_pending(serverConnectionHandlerID));
+}
+
+static PyObject* py_ts_wait_drained(PyObject* self, PyObject* args)
+{
+    uint64 serverConnectionHandlerID = 0;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("wait_drained")) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "|K", &serverConnectionHandlerID)) {
+        return NULL;
+    }
+
+    return python_outbound_wait_drained(serverConnectionHandlerID);
+}
+
+static PyObject* py_ts_set_send_rate(PyObject* self, PyObject* args)
+{
+    double rate;
+    double burst = get_config()->outboundBurst;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "d|d", &rate, &burst)) {
+        return NULL;
+    }
+
+    if (python_outbound_set_rate(rate, burst) != 0) {
+        PyErr_SetString(PyExc_ValueError, "rate must be in (0, 1000] and burst in [1, 1000]");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_ts_move_client(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"server", "client", "channel", "password", "timeout", NULL};
+    uint64 serverConnectionHandlerID;
+    int clientID;
+    uint64 channelID;
+    const char* password = "";
+    double timeout = get_config()->requestTimeout;
+    char returnCode[REQUEST_RETURN_CODE_BUFSIZE];
     unsigned int result;
+    PyObject* future;
     struct TS3Functions* ts3Functions = get_ts3_functions();
 
     (void)self; /* Unused parameter */
 
-    if (!PyArg_ParseTuple(args, "Ks", &serverConnectionHandlerID, &message)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KiK|s$d", kwlist, &serverConnectionHandlerID,
+                                     &clientID, &channelID, &password, &timeout)) {
+        return NULL;
+    }
+
+    if (ts3Functions == NULL || ts3Functions->requestClientMove == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "requestClientMove function not available");
+        return NULL;
+    }
+
+    future = begin_request(timeout, returnCode, sizeof(returnCode));
+    if (future == NULL) {
         return NULL;
     }
 
-    if (ts3Functions != NULL && ts3Functions->requestSendChannelTextMsg != NULL) {
-        result = ts3Functions->requestSendChannelTextMsg(serverConnectionHandlerID, message, targetChannelID, returnCode);
-        if (result != ERROR_ok) {
-            log_warning("Failed to send channel message: error=%u", result);
+    TRACE_BEGIN(span);
+    result = ts3Functions->requestClientMove(serverConnectionHandlerID, (anyID)clientID, channelID, password,
+                                             returnCode[0] != '\0' ? returnCode : NULL);
+    TRACE_END(span, "ts3api", "move_client");
+    if (result != ERROR_ok) {
+        log_warning("Failed to move client %d: error=%u", clientID, result);
+    }
+    end_request(returnCode, result);
+
+    return future;
+}
+
+/* Client ID arrays sent to TeamSpeak are split into requests of this many clients */
+#define CLIENT_BATCH_SIZE 100
+
+typedef enum ClientBatchAction {
+    BATCH_MOVE,
+    BATCH_KICK_CHANNEL,
+    BATCH_KICK_SERVER,
+    BATCH_MUTE,
+    BATCH_UNMUTE,
+    BATCH_MUTE_TEMPORARY,
+    BATCH_UNMUTE_TEMPORARY
+} ClientBatchAction;
+
+/* Store one ID from a sequence or buffer; 0 terminates TeamSpeak arrays, so it is rejected */
+static int store_client_id(anyID* ids, size_t index, long long value)
+{
+    if (value <= 0 || value > 0xFFFF) {
+        PyErr_Format(PyExc_ValueError, "invalid client ID %lld at index %zu", value, index);
+        return -1;
+    }
+    ids[index] = (anyID)value;
+    return 0;
+}
+
+/* Read client IDs straight from an integer buffer such as array.array('H') */
+static anyID* client_ids_from_buffer(PyObject* object, size_t* count)
+{
+    Py_buffer view;
+    const char* format;
+    anyID* ids = NULL;
+    Py_ssize_t i;
+
+    if (PyObject_GetBuffer(object, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) != 0) {
+        return NULL;
+    }
+
+    format = view.format != NULL ? view.format : "B";
+    if (format[0] == '@' || format[0] == '=') {
+        format++;
+    }
+    if (view.ndim > 1 || format[0] == '\0' || format[1] != '\0' || strchr("bBhHiIlLqQnN", format[0]) == NULL) {
+        PyErr_Format(PyExc_TypeError, "client ID buffer must hold native integers, not '%s'",
+                     view.format != NULL ? view.format : "B");
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    *count = (size_t)(view.len / view.itemsize);
+    ids = (anyID*)PyMem_Malloc((*count > 0 ? *count : 1) * sizeof(anyID));
+    if (ids == NULL) {
+        PyBuffer_Release(&view);
+        return (anyID*)PyErr_NoMemory();
+    }
+
+    for (i = 0; i < (Py_ssize_t)*count; i++) {
+        const char* item = (const char*)view.buf + i * view.itemsize;
+        long long value;
+        int isSigned = islower((unsigned char)format[0]);
+
+        switch (view.itemsize) {
+            case 1: {
+                uint8_t v = *(const uint8_t*)item;
+                value = isSigned ? (long long)(int8_t)v : (long long)v;
+                break;
+            }
+            case 2: {
+                uint16_t v;
+                memcpy(&v, item, sizeof(v));
+                value = isSigned ? (long long)(int16_t)v : (long long)v;
+                break;
+            }
+            case 4: {
+                uint32_t v;
+                memcpy(&v, item, sizeof(v));
+                value = isSigned ? (long long)(int32_t)v : (long long)v;
+                break;
+            }
+            default: {
+                uint64_t v;
+                memcpy(&v, item, sizeof(v));
+                value = isSigned ? (long long)(int64_t)v : (v > 0xFFFF ? 0x10000 : (long long)v);
+                break;
+            }
+        }
+        if (store_client_id(ids, (size_t)i, value) != 0) {
+            PyMem_Free(ids);
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+    }
+
+    PyBuffer_Release(&view);
+    return ids;
+}
+
+/* Convert a sequence of ints or an integer buffer to an anyID array (PyMem_Free it) */
+static anyID* client_ids_from_object(PyObject* object, size_t* count)
+{
+    PyObject* sequence;
+    PyObject** items;
+    anyID* ids;
+    Py_ssize_t i;
+
+    if (PyUnicode_Check(object) || PyBytes_Check(object) || PyByteArray_Check(object)) {
+        PyErr_SetString(PyExc_TypeError, "clients must be a sequence of client IDs");
+        return NULL;
+    }
+    if (PyObject_CheckBuffer(object)) {
+        return client_ids_from_buffer(object, count);
+    }
+
+    sequence = PySequence_Fast(object, "clients must be a sequence of client IDs");
+    if (sequence == NULL) {
+        return NULL;
+    }
+    *count = (size_t)PySequence_Fast_GET_SIZE(sequence);
+    items = PySequence_Fast_ITEMS(sequence);
+    ids = (anyID*)PyMem_Malloc((*count > 0 ? *count : 1) * sizeof(anyID));
+    if (ids == NULL) {
+        Py_DECREF(sequence);
+        return (anyID*)PyErr_NoMemory();
+    }
+
+    for (i = 0; i < (Py_ssize_t)*count; i++) {
+        long long value;
+
+        if (!PyLong_Check(items[i])) {
+            PyErr_Format(PyExc_TypeError, "client ID at index %zd is not an int", i);
+            break;
+        }
+        value = PyLong_AsLongLong(items[i]);
+        if (value == -1 && PyErr_Occurred()) {
+            PyErr_Clear();
+            value = 0x10000;
+        }
+        if (store_client_id(ids, (size_t)i, value) != 0) {
+            break;
+        }
+    }
+    Py_DECREF(sequence);
+
+    if (PyErr_Occurred()) {
+        PyMem_Free(ids);
+        return NULL;
+    }
+    return ids;
+}
+
+static unsigned int send_client_batch(ClientBatchAction action, uint64 serverConnectionHandlerID, const anyID* ids,
+                                      uint64 channelID, const char* text, const char* returnCode)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+
+    switch (action) {
+        case BATCH_MOVE:
+            return ts3Functions->requestClientsMove(serverConnectionHandlerID, ids, channelID, text, returnCode);
+        case BATCH_KICK_CHANNEL:
+            return ts3Functions->requestClientsKickFromChannel(serverConnectionHandlerID, ids, text, returnCode);
+        case BATCH_KICK_SERVER:
+            return ts3Functions->requestClientsKickFromServer(serverConnectionHandlerID, ids, text, returnCode);
+        case BATCH_MUTE:
+            return ts3Functions->requestMuteClients(serverConnectionHandlerID, ids, returnCode);
+        case BATCH_UNMUTE:
+            return ts3Functions->requestUnmuteClients(serverConnectionHandlerID, ids, returnCode);
+        case BATCH_MUTE_TEMPORARY:
+            return ts3Functions->requestMuteClientsTemporary(serverConnectionHandlerID, ids, returnCode);
+        case BATCH_UNMUTE_TEMPORARY:
+            return ts3Functions->requestUnmuteClientsTemporary(serverConnectionHandlerID, ids, returnCode);
+    }
+    return ERROR_not_implemented;
+}
+
+/* Muting is done by the client itself: the call's return value is the whole answer */
+static int client_batch_is_local(ClientBatchAction action)
+{
+    return action == BATCH_MUTE || action == BATCH_UNMUTE
+           || action == BATCH_MUTE_TEMPORARY || action == BATCH_UNMUTE_TEMPORARY;
+}
+
+static int client_batch_available(ClientBatchAction action)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+
+    if (ts3Functions == NULL) {
+        return 0;
+    }
+    switch (action) {
+        case BATCH_MOVE:             return ts3Functions->requestClientsMove != NULL;
+        case BATCH_KICK_CHANNEL:     return ts3Functions->requestClientsKickFromChannel != NULL;
+        case BATCH_KICK_SERVER:      return ts3Functions->requestClientsKickFromServer != NULL;
+        case BATCH_MUTE:             return ts3Functions->requestMuteClients != NULL;
+        case BATCH_UNMUTE:           return ts3Functions->requestUnmuteClients != NULL;
+        case BATCH_MUTE_TEMPORARY:   return ts3Functions->requestMuteClientsTemporary != NULL;
+        case BATCH_UNMUTE_TEMPORARY: return ts3Functions->requestUnmuteClientsTemporary != NULL;
+    }
+    return 0;
+}
+
+/*
+ * Send every chunk back to back, each under its own return code, and gather
+ * the futures so the script awaits one result: the error code of each chunk.
+ * Local actions resolve each chunk's future with the call's own result.
+ */
+static PyObject* run_client_batch(ClientBatchAction action, const char* name, uint64 serverConnectionHandlerID,
+                                  PyObject* clients, uint64 channelID, const char* text, double timeout)
+{
+    anyID chunk[CLIENT_BATCH_SIZE + 1];
+    char returnCode[REQUEST_RETURN_CODE_BUFSIZE];
+    anyID* ids;
+    size_t count;
+    size_t offset;
+    PyObject* futures = NULL;
+    PyObject* result = NULL;
+    int tracked = python_loop_get() != NULL;
+
+    if (!client_batch_available(action)) {
+        PyErr_Format(PyExc_RuntimeError, "%s is not available", name);
+        return NULL;
+    }
+
+    ids = client_ids_from_object(clients, &count);
+    if (ids == NULL) {
+        return NULL;
+    }
+    if (tracked) {
+        futures = PyTuple_New((Py_ssize_t)((count + CLIENT_BATCH_SIZE - 1) / CLIENT_BATCH_SIZE));
+        if (futures == NULL) {
+            PyMem_Free(ids);
+            return NULL;
+        }
+    }
+
+    TRACE_BEGIN(span);
+    for (offset = 0; offset < count; offset += CLIENT_BATCH_SIZE) {
+        size_t size = count - offset < CLIENT_BATCH_SIZE ? count - offset : CLIENT_BATCH_SIZE;
+        unsigned int error;
+
+        memcpy(chunk, ids + offset, size * sizeof(anyID));
+        chunk[size] = 0;
+
+        returnCode[0] = '\0';
+        if (tracked) {
+            PyObject* future = client_batch_is_local(action)
+                               ? PyObject_CallMethod(python_loop_get(), "create_future", NULL)
+                               : python_requests_begin(timeout, returnCode, sizeof(returnCode));
+            if (future == NULL) {
+                break;
+            }
+            PyTuple_SET_ITEM(futures, (Py_ssize_t)(offset / CLIENT_BATCH_SIZE), future);
+        }
+
+        error = send_client_batch(action, serverConnectionHandlerID, chunk, channelID, text,
+                                  returnCode[0] != '\0' ? returnCode : NULL);
+        if (error != ERROR_ok) {
+            log_warning("%s failed for %zu client(s): error=%u", name, size, error);
+        }
+        if (tracked && client_batch_is_local(action)) {
+            PyObject* value = PyLong_FromUnsignedLong(error);
+            int failed = value == NULL
+                         || python_loop_resolve(PyTuple_GET_ITEM(futures, (Py_ssize_t)(offset / CLIENT_BATCH_SIZE)), value) != 0;
+
+            Py_XDECREF(value);
+            if (failed) {
+                break;
+            }
         } else {
-            log_debug("Channel message sent successfully");
+            end_request(returnCode, error);
+        }
+    }
+    TRACE_END(span, "ts3api", name);
+    PyMem_Free(ids);
+
+    if (PyErr_Occurred()) {
+        Py_XDECREF(futures);
+        return NULL;
+    }
+    if (!tracked) {
+        Py_RETURN_NONE;
+    }
+
+    /* The futures are still pending and only the loop completes them, so gathering here is safe */
+    if (PyTuple_GET_SIZE(futures) == 0) {
+        PyObject* empty = PyList_New(0);
+
+        result = empty != NULL ? PyObject_CallMethod(python_loop_get(), "create_future", NULL) : NULL;
+        if (result != NULL && python_loop_resolve(result, empty) != 0) {
+            Py_CLEAR(result);
         }
+        Py_XDECREF(empty);
     } else {
-        log_error("requestSendChannelTextMsg function not available");
+        PyObject* asyncio = PyImport_ImportModule("asyncio");
+        PyObject* gather = asyncio != NULL ? PyObject_GetAttrString(asyncio, "gather") : NULL;
+
+        if (gather != NULL) {
+            result = PyObject_Call(gather, futures, NULL);
+        }
+        Py_XDECREF(gather);
+        Py_XDECREF(asyncio);
     }
+    Py_DECREF(futures);
+    return result;
+}
 
-    Py_RETURN_NONE;
+static PyObject* py_ts_move_clients(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"server", "clients", "channel", "password", "timeout", NULL};
+    uint64 serverConnectionHandlerID;
+    PyObject* clients;
+    uint64 channelID;
+    const char* password = "";
+    double timeout = get_config()->requestTimeout;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KOK|s$d", kwlist, &serverConnectionHandlerID,
+                                     &clients, &channelID, &password, &timeout)) {
+        return NULL;
+    }
+
+    return run_client_batch(BATCH_MOVE, "move_clients", serverConnectionHandlerID, clients, channelID,
+                            password, timeout);
 }
 
-static PyObject* py_ts_send_server_message(PyObject* self, PyObject* args)
+static PyObject* kick_clients(PyObject* args, PyObject* kwargs, ClientBatchAction action, const char* name)
 {
+    static char* kwlist[] = {"server", "clients", "reason", "timeout", NULL};
     uint64 serverConnectionHandlerID;
-    const char* message;
-    const char* returnCode = NULL;
-    struct TS3Functions* ts3Functions = get_ts3_functions();
+    PyObject* clients;
+    const char* reason = "";
+    double timeout = get_config()->requestTimeout;
 
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KO|s$d", kwlist, &serverConnectionHandlerID,
+                                     &clients, &reason, &timeout)) {
+        return NULL;
+    }
+
+    return run_client_batch(action, name, serverConnectionHandlerID, clients, 0, reason, timeout);
+}
+
+static PyObject* py_ts_kick_clients_from_channel(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    (void)self; /* Unused parameter */
+
+    return kick_clients(args, kwargs, BATCH_KICK_CHANNEL, "kick_clients_from_channel");
+}
+
+static PyObject* py_ts_kick_clients_from_server(PyObject* self, PyObject* args, PyObject* kwargs)
+{
     (void)self; /* Unused parameter */
 
-    if (!PyArg_ParseTuple(args, "Ks", &serverConnectionHandlerID, &message)) {
+    return kick_clients(args, kwargs, BATCH_KICK_SERVER, "kick_clients_from_server");
+}
+
+static PyObject* mute_clients(PyObject* args, PyObject* kwargs, int mute)
+{
+    static char* kwlist[] = {"server", "clients", "temporary", "timeout", NULL};
+    uint64 serverConnectionHandlerID;
+    PyObject* clients;
+    int temporary = 0;
+    double timeout = get_config()->requestTimeout;
+    ClientBatchAction action;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "KO|$pd", kwlist, &serverConnectionHandlerID,
+                                     &clients, &temporary, &timeout)) {
         return NULL;
     }
 
-    if (ts3Functions != NULL && ts3Functions->requestSendServerTextMsg != NULL) {
-        ts3Functions->requestSendServerTextMsg(serverConnectionHandlerID, message, returnCode);
+    if (mute) {
+        action = temporary ? BATCH_MUTE_TEMPORARY : BATCH_MUTE;
+    } else {
+        action = temporary ? BATCH_UNMUTE_TEMPORARY : BATCH_UNMUTE;
     }
+    return run_client_batch(action, mute ? "mute_clients" : "unmute_clients", serverConnectionHandlerID,
+                            clients, 0, NULL, timeout);
+}
 
-    Py_RETURN_NONE;
+static PyObject* py_ts_mute_clients(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    (void)self; /* Unused parameter */
+
+    return mute_clients(args, kwargs, 1);
+}
+
+static PyObject* py_ts_unmute_clients(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    (void)self; /* Unused parameter */
+
+    return mute_clients(args, kwargs, 0);
 }
 
 static PyObject* py_ts_log(PyObject* self, PyObject* args)
@@ -177,7 +695,10 @@ static PyObject* py_ts_get_audio_level(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->getPreProcessorInfoValueFloat != NULL) {
-        if (ts3Functions->getPreProcessorInfoValueFloat(serverConnectionHandlerID, ident, &result) == ERROR_ok) {
+        TRACE_BEGIN(span);
+        unsigned int error = ts3Functions->getPreProcessorInfoValueFloat(serverConnectionHandlerID, ident, &result);
+        TRACE_END(span, "ts3api", "get_audio_level");
+        if (error == ERROR_ok) {
             return PyFloat_FromDouble((double)result);
         }
     }
@@ -198,7 +719,9 @@ static PyObject* py_ts_start_recording(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->startVoiceRecording != NULL) {
+        TRACE_BEGIN(span);
         result = ts3Functions->startVoiceRecording(serverConnectionHandlerID);
+        TRACE_END(span, "ts3api", "start_recording");
         if (result == ERROR_ok) {
             log_info("Voice recording started");
             Py_RETURN_TRUE;
@@ -224,7 +747,9 @@ static PyObject* py_ts_stop_recording(PyObject* self, PyObject* args)
     }
 
     if (ts3Functions != NULL && ts3Functions->stopVoiceRecording != NULL) {
+        TRACE_BEGIN(span);
         result = ts3Functions->stopVoiceRecording(serverConnectionHandlerID);
+        TRACE_END(span, "ts3api", "stop_recording");
         if (result == ERROR_ok) {
             log_info("Voice recording stopped");
             Py_RETURN_TRUE;
@@ -237,6 +762,528 @@ static PyObject* py_ts_stop_recording(PyObject* self, PyObject* args)
     Py_RETURN_FALSE;
 }
 
+/* Event subscriptions */
+
+#define SUBSCRIPTION_CAPSULE "ts3api.subscription"
+
+typedef struct PendingSubscription {
+    PythonEventType    type;
+    SubscriptionFilter filter;
+    uint32_t           lane;
+} PendingSubscription;
+
+static void pending_subscription_destructor(PyObject* capsule)
+{
+    free(PyCapsule_GetPointer(capsule, SUBSCRIPTION_CAPSULE));
+}
+
+/* The decorator returned by ts3api.on(); self is the capsule holding the compiled filter */
+static PyObject* py_ts_on_register(PyObject* capsule, PyObject* func)
+{
+    PendingSubscription* pending = (PendingSubscription*)PyCapsule_GetPointer(capsule, SUBSCRIPTION_CAPSULE);
+    ScriptContext current;
+
+    if (pending == NULL) {
+        return NULL;
+    }
+
+    if (!PyCallable_Check(func)) {
+        PyErr_SetString(PyExc_TypeError, "ts3api.on() must decorate a callable");
+        return NULL;
+    }
+
+    /* Owned by the script being loaded (or whose handler is running) */
+    current = python_engine_get_current_script();
+    switch (python_subscriptions_add(pending->type, &pending->filter, func, current.script, current.generation,
+                                     pending->lane)) {
+        case -1:
+            return PyErr_NoMemory();
+        case -2:
+            return PyErr_Format(PyExc_ValueError, "'%s' handlers are limited to %d lanes",
+                                python_engine_get_event_name(pending->type), SUBSCRIPTION_MAX_LANES);
+        default:
+            break;
+    }
+
+    Py_INCREF(func);
+    return func;
+}
+
+static PyMethodDef OnRegisterDef = {
+    "on_decorator", py_ts_on_register, METH_O, "Register the decorated function as an event handler"
+};
+
+static int parse_id_filter(PyObject* value, uint64* result)
+{
+    unsigned long long id = PyLong_AsUnsignedLongLong(value);
+
+    if (id == (unsigned long long)-1 && PyErr_Occurred()) {
+        return 0;
+    }
+    *result = (uint64)id;
+    return 1;
+}
+
+static PyObject* py_ts_on(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"event", "server", "channel", "target_mode", "contains", "ignore_self", "lane", NULL};
+    const char* event_name;
+    PyObject* server = Py_None;
+    PyObject* channel = Py_None;
+    PyObject* target_mode = Py_None;
+    const char* contains = NULL;
+    int ignore_self = 0;
+    const char* lane = NULL;
+    PendingSubscription* pending;
+    PyObject* capsule;
+    PyObject* decorator;
+    unsigned int unsupported;
+    size_t i;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("on")) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|$OOOzpz", kwlist, &event_name, &server, &channel,
+                                     &target_mode, &contains, &ignore_self, &lane)) {
+        return NULL;
+    }
+
+    pending = (PendingSubscription*)calloc(1, sizeof(PendingSubscription));
+    if (pending == NULL) {
+        return PyErr_NoMemory();
+    }
+
+    pending->type = python_engine_find_event(event_name);
+    if (pending->type == PYTHON_EVENT_COUNT) {
+        PyErr_Format(PyExc_ValueError, "unknown event '%s'", event_name);
+        goto fail;
+    }
+
+    /* Compile the keyword filters into C predicates */
+    if (server != Py_None) {
+        pending->filter.flags |= FILTER_SERVER;
+        if (!parse_id_filter(server, &pending->filter.serverConnectionHandlerID)) {
+            goto fail;
+        }
+    }
+    if (channel != Py_None) {
+        pending->filter.flags |= FILTER_CHANNEL;
+        if (!parse_id_filter(channel, &pending->filter.channelID)) {
+            goto fail;
+        }
+    }
+    if (target_mode != Py_None) {
+        pending->filter.flags |= FILTER_TARGET_MODE;
+        pending->filter.targetMode = (int)PyLong_AsLong(target_mode);
+        if (pending->filter.targetMode == -1 && PyErr_Occurred()) {
+            goto fail;
+        }
+    }
+    if (contains != NULL) {
+        pending->filter.flags |= FILTER_CONTAINS;
+        pending->filter.containsLength = strlen(contains);
+        if (pending->filter.containsLength >= FILTER_CONTAINS_BUFSIZE) {
+            PyErr_Format(PyExc_ValueError, "contains= filter is limited to %d bytes", FILTER_CONTAINS_BUFSIZE - 1);
+            goto fail;
+        }
+        for (i = 0; i <= pending->filter.containsLength; i++) {
+            char c = contains[i];
+            pending->filter.contains[i] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        }
+    }
+    if (ignore_self) {
+        pending->filter.flags |= FILTER_IGNORE_SELF;
+    }
+    if (lane != NULL && lane[0] != '\0') {
+        pending->lane = python_subscriptions_lane(lane);
+    }
+
+    unsupported = pending->filter.flags & ~python_subscriptions_supported_filters(pending->type);
+    if (unsupported != 0) {
+        PyErr_Format(PyExc_ValueError, "event '%s' does not support the %s filter", event_name,
+                     (unsupported & FILTER_CHANNEL) ? "channel" :
+                     (unsupported & FILTER_TARGET_MODE) ? "target_mode" :
+                     (unsupported & FILTER_CONTAINS) ? "contains" : "ignore_self");
+        goto fail;
+    }
+
+    capsule = PyCapsule_New(pending, SUBSCRIPTION_CAPSULE, pending_subscription_destructor);
+    if (capsule == NULL) {
+        goto fail;
+    }
+
+    decorator = PyCFunction_New(&OnRegisterDef, capsule);
+    Py_DECREF(capsule);
+    return decorator;
+
+fail:
+    free(pending);
+    return NULL;
+}
+
+static PyObject* py_ts_off(PyObject* self, PyObject* func)
+{
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("off")) {
+        return NULL;
+    }
+
+    return PyLong_FromLong(python_subscriptions_remove_callable(func));
+}
+
+/* Chat triggers */
+
+static PyObject* py_ts_add_trigger(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"keyword", "whole_word", NULL};
+    const char* keyword;
+    int whole_word = 1;
+    ScriptContext current;
+    int id;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("add_trigger")) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|p", kwlist, &keyword, &whole_word)) {
+        return NULL;
+    }
+
+    if (keyword[0] == '\0' || strlen(keyword) > TRIGGER_KEYWORD_MAX) {
+        PyErr_Format(PyExc_ValueError, "keyword must be 1 to %d bytes", TRIGGER_KEYWORD_MAX);
+        return NULL;
+    }
+
+    current = python_engine_get_current_script();
+    id = python_triggers_add_keyword(keyword, whole_word, current.script, current.generation);
+    if (id < 0) {
+        return PyErr_NoMemory();
+    }
+
+    return PyLong_FromLong(id);
+}
+
+static PyObject* py_ts_add_pattern(PyObject* self, PyObject* args)
+{
+    const char* name;
+    TriggerKind kind;
+    ScriptContext current;
+    int id;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("add_pattern")) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "s", &name)) {
+        return NULL;
+    }
+
+    kind = python_triggers_find_pattern(name);
+    if (kind == TRIGGER_KIND_COUNT) {
+        PyErr_Format(PyExc_ValueError, "unknown pattern '%s' (expected 'callsign' or 'url')", name);
+        return NULL;
+    }
+
+    current = python_engine_get_current_script();
+    id = python_triggers_add_pattern(kind, current.script, current.generation);
+    if (id < 0) {
+        return PyErr_NoMemory();
+    }
+
+    return PyLong_FromLong(id);
+}
+
+static PyObject* py_ts_remove_trigger(PyObject* self, PyObject* args)
+{
+    int id;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("remove_trigger")) {
+        return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "i", &id)) {
+        return NULL;
+    }
+
+    return PyBool_FromLong(python_triggers_remove(id));
+}
+
+/* Callsign log */
+
+static PyObject* py_ts_qso_count(PyObject* self, PyObject* args)
+{
+    (void)self; /* Unused parameter */
+    (void)args; /* Unused parameter */
+
+    return PyLong_FromSize_t(qso_log_count());
+}
+
+static PyObject* py_ts_qso_recent(PyObject* self, PyObject* args)
+{
+    QsoRecord records[QSO_RECENT_COUNT];
+    int limit = 10;
+    size_t count;
+    size_t i;
+    PyObject* list;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "|i", &limit)) {
+        return NULL;
+    }
+    if (limit < 0) {
+        limit = 0;
+    }
+
+    count = qso_log_recent(records, (size_t)limit < QSO_RECENT_COUNT ? (size_t)limit : QSO_RECENT_COUNT);
+    list = PyList_New((Py_ssize_t)count);
+    if (list == NULL) {
+        return NULL;
+    }
+
+    /* (callsign, timestamp, heard_from), newest first */
+    for (i = 0; i < count; i++) {
+        PyObject* item = Py_BuildValue("(sIs)", records[i].call, records[i].timestamp, records[i].heardFrom);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, item);
+    }
+
+    return list;
+}
+
+static PyObject* py_ts_qso_logged(PyObject* self, PyObject* args)
+{
+    const char* text;
+    Callsign callsign;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "s", &text)) {
+        return NULL;
+    }
+
+    /* Normalise the same way the chat scanner does */
+    if (!callsign_parse(text, strlen(text), &callsign)) {
+        Py_RETURN_FALSE;
+    }
+
+    return PyBool_FromLong(qso_log_contains(callsign.call, (uint32_t)time(NULL)));
+}
+
+static PyObject* py_ts_qso_export_adif(PyObject* self, PyObject* args)
+{
+    const char* path = NULL;
+    char default_path[PATH_BUFSIZE];
+    long written;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "|z", &path)) {
+        return NULL;
+    }
+
+    if (path == NULL) {
+        join_path(default_path, sizeof(default_path), get_config_path(), "tspy_qso.adi");
+        path = default_path;
+    }
+
+    /* Streams record by record in C; nothing is materialised in Python */
+    Py_BEGIN_ALLOW_THREADS
+    written = qso_log_export_adif(path);
+    Py_END_ALLOW_THREADS
+
+    if (written < 0) {
+        PyErr_Format(PyExc_OSError, "failed to export callsign log to %s", path);
+        return NULL;
+    }
+
+    return PyLong_FromLong(written);
+}
+
+/* Store text in a dict, replacing bytes that a cut left as invalid UTF-8 */
+static int set_text_item(PyObject* dict, const char* key, const char* text)
+{
+    PyObject* value = PyUnicode_DecodeUTF8(text, (Py_ssize_t)strlen(text), "replace");
+    int result;
+
+    if (value == NULL) {
+        return -1;
+    }
+    result = PyDict_SetItemString(dict, key, value);
+    Py_DECREF(value);
+    return result;
+}
+
+static PyObject* error_to_dict(const ErrorInfo* error)
+{
+    char traceback[4096];
+    PyObject* dict = Py_BuildValue("{s:K,s:L,s:L,s:K}", "id", (unsigned long long)error->id,
+                                   "time", (long long)error->firstTime, "last_time", (long long)error->lastTime,
+                                   "count", (unsigned long long)error->count);
+
+    if (dict == NULL) {
+        return NULL;
+    }
+    /* Formatted now: only records someone asks for pay for it */
+    if (python_errors_traceback(error->id, traceback, sizeof(traceback)) != 0) {
+        traceback[0] = '\0';
+    }
+    if (set_text_item(dict, "script", error->script) != 0 || set_text_item(dict, "handler", error->handler) != 0 ||
+        set_text_item(dict, "type", error->type) != 0 || set_text_item(dict, "message", error->message) != 0 ||
+        set_text_item(dict, "traceback", traceback) != 0) {
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+static PyObject* py_ts_get_errors(PyObject* self, PyObject* args)
+{
+    ErrorInfo errors[ERROR_RING_SIZE];
+    int limit = 20;
+    size_t count;
+    size_t i;
+    PyObject* list;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "|i", &limit)) {
+        return NULL;
+    }
+    if (limit < 0) {
+        limit = 0;
+    }
+
+    count = python_errors_list(errors, (size_t)limit < ERROR_RING_SIZE ? (size_t)limit : ERROR_RING_SIZE);
+    list = PyList_New((Py_ssize_t)count);
+    if (list == NULL) {
+        return NULL;
+    }
+
+    /* Newest first */
+    for (i = 0; i < count; i++) {
+        PyObject* item = error_to_dict(&errors[i]);
+        if (item == NULL) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, item);
+    }
+
+    return list;
+}
+
+/* Shared by call_later() and every(): (seconds, func, *args) */
+static PyObject* schedule_timer(PyObject* args, const char* name, int periodic)
+{
+    PyObject* seconds;
+    PyObject* callable;
+    PyObject* callArgs;
+    PyObject* timer;
+    ScriptContext current;
+    double value;
+
+    if (!require_main_interpreter(name)) {
+        return NULL;
+    }
+    if (PyTuple_GET_SIZE(args) < 2) {
+        PyErr_Format(PyExc_TypeError, "%s() takes at least 2 arguments (seconds, func, *args)", name);
+        return NULL;
+    }
+
+    seconds = PyTuple_GET_ITEM(args, 0);
+    callable = PyTuple_GET_ITEM(args, 1);
+    value = PyFloat_AsDouble(seconds);
+    if (value == -1.0 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (periodic && value <= 0.0) {
+        PyErr_SetString(PyExc_ValueError, "interval must be positive");
+        return NULL;
+    }
+
+    callArgs = PyTuple_GetSlice(args, 2, PyTuple_GET_SIZE(args));
+    if (callArgs == NULL) {
+        return NULL;
+    }
+    current = python_engine_get_current_script();
+    timer = python_timers_schedule(callable, callArgs, value, periodic ? value : 0.0,
+                                   current.script, current.generation);
+    Py_DECREF(callArgs);
+
+    return timer;
+}
+
+static PyObject* py_ts_call_later(PyObject* self, PyObject* args)
+{
+    (void)self; /* Unused parameter */
+
+    return schedule_timer(args, "call_later", 0);
+}
+
+static PyObject* py_ts_every(PyObject* self, PyObject* args)
+{
+    (void)self; /* Unused parameter */
+
+    return schedule_timer(args, "every", 1);
+}
+
+static PyObject* py_ts_spawn(PyObject* self, PyObject* coroutine)
+{
+    ScriptContext current;
+
+    (void)self; /* Unused parameter */
+
+    if (!require_main_interpreter("spawn")) {
+        return NULL;
+    }
+
+    if (!python_loop_is_coroutine(coroutine)) {
+        PyErr_SetString(PyExc_TypeError, "spawn() expects a coroutine");
+        return NULL;
+    }
+
+    current = python_engine_get_current_script();
+    if (python_loop_submit(coroutine, current.script, current.generation) != 0) {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_ts_get_loop(PyObject* self, PyObject* unused)
+{
+    PyObject* loop = python_loop_get();
+
+    (void)self;   /* Unused parameter */
+    (void)unused; /* Unused parameter */
+
+    if (!require_main_interpreter("get_loop")) {
+        return NULL;
+    }
+
+    if (loop == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return NULL;
+    }
+
+    Py_INCREF(loop);
+    return loop;
+}
+
 /* Method definitions */
 static PyMethodDef TsApiMethods[] = {
     {"print_message", py_ts_print_message, METH_VARARGS, 
@@ -248,11 +1295,38 @@ static PyMethodDef TsApiMethods[] = {
     {"get_client_name", py_ts_get_client_name, METH_VARARGS,
      "Get client name by ID (serverConnectionHandlerID, clientID)"},
     
-    {"send_channel_message", py_ts_send_channel_message, METH_VARARGS,
-     "Send message to current channel (serverConnectionHandlerID, message)"},
+    {"send_channel_message", (PyCFunction)(void (*)(void))py_ts_send_channel_message, METH_VARARGS | METH_KEYWORDS,
+     "Queue a message to the current channel; returns a future with the server's error code (serverConnectionHandlerID, message, *, timeout=10, bulk=False)"},
+    
+    {"send_server_message", (PyCFunction)(void (*)(void))py_ts_send_server_message, METH_VARARGS | METH_KEYWORDS,
+     "Queue a message to the server; returns a future with the server's error code (serverConnectionHandlerID, message, *, timeout=10, bulk=False)"},
+    
+    {"send_queue_length", py_ts_send_queue_length, METH_VARARGS,
+     "Number of queued outgoing messages (serverConnectionHandlerID=0 for all servers)"},
+    
+    {"wait_drained", py_ts_wait_drained, METH_VARARGS,
+     "Future resolved once queued messages have been sent (serverConnectionHandlerID=0 for all servers)"},
     
-    {"send_server_message", py_ts_send_server_message, METH_VARARGS,
-     "Send message to server (serverConnectionHandlerID, message)"},
+    {"set_send_rate", py_ts_set_send_rate, METH_VARARGS,
+     "Limit outgoing messages per server (messages_per_second, burst=5)"},
+    
+    {"move_client", (PyCFunction)(void (*)(void))py_ts_move_client, METH_VARARGS | METH_KEYWORDS,
+     "Move a client; returns a future with the server's error code (serverConnectionHandlerID, clientID, channelID, password='', *, timeout=10)"},
+    
+    {"move_clients", (PyCFunction)(void (*)(void))py_ts_move_clients, METH_VARARGS | METH_KEYWORDS,
+     "Move many clients; returns a future with a list of error codes, one per request (serverConnectionHandlerID, clientIDs, channelID, password='', *, timeout=10)"},
+    
+    {"kick_clients_from_channel", (PyCFunction)(void (*)(void))py_ts_kick_clients_from_channel, METH_VARARGS | METH_KEYWORDS,
+     "Kick many clients from their channel; returns a future with a list of error codes (serverConnectionHandlerID, clientIDs, reason='', *, timeout=10)"},
+    
+    {"kick_clients_from_server", (PyCFunction)(void (*)(void))py_ts_kick_clients_from_server, METH_VARARGS | METH_KEYWORDS,
+     "Kick many clients from the server; returns a future with a list of error codes (serverConnectionHandlerID, clientIDs, reason='', *, timeout=10)"},
+    
+    {"mute_clients", (PyCFunction)(void (*)(void))py_ts_mute_clients, METH_VARARGS | METH_KEYWORDS,
+     "Mute many clients locally; returns a future with a list of error codes (serverConnectionHandlerID, clientIDs, *, temporary=False)"},
+    
+    {"unmute_clients", (PyCFunction)(void (*)(void))py_ts_unmute_clients, METH_VARARGS | METH_KEYWORDS,
+     "Unmute many clients locally; returns a future with a list of error codes (serverConnectionHandlerID, clientIDs, *, temporary=False)"},
     
     {"log", py_ts_log, METH_VARARGS,
      "Write to plugin log (message, [level: 0=info, 1=warn, 2=error])"},
@@ -266,22 +1340,94 @@ static PyMethodDef TsApiMethods[] = {
     {"stop_recording", py_ts_stop_recording, METH_VARARGS,
      "Stop voice recording (serverConnectionHandlerID)"},
     
+    {"on", (PyCFunction)(void (*)(void))py_ts_on, METH_VARARGS | METH_KEYWORDS,
+     "Decorator registering an event handler (event, *, server, channel, target_mode, contains, ignore_self, lane)"},
+    
+    {"off", py_ts_off, METH_O,
+     "Unregister a function from all events it was registered for (func)"},
+    
+    {"add_trigger", (PyCFunction)(void (*)(void))py_ts_add_trigger, METH_VARARGS | METH_KEYWORDS,
+     "Register a chat keyword delivered to on_trigger (keyword, whole_word=True)"},
+    
+    {"add_pattern", py_ts_add_pattern, METH_VARARGS,
+     "Register a built-in chat pattern delivered to on_trigger ('callsign' or 'url')"},
+    
+    {"remove_trigger", py_ts_remove_trigger, METH_VARARGS,
+     "Unregister a trigger (trigger_id)"},
+    
+    {"qso_count", py_ts_qso_count, METH_NOARGS,
+     "Number of callsigns in the callsign log"},
+    
+    {"qso_recent", py_ts_qso_recent, METH_VARARGS,
+     "Most recently logged callsigns as (callsign, timestamp, heard_from) tuples (limit=10)"},
+    
+    {"qso_logged", py_ts_qso_logged, METH_VARARGS,
+     "Check whether a callsign was logged today (callsign)"},
+    
+    {"qso_export_adif", py_ts_qso_export_adif, METH_VARARGS,
+     "Export the callsign log as ADIF; returns the record count (path=None)"},
+    
+    {"get_errors", py_ts_get_errors, METH_VARARGS,
+     "Recent Python errors as dicts with id, time, last_time, count, script, handler, type, message and traceback, newest first (limit=20)"},
+    
+    {"call_later", py_ts_call_later, METH_VARARGS,
+     "Call func(*args) once after a delay on the timer thread; returns a Timer (seconds, func, *args)"},
+    
+    {"every", py_ts_every, METH_VARARGS,
+     "Call func(*args) repeatedly on the timer thread; returns a Timer (seconds, func, *args)"},
+    
+    {"spawn", py_ts_spawn, METH_O,
+     "Run a coroutine as a task on the plugin's event loop, owned by the calling script (coro)"},
+    
+    {"get_loop", py_ts_get_loop, METH_NOARGS,
+     "The plugin's asyncio event loop (for asyncio.run_coroutine_threadsafe)"},
+    
     {NULL, NULL, 0, NULL}
 };
 
+/* Timer, Store and Event objects live in the main interpreter only */
+static int ts3api_exec(PyObject* module)
+{
+    if (!python_engine_in_main_interpreter()) {
+        return 0;
+    }
+    if (python_timers_add_types(module) != 0 || python_store_add_types(module) != 0
+        || python_event_object_add_types(module) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Multi-phase init lets isolated interpreters import their own copy of the module */
+static PyModuleDef_Slot TsApiSlots[] = {
+    {Py_mod_exec, (void*)ts3api_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+    {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030D0000
+    /* Shared state is under the engine state lock or the modules' own mutexes */
+    {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+    {0, NULL}
+};
+
 /* Module definition */
 static struct PyModuleDef TsApiModule = {
     PyModuleDef_HEAD_INIT,
     "ts3api",
     "TeamSpeak 3 API for Python scripts",
-    -1,
-    TsApiMethods
+    0,
+    TsApiMethods,
+    TsApiSlots,
+    NULL,
+    NULL,
+    NULL
 };
 
 /* Module initialization */
 static PyObject* PyInit_ts3api(void)
 {
-    return PyModule_Create(&TsApiModule);
+    return PyModuleDef_Init(&TsApiModule);
 }
 
 int python_api_init(void)
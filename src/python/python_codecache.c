@@ -0,0 +1,630 @@
+/**
+ * @file python_codecache.c
+ * @brief Compiled code cache implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Cache file layout (little-endian):
+ *   "TSPC", u32 interpreter magic number, u64 source mtime, u64 source size,
+ *   u32 CRC-32 of the source, u32 CRC-32 of the payload, marshalled code
+ *
+ * A memory entry is trusted while the source's mtime and size are unchanged,
+ * as CPython does for .pyc files. A cache file is only used if the source's
+ * CRC-32 matches as well: the source has to be read for its checksum anyway,
+ * and this catches two saves within the file system's timestamp resolution.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <marshal.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_codecache.h"
+#include "python_engine.h"
+#include "core/plugin_config.h"
+#include "core/plugin_main.h"
+#include "utils/crc32.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+#define CACHE_MAGIC       "TSPC"
+#define CACHE_HEADER_SIZE 32
+
+/* Everything a load needs from disk, gathered without the GIL */
+struct CodePrefetch {
+    char     path[PATH_BUFSIZE];
+    int      status;            /* 0, or PREFETCH_MISSING / PREFETCH_UNREADABLE */
+    int64_t  mtime;
+    uint64_t size;
+    uint32_t checksum;
+    char*    source;            /* NUL-terminated */
+    char*    cached;            /* Cache file made from this source, or NULL */
+    size_t   cachedLength;
+};
+
+#define PREFETCH_MISSING    1
+#define PREFETCH_UNREADABLE 2
+
+typedef struct CodeEntry {
+    char      path[PATH_BUFSIZE];
+    int64_t   mtime;
+    uint64_t  size;
+    uint32_t  checksum;
+    PyObject* code;
+} CodeEntry;
+
+/* GIL (state lock) guarded */
+static CodeEntry* g_entries = NULL;
+static size_t     g_entry_count = 0;
+static size_t     g_entry_capacity = 0;
+static char       g_cache_dir[PATH_BUFSIZE] = "";
+static uint32_t   g_magic = 0;       /* Interpreter magic number; set by init, read by any thread */
+
+static volatile int64_t g_memory_hits = 0;
+static volatile int64_t g_disk_hits = 0;
+static volatile int64_t g_compiles = 0;
+static volatile int64_t g_write_failures = 0;
+
+/* ========================================================================
+ * Files
+ * ======================================================================== */
+
+/* Modification time (in the platform's finest unit) and size of a file */
+static int source_stamp(const char* path, int64_t* mtime, uint64_t* size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) {
+        return -1;
+    }
+    *mtime = (int64_t)(((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+    *size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+#else
+    struct stat info;
+
+    if (stat(path, &info) != 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    *mtime = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    *mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    *size = (uint64_t)info.st_size;
+#endif
+    return 0;
+}
+
+/* Whole file, NUL-terminated so source can be compiled in place; free() the result */
+static char* read_file(const char* path, size_t* length)
+{
+    FILE* fp = fopen(path, "rb");
+    char* data;
+    long size;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    data = (char*)malloc((size_t)size + 1);
+    if (data != NULL && fread(data, 1, (size_t)size, fp) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (data != NULL) {
+        data[size] = '\0';
+        *length = (size_t)size;
+    }
+    return data;
+}
+
+static int make_directory(const char* path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS ? 0 : -1;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : -1;
+#endif
+}
+
+static int replace_file(const char* from, const char* to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+    return rename(from, to);
+#endif
+}
+
+static void put_u32(char* out, uint32_t value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        out[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static void put_u64(char* out, uint64_t value)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        out[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+static uint32_t get_u32(const char* in)
+{
+    uint32_t value = 0;
+    int i;
+
+    for (i = 3; i >= 0; i--) {
+        value = (value << 8) | (unsigned char)in[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const char* in)
+{
+    uint64_t value = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        value = (value << 8) | (unsigned char)in[i];
+    }
+    return value;
+}
+
+/* <cache>/<script file name>.<CRC-32 of its full path>.pyc, so equal names from different folders don't clash */
+static int cache_file_path(char* dest, size_t destSize, const char* script_path)
+{
+    char name[PATH_BUFSIZE];
+    const char* base = script_path;
+    const char* p;
+
+    if (g_cache_dir[0] == '\0') {
+        return -1;
+    }
+    for (p = script_path; *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+    snprintf(name, sizeof(name), "%s.%08x.pyc", base, (unsigned int)crc32_update(0, script_path, strlen(script_path)));
+    join_path(dest, destSize, g_cache_dir, name);
+    return 0;
+}
+
+/* Contents of a cache file if it was made from exactly this source, else NULL; needs no GIL */
+static char* read_cache_file(const char* cache_path, int64_t mtime, uint64_t size, uint32_t checksum,
+                             size_t* length)
+{
+    char* data = read_file(cache_path, length);
+
+    if (data == NULL) {
+        return NULL;
+    }
+    if (*length < CACHE_HEADER_SIZE
+        || memcmp(data, CACHE_MAGIC, 4) != 0
+        || get_u32(data + 4) != g_magic
+        || (int64_t)get_u64(data + 8) != mtime
+        || get_u64(data + 16) != size
+        || get_u32(data + 24) != checksum
+        || get_u32(data + 28) != crc32_update(0, data + CACHE_HEADER_SIZE, *length - CACHE_HEADER_SIZE)) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+/* Code object from validated cache file contents; NULL (no exception) if it doesn't unmarshal to code */
+static PyObject* unmarshal_code(const char* data, size_t length)
+{
+    PyObject* code = PyMarshal_ReadObjectFromString(data + CACHE_HEADER_SIZE, (Py_ssize_t)(length - CACHE_HEADER_SIZE));
+
+    if (code != NULL && !PyCode_Check(code)) {
+        Py_CLEAR(code);
+    }
+    if (code == NULL) {
+        PyErr_Clear();
+    }
+    return code;
+}
+
+/* Write through a temporary file so a crash never leaves a partial cache file behind */
+static int write_cache_file(const char* cache_path, PyObject* code, int64_t mtime, uint64_t size, uint32_t checksum)
+{
+    char temp_path[PATH_BUFSIZE + 8];
+    char header[CACHE_HEADER_SIZE];
+    PyObject* payload;
+    const char* bytes;
+    Py_ssize_t length;
+    FILE* fp;
+    int ok;
+
+    payload = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION);
+    if (payload == NULL) {
+        PyErr_Clear();
+        return -1;
+    }
+    bytes = PyBytes_AS_STRING(payload);
+    length = PyBytes_GET_SIZE(payload);
+
+    memcpy(header, CACHE_MAGIC, 4);
+    put_u32(header + 4, g_magic);
+    put_u64(header + 8, (uint64_t)mtime);
+    put_u64(header + 16, size);
+    put_u32(header + 24, checksum);
+    put_u32(header + 28, crc32_update(0, bytes, (size_t)length));
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+    fp = fopen(temp_path, "wb");
+    if (fp == NULL) {
+        Py_DECREF(payload);
+        return -1;
+    }
+    ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header)
+         && fwrite(bytes, 1, (size_t)length, fp) == (size_t)length;
+    ok = fclose(fp) == 0 && ok;
+    Py_DECREF(payload);
+
+    if (!ok || replace_file(temp_path, cache_path) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+/* ========================================================================
+ * Memory cache
+ * ======================================================================== */
+
+static CodeEntry* find_entry(const char* script_path)
+{
+    size_t i;
+
+    for (i = 0; i < g_entry_count; i++) {
+        if (strcmp(g_entries[i].path, script_path) == 0) {
+            return &g_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Remember code for a script, replacing an older version; on failure it just isn't cached */
+static void remember(const char* script_path, PyObject* code, int64_t mtime, uint64_t size, uint32_t checksum)
+{
+    CodeEntry* entry = find_entry(script_path);
+
+    if (entry == NULL) {
+        if (g_entry_count == g_entry_capacity) {
+            size_t capacity = g_entry_capacity > 0 ? g_entry_capacity * 2 : 8;
+            CodeEntry* entries = (CodeEntry*)realloc(g_entries, capacity * sizeof(CodeEntry));
+            if (entries == NULL) {
+                return;
+            }
+            g_entries = entries;
+            g_entry_capacity = capacity;
+        }
+        entry = &g_entries[g_entry_count++];
+        safe_strcpy(entry->path, sizeof(entry->path), script_path);
+        entry->code = NULL;
+    }
+
+    Py_INCREF(code);
+    Py_XSETREF(entry->code, code);
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->checksum = checksum;
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+int python_codecache_init(void)
+{
+    if (g_cache_dir[0] != '\0') {
+        return 0;
+    }
+    g_magic = (uint32_t)PyImport_GetMagicNumber();
+    if (PyErr_Occurred()) {
+        PyErr_Clear();
+    }
+    if (get_config_path()[0] == '\0') {
+        log_warning("No config path; compiled scripts are cached in memory only");
+        return -1;
+    }
+
+    join_path(g_cache_dir, sizeof(g_cache_dir), get_config_path(), CODECACHE_DIRNAME);
+    if (make_directory(g_cache_dir) != 0) {
+        log_warning("Cannot create %s; compiled scripts are cached in memory only", g_cache_dir);
+        g_cache_dir[0] = '\0';
+        return -1;
+    }
+    log_debug("Code cache: %s", g_cache_dir);
+    return 0;
+}
+
+CodePrefetch* python_codecache_prefetch(const char* script_path)
+{
+    CodePrefetch* prefetch = (CodePrefetch*)calloc(1, sizeof(CodePrefetch));
+    char cache_path[PATH_BUFSIZE];
+    size_t length;
+
+    if (prefetch == NULL) {
+        return NULL;
+    }
+    safe_strcpy(prefetch->path, sizeof(prefetch->path), script_path);
+
+    if (source_stamp(script_path, &prefetch->mtime, &prefetch->size) != 0) {
+        prefetch->status = PREFETCH_MISSING;
+        return prefetch;
+    }
+    prefetch->source = read_file(script_path, &length);
+    if (prefetch->source == NULL) {
+        prefetch->status = PREFETCH_UNREADABLE;
+        return prefetch;
+    }
+    prefetch->checksum = crc32_update(0, prefetch->source, length);
+
+    if (cache_file_path(cache_path, sizeof(cache_path), script_path) == 0) {
+        prefetch->cached = read_cache_file(cache_path, prefetch->mtime, prefetch->size, prefetch->checksum,
+                                           &prefetch->cachedLength);
+    }
+    return prefetch;
+}
+
+PyObject* python_codecache_compile(const CodePrefetch* prefetch, uint32_t* checksum)
+{
+    char cache_path[PATH_BUFSIZE];
+    PyObject* code = NULL;
+
+    if (prefetch->status == PREFETCH_MISSING) {
+        PyErr_Format(PyExc_FileNotFoundError, "Cannot open script %s", prefetch->path);
+        return NULL;
+    }
+    if (prefetch->status == PREFETCH_UNREADABLE) {
+        PyErr_Format(PyExc_OSError, "Cannot read script %s", prefetch->path);
+        return NULL;
+    }
+
+    if (prefetch->cached != NULL) {
+        code = unmarshal_code(prefetch->cached, prefetch->cachedLength);
+    }
+    if (code != NULL) {
+        atomic64_add(&g_disk_hits, 1);
+    } else {
+        TRACE_BEGIN(span);
+        code = Py_CompileStringExFlags(prefetch->source, prefetch->path, Py_file_input, NULL, -1);
+        TRACE_END(span, "script", "compile");
+        if (code == NULL) {
+            return NULL;
+        }
+        atomic64_add(&g_compiles, 1);
+        if (cache_file_path(cache_path, sizeof(cache_path), prefetch->path) == 0
+            && write_cache_file(cache_path, code, prefetch->mtime, prefetch->size, prefetch->checksum) != 0) {
+            atomic64_add(&g_write_failures, 1);
+            log_debug("Could not write %s", cache_path);
+        }
+    }
+
+    /* Code objects belong to one interpreter, so only the main one keeps them */
+    if (python_engine_in_main_interpreter()) {
+        python_engine_lock_state();
+        remember(prefetch->path, code, prefetch->mtime, prefetch->size, prefetch->checksum);
+        python_engine_unlock_state();
+    }
+    *checksum = prefetch->checksum;
+    return code;
+}
+
+uint32_t python_codecache_prefetch_checksum(const CodePrefetch* prefetch)
+{
+    return prefetch->checksum;
+}
+
+void python_codecache_prefetch_free(CodePrefetch* prefetch)
+{
+    if (prefetch != NULL) {
+        free(prefetch->source);
+        free(prefetch->cached);
+        free(prefetch);
+    }
+}
+
+PyObject* python_codecache_load(const char* script_path, uint32_t* checksum)
+{
+    CodeEntry* entry;
+    CodePrefetch* prefetch;
+    PyObject* code;
+    int64_t mtime;
+    uint64_t size;
+
+    python_engine_lock_state();
+    entry = find_entry(script_path);
+    if (entry != NULL && source_stamp(script_path, &mtime, &size) == 0
+        && entry->mtime == mtime && entry->size == size) {
+        atomic64_add(&g_memory_hits, 1);
+        *checksum = entry->checksum;
+        code = entry->code;
+        Py_INCREF(code);
+        python_engine_unlock_state();
+        return code;
+    }
+    python_engine_unlock_state();
+
+    prefetch = python_codecache_prefetch(script_path);
+    if (prefetch == NULL) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    code = python_codecache_compile(prefetch, checksum);
+    python_codecache_prefetch_free(prefetch);
+    return code;
+}
+
+void python_codecache_forget(const char* script_path)
+{
+    CodeEntry* entry;
+
+    python_engine_lock_state();
+    entry = find_entry(script_path);
+    if (entry != NULL) {
+        Py_DECREF(entry->code);
+        *entry = g_entries[--g_entry_count];
+    }
+    python_engine_unlock_state();
+}
+
+/* Body of python_codecache_benchmark (GIL held); -1 if the folder cannot be listed */
+static int benchmark_directory(const char* directory, unsigned int runs, CodeCacheBenchmark* result)
+{
+    PyObject* os;
+    PyObject* names;
+    Py_ssize_t count;
+    Py_ssize_t i;
+    unsigned int run;
+
+    os = PyImport_ImportModule("os");
+    if (os == NULL) {
+        return -1;
+    }
+    names = PyObject_CallMethod(os, "listdir", "s", directory);
+    Py_DECREF(os);
+    if (names == NULL) {
+        return -1;
+    }
+
+    count = PyList_GET_SIZE(names);
+    for (i = 0; i < count; i++) {
+        char path[PATH_BUFSIZE];
+        const char* name = PyUnicode_AsUTF8(PyList_GET_ITEM(names, i));
+        size_t length = name != NULL ? strlen(name) : 0;
+        PyObject* code = NULL;
+        PyObject* payload = NULL;
+        int64_t mtime;
+        uint64_t size;
+        char* source;
+
+        if (name == NULL) {
+            PyErr_Clear();
+            continue;
+        }
+        if (length < 3 || strcmp(name + length - 3, ".py") != 0) {
+            continue;
+        }
+        join_path(path, sizeof(path), directory, name);
+        source = read_file(path, &length);
+        if (source == NULL) {
+            continue;
+        }
+
+        /* Each pass measures the three ways a load can go, on the same source */
+        for (run = 0; run < runs; run++) {
+            uint64_t start = clock_monotonic_ns();
+            PyObject* loaded;
+
+            Py_XSETREF(code, Py_CompileStringExFlags(source, path, Py_file_input, NULL, -1));
+            result->compileNs += clock_monotonic_ns() - start;
+            if (code == NULL) {
+                break;
+            }
+            if (payload == NULL && (payload = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION)) == NULL) {
+                break;
+            }
+
+            start = clock_monotonic_ns();
+            loaded = PyMarshal_ReadObjectFromString(PyBytes_AS_STRING(payload), PyBytes_GET_SIZE(payload));
+            result->unmarshalNs += clock_monotonic_ns() - start;
+            if (loaded == NULL) {
+                break;
+            }
+            Py_DECREF(loaded);
+
+            start = clock_monotonic_ns();
+            source_stamp(path, &mtime, &size);
+            result->memoryNs += clock_monotonic_ns() - start;
+        }
+        free(source);
+
+        if (code != NULL && payload != NULL && !PyErr_Occurred()) {
+            result->scripts++;
+            result->sourceBytes += length;
+        }
+        PyErr_Clear();   /* A script that doesn't compile is left out */
+        Py_XDECREF(code);
+        Py_XDECREF(payload);
+    }
+    Py_DECREF(names);
+
+    result->compileNs /= runs;
+    result->unmarshalNs /= runs;
+    result->memoryNs /= runs;
+    return 0;
+}
+
+int python_codecache_benchmark(const char* directory, unsigned int runs, CodeCacheBenchmark* result)
+{
+    PyGILState_STATE gil;
+    int status;
+
+    memset(result, 0, sizeof(*result));
+    gil = PyGILState_Ensure();
+    status = benchmark_directory(directory, runs > 0 ? runs : 1, result);
+    if (status != 0) {
+        PyErr_Clear();
+    }
+    PyGILState_Release(gil);
+    return status;
+}
+
+void python_codecache_get_stats(CodeCacheStats* stats)
+{
+    stats->entries = g_entry_count;
+    stats->memoryHits = (uint64_t)atomic64_load(&g_memory_hits);
+    stats->diskHits = (uint64_t)atomic64_load(&g_disk_hits);
+    stats->compiles = (uint64_t)atomic64_load(&g_compiles);
+    stats->writeFailures = (uint64_t)atomic64_load(&g_write_failures);
+}
+
+void python_codecache_shutdown(void)
+{
+    size_t i;
+
+    for (i = 0; i < g_entry_count; i++) {
+        Py_DECREF(g_entries[i].code);
+    }
+    free(g_entries);
+    g_entries = NULL;
+    g_entry_count = 0;
+    g_entry_capacity = 0;
+    g_cache_dir[0] = '\0';
+}
@@ -0,0 +1,134 @@
+/**
+ * @file python_codecache.h
+ * @brief Compiled code cache for script loads
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Script sources are compiled once. Code objects are kept in memory, keyed by
+ * path, modification time and size, and written as marshalled files to a
+ * cache folder next to the settings so the next start skips compilation too.
+ */
+
+#ifndef PYTHON_CODECACHE_H
+#define PYTHON_CODECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Cache folder name inside the config directory
+ */
+#define CODECACHE_DIRNAME "tspy_cache"
+
+/**
+ * @brief Code cache counters
+ */
+typedef struct CodeCacheStats {
+    size_t   entries;         /* Scripts with code held in memory */
+    uint64_t memoryHits;      /* Loads answered from memory */
+    uint64_t diskHits;        /* Loads answered from a cache file */
+    uint64_t compiles;        /* Loads that compiled the source */
+    uint64_t writeFailures;   /* Cache files that could not be written */
+} CodeCacheStats;
+
+/**
+ * @brief Source and cache file contents for one script, read ahead of compiling
+ */
+typedef struct CodePrefetch CodePrefetch;
+
+/**
+ * @brief Load-time benchmark results, totals over all scripts
+ */
+typedef struct CodeCacheBenchmark {
+    size_t   scripts;         /* Scripts measured (those that compile) */
+    uint64_t sourceBytes;     /* Total source size */
+    uint64_t compileNs;       /* Compiling the sources (cache misses) */
+    uint64_t unmarshalNs;     /* Unmarshalling compiled code (cache file hits) */
+    uint64_t memoryNs;        /* Checking the sources are unchanged (memory hits) */
+} CodeCacheBenchmark;
+
+/**
+ * @brief Pick the cache folder and create it if needed (GIL held)
+ * @return 0 on success, non-zero if compiled code is kept in memory only
+ */
+int python_codecache_init(void);
+
+/**
+ * @brief Compiled code for a script, compiling only if the source changed (GIL held)
+ * @param script_path Script file
+ * @param checksum Receives the CRC-32 of the source
+ * @return New reference to a code object (PyObject*), or NULL with a Python
+ *         exception set (unreadable file, syntax error)
+ */
+struct _object* python_codecache_load(const char* script_path, uint32_t* checksum);
+
+/**
+ * @brief Read a script and its cache file; the first half of python_codecache_load
+ * @param script_path Script file
+ * @return Prefetched data (a missing or unreadable file is reported by
+ *         python_codecache_compile), or NULL if out of memory
+ * @note Needs no GIL and may run on any thread once python_codecache_init returned
+ */
+CodePrefetch* python_codecache_prefetch(const char* script_path);
+
+/**
+ * @brief Compile prefetched source, or unmarshal its cache file, and remember the code (GIL held)
+ *
+ * In an isolated interpreter the code is returned but not kept in memory.
+ *
+ * @param prefetch From python_codecache_prefetch
+ * @param checksum Receives the CRC-32 of the source
+ * @return New reference to a code object, or NULL with a Python exception set
+ */
+struct _object* python_codecache_compile(const CodePrefetch* prefetch, uint32_t* checksum);
+
+/**
+ * @brief CRC-32 of the prefetched source (0 if it could not be read)
+ * @param prefetch From python_codecache_prefetch
+ */
+uint32_t python_codecache_prefetch_checksum(const CodePrefetch* prefetch);
+
+/**
+ * @brief Free prefetched data
+ * @param prefetch From python_codecache_prefetch (may be NULL)
+ */
+void python_codecache_prefetch_free(CodePrefetch* prefetch);
+
+/**
+ * @brief Drop the in-memory entry for a script (GIL held)
+ * @param script_path Script file
+ * @note Its cache file is kept for the next load
+ */
+void python_codecache_forget(const char* script_path);
+
+/**
+ * @brief Compare compiling against cache hits for every .py in a folder
+ * @param directory Folder to measure
+ * @param runs Passes over the folder; results are per pass
+ * @param result Receives the timings
+ * @return 0 on success, -1 if the folder cannot be listed
+ * @note Takes the GIL. Scripts are compiled but not run, and the cache itself
+ *       is left untouched.
+ */
+int python_codecache_benchmark(const char* directory, unsigned int runs, CodeCacheBenchmark* result);
+
+/**
+ * @brief Read the cache counters
+ * @param stats Receives the counters
+ */
+void python_codecache_get_stats(CodeCacheStats* stats);
+
+/**
+ * @brief Release all cached code objects (GIL held)
+ */
+void python_codecache_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_CODECACHE_H */
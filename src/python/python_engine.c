@@ -24,22 +24,105 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 
 #include "python_engine.h"
+#include "python_errors.h"
 #include "python_api.h"
+#include "python_codecache.h"
+#include "python_events.h"
+#include "python_event_object.h"
+#include "python_gc.h"
+#include "python_interpreters.h"
+#include "python_loop.h"
+#include "python_memory.h"
+#include "python_outbound.h"
+#include "python_pool.h"
+#include "python_profile.h"
+#include "python_requests.h"
+#include "python_store.h"
+#include "python_strings.h"
+#include "python_subscriptions.h"
+#include "python_timers.h"
+#include "python_triggers.h"
+#include "core/plugin_config.h"
+#include "core/plugin_main.h"
+#include "utils/crc32.h"
+#include "utils/file_watch.h"
 #include "utils/logging.h"
 #include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
 
-/* Python engine state */
+/*
+ * Python engine state. g_scripts_path, g_main_module and g_main_dict are
+ * written only by init and shutdown, while no other thread runs Python; the
+ * dict itself locks per operation in free-threaded builds.
+ */
 static int g_python_initialized = 0;
-static char g_python_error[512] = {0};
 static char g_scripts_path[512] = {0};
 static PyObject* g_main_module = NULL;
 static PyObject* g_main_dict = NULL;
 
+/* Main thread state while the TeamSpeak thread does not hold the GIL */
+static PyThreadState* g_main_thread_state = NULL;
+
+/* Loaded scripts, in load order; each owns its module object */
+typedef struct ScriptEntry {
+    char      name[SCRIPT_NAME_BUFSIZE];
+    char         path[PATH_BUFSIZE];
+    PyObject*    module;
+    unsigned int generation;
+    uint32_t     checksum;   /* CRC-32 of the source it was loaded from */
+} ScriptEntry;
+
+static ScriptEntry* g_scripts = NULL;
+static size_t       g_script_count = 0;
+static size_t       g_script_capacity = 0;
+
+/* Precomputed fan-out lists, one per event; replaced only on load/unload */
+static HandlerList* g_handlers[PYTHON_EVENT_COUNT];
+
+/* Reloads scripts when their files are saved */
+static FileWatch* g_script_watch = NULL;
+
+/* Every load gets a new generation so a reload can tell old registrations from new */
+static unsigned int g_next_generation = 1;
+
+/* Script whose code is running on this thread (module body or handler) */
+static THREAD_LOCAL ScriptContext t_current_script = {NULL, 0};
+
+/* Why the calling thread's last engine call failed; exceptions also go to the error ring */
+static THREAD_LOCAL char t_last_error[512];
+
+#ifdef Py_GIL_DISABLED
+/*
+ * Without a GIL the engine state lock stands in for it: a recursive PyMutex,
+ * so a handler may call back into ts3api while a load holds it. PyMutex
+ * detaches the thread state while it waits, which keeps a blocked thread
+ * from stalling a stop-the-world pause.
+ */
+static PyMutex          g_state_mutex = {0};
+static volatile int32_t g_state_owner = 0;
+static int              g_state_depth = 0;
+static THREAD_LOCAL int32_t t_thread_id = 0;
+#endif
+
+static const char* const g_event_names[PYTHON_EVENT_COUNT] = {
+    "on_connect",
+    "on_disconnect",
+    "on_client_move",
+    "on_text_message",
+    "on_talk_status_change",
+    "on_command",
+    "on_trigger"
+};
+
 /* Forward declarations */
 static void set_python_error(const char* msg);
 static void clear_python_error(void);
+static void rebuild_handler_tables(void);
+static void on_script_file_changed(void* context, const char* name);
 
 int python_engine_init(const char* plugin_path)
 {
@@ -53,6 +136,9 @@ int python_engine_init(const char* plugin_path)
 
     log_info("Initializing Python engine (safe mode)...");
     clear_python_error();
+    python_errors_init();
+    python_triggers_init();
+    python_subscriptions_init();
 
     /* IMPORTANT: Register ts3api module BEFORE initializing Python */
     log_info("Registering Python API module...");
@@ -62,6 +148,11 @@ int python_engine_init(const char* plugin_path)
         return 1;
     }
 
+    /* Allocators can only be wrapped before the first allocation */
+    if (python_memory_init() != 0) {
+        log_warning("Memory accounting is off");
+    }
+
     /* Initialize Python configuration - use simplest config that works */
     PyConfig_InitPythonConfig(&config);
     
@@ -126,6 +217,24 @@ int python_engine_init(const char* plugin_path)
     Py_INCREF(g_main_dict);
 
     g_python_initialized = 1;
+
+    /* The loop and timer threads run scripts too: from here on every entry point takes the GIL */
+    python_loop_init();
+    python_timers_init();
+    python_outbound_init();
+    python_store_init();
+    python_codecache_init();
+    python_interpreters_init();
+    python_pool_init();
+    python_gc_init();
+    g_main_thread_state = PyEval_SaveThread();
+
+    /* The watch thread takes the GIL itself when a script is saved */
+    g_script_watch = file_watch_directory(g_scripts_path, ".py", on_script_file_changed, NULL);
+    if (g_script_watch == NULL) {
+        log_warning("Scripts will not reload automatically when saved");
+    }
+
     log_info("Python engine initialized successfully");
     log_info("Scripts path: %s", g_scripts_path);
 
@@ -140,8 +249,40 @@ void python_engine_shutdown(void)
 
     log_info("Shutting down Python engine...");
 
+    /* The worker threads need the GIL to exit, so stop them before taking it back */
+    file_watch_stop(g_script_watch);
+    g_script_watch = NULL;
+    python_profile_stop(NULL, NULL);
+    python_gc_stop();
+    python_pool_stop();
+    python_interpreters_stop();
+    python_outbound_stop();
+    python_timers_stop();
+    python_loop_stop();
+    PyEval_RestoreThread(g_main_thread_state);
+    g_main_thread_state = NULL;
+
     /* Cleanup Python API */
     python_api_shutdown();
+    python_gc_shutdown();
+
+    /* Drop unsent messages, requests, timers, subscriptions, triggers, handler tables and script modules */
+    python_outbound_shutdown();
+    python_store_shutdown();
+    python_codecache_shutdown();
+    python_requests_shutdown();
+    python_timers_shutdown();
+    python_subscriptions_shutdown();
+    python_triggers_shutdown();
+    python_event_object_shutdown();
+    python_strings_shutdown();
+    while (g_script_count > 0) {
+        Py_DECREF(g_scripts[--g_script_count].module);
+    }
+    rebuild_handler_tables();
+    free(g_scripts);
+    g_scripts = NULL;
+    g_script_capacity = 0;
 
     /* Release references */
     if (g_main_dict != NULL) {
@@ -159,10 +300,26 @@ void python_engine_shutdown(void)
         Py_Finalize();
     }
 
+    python_memory_shutdown();
+    python_errors_shutdown();
     g_python_initialized = 0;
     log_info("Python engine shut down");
 }
 
+int python_engine_in_main_interpreter(void)
+{
+#if PY_VERSION_HEX >= 0x030D0000
+    PyThreadState* state = PyThreadState_GetUnchecked();
+
+    return state == NULL || PyThreadState_GetInterpreter(state) == PyInterpreterState_Main();
+#elif PY_VERSION_HEX >= 0x030C0000
+    /* No public unchecked getter before 3.13; every caller holds the GIL */
+    return PyInterpreterState_Get() == PyInterpreterState_Main();
+#else
+    return 1;
+#endif
+}
+
 int python_engine_is_initialized(void)
 {
     return g_python_initialized;
@@ -173,96 +330,725 @@ const char* python_engine_get_scripts_path(void)
     return g_scripts_path;
 }
 
-int python_engine_load_script(const char* script_path)
+void python_engine_script_name(const char* script_path, char* name, size_t name_size)
 {
-    FILE* fp;
-    PyObject* result;
+    const char* base = script_path;
+    const char* p;
+    char* dot;
 
-    if (!g_python_initialized) {
-        set_python_error("Python engine not initialized");
-        return 1;
+    for (p = script_path; *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+
+    safe_strcpy(name, name_size, base);
+    dot = strrchr(name, '.');
+    if (dot != NULL && strcmp(dot, ".py") == 0) {
+        *dot = '\0';
+    }
+}
+
+void python_engine_module_key(const char* name, char* key, size_t key_size)
+{
+    snprintf(key, key_size, "%s%s", SCRIPT_MODULE_PREFIX, name);
+}
+
+int python_engine_claim_module(const char* key, PyObject* owned)
+{
+    PyObject* existing = PyDict_GetItemString(PyImport_GetModuleDict(), key);
+
+    if (existing == NULL || existing == owned) {
+        return 0;
+    }
+    PyErr_Format(PyExc_ImportError, "sys.modules['%s'] was not registered by TsPy; not replacing it", key);
+    return -1;
+}
+
+void python_engine_restore_module(const char* key, PyObject* module, PyObject* previous)
+{
+    PyObject* modules = PyImport_GetModuleDict();
+
+    if (PyDict_GetItemString(modules, key) != module) {
+        return;
+    }
+    if (previous != NULL) {
+        PyDict_SetItemString(modules, key, previous);
+    } else if (PyDict_DelItemString(modules, key) != 0) {
+        PyErr_Clear();
+    }
+}
+
+static int find_script(const char* name)
+{
+    size_t i;
+
+    for (i = 0; i < g_script_count; i++) {
+        if (strcmp(g_scripts[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Publish new per-event handler lists from the script table (load/unload only) */
+static void rebuild_handler_tables(void)
+{
+    int type;
+    size_t i;
+
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        HandlerList* list = NULL;
+        HandlerList* old;
+        char* names;
+        size_t n = 0;
+
+        for (i = 0; i < g_script_count; i++) {
+            PyObject* func = PyDict_GetItemString(PyModule_GetDict(g_scripts[i].module), g_event_names[type]);
+            if (func != NULL && PyCallable_Check(func)) {
+                n++;
+            }
+        }
+
+        if (n > 0) {
+            list = (HandlerList*)malloc(offsetof(HandlerList, handlers) + n * (sizeof(PythonHandler) + SCRIPT_NAME_BUFSIZE));
+            if (list == NULL) {
+                log_error("Out of memory rebuilding %s handler table", g_event_names[type]);
+                continue;
+            }
+            list->refcount = 1;
+            list->count = 0;
+            /* Names are copied so the list outlives changes to the script table */
+            names = (char*)&list->handlers[n];
+
+            for (i = 0; i < g_script_count; i++) {
+                PyObject* func = PyDict_GetItemString(PyModule_GetDict(g_scripts[i].module), g_event_names[type]);
+                if (func != NULL && PyCallable_Check(func)) {
+                    PythonHandler* handler = &list->handlers[list->count];
+                    char* name = names + list->count * SCRIPT_NAME_BUFSIZE;
+
+                    safe_strcpy(name, SCRIPT_NAME_BUFSIZE, g_scripts[i].name);
+                    Py_INCREF(func);
+                    handler->callable = func;
+                    handler->script = name;
+                    handler->generation = g_scripts[i].generation;
+                    handler->takesEvent = python_event_object_takes_event(func, (PythonEventType)type);
+                    list->count++;
+                }
+            }
+        }
+
+        /* Dispatches still iterating the old list keep their reference */
+        old = g_handlers[type];
+        g_handlers[type] = list;
+        python_engine_release_handlers(old);
+    }
+}
+
+/* Drop everything a script registered through ts3api within a generation range */
+static void release_registrations(const char* name, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    python_subscriptions_remove_script(name, minGeneration, maxGeneration);
+    python_triggers_remove_script(name, minGeneration, maxGeneration);
+    python_timers_remove_script(name, minGeneration, maxGeneration);
+    python_loop_remove_script(name, minGeneration, maxGeneration);
+}
+
+static void report_script_error(const char* script_path)
+{
+    char name[SCRIPT_NAME_BUFSIZE];
+    char message[256];
+
+    python_engine_script_name(script_path, name, sizeof(name));
+    if (python_errors_capture(name, "load", message, sizeof(message)) != 0) {
+        set_python_error(message);
+    } else {
+        set_python_error("Script execution failed (unknown error)");
+        log_error("Failed to execute script: %s", script_path);
+    }
+}
+
+/* CRC-32 of a file, so a save that changed nothing does not reload; 0 if unreadable */
+static uint32_t source_checksum(const char* script_path)
+{
+    char buffer[4096];
+    uint32_t crc = 0;
+    size_t length;
+    FILE* fp = fopen(script_path, "rb");
+
+    if (fp == NULL) {
+        return 0;
     }
+    while ((length = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        crc = crc32_update(crc, buffer, length);
+    }
+    fclose(fp);
+    return crc;
+}
+
+static int execute_script(const char* script_path, const char* name)
+{
+    PyObject* code;
+    PyObject* result;
+    PyObject* module;
+    PyObject* dict;
+    PyObject* path_obj;
+    PyObject* loaded;
+    char key[SCRIPT_MODULE_BUFSIZE];
+    int index;
+    unsigned int generation;
+    uint32_t checksum;
+    ScriptContext previous;
 
     log_info("Loading Python script: %s", script_path);
     clear_python_error();
 
-    /* Open and execute the script */
-    fp = fopen(script_path, "r");
-    if (fp == NULL) {
-        set_python_error("Failed to open script file");
-        log_error("Failed to open script: %s", script_path);
+    /* Compiled only if the source changed since it was last compiled */
+    code = python_codecache_load(script_path, &checksum);
+    if (code == NULL) {
+        report_script_error(script_path);
         return 1;
     }
 
-    result = PyRun_File(fp, script_path, Py_file_input, g_main_dict, g_main_dict);
-    fclose(fp);
+    /* A script's module is namespaced, so a json.py or ts3api.py does not replace the real one */
+    index = find_script(name);
+    loaded = index >= 0 ? g_scripts[index].module : NULL;
+    python_engine_module_key(name, key, sizeof(key));
+    if (python_engine_claim_module(key, loaded) != 0) {
+        Py_DECREF(code);
+        report_script_error(script_path);
+        return 1;
+    }
+
+    /* Each script runs in its own module so handlers cannot shadow each other */
+    module = PyModule_New(key);
+    if (module == NULL) {
+        Py_DECREF(code);
+        report_script_error(script_path);
+        return 1;
+    }
+    dict = PyModule_GetDict(module);
+    path_obj = PyUnicode_FromString(script_path);
+    if (path_obj == NULL
+        || PyDict_SetItemString(dict, "__file__", path_obj) != 0
+        || PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) != 0) {
+        Py_XDECREF(path_obj);
+        Py_DECREF(module);
+        Py_DECREF(code);
+        report_script_error(script_path);
+        return 1;
+    }
+    Py_DECREF(path_obj);
+
+    /* Visible in sys.modules while executing, as for a regular import (dataclasses etc. rely on it) */
+    PyDict_SetItemString(PyImport_GetModuleDict(), key, module);
+
+    /* Registrations made by the module body (e.g. @ts3api.on) belong to this load */
+    generation = g_next_generation++;
+    python_memory_reset(name);
+    previous = python_engine_enter_script(name, generation);
+
+    TRACE_BEGIN(span);
+    result = PyEval_EvalCode(code, dict, dict);
+    TRACE_END(span, "script", "load_script");
+    Py_DECREF(code);
+
+    python_engine_leave_script(previous);
 
     if (result == NULL) {
-        /* Python error occurred - capture the error details */
-        PyObject *ptype, *pvalue, *ptraceback;
-        PyErr_Fetch(&ptype, &pvalue, &ptraceback);
-        
-        if (pvalue != NULL) {
-            PyObject* str_obj = PyObject_Str(pvalue);
-            if (str_obj != NULL) {
-                const char* err_msg = PyUnicode_AsUTF8(str_obj);
-                if (err_msg != NULL) {
-                    set_python_error(err_msg);
-                    log_error("Python error in %s: %s", script_path, err_msg);
-                }
-                Py_DECREF(str_obj);
+        report_script_error(script_path);
+        release_registrations(name, generation, generation);
+
+        /* Keep the previous version (if any) registered */
+        python_engine_restore_module(key, module, loaded);
+        Py_DECREF(module);
+        return 1;
+    }
+    Py_DECREF(result);
+
+    /* Register the module, replacing an older version of the same script */
+    index = find_script(name);
+    if (index >= 0) {
+        Py_DECREF(g_scripts[index].module);
+    } else {
+        if (g_script_count == g_script_capacity) {
+            size_t capacity = g_script_capacity > 0 ? g_script_capacity * 2 : 8;
+            ScriptEntry* scripts = (ScriptEntry*)realloc(g_scripts, capacity * sizeof(ScriptEntry));
+            if (scripts == NULL) {
+                set_python_error("Out of memory registering script");
+                python_engine_restore_module(key, module, NULL);
+                Py_DECREF(module);
+                return 1;
             }
+            g_scripts = scripts;
+            g_script_capacity = capacity;
         }
-        
-        /* Also print to stderr for debugging */
-        if (ptype != NULL && pvalue != NULL) {
-            PyErr_Restore(ptype, pvalue, ptraceback);
-            PyErr_Print();
-        } else {
-            set_python_error("Script execution failed (unknown error)");
-            log_error("Failed to execute script: %s", script_path);
-            Py_XDECREF(ptype);
-            Py_XDECREF(pvalue);
-            Py_XDECREF(ptraceback);
-        }
-        return 1;
+        index = (int)g_script_count++;
+        safe_strcpy(g_scripts[index].name, sizeof(g_scripts[index].name), name);
     }
+    safe_strcpy(g_scripts[index].path, sizeof(g_scripts[index].path), script_path);
+    g_scripts[index].module = module;
+    g_scripts[index].generation = generation;
+    g_scripts[index].checksum = checksum;
 
-    Py_DECREF(result);
+    /* Drop what the previous version of this script registered */
+    release_registrations(name, 0, generation - 1);
+    rebuild_handler_tables();
+    python_gc_scripts_changed();
     log_info("Script loaded successfully: %s", script_path);
 
     return 0;
 }
 
-int python_engine_reload_scripts(void)
+static int load_script(const char* script_path)
 {
-    char default_script[512];
-    
+    char name[SCRIPT_NAME_BUFSIZE];
+    int replacing;
+    int result;
+
     if (!g_python_initialized) {
         set_python_error("Python engine not initialized");
         return 1;
     }
 
-    log_info("Reloading tspy_init.py...");
-    
-    /* Reload the default init script */
+    python_engine_script_name(script_path, name, sizeof(name));
+
+    /* Events arriving while the old version is replaced are held for the new one */
+    replacing = find_script(name) >= 0;
+    if (replacing) {
+        python_events_pause();
+    }
+    result = execute_script(script_path, name);
+    if (replacing) {
+        python_events_resume();
+    }
+    return result;
+}
+
+int python_engine_load_script(const char* script_path)
+{
+    char name[SCRIPT_NAME_BUFSIZE];
+    char interpreter[SCRIPT_NAME_BUFSIZE];
+    PyGILState_STATE gil;
+    int result;
+
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+
+    /* Moving a script out of an isolated interpreter */
+    python_engine_script_name(script_path, name, sizeof(name));
+    if (python_interpreters_find(name, interpreter, sizeof(interpreter))) {
+        python_interpreters_unload(name);
+    }
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    result = load_script(script_path);
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    return result;
+}
+
+static int unload_script(const char* name)
+{
+    char module_name[SCRIPT_NAME_BUFSIZE];
+    char key[SCRIPT_MODULE_BUFSIZE];
+    int index;
+
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+
+    python_engine_script_name(name, module_name, sizeof(module_name));
+    index = find_script(module_name);
+    if (index < 0) {
+        set_python_error("Script is not loaded");
+        return 1;
+    }
+
+    python_engine_module_key(module_name, key, sizeof(key));
+    python_engine_restore_module(key, g_scripts[index].module, NULL);
+    Py_DECREF(g_scripts[index].module);
+    release_registrations(module_name, 0, UINT_MAX);
+    python_codecache_forget(g_scripts[index].path);
+
+    memmove(&g_scripts[index], &g_scripts[index + 1], (g_script_count - (size_t)index - 1) * sizeof(ScriptEntry));
+    g_script_count--;
+
+    rebuild_handler_tables();
+    python_gc_scripts_changed();
+    log_info("Script unloaded: %s", module_name);
+
+    return 0;
+}
+
+int python_engine_load_script_in(const char* script_path, const char* interpreter)
+{
+    char name[SCRIPT_NAME_BUFSIZE];
+    PyGILState_STATE gil;
+    int index;
+
+    if (interpreter == NULL || interpreter[0] == '\0' || strcmp(interpreter, "main") == 0) {
+        return python_engine_load_script(script_path);
+    }
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+    if (!python_interpreters_supported()) {
+        log_warning("Isolated interpreters need Python 3.12 or newer; loading %s in the main interpreter",
+                    script_path);
+        return python_engine_load_script(script_path);
+    }
+
+    /* Moving a script out of the main interpreter */
+    python_engine_script_name(script_path, name, sizeof(name));
+    python_memory_reset(name);
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    index = find_script(name);
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    if (index >= 0) {
+        python_engine_unload_script(name);
+    }
+
+    if (python_interpreters_load(interpreter, script_path) != 0) {
+        set_python_error("Script failed to load in its interpreter (see log)");
+        return 1;
+    }
+    return 0;
+}
+
+int python_engine_unload_script(const char* name)
+{
+    PyGILState_STATE gil;
+    int result;
+
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+    if (python_interpreters_unload(name) == 0) {
+        return 0;
+    }
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    result = unload_script(name);
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    return result;
+}
+
+size_t python_engine_get_script_count(void)
+{
+    PyGILState_STATE gil;
+    size_t count;
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    count = g_script_count;
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    return count;
+}
+
+int python_engine_get_script_name(size_t index, char* buffer, size_t size)
+{
+    PyGILState_STATE gil;
+    int found;
+
+    /* Copied under the GIL: a load or unload may move or drop the entry right after */
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    found = index < g_script_count;
+    if (found) {
+        safe_strcpy(buffer, size, g_scripts[index].name);
+    }
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    return found ? 0 : 1;
+}
+
+int python_engine_get_script_handler_count(const char* name)
+{
+    PyGILState_STATE gil;
+    int type;
+    size_t i;
+    int count = 0;
+
+    if (name == NULL) {
+        return 0;
+    }
+
+    /* Scripts on other threads may (un)subscribe concurrently */
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        const HandlerList* list = g_handlers[type];
+        for (i = 0; list != NULL && i < list->count; i++) {
+            if (strcmp(list->handlers[i].script, name) == 0) {
+                count++;
+            }
+        }
+    }
+    count += python_subscriptions_count_for_script(name);
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+
+    return count;
+}
+
+const PythonHandler* python_engine_get_handlers(PythonEventType type, size_t* count)
+{
+    if (type < 0 || type >= PYTHON_EVENT_COUNT) {
+        *count = 0;
+        return NULL;
+    }
+    if (g_handlers[type] == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    *count = g_handlers[type]->count;
+    return g_handlers[type]->handlers;
+}
+
+HandlerList* python_engine_acquire_handlers(PythonEventType type)
+{
+    HandlerList* list;
+
+    if (type < 0 || type >= PYTHON_EVENT_COUNT) {
+        return NULL;
+    }
+
+    /* Without a GIL the reference must be taken before a rebuild can drop the list */
+    python_engine_lock_state();
+    list = g_handlers[type];
+    if (list != NULL) {
+        atomic32_add(&list->refcount, 1);
+    }
+    python_engine_unlock_state();
+    return list;
+}
+
+void python_engine_release_handlers(HandlerList* list)
+{
+    size_t i;
+
+    if (list == NULL || atomic32_add(&list->refcount, -1) != 0) {
+        return;
+    }
+    for (i = 0; i < list->count; i++) {
+        Py_DECREF((PyObject*)list->handlers[i].callable);
+    }
+    free(list);
+}
+
+const char* python_engine_get_event_name(PythonEventType type)
+{
+    return (type >= 0 && type < PYTHON_EVENT_COUNT) ? g_event_names[type] : "unknown";
+}
+
+PythonEventType python_engine_find_event(const char* name)
+{
+    int type;
+
+    if (name == NULL) {
+        return PYTHON_EVENT_COUNT;
+    }
+
+    /* Accept both "text_message" and "on_text_message" */
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        if (strcmp(name, g_event_names[type]) == 0 || strcmp(name, g_event_names[type] + 3) == 0) {
+            return (PythonEventType)type;
+        }
+    }
+    return PYTHON_EVENT_COUNT;
+}
+
+ScriptContext python_engine_enter_script(const char* script, unsigned int generation)
+{
+    ScriptContext previous = t_current_script;
+
+    t_current_script.script = script;
+    t_current_script.generation = generation;
+    python_memory_enter(script);
+    python_profile_enter();
+    return previous;
+}
+
+void python_engine_leave_script(ScriptContext previous)
+{
+    t_current_script = previous;
+    python_memory_enter(previous.script);
+    python_profile_leave();
+}
+
+ScriptContext python_engine_get_current_script(void)
+{
+    ScriptContext context = t_current_script;
+
+    /* Coroutines carry their owner in the task's context instead */
+    if (context.script == NULL) {
+        python_loop_get_task_script(&context);
+    }
+    return context;
+}
+
+void python_engine_report_exception(const char* script, const char* context)
+{
+    python_errors_capture(script, context, NULL, 0);
+}
+
+int python_engine_reload_script(const char* name)
+{
+    PyGILState_STATE gil;
+    char module_name[SCRIPT_NAME_BUFSIZE];
+    char path[PATH_BUFSIZE];
+    int index;
+    int result = 1;
+
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+
+    python_engine_script_name(name, module_name, sizeof(module_name));
+
+    switch (python_interpreters_reload(name, 0)) {
+        case 0:
+            return 0;
+        case 1:
+            set_python_error("Script failed to reload in its interpreter (see log)");
+            return 1;
+        default:
+            break;
+    }
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    index = find_script(module_name);
+    if (index < 0) {
+        set_python_error("Script is not loaded");
+    } else if (source_checksum(g_scripts[index].path) == g_scripts[index].checksum) {
+        log_debug("%s is unchanged, not reloading", module_name);
+        result = 0;
+    } else {
+        /* Loading may move the entry */
+        safe_strcpy(path, sizeof(path), g_scripts[index].path);
+        result = load_script(path);
+    }
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+
+    return result;
+}
+
+/* FileWatchCallback on the watch thread: reload a loaded script from the scripts directory */
+static void on_script_file_changed(void* context, const char* name)
+{
+    char expected[PATH_BUFSIZE];
+    char module_name[SCRIPT_NAME_BUFSIZE];
+    char interpreter[SCRIPT_NAME_BUFSIZE];
+    PyGILState_STATE gil;
+    int index;
+    int watched;
+    int length;
+
+    (void)context; /* Unused parameter */
+
+    if (!get_config()->autoReload) {
+        return;
+    }
+
+    /* Same path the load command builds, so a same-named script from elsewhere is left alone */
 #ifdef _WIN32
-    _snprintf_s(default_script, sizeof(default_script), _TRUNCATE, "%s\\tspy_init.py", g_scripts_path);
+    length = _snprintf_s(expected, sizeof(expected), _TRUNCATE, "%s\\%s", g_scripts_path, name);
 #else
-    snprintf(default_script, sizeof(default_script), "%s/tspy_init.py", g_scripts_path);
+    length = snprintf(expected, sizeof(expected), "%s/%s", g_scripts_path, name);
 #endif
+    if (length < 0 || (size_t)length >= sizeof(expected)) {
+        log_warning("Not reloading %s: its path does not fit in %d bytes", name, PATH_BUFSIZE);
+        return;
+    }
+    python_engine_script_name(name, module_name, sizeof(module_name));
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    index = find_script(module_name);
+    watched = index >= 0 && strcmp(g_scripts[index].path, expected) == 0;
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    if (index < 0 && python_interpreters_find(module_name, interpreter, sizeof(interpreter))) {
+        watched = 1;
+    }
+
+    if (watched && python_engine_reload_script(name) != 0) {
+        log_warning("Keeping the previous version of %s", module_name);
+    }
+}
+
+int python_engine_reload_scripts(void)
+{
+    char (*paths)[PATH_BUFSIZE];
+    PyGILState_STATE gil;
+    size_t count;
+    size_t i;
+    int failures = 0;
     
-    if (python_engine_load_script(default_script) == 0) {
-        log_info("Successfully reloaded tspy_init.py");
-        return 0;
-    } else {
-        log_warning("Failed to reload tspy_init.py");
+    if (!g_python_initialized) {
+        set_python_error("Python engine not initialized");
+        return 1;
+    }
+
+    failures += python_interpreters_reload_all();
+
+    /* Loading may reorder the table, so snapshot the paths first */
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    count = g_script_count;
+    paths = count > 0 ? malloc(count * sizeof(*paths)) : NULL;
+    for (i = 0; paths != NULL && i < count; i++) {
+        safe_strcpy(paths[i], PATH_BUFSIZE, g_scripts[i].path);
+    }
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+    if (count == 0) {
+        if (python_interpreters_count() == 0) {
+            log_info("No scripts loaded, nothing to reload");
+        }
+        return failures > 0 ? 1 : 0;
+    }
+    if (paths == NULL) {
+        set_python_error("Out of memory");
+        return 1;
+    }
+
+    log_info("Reloading %zu script(s)...", count);
+    for (i = 0; i < count; i++) {
+        if (python_engine_load_script(paths[i]) != 0) {
+            log_warning("Failed to reload %s", paths[i]);
+            failures++;
+        }
+    }
+    free(paths);
+
+    if (failures > 0) {
+        set_python_error("One or more scripts failed to reload");
         return 1;
     }
+
+    log_info("Successfully reloaded all scripts");
+    return 0;
 }
 
 int python_engine_execute(const char* code)
 {
+    PyGILState_STATE gil;
     PyObject* result;
 
     if (!g_python_initialized) {
@@ -278,15 +1064,18 @@ int python_engine_execute(const char* code)
     log_debug("Executing Python code: %s", code);
     clear_python_error();
 
+    gil = PyGILState_Ensure();
     result = PyRun_String(code, Py_file_input, g_main_dict, g_main_dict);
 
     if (result == NULL) {
-        PyErr_Print();
-        set_python_error("Code execution failed (check console for details)");
+        python_errors_capture("", "exec", NULL, 0);
+        PyGILState_Release(gil);
+        set_python_error("Code execution failed (see /tspy python errors)");
         return 1;
     }
 
     Py_DECREF(result);
+    PyGILState_Release(gil);
     return 0;
 }
 
@@ -297,6 +1086,7 @@ int python_engine_call_function(const char* function_name, const char* format, .
     PyObject* result;
     va_list va;
     int ret = 0;
+    PyGILState_STATE gil;
 
     if (!g_python_initialized) {
         set_python_error("Python engine not initialized");
@@ -309,12 +1099,14 @@ int python_engine_call_function(const char* function_name, const char* format, .
     }
 
     clear_python_error();
+    gil = PyGILState_Ensure();
 
     /* Get the function object */
     func = PyDict_GetItemString(g_main_dict, function_name);
     if (func == NULL || !PyCallable_Check(func)) {
         /* Function not found or not callable - this is not always an error */
         log_debug("Python function not found or not callable: %s", function_name);
+        PyGILState_Release(gil);
         return 0; /* Return success - script may not implement this function */
     }
 
@@ -326,7 +1118,8 @@ int python_engine_call_function(const char* function_name, const char* format, .
 
         if (args == NULL) {
             set_python_error("Failed to build arguments");
-            PyErr_Print();
+            python_errors_capture("", function_name, NULL, 0);
+            PyGILState_Release(gil);
             return 1;
         }
     }
@@ -340,76 +1133,57 @@ int python_engine_call_function(const char* function_name, const char* format, .
 
     if (result == NULL) {
         set_python_error("Function call failed");
-        PyErr_Print();
+        python_errors_capture("", function_name, NULL, 0);
         ret = 1;
     } else {
         Py_DECREF(result);
         ret = 0;
     }
 
+    PyGILState_Release(gil);
     return ret;
 }
 
-/* Event notification functions */
-int python_engine_on_connect(uint64 serverConnectionHandlerID)
-{
-    return python_engine_call_function("on_connect", "K", (unsigned long long)serverConnectionHandlerID);
-}
-
-int python_engine_on_disconnect(uint64 serverConnectionHandlerID)
-{
-    return python_engine_call_function("on_disconnect", "K", (unsigned long long)serverConnectionHandlerID);
-}
-
-int python_engine_on_client_move(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID)
-{
-    return python_engine_call_function("on_client_move", "KhKK", 
-        (unsigned long long)serverConnectionHandlerID,
-        (short)clientID,
-        (unsigned long long)oldChannelID,
-        (unsigned long long)newChannelID);
-}
-
-int python_engine_on_text_message(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, 
-                                   const char* fromName, const char* fromUniqueIdentifier, const char* message)
+const char* python_engine_get_error(void)
 {
-    return python_engine_call_function("on_text_message", "Khhhhsss",
-        (unsigned long long)serverConnectionHandlerID,
-        (short)targetMode,
-        (short)toID,
-        (short)fromID,
-        fromName ? fromName : "",
-        fromUniqueIdentifier ? fromUniqueIdentifier : "",
-        message ? message : "");
+    return t_last_error[0] != '\0' ? t_last_error : NULL;
 }
 
-int python_engine_on_command(uint64 serverConnectionHandlerID, const char* command, const char* args)
+void python_engine_lock_state(void)
 {
-    return python_engine_call_function("on_command", "Kss",
-        (unsigned long long)serverConnectionHandlerID,
-        command ? command : "",
-        args ? args : "");
+#ifdef Py_GIL_DISABLED
+    if (t_thread_id == 0) {
+        t_thread_id = (int32_t)thread_current_id();
+    }
+    if (atomic32_load(&g_state_owner) == t_thread_id) {
+        g_state_depth++;
+        return;
+    }
+    PyMutex_Lock(&g_state_mutex);
+    atomic32_store(&g_state_owner, t_thread_id);
+    g_state_depth = 1;
+#endif
 }
 
-const char* python_engine_get_error(void)
+void python_engine_unlock_state(void)
 {
-    return g_python_error[0] != '\0' ? g_python_error : NULL;
+#ifdef Py_GIL_DISABLED
+    if (--g_state_depth == 0) {
+        atomic32_store(&g_state_owner, 0);
+        PyMutex_Unlock(&g_state_mutex);
+    }
+#endif
 }
 
 /* Internal helper functions */
 static void set_python_error(const char* msg)
 {
     if (msg != NULL) {
-#ifdef _WIN32
-        strncpy_s(g_python_error, sizeof(g_python_error), msg, _TRUNCATE);
-#else
-        strncpy(g_python_error, msg, sizeof(g_python_error) - 1);
-        g_python_error[sizeof(g_python_error) - 1] = '\0';
-#endif
+        safe_strcpy(t_last_error, sizeof(t_last_error), msg);
     }
 }
 
 static void clear_python_error(void)
 {
-    g_python_error[0] = '\0';
+    t_last_error[0] = '\0';
 }
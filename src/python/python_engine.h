@@ -10,6 +10,7 @@
 #ifndef PYTHON_ENGINE_H
 #define PYTHON_ENGINE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "teamspeak/public_definitions.h"
 
@@ -17,6 +18,66 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Maximum length of a script (module) name
+ */
+#define SCRIPT_NAME_BUFSIZE 64
+
+/**
+ * @brief Package prefix of script modules in sys.modules, so scripts cannot shadow real modules
+ */
+#define SCRIPT_MODULE_PREFIX "tspy_scripts."
+
+/**
+ * @brief Size of a script's sys.modules key
+ */
+#define SCRIPT_MODULE_BUFSIZE (sizeof(SCRIPT_MODULE_PREFIX) - 1 + SCRIPT_NAME_BUFSIZE)
+
+/**
+ * @brief Events that scripts can handle by defining a function of that name
+ */
+typedef enum {
+    PYTHON_EVENT_CONNECT = 0,
+    PYTHON_EVENT_DISCONNECT,
+    PYTHON_EVENT_CLIENT_MOVE,
+    PYTHON_EVENT_TEXT_MESSAGE,
+    PYTHON_EVENT_TALK_STATUS_CHANGE,
+    PYTHON_EVENT_COMMAND,
+    PYTHON_EVENT_TRIGGER,
+    PYTHON_EVENT_COUNT
+} PythonEventType;
+
+/**
+ * @brief One entry of an event's fan-out array
+ */
+typedef struct PythonHandler {
+    struct _object* callable;   /* PyObject*, owned by the handler table */
+    const char*     script;     /* Name of the script that defines it */
+    unsigned int    generation; /* Load generation of that script */
+    int             takesEvent; /* Called with a ts3api.Event instead of positional arguments */
+} PythonHandler;
+
+/**
+ * @brief Immutable fan-out array for one event
+ *
+ * Loading or unloading a script publishes a new list instead of editing the
+ * current one, so a dispatch holding a reference keeps calling the handlers it
+ * started with while a script is swapped underneath it.
+ */
+typedef struct HandlerList {
+    volatile int32_t refcount;
+    size_t           count;
+    PythonHandler    handlers[1]; /* count entries; script names are stored after them */
+} HandlerList;
+
+/**
+ * @brief Identifies the script whose code is currently running
+ */
+typedef struct ScriptContext {
+    const char*  script;     /* NULL outside of script code */
+    unsigned int generation;
+} ScriptContext;
+
 /**
  * @brief Initialize the Python engine
  * @param plugin_path Path to the plugin directory
@@ -35,6 +96,13 @@ void python_engine_shutdown(void);
  */
 int python_engine_is_initialized(void);
 
+/**
+ * @brief Check whether the calling thread runs in the main interpreter
+ * @return 1 in the main interpreter (or with no thread state), 0 in an isolated one
+ * @note Before Python 3.13 the caller must hold the GIL
+ */
+int python_engine_in_main_interpreter(void);
+
 /**
  * @brief Get the scripts directory path
  * @return Path to scripts directory
@@ -42,18 +110,166 @@ int python_engine_is_initialized(void);
 const char* python_engine_get_scripts_path(void);
 
 /**
- * @brief Load and execute a Python script
+ * @brief Load a Python script as its own module
+ *
+ * Loading a script that is already loaded replaces it; if the new version
+ * fails to execute, the old one stays registered.
+ *
  * @param script_path Path to the Python script
  * @return 0 on success, non-zero on failure
  */
 int python_engine_load_script(const char* script_path);
 
 /**
- * @brief Reload all Python scripts
+ * @brief Load a Python script in an isolated interpreter
+ *
+ * The interpreter is created on first use. A script loaded elsewhere is moved.
+ * Before Python 3.12 the script is loaded in the main interpreter instead.
+ *
+ * @param script_path Path to the Python script
+ * @param interpreter Interpreter name, or NULL, empty or "main" for the main interpreter
+ * @return 0 on success, non-zero on failure
+ */
+int python_engine_load_script_in(const char* script_path, const char* interpreter);
+
+/**
+ * @brief Unload a script and drop its handlers
+ * @param name Script name, with or without .py
+ * @return 0 on success, non-zero if the script is not loaded
+ */
+int python_engine_unload_script(const char* name);
+
+/**
+ * @brief Reload one loaded script if its source changed on disk
+ * @param name Script name or file name
+ * @return 0 if reloaded or unchanged, non-zero if not loaded or the reload failed
+ */
+int python_engine_reload_script(const char* name);
+
+/**
+ * @brief Reload all loaded Python scripts from disk
  * @return 0 on success, non-zero on failure
  */
 int python_engine_reload_scripts(void);
 
+/**
+ * @brief Get the number of loaded scripts
+ * @return Script count
+ */
+size_t python_engine_get_script_count(void);
+
+/**
+ * @brief Copy the name of a loaded script
+ * @param index Index in load order
+ * @param buffer Receives the script name
+ * @param size Size of buffer
+ * @return 0 on success, non-zero if index is out of range
+ */
+int python_engine_get_script_name(size_t index, char* buffer, size_t size);
+
+/**
+ * @brief Count the event handlers a loaded script defines
+ * @param name Script name
+ * @return Number of handlers
+ */
+int python_engine_get_script_handler_count(const char* name);
+
+/**
+ * @brief Get the fan-out array for an event
+ * @param type Event type
+ * @param count Receives the number of handlers
+ * @return Handlers in script load order (valid until the next load/unload)
+ */
+const PythonHandler* python_engine_get_handlers(PythonEventType type, size_t* count);
+
+/**
+ * @brief Take a reference to the current fan-out list for an event (GIL held)
+ * @param type Event type
+ * @return List, or NULL if no script handles the event
+ */
+HandlerList* python_engine_acquire_handlers(PythonEventType type);
+
+/**
+ * @brief Drop a reference from python_engine_acquire_handlers (GIL held)
+ * @param list List, may be NULL
+ */
+void python_engine_release_handlers(HandlerList* list);
+
+/**
+ * @brief Get the Python function name handling an event
+ * @param type Event type
+ * @return Handler name, e.g. "on_text_message"
+ */
+const char* python_engine_get_event_name(PythonEventType type);
+
+/**
+ * @brief Look up an event by handler name
+ * @param name "text_message" or "on_text_message" style name
+ * @return Event type, or PYTHON_EVENT_COUNT if unknown
+ */
+PythonEventType python_engine_find_event(const char* name);
+
+/**
+ * @brief Mark the calling thread as running a script's code
+ * @param script Script name
+ * @param generation Load generation of the script
+ * @return Previous context, to pass to python_engine_leave_script
+ */
+ScriptContext python_engine_enter_script(const char* script, unsigned int generation);
+
+/**
+ * @brief Restore the context saved by python_engine_enter_script
+ * @param previous Context returned by python_engine_enter_script
+ */
+void python_engine_leave_script(ScriptContext previous);
+
+/**
+ * @brief Get the script whose code is running on the calling thread
+ * @return Current context (script is NULL outside script code)
+ * @note Inside an asyncio task the GIL must be held
+ */
+ScriptContext python_engine_get_current_script(void);
+
+/**
+ * @brief Record the pending Python exception in the error ring and clear it (GIL held)
+ * @param script Script the failing code belongs to (may be empty)
+ * @param context What was running, e.g. an event name
+ */
+void python_engine_report_exception(const char* script, const char* context);
+
+/**
+ * @brief Derive the module name from a script path: ".../greeter.py" -> "greeter"
+ * @param script_path Script path or file name
+ * @param name Receives the name
+ * @param name_size Size of name
+ */
+void python_engine_script_name(const char* script_path, char* name, size_t name_size);
+
+/**
+ * @brief sys.modules key and __name__ of a script: "greeter" -> "tspy_scripts.greeter"
+ * @param name Script name
+ * @param key Receives the key
+ * @param key_size Size of key (SCRIPT_MODULE_BUFSIZE)
+ */
+void python_engine_module_key(const char* name, char* key, size_t key_size);
+
+/**
+ * @brief Check that a script may take a sys.modules key (GIL held)
+ * @param key Key from python_engine_module_key
+ * @param owned Module this plugin registered there before, or NULL
+ * @return 0 if the key is free or holds owned, -1 with ImportError set otherwise
+ */
+int python_engine_claim_module(const char* key, struct _object* owned);
+
+/**
+ * @brief Put back or drop a script's sys.modules entry (GIL held)
+ * @param key Key from python_engine_module_key
+ * @param module Module this plugin registered there
+ * @param previous Module to put back, or NULL to remove the key
+ * @note Does nothing if the key no longer holds module
+ */
+void python_engine_restore_module(const char* key, struct _object* module, struct _object* previous);
+
 /**
  * @brief Execute Python code string
  * @param code Python code to execute
@@ -70,19 +286,30 @@ int python_engine_execute(const char* code);
  */
 int python_engine_call_function(const char* function_name, const char* format, ...);
 
-/* Event notifications to Python scripts */
-int python_engine_on_connect(uint64 serverConnectionHandlerID);
-int python_engine_on_disconnect(uint64 serverConnectionHandlerID);
-int python_engine_on_client_move(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID);
-int python_engine_on_text_message(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message);
-int python_engine_on_command(uint64 serverConnectionHandlerID, const char* command, const char* args);
-
 /**
- * @brief Get last Python error message
- * @return Error message string, or NULL if no error
+ * @brief Get why the calling thread's last engine call failed
+ * @return Error message string, or NULL if no error; owned by the calling
+ *         thread, valid until its next engine call
+ * @note Exceptions with their tracebacks are kept in the error ring (python_errors.h)
  */
 const char* python_engine_get_error(void);
 
+/**
+ * @brief Take the engine state lock (thread state attached)
+ *
+ * Free-threaded Python has no GIL to serialize the script table, handler
+ * and subscription lists, held events and pending requests, so in such a
+ * build "GIL held" in the python_* headers also means holding this lock. It
+ * is recursive and taken before any of the modules' own mutexes. With a GIL
+ * it does nothing.
+ */
+void python_engine_lock_state(void);
+
+/**
+ * @brief Release python_engine_lock_state
+ */
+void python_engine_unlock_state(void);
+
 #ifdef __cplusplus
 }
 #endif
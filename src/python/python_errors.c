@@ -0,0 +1,378 @@
+/**
+ * @file python_errors.c
+ * @brief Ring of recent Python errors implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Records live in a fixed ring indexed by ID. A traceback is stored as the
+ * file name, function and line of each frame, packed into the record's text
+ * buffer; no Python object is kept, so records from isolated interpreters
+ * are safe to read from any thread. g_lock guards the ring and counters and
+ * is never held while Python runs.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "python_errors.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+
+/* Frame strings of one record: file and function, NUL-terminated */
+#define ERROR_TEXT_SIZE 1024
+
+typedef struct ErrorFrame {
+    uint32_t line;
+    uint16_t file;        /* Offsets into ErrorRecord.text */
+    uint16_t function;
+} ErrorFrame;
+
+typedef struct ErrorRecord {
+    ErrorInfo  info;
+    uint32_t   hash;               /* Of script, handler, type and message */
+    uint64_t   lastLogNs;
+    uint64_t   unlogged;           /* Repeats since the last log line */
+    size_t     frameCount;
+    size_t     framesSkipped;      /* Outer frames that did not fit */
+    ErrorFrame frames[ERROR_MAX_FRAMES];
+    char       text[ERROR_TEXT_SIZE];
+} ErrorRecord;
+
+static ErrorRecord g_ring[ERROR_RING_SIZE];
+static uint64_t    g_next_id = 1;
+static uint64_t    g_oldest_id = 1;   /* Records below this were cleared or replaced */
+static Mutex       g_lock;
+static int         g_initialized = 0;
+
+static uint64_t g_captured = 0;
+static uint64_t g_repeats = 0;
+static uint64_t g_suppressed = 0;
+
+/* ========================================================================
+ * Capture (GIL held)
+ * ======================================================================== */
+
+static uint32_t hash_string(uint32_t hash, const char* text)
+{
+    /* FNV-1a, with the terminator so "ab"+"c" differs from "a"+"bc" */
+    do {
+        hash = (hash ^ (unsigned char)*text) * 16777619u;
+    } while (*text++ != '\0');
+    return hash;
+}
+
+/* Copy the innermost frames of a traceback that fit into the record */
+static void capture_frames(ErrorRecord* record, PyObject* traceback)
+{
+    struct {
+        const char* file;
+        const char* function;
+        uint32_t    line;
+    } window[ERROR_MAX_FRAMES];
+    PyTracebackObject* tb;
+    size_t total = 0;
+    size_t kept;
+    size_t fit = 0;
+    size_t used = 0;
+    size_t i;
+
+    if (traceback == NULL || !PyTraceBack_Check(traceback)) {
+        return;
+    }
+
+    /* The frames own their code objects, so the strings stay valid while the traceback lives */
+    for (tb = (PyTracebackObject*)traceback; tb != NULL; tb = tb->tb_next) {
+        PyCodeObject* code = PyFrame_GetCode(tb->tb_frame);
+        size_t slot = total++ % ERROR_MAX_FRAMES;
+
+        window[slot].file = PyUnicode_AsUTF8(code->co_filename);
+        window[slot].function = PyUnicode_AsUTF8(code->co_name);
+        if (window[slot].file == NULL || window[slot].function == NULL) {
+            PyErr_Clear();
+            window[slot].file = window[slot].file != NULL ? window[slot].file : "?";
+            window[slot].function = window[slot].function != NULL ? window[slot].function : "?";
+        }
+        /* 3.11+ computes tb_lineno on first access; work it out the same way */
+        window[slot].line = (uint32_t)(tb->tb_lineno >= 0 ? tb->tb_lineno : PyCode_Addr2Line(code, tb->tb_lasti));
+        Py_DECREF(code);
+    }
+    kept = total < ERROR_MAX_FRAMES ? total : ERROR_MAX_FRAMES;
+
+    /* The innermost frames matter most: count back from the last until the text is full */
+    while (fit < kept) {
+        size_t slot = (total - 1 - fit) % ERROR_MAX_FRAMES;
+        size_t length = strlen(window[slot].file) + strlen(window[slot].function) + 2;
+
+        if (used + length > ERROR_TEXT_SIZE) {
+            break;
+        }
+        used += length;
+        fit++;
+    }
+
+    used = 0;
+    for (i = total - fit; i < total; i++) {
+        size_t slot = i % ERROR_MAX_FRAMES;
+        ErrorFrame* frame = &record->frames[record->frameCount++];
+        size_t length = strlen(window[slot].file) + 1;
+
+        frame->file = (uint16_t)used;
+        memcpy(record->text + used, window[slot].file, length);
+        used += length;
+        length = strlen(window[slot].function) + 1;
+        frame->function = (uint16_t)used;
+        memcpy(record->text + used, window[slot].function, length);
+        used += length;
+        frame->line = window[slot].line;
+    }
+    record->framesSkipped = total - fit;
+}
+
+/* Find a record with the same key (g_lock held) */
+static ErrorRecord* find_repeat(const ErrorRecord* captured)
+{
+    uint64_t id;
+
+    for (id = g_next_id - 1; id >= g_oldest_id && id > 0; id--) {
+        ErrorRecord* record = &g_ring[(id - 1) % ERROR_RING_SIZE];
+
+        if (record->hash == captured->hash && strcmp(record->info.message, captured->info.message) == 0 &&
+            strcmp(record->info.type, captured->info.type) == 0 &&
+            strcmp(record->info.handler, captured->info.handler) == 0 &&
+            strcmp(record->info.script, captured->info.script) == 0) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+uint64_t python_errors_capture(const char* script, const char* handler, char* message, size_t message_size)
+{
+    PyObject *type, *value, *traceback;
+    ErrorRecord captured;
+    ErrorRecord* record;
+    uint64_t nowNs = clock_monotonic_ns();
+    uint64_t id;
+    uint64_t repeats = 0;
+    int log = 1;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    if (type == NULL) {
+        return 0;
+    }
+    PyErr_NormalizeException(&type, &value, &traceback);
+
+    memset(&captured, 0, offsetof(ErrorRecord, text));
+    captured.text[0] = '\0';
+    safe_strcpy(captured.info.script, sizeof(captured.info.script), script != NULL ? script : "");
+    safe_strcpy(captured.info.handler, sizeof(captured.info.handler), handler != NULL ? handler : "");
+    safe_strcpy(captured.info.type, sizeof(captured.info.type),
+                PyType_Check(type) ? ((PyTypeObject*)type)->tp_name : "Exception");
+    if (value != NULL) {
+        PyObject* text = PyObject_Str(value);
+        const char* utf8 = text != NULL ? PyUnicode_AsUTF8(text) : NULL;
+
+        if (utf8 == NULL) {
+            PyErr_Clear();
+            utf8 = "<unprintable>";
+        }
+        safe_strcpy(captured.info.message, sizeof(captured.info.message), utf8);
+        Py_XDECREF(text);
+    }
+    if (traceback == NULL && value != NULL) {
+        traceback = PyException_GetTraceback(value);
+    }
+    capture_frames(&captured, traceback);
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
+
+    captured.hash = hash_string(hash_string(hash_string(hash_string(2166136261u, captured.info.script),
+                                                        captured.info.handler), captured.info.type),
+                                captured.info.message);
+    captured.info.firstTime = (int64_t)time(NULL);
+    captured.info.lastTime = captured.info.firstTime;
+    captured.info.count = 1;
+    captured.lastLogNs = nowNs;
+
+    if (message != NULL && message_size > 0) {
+        safe_strcpy(message, message_size, captured.info.message);
+    }
+    if (!g_initialized) {
+        log_error("Python error in %s.%s: %s: %s", captured.info.script[0] != '\0' ? captured.info.script : "<unowned>",
+                  captured.info.handler, captured.info.type, captured.info.message);
+        return 0;
+    }
+
+    mutex_lock(&g_lock);
+    g_captured++;
+    record = find_repeat(&captured);
+    if (record != NULL) {
+        g_repeats++;
+        record->info.count++;
+        record->info.lastTime = captured.info.lastTime;
+        record->unlogged++;
+        if (nowNs - record->lastLogNs < (uint64_t)ERROR_REPEAT_MS * 1000000ull) {
+            g_suppressed++;
+            log = 0;
+        } else {
+            repeats = record->unlogged;
+            record->unlogged = 0;
+            record->lastLogNs = nowNs;
+        }
+        id = record->info.id;
+    } else {
+        id = g_next_id++;
+        captured.info.id = id;
+        g_ring[(id - 1) % ERROR_RING_SIZE] = captured;
+        if (id - g_oldest_id >= ERROR_RING_SIZE) {
+            g_oldest_id = id - ERROR_RING_SIZE + 1;
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    if (log) {
+        if (repeats > 1) {
+            log_error("Python error #%llu in %s.%s: %s: %s (%llu times in the last %d s)", (unsigned long long)id,
+                      captured.info.script[0] != '\0' ? captured.info.script : "<unowned>", captured.info.handler,
+                      captured.info.type, captured.info.message, (unsigned long long)repeats, ERROR_REPEAT_MS / 1000);
+        } else {
+            log_error("Python error #%llu in %s.%s: %s: %s", (unsigned long long)id,
+                      captured.info.script[0] != '\0' ? captured.info.script : "<unowned>", captured.info.handler,
+                      captured.info.type, captured.info.message);
+        }
+    }
+    return id;
+}
+
+/* ========================================================================
+ * Browsing (any thread)
+ * ======================================================================== */
+
+void python_errors_init(void)
+{
+    if (g_initialized) {
+        return;
+    }
+    mutex_init(&g_lock);
+    g_initialized = 1;
+}
+
+size_t python_errors_list(ErrorInfo* errors, size_t max)
+{
+    size_t count = 0;
+    uint64_t id;
+
+    if (!g_initialized) {
+        return 0;
+    }
+    mutex_lock(&g_lock);
+    for (id = g_next_id - 1; id >= g_oldest_id && id > 0 && count < max; id--) {
+        errors[count++] = g_ring[(id - 1) % ERROR_RING_SIZE].info;
+    }
+    mutex_unlock(&g_lock);
+    return count;
+}
+
+/* Append a line to a bounded buffer; returns 0 once it no longer fits */
+static int append_line(char* buffer, size_t size, size_t* used, const char* line)
+{
+    size_t length = strlen(line);
+
+    if (*used + length + 2 > size) {
+        return 0;
+    }
+    memcpy(buffer + *used, line, length);
+    *used += length;
+    buffer[(*used)++] = '\n';
+    buffer[*used] = '\0';
+    return 1;
+}
+
+int python_errors_traceback(uint64_t id, char* buffer, size_t size)
+{
+    const ErrorRecord* record;
+    char line[ERROR_TEXT_SIZE + 64];
+    size_t used = 0;
+    size_t i;
+
+    if (size == 0) {
+        return 1;
+    }
+    buffer[0] = '\0';
+    if (!g_initialized) {
+        return 1;
+    }
+
+    mutex_lock(&g_lock);
+    if (id < g_oldest_id || id >= g_next_id) {
+        mutex_unlock(&g_lock);
+        return 1;
+    }
+    record = &g_ring[(id - 1) % ERROR_RING_SIZE];
+
+    append_line(buffer, size, &used, "Traceback (most recent call last):");
+    if (record->framesSkipped > 0) {
+        snprintf(line, sizeof(line), "  ... %zu outer frames not kept", record->framesSkipped);
+        append_line(buffer, size, &used, line);
+    }
+    for (i = 0; i < record->frameCount; i++) {
+        const ErrorFrame* frame = &record->frames[i];
+
+        snprintf(line, sizeof(line), "  File \"%s\", line %u, in %s", record->text + frame->file,
+                 (unsigned int)frame->line, record->text + frame->function);
+        if (!append_line(buffer, size, &used, line)) {
+            break;
+        }
+    }
+    snprintf(line, sizeof(line), "%s: %s", record->info.type, record->info.message);
+    append_line(buffer, size, &used, line);
+    mutex_unlock(&g_lock);
+    return 0;
+}
+
+void python_errors_clear(void)
+{
+    if (!g_initialized) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    g_oldest_id = g_next_id;
+    mutex_unlock(&g_lock);
+}
+
+void python_errors_get_stats(ErrorStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!g_initialized) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    stats->records = (size_t)(g_next_id - g_oldest_id);
+    stats->captured = g_captured;
+    stats->repeats = g_repeats;
+    stats->suppressed = g_suppressed;
+    mutex_unlock(&g_lock);
+}
+
+void python_errors_shutdown(void)
+{
+    if (!g_initialized) {
+        return;
+    }
+    g_initialized = 0;
+    mutex_destroy(&g_lock);
+}
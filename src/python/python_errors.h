@@ -0,0 +1,124 @@
+/**
+ * @file python_errors.h
+ * @brief Ring of recent Python errors
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Every exception reported by the engine is kept as a record: when it
+ * happened, the script and handler that raised it, the exception type and
+ * message, and the frames of its traceback. Capturing copies a few strings
+ * and walks the traceback without calling back into Python; the traceback
+ * text is only put together when someone asks for it. The same error raised
+ * again (same script, handler, type and message) updates its record and is
+ * logged at most once per ERROR_REPEAT_MS with the number of repeats.
+ *
+ * Browse with /tspy python errors or ts3api.get_errors().
+ */
+
+#ifndef PYTHON_ERRORS_H
+#define PYTHON_ERRORS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "python_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Records kept; the oldest is replaced when the ring is full
+ */
+#define ERROR_RING_SIZE 64
+
+/**
+ * @brief Innermost traceback frames kept per record
+ */
+#define ERROR_MAX_FRAMES 16
+
+/**
+ * @brief Window in which a repeated error is counted instead of logged again
+ */
+#define ERROR_REPEAT_MS 10000
+
+/**
+ * @brief One recorded error
+ */
+typedef struct ErrorInfo {
+    uint64_t id;                              /* Increasing, from 1 */
+    int64_t  firstTime;                       /* Unix time of the first occurrence */
+    int64_t  lastTime;                        /* Unix time of the latest repeat */
+    uint64_t count;                           /* Occurrences, repeats included */
+    char     script[SCRIPT_NAME_BUFSIZE];     /* Empty if no script owned the code */
+    char     handler[48];                     /* e.g. "on_text_message", "timer", "load" */
+    char     type[64];                        /* Exception type name */
+    char     message[256];
+} ErrorInfo;
+
+/**
+ * @brief Error counters
+ */
+typedef struct ErrorStats {
+    size_t   records;     /* Records in the ring */
+    uint64_t captured;    /* Errors reported, repeats included */
+    uint64_t repeats;     /* Errors folded into an existing record */
+    uint64_t suppressed;  /* Repeats not written to the log */
+} ErrorStats;
+
+/**
+ * @brief Prepare the ring
+ * @note Call once at engine start, before any script runs
+ */
+void python_errors_init(void);
+
+/**
+ * @brief Record and clear the pending Python exception (GIL held, any interpreter)
+ * @param script Script the failing code belongs to (may be NULL or empty)
+ * @param handler What was running, e.g. an event name
+ * @param message Receives the exception message (may be NULL)
+ * @param message_size Size of message
+ * @return ID of the record, 0 if no exception was pending
+ */
+uint64_t python_errors_capture(const char* script, const char* handler, char* message, size_t message_size);
+
+/**
+ * @brief Copy the most recent records, newest first
+ * @param errors Receives up to max records
+ * @param max Capacity of errors
+ * @return Number of records written
+ * @note Any thread; does not need the GIL
+ */
+size_t python_errors_list(ErrorInfo* errors, size_t max);
+
+/**
+ * @brief Format the traceback of a record
+ * @param id Record ID
+ * @param buffer Receives "Traceback (most recent call last):" and one line per frame
+ * @param size Size of buffer; a longer traceback is cut at a line boundary
+ * @return 0 on success, non-zero if the record is no longer in the ring
+ */
+int python_errors_traceback(uint64_t id, char* buffer, size_t size);
+
+/**
+ * @brief Forget all records (counters are kept)
+ */
+void python_errors_clear(void);
+
+/**
+ * @brief Read the counters
+ * @param stats Receives the counters
+ */
+void python_errors_get_stats(ErrorStats* stats);
+
+/**
+ * @brief Release the ring
+ * @note Call at engine shutdown
+ */
+void python_errors_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_ERRORS_H */
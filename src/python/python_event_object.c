@@ -0,0 +1,351 @@
+/**
+ * @file python_event_object.c
+ * @brief ts3api.Event, a lazily decoded event payload for single-parameter handlers
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include "python_event_object.h"
+#include "python_engine.h"
+#include "python_strings.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Attributes; which events have them is in g_field_events */
+typedef enum EventField {
+    FIELD_SERVER_ID = 0,
+    FIELD_CLIENT_ID,
+    FIELD_OLD_CHANNEL,
+    FIELD_NEW_CHANNEL,
+    FIELD_TARGET_MODE,
+    FIELD_TO_ID,
+    FIELD_FROM_ID,
+    FIELD_FROM_NAME,
+    FIELD_FROM_UID,
+    FIELD_MESSAGE,
+    FIELD_STATUS,
+    FIELD_COMMAND,
+    FIELD_ARGS,
+    FIELD_TRIGGER_ID,
+    FIELD_MATCH,
+    FIELD_COUNT
+} EventField;
+
+/* Decoded strings cached per object */
+enum {
+    STRING_FROM_NAME = 0,
+    STRING_FROM_UID,
+    STRING_MESSAGE,  /* Also the arguments of a command */
+    STRING_COMMAND,
+    STRING_MATCH,
+    STRING_COUNT
+};
+
+#define EVENT_BIT(type) (1u << (type))
+#define MESSAGE_EVENTS  (EVENT_BIT(PYTHON_EVENT_TEXT_MESSAGE) | EVENT_BIT(PYTHON_EVENT_TRIGGER))
+
+/* Same names and events as the positional arguments */
+static const char* const g_field_names[FIELD_COUNT] = {
+    "server_id", "client_id", "old_channel", "new_channel", "target_mode", "to_id", "from_id",
+    "from_name", "from_uid", "message", "status", "command", "args", "trigger_id", "match"
+};
+
+static const unsigned int g_field_events[FIELD_COUNT] = {
+    0xFFFFFFFFu,                                                                       /* server_id */
+    EVENT_BIT(PYTHON_EVENT_CLIENT_MOVE) | EVENT_BIT(PYTHON_EVENT_TALK_STATUS_CHANGE),  /* client_id */
+    EVENT_BIT(PYTHON_EVENT_CLIENT_MOVE),                                               /* old_channel */
+    EVENT_BIT(PYTHON_EVENT_CLIENT_MOVE),                                               /* new_channel */
+    MESSAGE_EVENTS,                                                                    /* target_mode */
+    MESSAGE_EVENTS,                                                                    /* to_id */
+    MESSAGE_EVENTS,                                                                    /* from_id */
+    MESSAGE_EVENTS,                                                                    /* from_name */
+    MESSAGE_EVENTS,                                                                    /* from_uid */
+    MESSAGE_EVENTS,                                                                    /* message */
+    EVENT_BIT(PYTHON_EVENT_TALK_STATUS_CHANGE),                                        /* status */
+    EVENT_BIT(PYTHON_EVENT_COMMAND),                                                   /* command */
+    EVENT_BIT(PYTHON_EVENT_COMMAND),                                                   /* args */
+    EVENT_BIT(PYTHON_EVENT_TRIGGER),                                                   /* trigger_id */
+    EVENT_BIT(PYTHON_EVENT_TRIGGER)                                                    /* match */
+};
+
+/* Events whose positional form has a single argument keep it */
+#define OBJECT_EVENTS (~(EVENT_BIT(PYTHON_EVENT_CONNECT) | EVENT_BIT(PYTHON_EVENT_DISCONNECT)))
+
+typedef struct PyEvent {
+    PyObject_HEAD
+    PythonEvent     event;                  /* Strings point into storage */
+    PyObject*       strings[STRING_COUNT];  /* Decoded on first access */
+    char*           storage;                /* inlineStorage or a PyMem buffer */
+    struct PyEvent* nextFree;
+    char            inlineStorage[EVENT_INLINE_STORAGE];
+} PyEvent;
+
+static PyTypeObject* g_event_type = NULL;
+
+/* Only touched with the main interpreter's GIL held; free-threaded builds do without */
+static PyEvent* g_free_list = NULL;
+static size_t   g_free_count = 0;
+
+/* ========================================================================
+ * ts3api.Event
+ * ======================================================================== */
+
+static void event_clear(PyEvent* self)
+{
+    int i;
+
+    for (i = 0; i < STRING_COUNT; i++) {
+        Py_CLEAR(self->strings[i]);
+    }
+    if (self->storage != self->inlineStorage) {
+        PyMem_Free(self->storage);
+        self->storage = self->inlineStorage;
+    }
+}
+
+static void event_dealloc(PyObject* self)
+{
+    PyEvent* event = (PyEvent*)self;
+    PyTypeObject* type = Py_TYPE(self);
+
+    event_clear(event);
+#ifndef Py_GIL_DISABLED
+    if (g_free_count < EVENT_FREELIST_MAX && type == g_event_type) {
+        event->nextFree = g_free_list;
+        g_free_list = event;
+        g_free_count++;
+        Py_DECREF(type);
+        return;
+    }
+#endif
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+/* Decode a string field once; later reads return the cached object */
+static PyObject* event_string(PyEvent* self, int slot, const char* text, size_t length)
+{
+    if (self->strings[slot] == NULL) {
+        self->strings[slot] = PyUnicode_DecodeUTF8(text != NULL ? text : "", (Py_ssize_t)length, "replace");
+        if (self->strings[slot] == NULL) {
+            return NULL;
+        }
+    }
+    return Py_NewRef(self->strings[slot]);
+}
+
+static PyObject* event_text(PyEvent* self, int slot, const char* text)
+{
+    return event_string(self, slot, text, text != NULL ? strlen(text) : 0);
+}
+
+/* Nicknames and UIDs come from the shared string cache */
+static PyObject* event_shared(PyEvent* self, int slot, const char* text)
+{
+    if (self->strings[slot] == NULL) {
+        self->strings[slot] = python_strings_get(text, STRING_OWNER(self->event.serverConnectionHandlerID,
+                                                                    self->event.clientID));
+        if (self->strings[slot] == NULL) {
+            return NULL;
+        }
+    }
+    return Py_NewRef(self->strings[slot]);
+}
+
+static PyObject* event_get(PyObject* self, void* closure)
+{
+    PyEvent* object = (PyEvent*)self;
+    const PythonEvent* event = &object->event;
+    EventField field = (EventField)(intptr_t)closure;
+
+    if (!(g_field_events[field] & EVENT_BIT(event->type))) {
+        PyErr_Format(PyExc_AttributeError, "%s event has no attribute '%s'",
+                     python_engine_get_event_name(event->type), g_field_names[field]);
+        return NULL;
+    }
+
+    switch (field) {
+        case FIELD_SERVER_ID:
+            return PyLong_FromUnsignedLongLong(event->serverConnectionHandlerID);
+        case FIELD_CLIENT_ID:
+        case FIELD_FROM_ID:
+            return PyLong_FromLong(event->clientID);
+        case FIELD_OLD_CHANNEL:
+            return PyLong_FromUnsignedLongLong(event->oldChannelID);
+        case FIELD_NEW_CHANNEL:
+            return PyLong_FromUnsignedLongLong(event->newChannelID);
+        case FIELD_TARGET_MODE:
+            return PyLong_FromLong(event->targetMode);
+        case FIELD_TO_ID:
+            return PyLong_FromLong(event->toID);
+        case FIELD_STATUS:
+            return PyLong_FromLong(event->status);
+        case FIELD_TRIGGER_ID:
+            return PyLong_FromLong(event->triggerID);
+        case FIELD_FROM_NAME:
+            return event_shared(object, STRING_FROM_NAME, event->fromName);
+        case FIELD_FROM_UID:
+            return event_shared(object, STRING_FROM_UID, event->fromUniqueIdentifier);
+        case FIELD_MESSAGE:
+        case FIELD_ARGS:
+            return event_text(object, STRING_MESSAGE, event->message);
+        case FIELD_COMMAND:
+            return event_text(object, STRING_COMMAND, event->command);
+        case FIELD_MATCH:
+            return event_string(object, STRING_MATCH, event->match, event->matchLength);
+        default:
+            break;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* event_get_type(PyObject* self, void* closure)
+{
+    (void)closure; /* Unused parameter */
+
+    return PyUnicode_FromString(python_engine_get_event_name(((PyEvent*)self)->event.type));
+}
+
+static PyObject* event_repr(PyObject* self)
+{
+    const PythonEvent* event = &((PyEvent*)self)->event;
+
+    return PyUnicode_FromFormat("<ts3api.Event %s server_id=%llu>", python_engine_get_event_name(event->type),
+                                (unsigned long long)event->serverConnectionHandlerID);
+}
+
+static PyGetSetDef EventGetSet[] = {
+    {"type", event_get_type, NULL, "Handler name of the event, e.g. 'on_text_message'", NULL},
+    {"server_id", event_get, NULL, "Server connection handler ID", (void*)(intptr_t)FIELD_SERVER_ID},
+    {"client_id", event_get, NULL, "Moving or talking client (client_move, talk_status_change)", (void*)(intptr_t)FIELD_CLIENT_ID},
+    {"old_channel", event_get, NULL, "Channel left (client_move)", (void*)(intptr_t)FIELD_OLD_CHANNEL},
+    {"new_channel", event_get, NULL, "Channel entered (client_move)", (void*)(intptr_t)FIELD_NEW_CHANNEL},
+    {"target_mode", event_get, NULL, "1=private, 2=channel, 3=server (text_message, trigger)", (void*)(intptr_t)FIELD_TARGET_MODE},
+    {"to_id", event_get, NULL, "Recipient ID (text_message, trigger)", (void*)(intptr_t)FIELD_TO_ID},
+    {"from_id", event_get, NULL, "Sender client ID (text_message, trigger)", (void*)(intptr_t)FIELD_FROM_ID},
+    {"from_name", event_get, NULL, "Sender nickname (text_message, trigger)", (void*)(intptr_t)FIELD_FROM_NAME},
+    {"from_uid", event_get, NULL, "Sender unique identifier (text_message, trigger)", (void*)(intptr_t)FIELD_FROM_UID},
+    {"message", event_get, NULL, "Message text (text_message, trigger)", (void*)(intptr_t)FIELD_MESSAGE},
+    {"status", event_get, NULL, "1 while talking (talk_status_change)", (void*)(intptr_t)FIELD_STATUS},
+    {"command", event_get, NULL, "Command word (command)", (void*)(intptr_t)FIELD_COMMAND},
+    {"args", event_get, NULL, "Rest of the command line (command)", (void*)(intptr_t)FIELD_ARGS},
+    {"trigger_id", event_get, NULL, "ID returned by ts3api.add_trigger (trigger)", (void*)(intptr_t)FIELD_TRIGGER_ID},
+    {"match", event_get, NULL, "Text the trigger matched (trigger)", (void*)(intptr_t)FIELD_MATCH},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot EventSlots[] = {
+    {Py_tp_dealloc, (void*)event_dealloc},
+    {Py_tp_repr, (void*)event_repr},
+    {Py_tp_getset, EventGetSet},
+    {Py_tp_doc, (void*)"Event passed to handlers that take a single parameter; string fields are decoded on first access"},
+    {0, NULL}
+};
+
+static PyType_Spec EventSpec = {
+    "ts3api.Event",
+    sizeof(PyEvent),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    EventSlots
+};
+
+static int ensure_type(void)
+{
+    if (g_event_type == NULL) {
+        g_event_type = (PyTypeObject*)PyType_FromSpec(&EventSpec);
+        if (g_event_type == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int python_event_object_add_types(PyObject* module)
+{
+    if (ensure_type() != 0) {
+        return -1;
+    }
+    return PyModule_AddObjectRef(module, "Event", (PyObject*)g_event_type);
+}
+
+int python_event_object_takes_event(PyObject* callable, PythonEventType type)
+{
+    PyObject* function = callable;
+    PyCodeObject* code;
+    int bound = 0;
+
+    if (type < 0 || type >= PYTHON_EVENT_COUNT || !(OBJECT_EVENTS & EVENT_BIT(type))) {
+        return 0;
+    }
+    if (PyMethod_Check(function)) {
+        function = PyMethod_GET_FUNCTION(function);
+        bound = 1;
+    }
+    if (!PyFunction_Check(function)) {
+        return 0;
+    }
+    code = (PyCodeObject*)PyFunction_GET_CODE(function);
+    if (code->co_flags & CO_VARARGS) {
+        return 0;
+    }
+    return code->co_argcount - bound == 1;
+}
+
+PyObject* python_event_object_new(const PythonEvent* event)
+{
+    PyEvent* object;
+    size_t size = python_event_copy_size(event);
+
+    if (g_free_list != NULL) {
+        object = g_free_list;
+        g_free_list = object->nextFree;
+        g_free_count--;
+        PyObject_Init((PyObject*)object, g_event_type);
+    } else {
+        if (ensure_type() != 0) {
+            return NULL;
+        }
+        object = PyObject_New(PyEvent, g_event_type);
+        if (object == NULL) {
+            return NULL;
+        }
+        memset(object->strings, 0, sizeof(object->strings));
+        object->storage = object->inlineStorage;
+    }
+    object->nextFree = NULL;
+
+    if (size > sizeof(object->inlineStorage)) {
+        object->storage = (char*)PyMem_Malloc(size);
+        if (object->storage == NULL) {
+            object->storage = object->inlineStorage;
+            Py_DECREF(object);
+            return PyErr_NoMemory();
+        }
+    }
+    python_event_copy(&object->event, event, object->storage);
+    return (PyObject*)object;
+}
+
+void python_event_object_shutdown(void)
+{
+    while (g_free_list != NULL) {
+        PyEvent* object = g_free_list;
+
+        g_free_list = object->nextFree;
+        PyObject_Free(object);
+    }
+    g_free_count = 0;
+    Py_CLEAR(g_event_type);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file python_event_object.h
+ * @brief ts3api.Event, a lazily decoded event payload for single-parameter handlers
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * A handler or subscription whose function takes exactly one positional
+ * parameter gets a ts3api.Event instead of the positional arguments. The
+ * object copies the event's C strings once into storage it owns and only
+ * turns a field into a Python str when the handler first reads it, so a
+ * handler that looks at target_mode never pays for decoding the message.
+ * Released objects are kept on a short freelist for the next event.
+ *
+ * Events are only built in the main interpreter; handlers in isolated
+ * interpreters always get positional arguments.
+ */
+
+#ifndef PYTHON_EVENT_OBJECT_H
+#define PYTHON_EVENT_OBJECT_H
+
+#include <stddef.h>
+
+#include "python_events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief String bytes stored inside the object; longer events use a separate buffer
+ */
+#define EVENT_INLINE_STORAGE 256
+
+/**
+ * @brief Released Event objects kept for reuse
+ */
+#define EVENT_FREELIST_MAX 32
+
+/**
+ * @brief Add the Event type to the ts3api module (GIL held, main interpreter)
+ * @param module ts3api module (PyObject*)
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_event_object_add_types(struct _object* module);
+
+/**
+ * @brief Whether a handler should be called with an Event
+ * @param callable Handler (PyObject*)
+ * @param type Event it handles
+ * @return 1 for a function or bound method taking exactly one positional
+ *         parameter, for events that otherwise pass more than one argument
+ * @note Decided once when the handler is registered, not per event
+ */
+int python_event_object_takes_event(struct _object* callable, PythonEventType type);
+
+/**
+ * @brief Wrap an event for a handler (GIL held, main interpreter)
+ * @param event Event; its strings are copied
+ * @return New Event (PyObject*), or NULL with a Python exception set
+ */
+struct _object* python_event_object_new(const PythonEvent* event);
+
+/**
+ * @brief Free the recycled objects and drop the type (GIL held)
+ * @note Call before the interpreter is finalized
+ */
+void python_event_object_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_EVENT_OBJECT_H */
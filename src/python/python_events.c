@@ -20,99 +20,410 @@
 
 #include "python_events.h"
 #include "python_engine.h"
+#include "python_event_object.h"
+#include "python_gc.h"
+#include "python_interpreters.h"
+#include "python_loop.h"
+#include "python_memory.h"
+#include "python_pool.h"
+#include "python_strings.h"
+#include "python_subscriptions.h"
+#include "python_triggers.h"
 #include "utils/logging.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+#include <stdlib.h>
 #include <string.h>
 
-/* Helper function to call a Python function if it exists */
-static int call_python_handler(const char* func_name, PyObject* args)
+/* An event copied while dispatch was paused; its strings follow the struct */
+typedef struct DeferredEvent {
+    struct DeferredEvent* next;
+    PythonEvent           event;
+} DeferredEvent;
+
+/* Guarded by g_defer_lock, which dispatch takes without the GIL; never held while calling Python */
+static Mutex          g_defer_lock;
+static int            g_defer_lock_ready = 0;
+static DeferredEvent* g_deferred_head = NULL;
+static DeferredEvent* g_deferred_tail = NULL;
+static size_t         g_deferred_count = 0;
+static size_t         g_deferred_dropped = 0;
+static int            g_pause_depth = 0;
+static int            g_draining = 0;
+
+PyObject* python_event_build_args(const PythonEvent* event)
+{
+    int64_t sender = STRING_OWNER(event->serverConnectionHandlerID, event->clientID);
+    PyObject* match;
+    
+    switch (event->type) {
+        case PYTHON_EVENT_CONNECT:
+        case PYTHON_EVENT_DISCONNECT:
+            return Py_BuildValue("(K)", event->serverConnectionHandlerID);
+        case PYTHON_EVENT_CLIENT_MOVE:
+            /* (server_id, client_id, old_channel, new_channel) */
+            return Py_BuildValue("(KhKK)", event->serverConnectionHandlerID, event->clientID,
+                                 event->oldChannelID, event->newChannelID);
+        case PYTHON_EVENT_TEXT_MESSAGE:
+            /* (server_id, target_mode, to_id, from_id, from_name, from_uid, message) */
+            return Py_BuildValue("(KhhhNNs)", 
+                                 event->serverConnectionHandlerID, 
+                                 event->targetMode, 
+                                 event->toID, 
+                                 event->clientID, 
+                                 python_strings_get(event->fromName, sender), 
+                                 python_strings_get(event->fromUniqueIdentifier, sender),
+                                 event->message ? event->message : "");
+        case PYTHON_EVENT_TALK_STATUS_CHANGE:
+            /* (server_id, status, client_id) */
+            return Py_BuildValue("(Kih)", event->serverConnectionHandlerID, event->status, event->clientID);
+        case PYTHON_EVENT_COMMAND:
+            /* (server_id, command, args) */
+            return Py_BuildValue("(Kss)", event->serverConnectionHandlerID,
+                                 event->command ? event->command : "", event->message ? event->message : "");
+        case PYTHON_EVENT_TRIGGER:
+            /* (server_id, trigger_id, match, message_info) */
+            match = PyUnicode_DecodeUTF8(event->match, (Py_ssize_t)event->matchLength, "replace");
+            if (match == NULL) {
+                return NULL;
+            }
+            return Py_BuildValue("(KiN{s:h,s:h,s:h,s:N,s:N,s:s})",
+                                 event->serverConnectionHandlerID,
+                                 event->triggerID,
+                                 match,
+                                 "target_mode", event->targetMode,
+                                 "to_id", event->toID,
+                                 "from_id", event->clientID,
+                                 "from_name", python_strings_get(event->fromName, sender),
+                                 "from_uid", python_strings_get(event->fromUniqueIdentifier, sender),
+                                 "message", event->message ? event->message : "");
+        default:
+            return NULL;
+    }
+}
+
+/* Arguments of one dispatch, each built on first use */
+typedef struct HandlerArgs {
+    PyObject* tuple;   /* Positional arguments */
+    PyObject* object;  /* ts3api.Event for single-parameter handlers */
+} HandlerArgs;
+
+/* The tuple or Event a handler takes, or NULL with a Python exception set */
+static PyObject* handler_args(HandlerArgs* args, const PythonEvent* event, int takesEvent)
+{
+    if (takesEvent) {
+        if (args->object == NULL) {
+            args->object = python_event_object_new(event);
+        }
+        return args->object;
+    }
+    if (args->tuple == NULL) {
+        args->tuple = python_event_build_args(event);
+    }
+    return args->tuple;
+}
+
+/* Call one handler, logging (not propagating) any Python exception */
+static int call_handler(PyObject* callable, const char* script, unsigned int generation,
+                        PythonEventType type, PyObject* args, int takesEvent)
 {
-    PyObject* main_dict;
-    PyObject* func;
     PyObject* result;
+    ScriptContext previous = python_engine_enter_script(script, generation);
     
-    if (!python_engine_is_initialized()) {
-        if (args) Py_DECREF(args);
+    /* Call the function */
+    TRACE_BEGIN(span);
+    result = takesEvent ? PyObject_CallOneArg(callable, args) : PyObject_CallObject(callable, args);
+    TRACE_END(span, "python", python_engine_get_event_name(type));
+    
+    python_engine_leave_script(previous);
+    
+    if (result == NULL) {
+        python_engine_report_exception(script, python_engine_get_event_name(type));
         return 1;
     }
     
-    /* Get __main__ module dictionary */
-    main_dict = PyModule_GetDict(PyImport_AddModule("__main__"));
-    if (main_dict == NULL) {
-        log_error("Failed to get __main__ dictionary");
-        if (args) Py_DECREF(args);
+    /* async def handlers run as tasks on the event loop */
+    if (python_loop_is_coroutine(result) && python_loop_submit(result, script, generation) != 0) {
+        python_engine_report_exception(script, python_engine_get_event_name(type));
+        Py_DECREF(result);
         return 1;
     }
     
-    /* Look up the function */
-    func = PyDict_GetItemString(main_dict, func_name);
-    if (func == NULL || !PyCallable_Check(func)) {
-        /* Function not defined - this is OK, not all scripts implement all handlers */
-        if (args) Py_DECREF(args);
-        return 0;
-    }
+    Py_DECREF(result);
+    return 0;
+}
+
+/* Whether a handler on the given lane takes part in a delivery for lane */
+static int lane_selected(uint32_t handlerLane, uint32_t lane)
+{
+    return lane == EVENT_LANE_ALL || handlerLane == lane;
+}
+
+/* Fan an event out to module handlers and matching subscriptions on a lane (GIL held) */
+static int deliver_event(const PythonEvent* event, uint32_t lane)
+{
+    HandlerList* handlers;
+    SubscriptionList* subscriptions;
+    SubscriptionCache cache;
+    HandlerArgs args = {NULL, NULL};
+    PyObject* arg;
+    size_t i;
+    int failures = 0;
     
-    /* Call the function */
-    result = PyObject_CallObject(func, args);
-    if (args) Py_DECREF(args);
+    /* References keep both lists intact if a handler causes a script to be swapped */
+    handlers = lane_selected(SUBSCRIPTION_LANE_CONNECTION, lane) ? python_engine_acquire_handlers(event->type) : NULL;
+    subscriptions = python_subscriptions_acquire(event->type);
+    memset(&cache, 0, sizeof(cache));
     
-    if (result == NULL) {
-        /* Python exception occurred */
-        PyObject *ptype, *pvalue, *ptraceback;
-        PyErr_Fetch(&ptype, &pvalue, &ptraceback);
+    /* Arguments are built once per form, and only if some handler will actually run */
+    for (i = 0; handlers != NULL && i < handlers->count; i++) {
+        const PythonHandler* handler = &handlers->handlers[i];
         
-        if (pvalue != NULL) {
-            PyObject* str_obj = PyObject_Str(pvalue);
-            if (str_obj != NULL) {
-                const char* err_msg = PyUnicode_AsUTF8(str_obj);
-                if (err_msg != NULL) {
-                    log_error("Python error in %s: %s", func_name, err_msg);
-                }
-                Py_DECREF(str_obj);
-            }
+        if (event->script != NULL && strcmp(handler->script, event->script) != 0) {
+            continue;
         }
+        if ((arg = handler_args(&args, event, handler->takesEvent)) == NULL) {
+            goto done;
+        }
+        failures += call_handler((PyObject*)handler->callable, handler->script,
+                                 handler->generation, event->type, arg, handler->takesEvent);
+    }
+    
+    for (i = 0; subscriptions != NULL && i < subscriptions->count; i++) {
+        const Subscription* subscription = subscriptions->items[i];
         
-        /* Clean up */
-        Py_XDECREF(ptype);
-        Py_XDECREF(pvalue);
-        Py_XDECREF(ptraceback);
-        
+        if (!lane_selected(subscription->lane, lane)) {
+            continue;
+        }
+        if (event->script != NULL && strcmp(subscription->script, event->script) != 0) {
+            continue;
+        }
+        if (!python_subscription_matches(subscription, event, &cache)) {
+            continue;
+        }
+        if ((arg = handler_args(&args, event, subscription->takesEvent)) == NULL) {
+            goto done;
+        }
+        failures += call_handler((PyObject*)subscription->callable, subscription->script,
+                                 subscription->generation, event->type, arg, subscription->takesEvent);
+    }
+    
+done:
+    if (PyErr_Occurred()) {
+        log_error("Failed to build arguments for %s", python_engine_get_event_name(event->type));
+        PyErr_Clear();
+    }
+    Py_XDECREF(args.tuple);
+    Py_XDECREF(args.object);
+    python_subscriptions_release(subscriptions);
+    python_engine_release_handlers(handlers);
+    return failures > 0 ? 1 : 0;
+}
+
+int python_events_deliver(const PythonEvent* event, uint32_t lane)
+{
+    return deliver_event(event, lane);
+}
+
+static size_t copy_length(const char* text)
+{
+    return text != NULL ? strlen(text) + 1 : 0;
+}
+
+static const char* copy_into(char** cursor, const char* text, size_t length)
+{
+    const char* copy = *cursor;
+
+    if (text == NULL) {
+        return NULL;
+    }
+    memcpy(*cursor, text, length);
+    *cursor += length;
+    return copy;
+}
+
+size_t python_event_copy_size(const PythonEvent* event)
+{
+    return copy_length(event->fromName) + copy_length(event->fromUniqueIdentifier) + copy_length(event->message)
+           + copy_length(event->command) + copy_length(event->script) + event->matchLength;
+}
+
+void python_event_copy(PythonEvent* dest, const PythonEvent* src, char* storage)
+{
+    *dest = *src;
+    dest->fromName = copy_into(&storage, src->fromName, copy_length(src->fromName));
+    dest->fromUniqueIdentifier = copy_into(&storage, src->fromUniqueIdentifier, copy_length(src->fromUniqueIdentifier));
+    dest->message = copy_into(&storage, src->message, copy_length(src->message));
+    dest->command = copy_into(&storage, src->command, copy_length(src->command));
+    dest->script = copy_into(&storage, src->script, copy_length(src->script));
+    if (src->match != NULL) {
+        dest->match = copy_into(&storage, src->match, src->matchLength);
+    }
+}
+
+/* Queue a copy of an event (g_defer_lock held); the caller's strings are only valid during the callback */
+static void defer_event(const PythonEvent* event)
+{
+    DeferredEvent* deferred;
+
+    if (g_deferred_count >= EVENT_DEFER_MAX) {
+        g_deferred_dropped++;
+        return;
+    }
+
+    deferred = (DeferredEvent*)malloc(sizeof(DeferredEvent) + python_event_copy_size(event));
+    if (deferred == NULL) {
+        g_deferred_dropped++;
+        return;
+    }
+    deferred->next = NULL;
+    python_event_copy(&deferred->event, event, (char*)(deferred + 1));
+
+    if (g_deferred_tail != NULL) {
+        g_deferred_tail->next = deferred;
+    } else {
+        g_deferred_head = deferred;
+    }
+    g_deferred_tail = deferred;
+    g_deferred_count++;
+}
+
+/*
+ * Deliver held events in arrival order (GIL and g_defer_lock held); stops if
+ * dispatch is paused again. With a handler pool they are handed to it.
+ */
+static void drain_deferred(void)
+{
+    size_t delivered = 0;
+
+    g_draining = 1;
+    while (g_pause_depth == 0 && g_deferred_head != NULL) {
+        DeferredEvent* deferred = g_deferred_head;
+
+        g_deferred_head = deferred->next;
+        if (g_deferred_head == NULL) {
+            g_deferred_tail = NULL;
+        }
+        g_deferred_count--;
+
+        /* Handlers may release the GIL; new events queue behind this one */
+        if (python_pool_submit(&deferred->event) != 0) {
+            mutex_unlock(&g_defer_lock);
+            deliver_event(&deferred->event, EVENT_LANE_ALL);
+            mutex_lock(&g_defer_lock);
+        }
+        free(deferred);
+        delivered++;
+    }
+    g_draining = 0;
+
+    if (delivered > 0) {
+        log_debug("Delivered %zu event(s) held during a script reload", delivered);
+    }
+    if (g_deferred_dropped > 0 && g_pause_depth == 0) {
+        log_warning("Dropped %zu event(s) while a script reload was in progress", g_deferred_dropped);
+        g_deferred_dropped = 0;
+    }
+}
+
+static int dispatch_event(const PythonEvent* event)
+{
+    PyGILState_STATE gil;
+    int result;
+    
+    if (!python_engine_is_initialized()) {
         return 1;
     }
+    python_gc_note_event();
+    python_memory_enforce();
     
-    Py_DECREF(result);
-    return 0;
+    /* Isolated interpreters get their copy first and handle it on their own threads */
+    if (event->type != PYTHON_EVENT_TRIGGER && python_interpreters_count() > 0) {
+        python_interpreters_post(event);
+    }
+    
+    /* Keep order: nothing overtakes events that are still held */
+    mutex_lock(&g_defer_lock);
+    if (g_pause_depth > 0 || g_draining) {
+        defer_event(event);
+        mutex_unlock(&g_defer_lock);
+        return 0;
+    }
+    /* With a handler pool the client thread neither takes the GIL nor waits for handlers */
+    if (python_pool_submit(event) == 0) {
+        mutex_unlock(&g_defer_lock);
+        return 0;
+    }
+    mutex_unlock(&g_defer_lock);
+
+    gil = PyGILState_Ensure();
+    result = deliver_event(event, EVENT_LANE_ALL);
+    PyGILState_Release(gil);
+    return result;
+}
+
+void python_events_pause(void)
+{
+    mutex_lock(&g_defer_lock);
+    g_pause_depth++;
+    mutex_unlock(&g_defer_lock);
+}
+
+void python_events_resume(void)
+{
+    mutex_lock(&g_defer_lock);
+    if (g_pause_depth > 0 && --g_pause_depth == 0 && !g_draining) {
+        drain_deferred();
+    }
+    mutex_unlock(&g_defer_lock);
 }
 
 int python_events_init(void)
 {
+    /* Kept across shutdown: the watch thread may still pause dispatch until the engine stops it */
+    if (!g_defer_lock_ready) {
+        mutex_init(&g_defer_lock);
+        g_defer_lock_ready = 1;
+    }
     log_info("Python event dispatcher initialized");
     return 0;
 }
 
 void python_events_shutdown(void)
 {
+    mutex_lock(&g_defer_lock);
+    while (g_deferred_head != NULL) {
+        DeferredEvent* next = g_deferred_head->next;
+        free(g_deferred_head);
+        g_deferred_head = next;
+    }
+    g_deferred_tail = NULL;
+    g_deferred_count = 0;
+    mutex_unlock(&g_defer_lock);
+
     log_debug("Python event dispatcher shutdown");
 }
 
 void python_event_on_connect_status_changed(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber)
 {
-    PyObject* args;
+    PythonEvent event;
+    
+    memset(&event, 0, sizeof(event));
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.status = newStatus;
+    event.errorNumber = errorNumber;
     
     /* STATUS_DISCONNECTED = 0, STATUS_CONNECTING = 1, STATUS_CONNECTED = 2, STATUS_CONNECTION_ESTABLISHING = 3 */
     
     /* Call on_connect for STATUS_CONNECTED (2) */
     if (newStatus == 2 && errorNumber == 0) {
-        args = Py_BuildValue("(K)", serverConnectionHandlerID);
-        if (args != NULL) {
-            call_python_handler("on_connect", args);
-        }
+        event.type = PYTHON_EVENT_CONNECT;
+        dispatch_event(&event);
     }
     /* Call on_disconnect for STATUS_DISCONNECTED (0) */
     else if (newStatus == 0) {
-        args = Py_BuildValue("(K)", serverConnectionHandlerID);
-        if (args != NULL) {
-            call_python_handler("on_disconnect", args);
-        }
+        event.type = PYTHON_EVENT_DISCONNECT;
+        dispatch_event(&event);
     }
 }
 
@@ -120,50 +431,102 @@ void python_event_on_client_move(uint64 serverConnectionHandlerID, anyID clientI
                                   uint64 oldChannelID, uint64 newChannelID, 
                                   int visibility, const char* moveMessage)
 {
-    PyObject* args;
+    PythonEvent event;
     
-    (void)visibility;    /* Unused for now */
-    (void)moveMessage;   /* Unused for now */
+    memset(&event, 0, sizeof(event));
+    event.type = PYTHON_EVENT_CLIENT_MOVE;
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.clientID = clientID;
+    event.oldChannelID = oldChannelID;
+    event.newChannelID = newChannelID;
+    event.visibility = visibility;
+    event.message = moveMessage;
     
-    /* Build arguments: (server_id, client_id, old_channel, new_channel) */
-    args = Py_BuildValue("(KhKK)", serverConnectionHandlerID, clientID, oldChannelID, newChannelID);
-    if (args != NULL) {
-        call_python_handler("on_client_move", args);
-    }
+    dispatch_event(&event);
 }
 
 void python_event_on_text_message(uint64 serverConnectionHandlerID, anyID targetMode,
                                    anyID toID, anyID fromID, const char* fromName,
                                    const char* fromUniqueIdentifier, const char* message)
 {
-    PyObject* args;
+    PythonEvent event;
     
-    /* Build arguments: (server_id, target_mode, to_id, from_id, from_name, from_uid, message) */
-    args = Py_BuildValue("(Khhhsss)", 
-                         serverConnectionHandlerID, 
-                         targetMode, 
-                         toID, 
-                         fromID, 
-                         fromName ? fromName : "", 
-                         fromUniqueIdentifier ? fromUniqueIdentifier : "",
-                         message ? message : "");
+    memset(&event, 0, sizeof(event));
+    event.type = PYTHON_EVENT_TEXT_MESSAGE;
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.targetMode = targetMode;
+    event.toID = toID;
+    event.clientID = fromID;
+    event.fromName = fromName;
+    event.fromUniqueIdentifier = fromUniqueIdentifier;
+    event.message = message;
     
-    if (args != NULL) {
-        call_python_handler("on_text_message", args);
+    dispatch_event(&event);
+}
+
+void python_event_on_text_triggers(uint64 serverConnectionHandlerID, anyID targetMode,
+                                    anyID toID, anyID fromID, const char* fromName,
+                                    const char* fromUniqueIdentifier, const char* message)
+{
+    TriggerHit hits[TRIGGER_MAX_HITS];
+    PythonEvent event;
+    size_t count;
+    size_t i;
+    
+    if (!python_engine_is_initialized()) {
+        return;
+    }
+    
+    /* Matching happens entirely in C and without the GIL; Python only runs for hits */
+    TRACE_BEGIN(span);
+    count = python_triggers_scan(message, hits, TRIGGER_MAX_HITS);
+    TRACE_END(span, "triggers", "scan");
+    
+    memset(&event, 0, sizeof(event));
+    event.type = PYTHON_EVENT_TRIGGER;
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.targetMode = targetMode;
+    event.toID = toID;
+    event.clientID = fromID;
+    event.fromName = fromName;
+    event.fromUniqueIdentifier = fromUniqueIdentifier;
+    event.message = message;
+    
+    /* Each hit goes to the script that registered the trigger */
+    for (i = 0; i < count; i++) {
+        event.triggerID = hits[i].id;
+        event.match = message + hits[i].start;
+        event.matchLength = hits[i].length;
+        event.script = hits[i].script;
+        dispatch_event(&event);
     }
 }
 
 void python_event_on_talk_status_change(uint64 serverConnectionHandlerID, int status,
                                          int isReceivedWhisper, anyID clientID)
 {
-    PyObject* args;
+    PythonEvent event;
     
     (void)isReceivedWhisper; /* Unused for now */
     
-    /* Build arguments: (server_id, status, client_id) */
-    args = Py_BuildValue("(Kih)", serverConnectionHandlerID, status, clientID);
+    memset(&event, 0, sizeof(event));
+    event.type = PYTHON_EVENT_TALK_STATUS_CHANGE;
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.status = status;
+    event.clientID = clientID;
     
-    if (args != NULL) {
-        call_python_handler("on_talk_status_change", args);
-    }
+    dispatch_event(&event);
+}
+
+void python_event_on_command(uint64 serverConnectionHandlerID, const char* command, const char* args)
+{
+    PythonEvent event;
+    
+    memset(&event, 0, sizeof(event));
+    event.type = PYTHON_EVENT_COMMAND;
+    event.serverConnectionHandlerID = serverConnectionHandlerID;
+    event.command = command;
+    event.message = args;
+    
+    dispatch_event(&event);
 }
@@ -10,13 +10,39 @@
 #ifndef PYTHON_EVENTS_H
 #define PYTHON_EVENTS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "teamspeak/public_definitions.h"
+#include "python_engine.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief C-side view of an event, used for filtering before any Python objects exist
+ */
+typedef struct PythonEvent {
+    PythonEventType type;
+    uint64          serverConnectionHandlerID;
+    anyID           clientID;             /* Moving/talking client, or text message sender */
+    uint64          oldChannelID;
+    uint64          newChannelID;
+    int             visibility;
+    anyID           targetMode;
+    anyID           toID;
+    int             status;               /* Talk status or connection status */
+    unsigned int    errorNumber;
+    const char*     fromName;
+    const char*     fromUniqueIdentifier;
+    const char*     message;              /* Text message, or command arguments */
+    const char*     command;
+    int             triggerID;
+    const char*     match;                /* Trigger match, not NUL-terminated */
+    size_t          matchLength;
+    const char*     script;               /* Only deliver to this script; NULL for all */
+} PythonEvent;
+
 /**
  * @brief Initialize the Python event dispatcher
  * @return 0 on success, non-zero on failure
@@ -28,6 +54,62 @@ int python_events_init(void);
  */
 void python_events_shutdown(void);
 
+/**
+ * @brief Most events held while dispatch is paused; later ones are dropped
+ */
+#define EVENT_DEFER_MAX 4096
+
+/**
+ * @brief Bytes python_event_copy needs for an event's strings
+ * @param event Event
+ * @return Size in bytes
+ */
+size_t python_event_copy_size(const PythonEvent* event);
+
+/**
+ * @brief Copy an event together with the strings it points to
+ * @param dest Receives the copy
+ * @param src Event to copy
+ * @param storage python_event_copy_size(src) bytes for the strings; must outlive dest
+ */
+void python_event_copy(PythonEvent* dest, const PythonEvent* src, char* storage);
+
+/**
+ * @brief Lane value for python_events_deliver that selects every handler
+ */
+#define EVENT_LANE_ALL 0xFFFFFFFFu
+
+/**
+ * @brief Call the handlers of one lane for an event (GIL held)
+ * @param event Event
+ * @param lane SUBSCRIPTION_LANE_CONNECTION for the on_* functions and the
+ *        subscriptions without a lane, a lane ID for that lane's
+ *        subscriptions, or EVENT_LANE_ALL
+ * @return 0 if every handler succeeded, 1 if one raised (logged)
+ */
+int python_events_deliver(const PythonEvent* event, uint32_t lane);
+
+/**
+ * @brief Handler arguments for an event (GIL of the calling interpreter held)
+ * @param event Event
+ * @return New tuple (PyObject*), or NULL with a Python exception set
+ */
+struct _object* python_event_build_args(const PythonEvent* event);
+
+/**
+ * @brief Hold events until python_events_resume (GIL held)
+ *
+ * Used while a script is swapped: events that arrive meanwhile are copied
+ * and queued, then delivered in order to the handlers in place afterwards.
+ * Calls nest.
+ */
+void python_events_pause(void);
+
+/**
+ * @brief End a python_events_pause and deliver the held events (GIL held)
+ */
+void python_events_resume(void);
+
 /**
  * @brief Dispatch onConnectStatusChange event to Python
  * @param serverConnectionHandlerID Server connection handler ID
@@ -63,6 +145,20 @@ void python_event_on_text_message(uint64 serverConnectionHandlerID, anyID target
                                    anyID toID, anyID fromID, const char* fromName,
                                    const char* fromUniqueIdentifier, const char* message);
 
+/**
+ * @brief Scan a text message for registered triggers and dispatch on_trigger for each hit
+ * @param serverConnectionHandlerID Server connection handler ID
+ * @param targetMode Target mode (1=client, 2=channel, 3=server)
+ * @param toID Recipient ID
+ * @param fromID Sender client ID
+ * @param fromName Sender name
+ * @param fromUniqueIdentifier Sender unique ID
+ * @param message Message text
+ */
+void python_event_on_text_triggers(uint64 serverConnectionHandlerID, anyID targetMode,
+                                    anyID toID, anyID fromID, const char* fromName,
+                                    const char* fromUniqueIdentifier, const char* message);
+
 /**
  * @brief Dispatch onTalkStatusChange event to Python
  * @param serverConnectionHandlerID Server connection handler ID
@@ -73,6 +169,14 @@ void python_event_on_text_message(uint64 serverConnectionHandlerID, anyID target
 void python_event_on_talk_status_change(uint64 serverConnectionHandlerID, int status,
                                          int isReceivedWhisper, anyID clientID);
 
+/**
+ * @brief Dispatch a script-defined plugin command to Python
+ * @param serverConnectionHandlerID Server connection handler ID
+ * @param command First word after /tspy
+ * @param args Rest of the command line (may be empty)
+ */
+void python_event_on_command(uint64 serverConnectionHandlerID, const char* command, const char* args);
+
 #ifdef __cplusplus
 }
 #endif
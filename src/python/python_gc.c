@@ -0,0 +1,450 @@
+/**
+ * @file python_gc.c
+ * @brief Idle-window garbage collection implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * The collector thread wakes every idle_ms. It takes the GIL only when the
+ * dispatcher has been quiet for idle_ms and something was dispatched since
+ * its last collection, when a freeze is pending, or when max_interval_ms
+ * has passed; a client with no traffic costs one GIL acquisition per
+ * max_interval_ms. The generation collected follows Python's own rule: the
+ * oldest whose count exceeds its (original) threshold.
+ *
+ * [gc] changes are picked up by the thread itself on its next wake-up, since
+ * applying them needs the GIL. g_lock guards the counters and the thread's
+ * wake-up; no Python code runs while it is held.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <string.h>
+
+#include "python_gc.h"
+#include "python_engine.h"
+#include "core/plugin_config.h"
+#include "utils/logging.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+typedef enum GcKind {
+    GC_KIND_AUTOMATIC = 0,
+    GC_KIND_IDLE,
+    GC_KIND_FORCED,
+    GC_KIND_FREEZE
+} GcKind;
+
+static int     g_running = 0;
+static int     g_stopping = 0;
+static Thread  g_thread;
+static Mutex   g_lock;
+static CondVar g_wake;
+
+/* Main interpreter's gc module and the callback in gc.callbacks; GIL */
+static PyObject* g_gc = NULL;
+static PyObject* g_callback = NULL;
+static long      g_base_thresholds[3] = {700, 10, 10};
+
+static volatile int64_t g_last_event_ns = 0;
+static volatile int32_t g_freeze_pending = 0;
+
+/* Collector thread only */
+static unsigned int g_applied_version = (unsigned int)-1;
+static int          g_scheduled = 0;
+static unsigned int g_threshold = 0;
+static unsigned int g_idle_ms = GC_DEFAULT_IDLE_MS;
+static unsigned int g_max_interval_ms = GC_DEFAULT_MAX_INTERVAL_MS;
+static uint64_t     g_last_collect_ns = 0;
+
+/* Guarded by g_lock */
+static GcStats g_stats;
+
+/* Set by the collector thread around its own collections */
+static THREAD_LOCAL GcKind   t_kind = GC_KIND_AUTOMATIC;
+static THREAD_LOCAL uint64_t t_start_ns = 0;
+
+/* ========================================================================
+ * Timing (gc.callbacks, GIL held)
+ * ======================================================================== */
+
+static PyObject* gc_callback(PyObject* self, PyObject* args)
+{
+    const char* phase;
+    PyObject* info;
+    PyObject* collected;
+    uint64_t pauseNs;
+    uint64_t found = 0;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "sO", &phase, &info)) {
+        return NULL;
+    }
+    if (strcmp(phase, "start") == 0) {
+        t_start_ns = clock_monotonic_ns();
+        Py_RETURN_NONE;
+    }
+    if (t_start_ns == 0) {
+        Py_RETURN_NONE;
+    }
+    pauseNs = clock_monotonic_ns() - t_start_ns;
+    t_start_ns = 0;
+
+    collected = PyDict_Check(info) ? PyDict_GetItemString(info, "collected") : NULL;
+    if (collected != NULL && PyLong_Check(collected)) {
+        found = (uint64_t)PyLong_AsUnsignedLongLong(collected);
+        if (PyErr_Occurred()) {
+            PyErr_Clear();
+            found = 0;
+        }
+    }
+
+    mutex_lock(&g_lock);
+    switch (t_kind) {
+        case GC_KIND_IDLE:
+            g_stats.idle++;
+            break;
+        case GC_KIND_FORCED:
+            g_stats.forced++;
+            break;
+        case GC_KIND_FREEZE:
+            break;
+        case GC_KIND_AUTOMATIC:
+            g_stats.automatic++;
+            if (pauseNs > g_stats.maxAutomaticPauseNs) {
+                g_stats.maxAutomaticPauseNs = pauseNs;
+            }
+            break;
+    }
+    g_stats.collected += found;
+    g_stats.pauseNs += pauseNs;
+    if (pauseNs > g_stats.maxPauseNs) {
+        g_stats.maxPauseNs = pauseNs;
+    }
+    mutex_unlock(&g_lock);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef g_callback_def = {
+    "tspy_gc_timer", gc_callback, METH_VARARGS, "Times collections for /tspy stats"
+};
+
+/* ========================================================================
+ * Collector thread
+ * ======================================================================== */
+
+/* Call a gc function with an int argument, or none if arg < 0; returns 0 on success */
+static int call_gc(const char* name, int arg)
+{
+    PyObject* result = arg >= 0 ? PyObject_CallMethod(g_gc, name, "i", arg) : PyObject_CallMethod(g_gc, name, NULL);
+
+    if (result == NULL) {
+        python_engine_report_exception("", "gc");
+        return 1;
+    }
+    Py_DECREF(result);
+    return 0;
+}
+
+/* Python's own thresholds, collection on, nothing frozen (GIL held) */
+static void restore_python_gc(void)
+{
+    PyObject* result = PyObject_CallMethod(g_gc, "set_threshold", "lll", g_base_thresholds[0], g_base_thresholds[1],
+                                           g_base_thresholds[2]);
+
+    Py_XDECREF(result);
+    call_gc("unfreeze", -1);
+    call_gc("enable", -1);
+    PyErr_Clear();
+}
+
+static void publish_mode(void)
+{
+    mutex_lock(&g_lock);
+    g_stats.scheduled = g_scheduled;
+    g_stats.threshold = g_scheduled ? g_threshold : (unsigned int)g_base_thresholds[0];
+    mutex_unlock(&g_lock);
+}
+
+/* Set thresholds for a configuration (GIL held) */
+static void apply_config(const PluginConfig* config)
+{
+    PyObject* result;
+
+    g_applied_version = config->version;
+    g_idle_ms = config->gcIdleMs;
+    g_max_interval_ms = config->gcMaxIntervalMs;
+    g_threshold = config->gcThreshold;
+
+    if (g_idle_ms == 0) {
+        if (g_scheduled) {
+            restore_python_gc();
+            log_info("Garbage collection left to Python");
+        }
+        g_scheduled = 0;
+        publish_mode();
+        return;
+    }
+
+    if (g_threshold == 0) {
+        call_gc("disable", -1);
+    } else {
+        result = PyObject_CallMethod(g_gc, "set_threshold", "Ill", g_threshold, g_base_thresholds[1],
+                                     g_base_thresholds[2]);
+        Py_XDECREF(result);
+        call_gc("enable", -1);
+    }
+    PyErr_Clear();
+    if (!g_scheduled) {
+        atomic32_store(&g_freeze_pending, 1);
+    }
+    g_scheduled = 1;
+    publish_mode();
+    if (g_threshold > 0) {
+        log_info("Garbage collection in idle windows of %u ms (at least every %u ms), automatic after %u allocations",
+                 g_idle_ms, g_max_interval_ms, g_threshold);
+    } else {
+        log_info("Garbage collection in idle windows of %u ms (at least every %u ms) only", g_idle_ms,
+                 g_max_interval_ms);
+    }
+}
+
+/* Oldest generation over its threshold, like Python picks; -1 if too little was allocated */
+static int pick_generation(int forced)
+{
+    PyObject* counts = PyObject_CallMethod(g_gc, "get_count", NULL);
+    long count[3] = {0, 0, 0};
+    int generation;
+    Py_ssize_t i;
+
+    if (counts == NULL || !PyTuple_Check(counts)) {
+        Py_XDECREF(counts);
+        PyErr_Clear();
+        return forced ? 0 : -1;
+    }
+    for (i = 0; i < PyTuple_GET_SIZE(counts) && i < 3; i++) {
+        count[i] = PyLong_AsLong(PyTuple_GET_ITEM(counts, i));
+    }
+    Py_DECREF(counts);
+    PyErr_Clear();
+
+    if (count[0] < (forced ? 1 : GC_MIN_ALLOCATIONS) && count[1] < g_base_thresholds[1]) {
+        return -1;
+    }
+    for (generation = 2; generation > 0; generation--) {
+        if (count[generation] >= g_base_thresholds[generation]) {
+            break;
+        }
+    }
+    return generation;
+}
+
+/* Collect and freeze everything alive (GIL held) */
+static void freeze_heap(void)
+{
+    PyObject* count;
+
+    t_kind = GC_KIND_FREEZE;
+    /* Objects frozen before may belong to unloaded scripts now */
+    call_gc("unfreeze", -1);
+    call_gc("collect", 2);
+    call_gc("freeze", -1);
+    t_kind = GC_KIND_AUTOMATIC;
+
+    count = PyObject_CallMethod(g_gc, "get_freeze_count", NULL);
+    mutex_lock(&g_lock);
+    g_stats.freezes++;
+    if (count != NULL) {
+        g_stats.frozen = PyLong_AsSize_t(count);
+    }
+    mutex_unlock(&g_lock);
+    Py_XDECREF(count);
+    PyErr_Clear();
+}
+
+/* One wake-up: collect if the dispatcher is idle or the interval is over (no GIL) */
+static void collector_tick(void)
+{
+    const PluginConfig* config = get_config();
+    uint64_t nowNs = clock_monotonic_ns();
+    uint64_t lastEventNs = (uint64_t)atomic64_load(&g_last_event_ns);
+    uint64_t idleNs = (uint64_t)g_idle_ms * 1000000ull;
+    int due = nowNs - g_last_collect_ns >= (uint64_t)g_max_interval_ms * 1000000ull;
+    int idle = nowNs - lastEventNs >= idleNs && lastEventNs > g_last_collect_ns;
+    int freeze = atomic32_load(&g_freeze_pending) != 0 && nowNs - lastEventNs >= idleNs;
+    PyGILState_STATE gil;
+    int generation;
+
+    if (config->version == g_applied_version && (!g_scheduled || (!due && !idle && !freeze))) {
+        return;
+    }
+
+    gil = PyGILState_Ensure();
+    if (config->version != g_applied_version) {
+        apply_config(config);
+    }
+    if (g_scheduled) {
+        TRACE_BEGIN(span);
+        if (freeze && atomic32_cas(&g_freeze_pending, 1, 0)) {
+            freeze_heap();
+        } else if (due || idle) {
+            generation = pick_generation(due && !idle);
+            if (generation >= 0) {
+                t_kind = idle ? GC_KIND_IDLE : GC_KIND_FORCED;
+                call_gc("collect", generation);
+                t_kind = GC_KIND_AUTOMATIC;
+            }
+        }
+        TRACE_END(span, "gc", "collect");
+        g_last_collect_ns = clock_monotonic_ns();
+    }
+    PyGILState_Release(gil);
+}
+
+static void collector_main(void* arg)
+{
+    (void)arg; /* Unused parameter */
+
+    trace_set_thread_name("TsPy gc");
+
+    mutex_lock(&g_lock);
+    while (!g_stopping) {
+        unsigned int waitMs = g_idle_ms > 0 ? g_idle_ms : 1000;
+
+        cond_timed_wait(&g_wake, &g_lock, waitMs);
+        if (g_stopping) {
+            break;
+        }
+        mutex_unlock(&g_lock);
+        collector_tick();
+        mutex_lock(&g_lock);
+    }
+    mutex_unlock(&g_lock);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+int python_gc_init(void)
+{
+    PyObject* thresholds;
+    PyObject* callbacks;
+    Py_ssize_t i;
+
+    if (g_running) {
+        return 0;
+    }
+
+    g_gc = PyImport_ImportModule("gc");
+    if (g_gc == NULL) {
+        python_engine_report_exception("", "gc");
+        return 1;
+    }
+    thresholds = PyObject_CallMethod(g_gc, "get_threshold", NULL);
+    for (i = 0; thresholds != NULL && PyTuple_Check(thresholds) && i < PyTuple_GET_SIZE(thresholds) && i < 3; i++) {
+        g_base_thresholds[i] = PyLong_AsLong(PyTuple_GET_ITEM(thresholds, i));
+    }
+    Py_XDECREF(thresholds);
+    PyErr_Clear();
+
+    g_callback = PyCFunction_New(&g_callback_def, NULL);
+    callbacks = g_callback != NULL ? PyObject_GetAttrString(g_gc, "callbacks") : NULL;
+    if (callbacks == NULL || PyList_Append(callbacks, g_callback) != 0) {
+        python_engine_report_exception("", "gc");
+        Py_XDECREF(callbacks);
+        Py_CLEAR(g_callback);
+        Py_CLEAR(g_gc);
+        return 1;
+    }
+    Py_DECREF(callbacks);
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    /* Before apply_config, which publishes the mode under it */
+    mutex_init(&g_lock);
+    cond_init(&g_wake);
+    atomic64_store(&g_last_event_ns, (int64_t)clock_monotonic_ns());
+    g_last_collect_ns = clock_monotonic_ns();
+    g_applied_version = (unsigned int)-1;
+    g_scheduled = 0;
+    apply_config(get_config());
+
+    g_stopping = 0;
+    if (thread_create(&g_thread, collector_main, NULL) != 0) {
+        log_error("Failed to start the garbage collection thread; Python collects by itself");
+        restore_python_gc();
+        g_scheduled = 0;
+        return 1;
+    }
+    g_running = 1;
+    return 0;
+}
+
+void python_gc_note_event(void)
+{
+    atomic64_store(&g_last_event_ns, (int64_t)clock_monotonic_ns());
+}
+
+void python_gc_scripts_changed(void)
+{
+    atomic32_store(&g_freeze_pending, 1);
+}
+
+void python_gc_get_stats(GcStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!g_running) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    *stats = g_stats;
+    mutex_unlock(&g_lock);
+}
+
+void python_gc_stop(void)
+{
+    if (!g_running) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    g_stopping = 1;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+    thread_join(g_thread);
+}
+
+void python_gc_shutdown(void)
+{
+    PyObject* callbacks;
+    PyObject* result;
+
+    if (!g_running) {
+        return;
+    }
+    g_running = 0;
+
+    /* Leave Python's collector as it found it for Py_Finalize */
+    restore_python_gc();
+    callbacks = PyObject_GetAttrString(g_gc, "callbacks");
+    if (callbacks != NULL) {
+        result = PyObject_CallMethod(callbacks, "remove", "O", g_callback);
+        Py_XDECREF(result);
+        Py_DECREF(callbacks);
+    }
+    PyErr_Clear();
+    Py_CLEAR(g_callback);
+    Py_CLEAR(g_gc);
+
+    cond_destroy(&g_wake);
+    mutex_destroy(&g_lock);
+    g_scheduled = 0;
+}
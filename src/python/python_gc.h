@@ -0,0 +1,109 @@
+/**
+ * @file python_gc.h
+ * @brief Garbage collection in idle windows instead of inside event handlers
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Python's cyclic collector normally starts whenever enough objects were
+ * allocated, which can be in the middle of a text or talk-status handler.
+ * While scheduling is on, the main interpreter's gen0 threshold is raised
+ * (or automatic collection turned off) and a thread collects instead once
+ * no event was dispatched for [gc] idle_ms, or after [gc] max_interval_ms
+ * at the latest. After scripts are loaded or unloaded the next idle window
+ * also moves everything alive into the permanent generation (gc.freeze), so
+ * later collections no longer walk the scripts' modules, functions and
+ * data.
+ *
+ * Every collection, scheduled or automatic, is timed through gc.callbacks.
+ * Isolated interpreters keep Python's own collector.
+ */
+
+#ifndef PYTHON_GC_H
+#define PYTHON_GC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default gen0 threshold while scheduling ([gc] threshold); 0 turns automatic collection off
+ */
+#define GC_DEFAULT_THRESHOLD 20000
+
+/**
+ * @brief Default quiet time before an idle collection ([gc] idle_ms); 0 leaves collection to Python
+ */
+#define GC_DEFAULT_IDLE_MS 50
+
+/**
+ * @brief Default longest time between collections, idle or not ([gc] max_interval_ms)
+ */
+#define GC_DEFAULT_MAX_INTERVAL_MS 5000
+
+/**
+ * @brief Fewest new objects worth an idle collection
+ */
+#define GC_MIN_ALLOCATIONS 100
+
+/**
+ * @brief Collector counters
+ */
+typedef struct GcStats {
+    int          scheduled;       /* 1 while collections run in idle windows */
+    unsigned int threshold;       /* gen0 threshold in effect, 0 if automatic collection is off */
+    uint64_t     idle;            /* Collections in idle windows */
+    uint64_t     forced;          /* Collections at max_interval_ms without an idle window */
+    uint64_t     automatic;       /* Collections Python started by itself, possibly inside handlers */
+    uint64_t     freezes;         /* Heap freezes after script loads */
+    uint64_t     collected;       /* Unreachable objects found */
+    uint64_t     pauseNs;         /* All collections, summed */
+    uint64_t     maxPauseNs;
+    uint64_t     maxAutomaticPauseNs;
+    size_t       frozen;          /* Objects in the permanent generation after the last freeze */
+} GcStats;
+
+/**
+ * @brief Apply [gc], start timing collections and start the collector thread
+ * @return 0 on success, non-zero on failure (Python's collector stays in charge)
+ * @note Call with the GIL held at engine start; the thread waits for the GIL until it is released
+ */
+int python_gc_init(void);
+
+/**
+ * @brief Note that an event is being dispatched, which ends the idle window
+ * @note Any thread; does not need the GIL
+ */
+void python_gc_note_event(void);
+
+/**
+ * @brief Note that scripts were loaded or unloaded, so the heap is frozen again in the next idle window
+ * @note Any thread; does not need the GIL
+ */
+void python_gc_scripts_changed(void);
+
+/**
+ * @brief Read the counters
+ * @param stats Receives the counters
+ */
+void python_gc_get_stats(GcStats* stats);
+
+/**
+ * @brief Stop the collector thread
+ * @note Call without the GIL, before the main thread takes it back for shutdown
+ */
+void python_gc_stop(void);
+
+/**
+ * @brief Give collection back to Python
+ * @note Call with the GIL held, after python_gc_stop
+ */
+void python_gc_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_GC_H */
@@ -0,0 +1,1008 @@
+/**
+ * @file python_interpreters.c
+ * @brief Isolated interpreters: script groups with their own GIL and thread
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Each interpreter is owned by one worker thread. The thread creates the
+ * subinterpreter, then takes jobs off its queue: event copies posted by the
+ * dispatcher, and load/unload/reload requests from callers that wait for the
+ * result. Jobs run in queue order, so events posted before a reload reach the
+ * old version and later ones the new version. The worker gives up its GIL
+ * while the queue is empty.
+ *
+ * Locks: g_control serializes loads, unloads, reloads and shutdown; g_lock
+ * guards the table; each interpreter's lock guards its queue, counters and
+ * script names. Order: g_control, then g_lock, then an interpreter's lock.
+ * No Python code runs while any of them is held.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_interpreters.h"
+#include "python_codecache.h"
+#include "python_memory.h"
+#include "core/plugin_main.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+#if PY_VERSION_HEX >= 0x030C0000
+
+typedef enum JobType {
+    JOB_EVENT,
+    JOB_LOAD,
+    JOB_UNLOAD,
+    JOB_RELOAD,
+    JOB_RELOAD_ALL,
+    JOB_STOP
+} JobType;
+
+/* Event jobs are allocated with their strings and freed by the worker; the rest live on the caller's stack */
+typedef struct InterpreterJob {
+    struct InterpreterJob* next;
+    JobType                type;
+    const char*            argument;   /* Script path (load) or name (unload, reload) */
+    int                    force;      /* Reload even if the file is unchanged */
+    int                    result;
+    int                    done;
+    PythonEvent            event;
+} InterpreterJob;
+
+typedef struct IsolatedScript {
+    char      name[SCRIPT_NAME_BUFSIZE];
+    char      path[PATH_BUFSIZE];
+    uint32_t  checksum;
+    PyObject* module;
+    PyObject* handlers[PYTHON_EVENT_COUNT];   /* on_* functions, NULL if not defined */
+} IsolatedScript;
+
+typedef enum InterpreterStatus {
+    INTERPRETER_STARTING,
+    INTERPRETER_RUNNING,
+    INTERPRETER_FAILED
+} InterpreterStatus;
+
+typedef struct Interpreter {
+    char              name[SCRIPT_NAME_BUFSIZE];
+    Thread            thread;
+    Mutex             lock;
+    CondVar           wake;       /* Signalled when a job is queued */
+    CondVar           done;       /* Broadcast when a control job finished or the thread started */
+    InterpreterStatus status;
+    InterpreterJob*   head;
+    InterpreterJob*   tail;
+    size_t            queued;     /* Event jobs waiting */
+    uint64_t          handled;
+    uint64_t          dropped;
+    int               overflowing;
+    IsolatedScript*   scripts;    /* Written by the worker; names read under lock */
+    size_t            scriptCount;
+    size_t            scriptCapacity;
+} Interpreter;
+
+static Mutex           g_control;
+static Mutex           g_lock;
+static Interpreter*    g_interpreters[INTERPRETER_MAX];
+static size_t          g_interpreter_count = 0;
+static volatile int32_t g_count = 0;
+static int             g_initialized = 0;
+
+/* Worker side (the interpreter's own GIL held) */
+
+static int find_isolated_script(const Interpreter* interpreter, const char* name)
+{
+    size_t i;
+
+    for (i = 0; i < interpreter->scriptCount; i++) {
+        if (strcmp(interpreter->scripts[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void release_isolated_script(IsolatedScript* script)
+{
+    int type;
+
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        Py_CLEAR(script->handlers[type]);
+    }
+    Py_CLEAR(script->module);
+}
+
+/* Run a script in this interpreter, replacing an older version; 0 on success */
+static int load_isolated_script(Interpreter* interpreter, const char* script_path, int force)
+{
+    char name[SCRIPT_NAME_BUFSIZE];
+    char key[SCRIPT_MODULE_BUFSIZE];
+    CodePrefetch* prefetch;
+    IsolatedScript script;
+    PyObject* code;
+    PyObject* dict;
+    PyObject* path_obj;
+    PyObject* result;
+    int index;
+    int type;
+
+    python_engine_script_name(script_path, name, sizeof(name));
+    index = find_isolated_script(interpreter, name);
+
+    prefetch = python_codecache_prefetch(script_path);
+    if (prefetch == NULL) {
+        log_error("Out of memory loading %s", script_path);
+        return 1;
+    }
+    if (!force && index >= 0 && interpreter->scripts[index].checksum != 0
+        && python_codecache_prefetch_checksum(prefetch) == interpreter->scripts[index].checksum) {
+        python_codecache_prefetch_free(prefetch);
+        log_debug("Script %s unchanged, not reloading", name);
+        return 0;
+    }
+
+    log_info("Loading Python script: %s (interpreter %s)", script_path, interpreter->name);
+    memset(&script, 0, sizeof(script));
+    safe_strcpy(script.name, sizeof(script.name), name);
+    safe_strcpy(script.path, sizeof(script.path), script_path);
+
+    code = python_codecache_compile(prefetch, &script.checksum);
+    python_codecache_prefetch_free(prefetch);
+    if (code == NULL) {
+        python_engine_report_exception(name, "load");
+        return 1;
+    }
+
+    /* Namespaced as in the main interpreter */
+    python_engine_module_key(name, key, sizeof(key));
+    if (python_engine_claim_module(key, index >= 0 ? interpreter->scripts[index].module : NULL) != 0) {
+        Py_DECREF(code);
+        python_engine_report_exception(name, "load");
+        return 1;
+    }
+
+    script.module = PyModule_New(key);
+    if (script.module == NULL) {
+        Py_DECREF(code);
+        python_engine_report_exception(name, "load");
+        return 1;
+    }
+    dict = PyModule_GetDict(script.module);
+    path_obj = PyUnicode_FromString(script_path);
+    if (path_obj == NULL
+        || PyDict_SetItemString(dict, "__file__", path_obj) != 0
+        || PyDict_SetItemString(dict, "__builtins__", PyEval_GetBuiltins()) != 0) {
+        Py_XDECREF(path_obj);
+        Py_DECREF(code);
+        release_isolated_script(&script);
+        python_engine_report_exception(name, "load");
+        return 1;
+    }
+    Py_DECREF(path_obj);
+
+    PyDict_SetItemString(PyImport_GetModuleDict(), key, script.module);
+
+    python_memory_enter(name);
+    TRACE_BEGIN(span);
+    result = PyEval_EvalCode(code, dict, dict);
+    TRACE_END(span, "script", "load_script");
+    python_memory_enter(NULL);
+    Py_DECREF(code);
+
+    if (result == NULL) {
+        python_engine_report_exception(name, "load");
+        python_engine_restore_module(key, script.module, index >= 0 ? interpreter->scripts[index].module : NULL);
+        release_isolated_script(&script);
+        return 1;
+    }
+    Py_DECREF(result);
+
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        PyObject* func = PyDict_GetItemString(dict, python_engine_get_event_name((PythonEventType)type));
+
+        if (func != NULL && PyCallable_Check(func)) {
+            Py_INCREF(func);
+            script.handlers[type] = func;
+        }
+    }
+
+    if (index >= 0) {
+        IsolatedScript previous = interpreter->scripts[index];
+
+        mutex_lock(&interpreter->lock);
+        interpreter->scripts[index] = script;
+        mutex_unlock(&interpreter->lock);
+        release_isolated_script(&previous);
+    } else {
+        if (interpreter->scriptCount == interpreter->scriptCapacity) {
+            size_t capacity = interpreter->scriptCapacity ? interpreter->scriptCapacity * 2 : 4;
+            IsolatedScript* grown;
+
+            mutex_lock(&interpreter->lock);
+            grown = (IsolatedScript*)realloc(interpreter->scripts, capacity * sizeof(IsolatedScript));
+            if (grown != NULL) {
+                interpreter->scripts = grown;
+                interpreter->scriptCapacity = capacity;
+            }
+            mutex_unlock(&interpreter->lock);
+            if (grown == NULL) {
+                log_error("Out of memory registering %s", name);
+                python_engine_restore_module(key, script.module, NULL);
+                release_isolated_script(&script);
+                return 1;
+            }
+        }
+        mutex_lock(&interpreter->lock);
+        interpreter->scripts[interpreter->scriptCount++] = script;
+        mutex_unlock(&interpreter->lock);
+    }
+
+    log_info("Script %s loaded in interpreter %s", name, interpreter->name);
+    return 0;
+}
+
+static int unload_isolated_script(Interpreter* interpreter, const char* name)
+{
+    char key[SCRIPT_MODULE_BUFSIZE];
+    IsolatedScript script;
+    int index = find_isolated_script(interpreter, name);
+
+    if (index < 0) {
+        return 1;
+    }
+
+    mutex_lock(&interpreter->lock);
+    script = interpreter->scripts[index];
+    interpreter->scripts[index] = interpreter->scripts[--interpreter->scriptCount];
+    mutex_unlock(&interpreter->lock);
+
+    python_engine_module_key(script.name, key, sizeof(key));
+    python_engine_restore_module(key, script.module, NULL);
+    release_isolated_script(&script);
+    log_info("Script %s unloaded from interpreter %s", name, interpreter->name);
+    return 0;
+}
+
+static int reload_isolated_scripts(Interpreter* interpreter)
+{
+    char (*paths)[PATH_BUFSIZE];
+    size_t count = interpreter->scriptCount;
+    size_t i;
+    int failures = 0;
+
+    /* Loading replaces entries in place, but copy the paths all the same */
+    paths = (char (*)[PATH_BUFSIZE])malloc((count ? count : 1) * sizeof(*paths));
+    if (paths == NULL) {
+        log_error("Out of memory reloading interpreter %s", interpreter->name);
+        return (int)count;
+    }
+    for (i = 0; i < count; i++) {
+        safe_strcpy(paths[i], sizeof(paths[i]), interpreter->scripts[i].path);
+    }
+    for (i = 0; i < count; i++) {
+        failures += load_isolated_script(interpreter, paths[i], 1) != 0;
+    }
+    free(paths);
+    return failures;
+}
+
+/* Call the scripts' on_* functions for one event, in load order */
+static void deliver_isolated_event(Interpreter* interpreter, const PythonEvent* event)
+{
+    const char* event_name = python_engine_get_event_name(event->type);
+    PyObject* args = NULL;
+    size_t i;
+
+    for (i = 0; i < interpreter->scriptCount; i++) {
+        IsolatedScript* script = &interpreter->scripts[i];
+        PyObject* handler = script->handlers[event->type];
+        PyObject* result;
+
+        if (handler == NULL || (event->script != NULL && strcmp(script->name, event->script) != 0)) {
+            continue;
+        }
+        if (args == NULL && (args = python_event_build_args(event)) == NULL) {
+            log_error("Failed to build arguments for %s", event_name);
+            PyErr_Clear();
+            return;
+        }
+
+        python_memory_enter(script->name);
+        TRACE_BEGIN(span);
+        result = PyObject_CallObject(handler, args);
+        TRACE_END(span, "python", event_name);
+        python_memory_enter(NULL);
+
+        if (result == NULL) {
+            python_engine_report_exception(script->name, event_name);
+            continue;
+        }
+        /* There is no event loop here to run async handlers on */
+        if (PyCoro_CheckExact(result)) {
+            PyObject* closed = PyObject_CallMethod(result, "close", NULL);
+
+            Py_XDECREF(closed);
+            PyErr_Clear();
+            log_warning("%s.%s is async, which isolated interpreters do not support", script->name, event_name);
+        }
+        Py_DECREF(result);
+    }
+    Py_XDECREF(args);
+}
+
+static void run_job(Interpreter* interpreter, InterpreterJob* job)
+{
+    switch (job->type) {
+        case JOB_EVENT:
+            deliver_isolated_event(interpreter, &job->event);
+            break;
+        case JOB_LOAD:
+            job->result = load_isolated_script(interpreter, job->argument, 1);
+            break;
+        case JOB_UNLOAD:
+            job->result = unload_isolated_script(interpreter, job->argument);
+            break;
+        case JOB_RELOAD: {
+            char path[PATH_BUFSIZE];
+            int index = find_isolated_script(interpreter, job->argument);
+
+            /* The entry holding the path is replaced by the load */
+            if (index < 0) {
+                job->result = -1;
+            } else {
+                safe_strcpy(path, sizeof(path), interpreter->scripts[index].path);
+                job->result = load_isolated_script(interpreter, path, job->force);
+            }
+            break;
+        }
+        case JOB_RELOAD_ALL:
+            job->result = reload_isolated_scripts(interpreter);
+            break;
+        case JOB_STOP:
+            while (interpreter->scriptCount > 0) {
+                unload_isolated_script(interpreter, interpreter->scripts[interpreter->scriptCount - 1].name);
+            }
+            job->result = 0;
+            break;
+    }
+}
+
+static void interpreter_main(void* arg)
+{
+    Interpreter* interpreter = (Interpreter*)arg;
+    PyInterpreterConfig config;
+    PyGILState_STATE gil;
+    PyThreadState* main_state;
+    PyThreadState* state = NULL;
+    PyStatus status;
+    PyObject* sys_path;
+    PyObject* path_str;
+    char threadName[TRACE_THREAD_NAME_BUFSIZE];
+    int stopping = 0;
+
+    /* The trace keeps a copy, since the interpreter is freed when its last script goes */
+    snprintf(threadName, sizeof(threadName), "TsPy %.*s", (int)sizeof(threadName) - 6, interpreter->name);
+    trace_set_thread_name(threadName);
+
+    memset(&config, 0, sizeof(config));
+    config.use_main_obmalloc = 0;
+    config.allow_fork = 0;
+    config.allow_exec = 0;
+    config.allow_threads = 1;
+    config.allow_daemon_threads = 0;
+    config.check_multi_interp_extensions = 1;
+    config.gil = PyInterpreterConfig_OWN_GIL;
+
+    /* Creating an interpreter needs a current thread state; the main GIL is released on success */
+    gil = PyGILState_Ensure();
+    main_state = PyThreadState_Get();
+    status = Py_NewInterpreterFromConfig(&state, &config);
+    if (PyStatus_Exception(status)) {
+        PyGILState_Release(gil);
+        log_error("Failed to create interpreter %s: %s", interpreter->name,
+                  status.err_msg != NULL ? status.err_msg : "unknown error");
+        mutex_lock(&interpreter->lock);
+        interpreter->status = INTERPRETER_FAILED;
+        cond_broadcast(&interpreter->done);
+        mutex_unlock(&interpreter->lock);
+        return;
+    }
+
+    /* Scripts import their helpers from the scripts folder, as in the main interpreter */
+    sys_path = PySys_GetObject("path");
+    path_str = PyUnicode_FromString(python_engine_get_scripts_path());
+    if (sys_path == NULL || path_str == NULL || PyList_Append(sys_path, path_str) != 0) {
+        PyErr_Clear();
+    }
+    Py_XDECREF(path_str);
+
+    mutex_lock(&interpreter->lock);
+    interpreter->status = INTERPRETER_RUNNING;
+    cond_broadcast(&interpreter->done);
+    mutex_unlock(&interpreter->lock);
+
+    while (!stopping) {
+        InterpreterJob* job;
+        PyThreadState* saved = PyEval_SaveThread();
+
+        mutex_lock(&interpreter->lock);
+        while (interpreter->head == NULL) {
+            cond_wait(&interpreter->wake, &interpreter->lock);
+        }
+        job = interpreter->head;
+        interpreter->head = job->next;
+        if (interpreter->head == NULL) {
+            interpreter->tail = NULL;
+        }
+        if (job->type == JOB_EVENT) {
+            interpreter->queued--;
+            interpreter->handled++;
+            interpreter->overflowing = 0;
+        }
+        mutex_unlock(&interpreter->lock);
+
+        PyEval_RestoreThread(saved);
+        run_job(interpreter, job);
+
+        if (job->type == JOB_EVENT) {
+            free(job);
+            continue;
+        }
+        stopping = job->type == JOB_STOP;
+        mutex_lock(&interpreter->lock);
+        job->done = 1;
+        cond_broadcast(&interpreter->done);
+        mutex_unlock(&interpreter->lock);
+    }
+
+    Py_EndInterpreter(state);
+    PyEval_RestoreThread(main_state);
+    PyGILState_Release(gil);
+}
+
+/* Caller side (no GIL) */
+
+/* Queue a control job and wait for the worker to finish it */
+static int run_control_job(Interpreter* interpreter, InterpreterJob* job)
+{
+    job->next = NULL;
+    job->done = 0;
+    job->result = 0;
+
+    mutex_lock(&interpreter->lock);
+    if (interpreter->tail != NULL) {
+        interpreter->tail->next = job;
+    } else {
+        interpreter->head = job;
+    }
+    interpreter->tail = job;
+    cond_signal(&interpreter->wake);
+    while (!job->done) {
+        cond_wait(&interpreter->done, &interpreter->lock);
+    }
+    mutex_unlock(&interpreter->lock);
+    return job->result;
+}
+
+static void free_interpreter(Interpreter* interpreter)
+{
+    while (interpreter->head != NULL) {
+        InterpreterJob* job = interpreter->head;
+
+        interpreter->head = job->next;
+        free(job);
+    }
+    cond_destroy(&interpreter->done);
+    cond_destroy(&interpreter->wake);
+    mutex_destroy(&interpreter->lock);
+    free(interpreter->scripts);
+    free(interpreter);
+}
+
+/* Start an interpreter and add it to the table (g_control held); NULL on failure */
+static Interpreter* start_interpreter(const char* name)
+{
+    Interpreter* interpreter;
+    InterpreterStatus status;
+
+    if (g_interpreter_count >= INTERPRETER_MAX) {
+        log_error("Cannot create interpreter %s: at most %d isolated interpreters", name, INTERPRETER_MAX);
+        return NULL;
+    }
+
+    interpreter = (Interpreter*)calloc(1, sizeof(Interpreter));
+    if (interpreter == NULL) {
+        log_error("Out of memory creating interpreter %s", name);
+        return NULL;
+    }
+    safe_strcpy(interpreter->name, sizeof(interpreter->name), name);
+    mutex_init(&interpreter->lock);
+    cond_init(&interpreter->wake);
+    cond_init(&interpreter->done);
+    interpreter->status = INTERPRETER_STARTING;
+
+    if (thread_create(&interpreter->thread, interpreter_main, interpreter) != 0) {
+        log_error("Failed to start the thread for interpreter %s", name);
+        free_interpreter(interpreter);
+        return NULL;
+    }
+
+    mutex_lock(&interpreter->lock);
+    while (interpreter->status == INTERPRETER_STARTING) {
+        cond_wait(&interpreter->done, &interpreter->lock);
+    }
+    status = interpreter->status;
+    mutex_unlock(&interpreter->lock);
+
+    if (status == INTERPRETER_FAILED) {
+        thread_join(interpreter->thread);
+        free_interpreter(interpreter);
+        return NULL;
+    }
+
+    mutex_lock(&g_lock);
+    g_interpreters[g_interpreter_count++] = interpreter;
+    atomic32_store(&g_count, (int32_t)g_interpreter_count);
+    mutex_unlock(&g_lock);
+    log_info("Started isolated interpreter %s", name);
+    return interpreter;
+}
+
+/* Take an interpreter out of the table, unload its scripts and end it (g_control held) */
+static void stop_interpreter(Interpreter* interpreter)
+{
+    InterpreterJob job;
+    size_t i;
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count; i++) {
+        if (g_interpreters[i] == interpreter) {
+            g_interpreters[i] = g_interpreters[--g_interpreter_count];
+            break;
+        }
+    }
+    atomic32_store(&g_count, (int32_t)g_interpreter_count);
+    mutex_unlock(&g_lock);
+
+    memset(&job, 0, sizeof(job));
+    job.type = JOB_STOP;
+    run_control_job(interpreter, &job);
+    thread_join(interpreter->thread);
+
+    if (interpreter->dropped > 0) {
+        log_warning("Interpreter %s dropped %llu event(s) in total", interpreter->name,
+                    (unsigned long long)interpreter->dropped);
+    }
+    log_info("Stopped isolated interpreter %s", interpreter->name);
+    free_interpreter(interpreter);
+}
+
+static Interpreter* find_interpreter(const char* name)
+{
+    Interpreter* found = NULL;
+    size_t i;
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count && found == NULL; i++) {
+        if (strcmp(g_interpreters[i]->name, name) == 0) {
+            found = g_interpreters[i];
+        }
+    }
+    mutex_unlock(&g_lock);
+    return found;
+}
+
+/* Interpreter running a script (g_control held); name is already bare */
+static Interpreter* find_script_owner(const char* name)
+{
+    Interpreter* found = NULL;
+    size_t i;
+    size_t j;
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count && found == NULL; i++) {
+        Interpreter* interpreter = g_interpreters[i];
+
+        mutex_lock(&interpreter->lock);
+        for (j = 0; j < interpreter->scriptCount; j++) {
+            if (strcmp(interpreter->scripts[j].name, name) == 0) {
+                found = interpreter;
+                break;
+            }
+        }
+        mutex_unlock(&interpreter->lock);
+    }
+    mutex_unlock(&g_lock);
+    return found;
+}
+
+static size_t script_count(Interpreter* interpreter)
+{
+    size_t count;
+
+    mutex_lock(&interpreter->lock);
+    count = interpreter->scriptCount;
+    mutex_unlock(&interpreter->lock);
+    return count;
+}
+
+void python_interpreters_init(void)
+{
+    if (!g_initialized) {
+        mutex_init(&g_control);
+        mutex_init(&g_lock);
+        g_initialized = 1;
+    }
+}
+
+int python_interpreters_supported(void)
+{
+    return 1;
+}
+
+int python_interpreters_load(const char* interpreter_name, const char* script_path)
+{
+    char name[SCRIPT_NAME_BUFSIZE];
+    Interpreter* interpreter;
+    Interpreter* owner;
+    InterpreterJob job;
+    int result;
+
+    if (!g_initialized) {
+        return 1;
+    }
+    if (strlen(interpreter_name) >= SCRIPT_NAME_BUFSIZE) {
+        log_error("Interpreter name too long: %s", interpreter_name);
+        return 1;
+    }
+
+    python_engine_script_name(script_path, name, sizeof(name));
+    mutex_lock(&g_control);
+
+    /* A script runs in one interpreter at a time */
+    owner = find_script_owner(name);
+    interpreter = find_interpreter(interpreter_name);
+    if (owner != NULL && owner != interpreter) {
+        memset(&job, 0, sizeof(job));
+        job.type = JOB_UNLOAD;
+        job.argument = name;
+        run_control_job(owner, &job);
+        if (script_count(owner) == 0) {
+            stop_interpreter(owner);
+        }
+    }
+
+    if (interpreter == NULL && (interpreter = start_interpreter(interpreter_name)) == NULL) {
+        mutex_unlock(&g_control);
+        return 1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.type = JOB_LOAD;
+    job.argument = script_path;
+    result = run_control_job(interpreter, &job);
+    if (script_count(interpreter) == 0) {
+        stop_interpreter(interpreter);
+    }
+
+    mutex_unlock(&g_control);
+    return result;
+}
+
+int python_interpreters_unload(const char* name)
+{
+    char bare[SCRIPT_NAME_BUFSIZE];
+    Interpreter* owner;
+    InterpreterJob job;
+    int result = 1;
+
+    if (!g_initialized || atomic32_load(&g_count) == 0) {
+        return 1;
+    }
+
+    python_engine_script_name(name, bare, sizeof(bare));
+    mutex_lock(&g_control);
+    owner = find_script_owner(bare);
+    if (owner != NULL) {
+        memset(&job, 0, sizeof(job));
+        job.type = JOB_UNLOAD;
+        job.argument = bare;
+        result = run_control_job(owner, &job);
+        if (script_count(owner) == 0) {
+            stop_interpreter(owner);
+        }
+    }
+    mutex_unlock(&g_control);
+    return result;
+}
+
+int python_interpreters_reload(const char* name, int force)
+{
+    char bare[SCRIPT_NAME_BUFSIZE];
+    Interpreter* owner;
+    InterpreterJob job;
+    int result = -1;
+
+    if (!g_initialized || atomic32_load(&g_count) == 0) {
+        return -1;
+    }
+
+    python_engine_script_name(name, bare, sizeof(bare));
+    mutex_lock(&g_control);
+    owner = find_script_owner(bare);
+    if (owner != NULL) {
+        memset(&job, 0, sizeof(job));
+        job.type = JOB_RELOAD;
+        job.argument = bare;
+        job.force = force;
+        result = run_control_job(owner, &job);
+    }
+    mutex_unlock(&g_control);
+    return result;
+}
+
+int python_interpreters_reload_all(void)
+{
+    Interpreter* interpreters[INTERPRETER_MAX];
+    InterpreterJob job;
+    size_t count;
+    size_t i;
+    int failures = 0;
+
+    if (!g_initialized || atomic32_load(&g_count) == 0) {
+        return 0;
+    }
+
+    mutex_lock(&g_control);
+    mutex_lock(&g_lock);
+    count = g_interpreter_count;
+    memcpy(interpreters, g_interpreters, count * sizeof(Interpreter*));
+    mutex_unlock(&g_lock);
+
+    for (i = 0; i < count; i++) {
+        memset(&job, 0, sizeof(job));
+        job.type = JOB_RELOAD_ALL;
+        failures += run_control_job(interpreters[i], &job);
+    }
+    mutex_unlock(&g_control);
+    return failures;
+}
+
+int python_interpreters_find(const char* name, char* interpreter, size_t size)
+{
+    char bare[SCRIPT_NAME_BUFSIZE];
+    size_t i;
+    size_t j;
+    int found = 0;
+
+    if (!g_initialized || atomic32_load(&g_count) == 0) {
+        return 0;
+    }
+
+    python_engine_script_name(name, bare, sizeof(bare));
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count && !found; i++) {
+        Interpreter* candidate = g_interpreters[i];
+
+        mutex_lock(&candidate->lock);
+        for (j = 0; j < candidate->scriptCount; j++) {
+            if (strcmp(candidate->scripts[j].name, bare) == 0) {
+                safe_strcpy(interpreter, size, candidate->name);
+                found = 1;
+                break;
+            }
+        }
+        mutex_unlock(&candidate->lock);
+    }
+    mutex_unlock(&g_lock);
+    return found;
+}
+
+void python_interpreters_post(const PythonEvent* event)
+{
+    size_t size;
+    size_t i;
+
+    if (!g_initialized || atomic32_load(&g_count) == 0) {
+        return;
+    }
+
+    size = python_event_copy_size(event);
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count; i++) {
+        Interpreter* interpreter = g_interpreters[i];
+        InterpreterJob* job = (InterpreterJob*)malloc(sizeof(InterpreterJob) + size);
+
+        if (job != NULL) {
+            memset(job, 0, sizeof(InterpreterJob));
+            job->type = JOB_EVENT;
+            python_event_copy(&job->event, event, (char*)(job + 1));
+        }
+
+        mutex_lock(&interpreter->lock);
+        if (job == NULL || interpreter->queued >= INTERPRETER_QUEUE_MAX) {
+            interpreter->dropped++;
+            if (!interpreter->overflowing) {
+                interpreter->overflowing = 1;
+                log_warning("Interpreter %s is falling behind; dropping events", interpreter->name);
+            }
+            free(job);
+        } else {
+            if (interpreter->tail != NULL) {
+                interpreter->tail->next = job;
+            } else {
+                interpreter->head = job;
+            }
+            interpreter->tail = job;
+            interpreter->queued++;
+            cond_signal(&interpreter->wake);
+        }
+        mutex_unlock(&interpreter->lock);
+    }
+    mutex_unlock(&g_lock);
+}
+
+size_t python_interpreters_count(void)
+{
+    return (size_t)atomic32_load(&g_count);
+}
+
+size_t python_interpreters_list(InterpreterInfo* info, size_t max)
+{
+    size_t count = 0;
+    size_t i;
+
+    if (!g_initialized) {
+        return 0;
+    }
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count && count < max; i++) {
+        Interpreter* interpreter = g_interpreters[i];
+        InterpreterInfo* entry = &info[count++];
+
+        mutex_lock(&interpreter->lock);
+        safe_strcpy(entry->name, sizeof(entry->name), interpreter->name);
+        entry->scripts = interpreter->scriptCount;
+        entry->queued = interpreter->queued;
+        entry->handled = interpreter->handled;
+        entry->dropped = interpreter->dropped;
+        mutex_unlock(&interpreter->lock);
+    }
+    mutex_unlock(&g_lock);
+    return count;
+}
+
+size_t python_interpreters_scripts(const char* interpreter_name, char (*names)[SCRIPT_NAME_BUFSIZE], size_t max)
+{
+    size_t count = 0;
+    size_t i;
+
+    if (!g_initialized) {
+        return 0;
+    }
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_interpreter_count; i++) {
+        Interpreter* interpreter = g_interpreters[i];
+
+        if (strcmp(interpreter->name, interpreter_name) == 0) {
+            mutex_lock(&interpreter->lock);
+            for (count = 0; count < interpreter->scriptCount && count < max; count++) {
+                safe_strcpy(names[count], sizeof(names[count]), interpreter->scripts[count].name);
+            }
+            mutex_unlock(&interpreter->lock);
+            break;
+        }
+    }
+    mutex_unlock(&g_lock);
+    return count;
+}
+
+void python_interpreters_stop(void)
+{
+    if (!g_initialized) {
+        return;
+    }
+
+    mutex_lock(&g_control);
+    while (atomic32_load(&g_count) > 0) {
+        Interpreter* interpreter;
+
+        mutex_lock(&g_lock);
+        interpreter = g_interpreters[g_interpreter_count - 1];
+        mutex_unlock(&g_lock);
+        stop_interpreter(interpreter);
+    }
+    mutex_unlock(&g_control);
+}
+
+#else /* PY_VERSION_HEX < 0x030C0000 */
+
+/* Without per-interpreter GILs every script runs in the main interpreter */
+
+void python_interpreters_init(void)
+{
+}
+
+int python_interpreters_supported(void)
+{
+    return 0;
+}
+
+int python_interpreters_load(const char* interpreter, const char* script_path)
+{
+    (void)interpreter; /* Unused parameter */
+    log_error("Cannot load %s in an isolated interpreter: needs Python 3.12 or newer", script_path);
+    return 1;
+}
+
+int python_interpreters_unload(const char* name)
+{
+    (void)name; /* Unused parameter */
+    return 1;
+}
+
+int python_interpreters_reload(const char* name, int force)
+{
+    (void)name;  /* Unused parameter */
+    (void)force; /* Unused parameter */
+    return -1;
+}
+
+int python_interpreters_reload_all(void)
+{
+    return 0;
+}
+
+int python_interpreters_find(const char* name, char* interpreter, size_t size)
+{
+    (void)name;        /* Unused parameter */
+    (void)interpreter; /* Unused parameter */
+    (void)size;        /* Unused parameter */
+    return 0;
+}
+
+void python_interpreters_post(const PythonEvent* event)
+{
+    (void)event; /* Unused parameter */
+}
+
+size_t python_interpreters_count(void)
+{
+    return 0;
+}
+
+size_t python_interpreters_list(InterpreterInfo* info, size_t max)
+{
+    (void)info; /* Unused parameter */
+    (void)max;  /* Unused parameter */
+    return 0;
+}
+
+size_t python_interpreters_scripts(const char* interpreter, char (*names)[SCRIPT_NAME_BUFSIZE], size_t max)
+{
+    (void)interpreter; /* Unused parameter */
+    (void)names;       /* Unused parameter */
+    (void)max;         /* Unused parameter */
+    return 0;
+}
+
+void python_interpreters_stop(void)
+{
+}
+
+#endif /* PY_VERSION_HEX >= 0x030C0000 */
@@ -0,0 +1,145 @@
+/**
+ * @file python_interpreters.h
+ * @brief Isolated interpreters: script groups with their own GIL and thread
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * On Python 3.12 and newer a group of scripts can run in a subinterpreter
+ * with its own GIL, so a CPU-heavy script no longer holds up the others.
+ * Each interpreter has one worker thread and an event queue: every event is
+ * copied to every interpreter and handled there in arrival order, in
+ * parallel with the main interpreter and each other.
+ *
+ * Isolated scripts receive events through their on_* functions and may call
+ * the parts of ts3api that need no state shared with the main interpreter.
+ * Requests they send are not awaitable, and @ts3api.on, triggers, timers,
+ * tasks and ts3api.store are only available in the main interpreter.
+ */
+
+#ifndef PYTHON_INTERPRETERS_H
+#define PYTHON_INTERPRETERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "python_engine.h"
+#include "python_events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Most isolated interpreters
+ */
+#define INTERPRETER_MAX 8
+
+/**
+ * @brief Most events queued for one interpreter; later ones are dropped
+ */
+#define INTERPRETER_QUEUE_MAX 4096
+
+/**
+ * @brief State of one isolated interpreter
+ */
+typedef struct InterpreterInfo {
+    char     name[SCRIPT_NAME_BUFSIZE];
+    size_t   scripts;     /* Scripts loaded */
+    size_t   queued;      /* Events waiting */
+    uint64_t handled;     /* Events taken off the queue */
+    uint64_t dropped;     /* Events dropped because the queue was full */
+} InterpreterInfo;
+
+/**
+ * @brief Prepare the interpreter table (GIL held, at engine start)
+ */
+void python_interpreters_init(void);
+
+/**
+ * @brief Whether this Python build supports interpreters with their own GIL
+ * @return 1 on Python 3.12 and newer, 0 otherwise
+ */
+int python_interpreters_supported(void);
+
+/**
+ * @brief Load (or replace) a script in an isolated interpreter, creating it if needed
+ * @param interpreter Interpreter name
+ * @param script_path Script file
+ * @return 0 on success, non-zero on failure (logged)
+ * @note Call without the GIL; waits until the script ran on the interpreter's thread
+ */
+int python_interpreters_load(const char* interpreter, const char* script_path);
+
+/**
+ * @brief Unload a script from whichever isolated interpreter has it
+ * @param name Script name, with or without ".py"
+ * @return 0 if unloaded, 1 if no interpreter has it
+ * @note Call without the GIL
+ */
+int python_interpreters_unload(const char* name);
+
+/**
+ * @brief Reload a script from whichever isolated interpreter has it
+ * @param name Script name, with or without ".py"
+ * @param force 0 to skip the reload if the file is unchanged
+ * @return 0 if reloaded or unchanged, 1 if the new version failed, -1 if no interpreter has it
+ * @note Call without the GIL
+ */
+int python_interpreters_reload(const char* name, int force);
+
+/**
+ * @brief Reload every script in every isolated interpreter
+ * @return Number of scripts that failed
+ * @note Call without the GIL
+ */
+int python_interpreters_reload_all(void);
+
+/**
+ * @brief Name of the isolated interpreter running a script
+ * @param name Script name, with or without ".py"
+ * @param interpreter Receives the interpreter name
+ * @param size Size of interpreter
+ * @return 1 if found, 0 otherwise
+ */
+int python_interpreters_find(const char* name, char* interpreter, size_t size);
+
+/**
+ * @brief Copy an event to every isolated interpreter's queue
+ * @param event Event; its strings are copied
+ * @note Any thread; does not need the GIL
+ */
+void python_interpreters_post(const PythonEvent* event);
+
+/**
+ * @brief Number of isolated interpreters running
+ */
+size_t python_interpreters_count(void);
+
+/**
+ * @brief Describe the isolated interpreters
+ * @param info Receives up to max entries
+ * @param max Capacity of info
+ * @return Number of entries written
+ */
+size_t python_interpreters_list(InterpreterInfo* info, size_t max);
+
+/**
+ * @brief Names of the scripts in one isolated interpreter
+ * @param interpreter Interpreter name
+ * @param names Receives up to max names
+ * @param max Capacity of names
+ * @return Number of names written
+ */
+size_t python_interpreters_scripts(const char* interpreter, char (*names)[SCRIPT_NAME_BUFSIZE], size_t max);
+
+/**
+ * @brief Unload everything and end all isolated interpreters
+ * @note Call without the GIL, before the main thread takes it back for shutdown
+ */
+void python_interpreters_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_INTERPRETERS_H */
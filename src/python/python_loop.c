@@ -0,0 +1,604 @@
+/**
+ * @file python_loop.c
+ * @brief Plugin-owned asyncio event loop implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * The pending queues are Python lists guarded by the GIL (and the engine
+ * state lock, since the queues themselves are swapped). A submission that
+ * finds both empty wakes the loop with call_soon_threadsafe(), which writes
+ * to the loop's self-pipe; the drain callback then runs every queued call
+ * and starts every queued coroutine in one pass. Each task runs in its own
+ * contextvars context carrying the owning (script, generation), so ts3api
+ * registrations made by coroutines belong to the right script.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <string.h>
+
+#include "python_loop.h"
+#include "python_engine.h"
+#include "utils/logging.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+static PyObject* g_loop = NULL;       /* asyncio event loop */
+static PyObject* g_pending = NULL;    /* [(coroutine, (script, generation)), ...] */
+static PyObject* g_calls = NULL;      /* [(callable, args), ...] */
+static PyObject* g_tasks = NULL;      /* {task: (script, generation)} */
+static PyObject* g_owner_var = NULL;  /* ContextVar holding (script, generation) */
+static PyObject* g_drain = NULL;
+static PyObject* g_task_done = NULL;
+static PyObject* g_cancel_tasks = NULL;
+static PyObject* g_resolve = NULL;
+static Thread    g_thread;
+static int       g_running = 0;
+
+static volatile int64_t g_task_count = 0;
+static volatile int64_t g_submitted = 0;
+static volatile int64_t g_wakeups = 0;
+static volatile int64_t g_failed = 0;
+
+static int owner_matches(PyObject* owner, const char* script, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    const char* name = PyUnicode_AsUTF8(PyTuple_GET_ITEM(owner, 0));
+    unsigned long generation = PyLong_AsUnsignedLong(PyTuple_GET_ITEM(owner, 1));
+
+    return name != NULL && strcmp(name, script) == 0
+           && generation >= minGeneration && generation <= maxGeneration;
+}
+
+static const char* owner_script(PyObject* owner)
+{
+    const char* name = owner != NULL ? PyUnicode_AsUTF8(PyTuple_GET_ITEM(owner, 0)) : NULL;
+    return name != NULL ? name : "";
+}
+
+/* Start one queued coroutine as a task; loop thread, GIL held */
+static void start_task(PyObject* coroutine, PyObject* owner)
+{
+    PyObject* context;
+    PyObject* token;
+    PyObject* createTask;
+    PyObject* args = NULL;
+    PyObject* kwargs = NULL;
+    PyObject* task = NULL;
+    PyObject* result;
+
+    /* A fresh context per task, entered by the loop around every step */
+    context = PyContext_New();
+    if (context == NULL || PyContext_Enter(context) != 0) {
+        Py_XDECREF(context);
+        goto fail;
+    }
+    token = PyContextVar_Set(g_owner_var, owner);
+    PyContext_Exit(context);
+    if (token == NULL) {
+        Py_DECREF(context);
+        goto fail;
+    }
+    Py_DECREF(token);
+
+    createTask = PyObject_GetAttrString(g_loop, "create_task");
+#if PY_VERSION_HEX >= 0x030B0000
+    args = PyTuple_Pack(1, coroutine);
+    kwargs = Py_BuildValue("{s:N}", "context", context);
+    if (createTask != NULL && args != NULL && kwargs != NULL) {
+        task = PyObject_Call(createTask, args, kwargs);
+    }
+#else
+    /* create_task has no context argument before 3.11; the task copies the context it is created in */
+    if (createTask != NULL) {
+        task = PyObject_CallMethod(context, "run", "OO", createTask, coroutine);
+    }
+    Py_DECREF(context);
+#endif
+    Py_XDECREF(createTask);
+    Py_XDECREF(args);
+    Py_XDECREF(kwargs);
+    if (task == NULL || PyDict_SetItem(g_tasks, task, owner) != 0) {
+        Py_XDECREF(task);
+        goto fail;
+    }
+
+    atomic64_add(&g_task_count, 1);
+    result = PyObject_CallMethod(task, "add_done_callback", "O", g_task_done);
+    if (result == NULL) {
+        python_engine_report_exception(owner_script(owner), "task");
+    }
+    Py_XDECREF(result);
+    Py_DECREF(task);
+    return;
+
+fail:
+    python_engine_report_exception(owner_script(owner), "task");
+    /* Never started: close it so Python does not warn it was never awaited */
+    result = PyObject_CallMethod(coroutine, "close", NULL);
+    if (result == NULL) {
+        PyErr_Clear();
+    }
+    Py_XDECREF(result);
+}
+
+/* call_soon_threadsafe target: start everything queued since the last wake-up */
+static PyObject* loop_drain(PyObject* self, PyObject* unused)
+{
+    PyObject* pending;
+    PyObject* calls;
+    Py_ssize_t i;
+
+    (void)self;   /* Unused parameter */
+    (void)unused; /* Unused parameter */
+
+    python_engine_lock_state();
+    pending = g_pending;
+    calls = g_calls;
+    g_pending = PyList_New(0);
+    g_calls = PyList_New(0);
+    if (g_pending == NULL || g_calls == NULL) {
+        Py_XSETREF(g_pending, pending);
+        Py_XSETREF(g_calls, calls);
+        python_engine_unlock_state();
+        return NULL;
+    }
+    python_engine_unlock_state();
+
+    TRACE_BEGIN(span);
+    for (i = 0; i < PyList_GET_SIZE(calls); i++) {
+        PyObject* entry = PyList_GET_ITEM(calls, i);
+        PyObject* result = PyObject_Call(PyTuple_GET_ITEM(entry, 0), PyTuple_GET_ITEM(entry, 1), NULL);
+
+        if (result == NULL) {
+            python_engine_report_exception("", "asyncio");
+        }
+        Py_XDECREF(result);
+    }
+    for (i = 0; i < PyList_GET_SIZE(pending); i++) {
+        PyObject* entry = PyList_GET_ITEM(pending, i);
+        start_task(PyTuple_GET_ITEM(entry, 0), PyTuple_GET_ITEM(entry, 1));
+    }
+    TRACE_END(span, "asyncio", "drain");
+
+    Py_DECREF(pending);
+    Py_DECREF(calls);
+    Py_RETURN_NONE;
+}
+
+/* Done callback of every task: forget it and log an unhandled exception */
+static PyObject* loop_task_done(PyObject* self, PyObject* task)
+{
+    PyObject* owner;
+    PyObject* cancelled;
+    PyObject* exception;
+
+    (void)self; /* Unused parameter */
+
+    owner = PyDict_GetItemWithError(g_tasks, task);
+    if (owner == NULL) {
+        if (PyErr_Occurred()) {
+            return NULL;
+        }
+        Py_RETURN_NONE;
+    }
+    Py_INCREF(owner);
+    PyDict_DelItem(g_tasks, task);
+    atomic64_add(&g_task_count, -1);
+
+    cancelled = PyObject_CallMethod(task, "cancelled", NULL);
+    if (cancelled != NULL && !PyObject_IsTrue(cancelled)) {
+        exception = PyObject_CallMethod(task, "exception", NULL);
+        if (exception != NULL && exception != Py_None) {
+            PyErr_SetObject((PyObject*)Py_TYPE(exception), exception);
+            python_engine_report_exception(owner_script(owner), "task");
+            atomic64_add(&g_failed, 1);
+        }
+        Py_XDECREF(exception);
+    }
+    Py_XDECREF(cancelled);
+    Py_DECREF(owner);
+
+    if (PyErr_Occurred()) {
+        PyErr_Clear();
+    }
+    Py_RETURN_NONE;
+}
+
+/* call_soon_threadsafe target: cancel a script's tasks (Task.cancel is not thread-safe) */
+static PyObject* loop_cancel_tasks(PyObject* self, PyObject* args)
+{
+    const char* script;
+    unsigned int minGeneration;
+    unsigned int maxGeneration;
+    PyObject* items;
+    Py_ssize_t i;
+    int cancelled = 0;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "sII", &script, &minGeneration, &maxGeneration)) {
+        return NULL;
+    }
+
+    items = PyDict_Items(g_tasks);
+    if (items == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject* item = PyList_GET_ITEM(items, i);
+        PyObject* result;
+
+        if (!owner_matches(PyTuple_GET_ITEM(item, 1), script, minGeneration, maxGeneration)) {
+            continue;
+        }
+        result = PyObject_CallMethod(PyTuple_GET_ITEM(item, 0), "cancel", NULL);
+        if (result == NULL) {
+            PyErr_Clear();
+        }
+        Py_XDECREF(result);
+        cancelled++;
+    }
+    Py_DECREF(items);
+
+    if (cancelled > 0) {
+        log_debug("Cancelled %d task(s) of %s", cancelled, script);
+    }
+    Py_RETURN_NONE;
+}
+
+/* call_soon target: complete a future unless it was cancelled meanwhile */
+static PyObject* loop_resolve(PyObject* self, PyObject* args)
+{
+    PyObject* future;
+    PyObject* value;
+    PyObject* done;
+    PyObject* result;
+    int isDone;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "OO", &future, &value)) {
+        return NULL;
+    }
+
+    done = PyObject_CallMethod(future, "done", NULL);
+    if (done == NULL) {
+        return NULL;
+    }
+    isDone = PyObject_IsTrue(done);
+    Py_DECREF(done);
+    if (isDone) {
+        Py_RETURN_NONE;
+    }
+
+    if (PyExceptionInstance_Check(value)) {
+        result = PyObject_CallMethod(future, "set_exception", "O", value);
+        if (result != NULL) {
+            /* Mark it retrieved: a future nobody awaits must not log a traceback */
+            Py_DECREF(result);
+            result = PyObject_CallMethod(future, "exception", NULL);
+        }
+    } else {
+        result = PyObject_CallMethod(future, "set_result", "O", value);
+    }
+    return result;
+}
+
+static PyMethodDef DrainDef = {"_drain", loop_drain, METH_NOARGS, NULL};
+static PyMethodDef TaskDoneDef = {"_task_done", loop_task_done, METH_O, NULL};
+static PyMethodDef CancelTasksDef = {"_cancel_tasks", loop_cancel_tasks, METH_VARARGS, NULL};
+static PyMethodDef ResolveDef = {"_resolve", loop_resolve, METH_VARARGS, NULL};
+
+/* Cancel what is left at shutdown and give the tasks a chance to clean up */
+static void cancel_remaining_tasks(void)
+{
+    PyObject* tasks = PyDict_Keys(g_tasks);
+    PyObject* gather = NULL;
+    PyObject* awaitable = NULL;
+    PyObject* kwargs = NULL;
+    PyObject* result;
+    Py_ssize_t i;
+
+    if (tasks == NULL || PyList_GET_SIZE(tasks) == 0) {
+        Py_XDECREF(tasks);
+        PyErr_Clear();
+        return;
+    }
+
+    for (i = 0; i < PyList_GET_SIZE(tasks); i++) {
+        result = PyObject_CallMethod(PyList_GET_ITEM(tasks, i), "cancel", NULL);
+        Py_XDECREF(result);
+    }
+    PyErr_Clear();
+
+    gather = PyImport_ImportModule("asyncio");
+    if (gather != NULL) {
+        Py_SETREF(gather, PyObject_GetAttrString(gather, "gather"));
+    }
+    Py_SETREF(tasks, PyList_AsTuple(tasks));
+    kwargs = Py_BuildValue("{s:O}", "return_exceptions", Py_True);
+    if (gather != NULL && tasks != NULL && kwargs != NULL) {
+        awaitable = PyObject_Call(gather, tasks, kwargs);
+    }
+    if (awaitable != NULL) {
+        result = PyObject_CallMethod(g_loop, "run_until_complete", "O", awaitable);
+        Py_XDECREF(result);
+    }
+    if (PyErr_Occurred()) {
+        python_engine_report_exception("", "asyncio");
+    }
+
+    Py_XDECREF(awaitable);
+    Py_XDECREF(kwargs);
+    Py_XDECREF(tasks);
+    Py_XDECREF(gather);
+}
+
+static void loop_main(void* arg)
+{
+    PyGILState_STATE gil;
+    PyObject* asyncio;
+    PyObject* result = NULL;
+
+    (void)arg; /* Unused parameter */
+
+    trace_set_thread_name("TsPy asyncio");
+
+    /* run_forever() releases the GIL whenever the loop waits for I/O */
+    gil = PyGILState_Ensure();
+    asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio != NULL) {
+        result = PyObject_CallMethod(asyncio, "set_event_loop", "O", g_loop);
+        Py_XDECREF(result);
+        result = PyObject_CallMethod(g_loop, "run_forever", NULL);
+    }
+    if (result == NULL) {
+        python_engine_report_exception("", "asyncio");
+    }
+    Py_XDECREF(result);
+
+    cancel_remaining_tasks();
+    result = PyObject_CallMethod(g_loop, "close", NULL);
+    if (result == NULL) {
+        python_engine_report_exception("", "asyncio");
+    }
+    Py_XDECREF(result);
+    Py_XDECREF(asyncio);
+
+    PyGILState_Release(gil);
+}
+
+static void clear_state(void)
+{
+    Py_CLEAR(g_loop);
+    Py_CLEAR(g_pending);
+    Py_CLEAR(g_calls);
+    Py_CLEAR(g_tasks);
+    Py_CLEAR(g_owner_var);
+    Py_CLEAR(g_drain);
+    Py_CLEAR(g_task_done);
+    Py_CLEAR(g_cancel_tasks);
+    Py_CLEAR(g_resolve);
+}
+
+int python_loop_init(void)
+{
+    PyObject* asyncio;
+
+    if (g_running) {
+        return 0;
+    }
+
+    /* Created here so coroutines can be queued before the thread starts running it */
+    asyncio = PyImport_ImportModule("asyncio");
+    if (asyncio != NULL) {
+        g_loop = PyObject_CallMethod(asyncio, "new_event_loop", NULL);
+        Py_DECREF(asyncio);
+    }
+    g_pending = PyList_New(0);
+    g_calls = PyList_New(0);
+    g_tasks = PyDict_New();
+    g_owner_var = PyContextVar_New("ts3api_script", NULL);
+    g_drain = PyCFunction_New(&DrainDef, NULL);
+    g_task_done = PyCFunction_New(&TaskDoneDef, NULL);
+    g_cancel_tasks = PyCFunction_New(&CancelTasksDef, NULL);
+    g_resolve = PyCFunction_New(&ResolveDef, NULL);
+
+    if (g_loop == NULL || g_pending == NULL || g_calls == NULL || g_tasks == NULL || g_owner_var == NULL
+        || g_drain == NULL || g_task_done == NULL || g_cancel_tasks == NULL || g_resolve == NULL) {
+        python_engine_report_exception("", "asyncio");
+        clear_state();
+        return 1;
+    }
+
+    if (thread_create(&g_thread, loop_main, NULL) != 0) {
+        log_error("Failed to start the asyncio thread");
+        clear_state();
+        return 1;
+    }
+
+    g_running = 1;
+    log_info("asyncio event loop started");
+    return 0;
+}
+
+int python_loop_is_coroutine(PyObject* object)
+{
+    return object != NULL && PyCoro_CheckExact(object);
+}
+
+/*
+ * Append to a queue (&g_pending or &g_calls, read under the lock because the
+ * drain swaps the lists); only the first entry since the last drain wakes the loop
+ */
+static int enqueue(PyObject** queue, PyObject* entry)
+{
+    PyObject* result;
+    int wake;
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    python_engine_lock_state();
+    wake = PyList_GET_SIZE(g_pending) == 0 && PyList_GET_SIZE(g_calls) == 0;
+    if (PyList_Append(*queue, entry) != 0) {
+        python_engine_unlock_state();
+        Py_DECREF(entry);
+        return -1;
+    }
+    python_engine_unlock_state();
+    Py_DECREF(entry);
+
+    if (wake) {
+        result = PyObject_CallMethod(g_loop, "call_soon_threadsafe", "O", g_drain);
+        if (result == NULL) {
+            return -1;
+        }
+        Py_DECREF(result);
+        atomic64_add(&g_wakeups, 1);
+    }
+    return 0;
+}
+
+int python_loop_submit(PyObject* coroutine, const char* script, unsigned int generation)
+{
+    if (!g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return -1;
+    }
+
+    if (enqueue(&g_pending, Py_BuildValue("(O(sI))", coroutine, script != NULL ? script : "", generation)) != 0) {
+        return -1;
+    }
+    atomic64_add(&g_submitted, 1);
+    return 0;
+}
+
+int python_loop_call_soon(PyObject* callable, PyObject* args)
+{
+    if (!g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return -1;
+    }
+
+    return enqueue(&g_calls, Py_BuildValue("(OO)", callable, args));
+}
+
+int python_loop_resolve(PyObject* future, PyObject* value)
+{
+    if (!g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return -1;
+    }
+
+    return enqueue(&g_calls, Py_BuildValue("(O(OO))", g_resolve, future, value));
+}
+
+void python_loop_get_task_script(ScriptContext* context)
+{
+    PyObject* owner = NULL;
+
+    context->script = NULL;
+    context->generation = 0;
+
+    if (g_owner_var == NULL || PyContextVar_Get(g_owner_var, NULL, &owner) != 0 || owner == NULL) {
+        PyErr_Clear();
+        return;
+    }
+
+    /* The task's context keeps the tuple, and with it the name, alive */
+    context->script = owner_script(owner);
+    context->generation = (unsigned int)PyLong_AsUnsignedLong(PyTuple_GET_ITEM(owner, 1));
+    Py_DECREF(owner);
+}
+
+void python_loop_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    PyObject* pending;
+    PyObject* result;
+    Py_ssize_t i;
+
+    if (!g_running) {
+        return;
+    }
+
+    /* Drop queued coroutines that have not become tasks yet */
+    pending = PyList_New(0);
+    if (pending == NULL) {
+        PyErr_Clear();
+        return;
+    }
+    for (i = 0; i < PyList_GET_SIZE(g_pending); i++) {
+        PyObject* entry = PyList_GET_ITEM(g_pending, i);
+
+        if (owner_matches(PyTuple_GET_ITEM(entry, 1), script, minGeneration, maxGeneration)) {
+            result = PyObject_CallMethod(PyTuple_GET_ITEM(entry, 0), "close", NULL);
+            Py_XDECREF(result);
+        } else {
+            PyList_Append(pending, entry);
+        }
+    }
+    PyErr_Clear();
+    /* An emptied queue stays empty, so the next submission still wakes the loop */
+    python_engine_lock_state();
+    Py_SETREF(g_pending, pending);
+    python_engine_unlock_state();
+
+    result = PyObject_CallMethod(g_loop, "call_soon_threadsafe", "OsII", g_cancel_tasks,
+                                 script, minGeneration, maxGeneration);
+    if (result == NULL) {
+        python_engine_report_exception(script, "asyncio");
+    }
+    Py_XDECREF(result);
+}
+
+PyObject* python_loop_get(void)
+{
+    /* The loop belongs to the main interpreter; isolated ones get no futures */
+    return python_engine_in_main_interpreter() ? g_loop : NULL;
+}
+
+void python_loop_get_stats(LoopStats* stats)
+{
+    stats->tasks = (size_t)atomic64_load(&g_task_count);
+    stats->submitted = (uint64_t)atomic64_load(&g_submitted);
+    stats->wakeups = (uint64_t)atomic64_load(&g_wakeups);
+    stats->failed = (uint64_t)atomic64_load(&g_failed);
+}
+
+void python_loop_stop(void)
+{
+    PyGILState_STATE gil;
+    PyObject* result;
+
+    if (!g_running) {
+        return;
+    }
+
+    gil = PyGILState_Ensure();
+    result = PyObject_CallMethod(g_loop, "call_soon_threadsafe", "N", PyObject_GetAttrString(g_loop, "stop"));
+    if (result == NULL) {
+        python_engine_report_exception("", "asyncio");
+    }
+    Py_XDECREF(result);
+    PyGILState_Release(gil);
+
+    thread_join(g_thread);
+
+    gil = PyGILState_Ensure();
+    clear_state();
+    PyGILState_Release(gil);
+
+    g_running = 0;
+    log_debug("asyncio event loop stopped");
+}
@@ -0,0 +1,109 @@
+/**
+ * @file python_loop.h
+ * @brief Plugin-owned asyncio event loop for coroutine handlers
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Handlers and timer callbacks may be coroutine functions. Calling one
+ * yields a coroutine, which is queued here and started as a task on an
+ * asyncio loop running on its own thread. Submissions are batched: only the
+ * first coroutine queued after the loop last drained the queue wakes it.
+ */
+
+#ifndef PYTHON_LOOP_H
+#define PYTHON_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "python_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Event loop counters
+ */
+typedef struct LoopStats {
+    size_t   tasks;     /* Tasks not yet finished */
+    uint64_t submitted; /* Coroutines handed to the loop */
+    uint64_t wakeups;   /* Times the loop was woken to start tasks */
+    uint64_t failed;    /* Tasks that ended with an exception */
+} LoopStats;
+
+/**
+ * @brief Create the event loop and start its thread (GIL held)
+ * @return 0 on success, non-zero on failure
+ */
+int python_loop_init(void);
+
+/**
+ * @brief Check whether an object is a coroutine the loop can run (GIL held)
+ * @param object Object returned by a handler (PyObject*)
+ * @return Non-zero for coroutines
+ */
+int python_loop_is_coroutine(struct _object* object);
+
+/**
+ * @brief Queue a coroutine to run as a task owned by a script (GIL held)
+ * @param coroutine Coroutine (PyObject*); a reference is taken
+ * @param script Owning script name (may be NULL)
+ * @param generation Load generation of the owning script
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_loop_submit(struct _object* coroutine, const char* script, unsigned int generation);
+
+/**
+ * @brief Queue a plain call to run on the loop thread (GIL held)
+ * @param callable Callable (PyObject*)
+ * @param args Positional arguments tuple (PyObject*)
+ * @return 0 on success, -1 with a Python exception set
+ * @note Use this to complete asyncio futures from other threads
+ */
+int python_loop_call_soon(struct _object* callable, struct _object* args);
+
+/**
+ * @brief Complete a future of the loop from another thread (GIL held)
+ * @param future asyncio future (PyObject*); left alone if already done
+ * @param value Result, or an exception instance to set instead (PyObject*)
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_loop_resolve(struct _object* future, struct _object* value);
+
+/**
+ * @brief Get the script owning the task running on the calling thread (GIL held)
+ * @param context Receives the owner; script is NULL outside loop tasks
+ */
+void python_loop_get_task_script(ScriptContext* context);
+
+/**
+ * @brief Cancel a script's tasks within a generation range (GIL held)
+ * @param script Script name
+ * @param minGeneration Lowest generation to cancel
+ * @param maxGeneration Highest generation to cancel
+ */
+void python_loop_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration);
+
+/**
+ * @brief The running event loop (borrowed PyObject*), or NULL
+ * @note NULL in an isolated interpreter, so requests sent there are not awaitable
+ */
+struct _object* python_loop_get(void);
+
+/**
+ * @brief Read the loop counters
+ * @param stats Receives the counters
+ */
+void python_loop_get_stats(LoopStats* stats);
+
+/**
+ * @brief Stop the loop, cancel unfinished tasks and join the thread
+ * @note Must be called without the GIL
+ */
+void python_loop_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_LOOP_H */
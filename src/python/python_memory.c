@@ -0,0 +1,443 @@
+/**
+ * @file python_memory.c
+ * @brief Per-script memory accounting implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * The wrappers put a small header in front of every block of the memory and
+ * object domains holding its requested size and the owning script's slot,
+ * and forward to the allocators they replaced. The raw domain is left alone:
+ * the object allocator takes large blocks from it, which would count them
+ * twice. Each slot's live bytes are kept in MEMORY_SHARDS counters, one per
+ * group of threads, so isolated interpreters and handler threads allocating
+ * at the same time do not fight over one cache line. Summing the shards is
+ * left to the checks every MEMORY_CHECK_BYTES and to readers, which also
+ * makes the peak a sampled one.
+ *
+ * A block that grows is attributed to the script growing it, as tracemalloc
+ * does; freeing always credits the slot stored in the header.
+ *
+ * Py_Finalize does not free every block, so once installed the wrappers stay
+ * for the life of the process: a block carrying a header must never reach
+ * the allocator underneath without it. Shutting down only turns reporting
+ * off, and a later start turns it back on with the same slots.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <string.h>
+
+#include "python_memory.h"
+#include "python_engine.h"
+#include "core/plugin_config.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+
+#define MEGABYTE (1024.0 * 1024.0)
+
+/* Keeps blocks aligned as the wrapped allocator aligned them */
+#define HEADER_SIZE 16
+
+typedef struct BlockHeader {
+    size_t   size;
+    uint32_t slot;
+} BlockHeader;
+
+typedef char header_fits[sizeof(BlockHeader) <= HEADER_SIZE ? 1 : -1];
+
+/* Limit states: crossing sets PENDING, python_memory_enforce() moves it on */
+enum {
+    LIMIT_BELOW = 0,
+    LIMIT_PENDING,
+    LIMIT_HANDLED
+};
+
+typedef struct MemorySlot {
+    char             name[SCRIPT_NAME_BUFSIZE];
+    volatile int64_t peak;
+    volatile int32_t soft;
+    volatile int32_t hard;
+} MemorySlot;
+
+typedef struct MemoryShard {
+    volatile int64_t live[MEMORY_MAX_SCRIPTS];
+} MemoryShard;
+
+static int              g_enabled = 0;
+static int              g_installed = 0;      /* Wrappers in place; they are never removed */
+static Mutex            g_lock;               /* Serializes claiming slots */
+static PyMemAllocatorEx g_original[2];        /* Memory and object domains, as wrapped */
+
+/* Slot 0 is unattributed memory; names are written before g_slot_count publishes them */
+static MemorySlot       g_slots[MEMORY_MAX_SCRIPTS];
+static volatile int32_t g_slot_count = 0;
+static MemoryShard      g_shards[MEMORY_SHARDS];
+static volatile int32_t g_next_shard = 0;
+static volatile int32_t g_pending = 0;        /* Some slot crossed a limit */
+
+static THREAD_LOCAL uint32_t t_slot = 0;       /* Script running on this thread */
+static THREAD_LOCAL uint32_t t_cached_slot = 0; /* Last script seen, to skip the lookup */
+static THREAD_LOCAL int32_t  t_shard = -1;
+static THREAD_LOCAL int64_t  t_unchecked = 0;  /* Bytes allocated since the last check */
+
+/* ========================================================================
+ * Counters
+ * ======================================================================== */
+
+static int64_t slot_live(uint32_t slot)
+{
+    int64_t live = 0;
+    int i;
+
+    for (i = 0; i < MEMORY_SHARDS; i++) {
+        live += atomic64_load(&g_shards[i].live[slot]);
+    }
+    return live;
+}
+
+static void raise_peak(MemorySlot* slot, int64_t live)
+{
+    int64_t peak = atomic64_load(&slot->peak);
+
+    while (live > peak && !atomic64_cas(&slot->peak, peak, live)) {
+        peak = atomic64_load(&slot->peak);
+    }
+}
+
+/* Update the peak and flag limit crossings; never logs, it runs inside allocations */
+static void check_slot(uint32_t index)
+{
+    MemorySlot* slot = &g_slots[index];
+    const PluginConfig* config;
+    int64_t live = slot_live(index);
+    int64_t soft;
+    int64_t hard;
+
+    raise_peak(slot, live);
+    if (index == 0) {
+        return;
+    }
+
+    config = get_config();
+    soft = (int64_t)config->memorySoftLimitMb * 1024 * 1024;
+    hard = (int64_t)config->memoryHardLimitMb * 1024 * 1024;
+
+    if (soft > 0 && live > soft) {
+        if (atomic32_cas(&slot->soft, LIMIT_BELOW, LIMIT_PENDING)) {
+            atomic32_store(&g_pending, 1);
+        }
+    } else {
+        atomic32_cas(&slot->soft, LIMIT_HANDLED, LIMIT_BELOW);
+    }
+    if (hard > 0 && live > hard && atomic32_cas(&slot->hard, LIMIT_BELOW, LIMIT_PENDING)) {
+        atomic32_store(&g_pending, 1);
+    }
+}
+
+static void account(uint32_t slot, int64_t bytes)
+{
+    if (t_shard < 0) {
+        t_shard = (atomic32_add(&g_next_shard, 1) - 1) % MEMORY_SHARDS;
+    }
+    atomic64_add(&g_shards[t_shard].live[slot], bytes);
+
+    if (bytes > 0 && (t_unchecked += bytes) >= MEMORY_CHECK_BYTES) {
+        t_unchecked = 0;
+        check_slot(slot);
+    }
+}
+
+/* ========================================================================
+ * Allocator wrappers (ctx is the wrapped allocator)
+ * ======================================================================== */
+
+static void* tag_block(void* block, size_t size)
+{
+    BlockHeader* header = (BlockHeader*)block;
+
+    if (block == NULL) {
+        return NULL;
+    }
+    header->size = size;
+    header->slot = t_slot;
+    account(header->slot, (int64_t)size);
+    return (char*)block + HEADER_SIZE;
+}
+
+static void* memory_malloc(void* ctx, size_t size)
+{
+    PyMemAllocatorEx* original = (PyMemAllocatorEx*)ctx;
+
+    if (size > (size_t)PY_SSIZE_T_MAX - HEADER_SIZE) {
+        return NULL;
+    }
+    return tag_block(original->malloc(original->ctx, size + HEADER_SIZE), size);
+}
+
+static void* memory_calloc(void* ctx, size_t nelem, size_t elsize)
+{
+    PyMemAllocatorEx* original = (PyMemAllocatorEx*)ctx;
+    size_t size;
+
+    if (elsize != 0 && nelem > ((size_t)PY_SSIZE_T_MAX - HEADER_SIZE) / elsize) {
+        return NULL;
+    }
+    size = nelem * elsize;
+    return tag_block(original->calloc(original->ctx, 1, size + HEADER_SIZE), size);
+}
+
+static void* memory_realloc(void* ctx, void* ptr, size_t size)
+{
+    PyMemAllocatorEx* original = (PyMemAllocatorEx*)ctx;
+    BlockHeader* header;
+    BlockHeader previous;
+    void* block;
+
+    if (ptr == NULL) {
+        return memory_malloc(ctx, size);
+    }
+    if (size > (size_t)PY_SSIZE_T_MAX - HEADER_SIZE) {
+        return NULL;
+    }
+
+    header = (BlockHeader*)((char*)ptr - HEADER_SIZE);
+    previous = *header;
+    block = original->realloc(original->ctx, header, size + HEADER_SIZE);
+    if (block == NULL) {
+        return NULL;
+    }
+    account(previous.slot, -(int64_t)previous.size);
+    return tag_block(block, size);
+}
+
+static void memory_free(void* ctx, void* ptr)
+{
+    PyMemAllocatorEx* original = (PyMemAllocatorEx*)ctx;
+    BlockHeader* header;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = (BlockHeader*)((char*)ptr - HEADER_SIZE);
+    account(header->slot, -(int64_t)header->size);
+    original->free(original->ctx, header);
+}
+
+/* ========================================================================
+ * Slots
+ * ======================================================================== */
+
+static uint32_t find_slot(const char* script)
+{
+    int32_t count = atomic32_load(&g_slot_count);
+    int32_t i;
+
+    for (i = 1; i < count; i++) {
+        if (strcmp(g_slots[i].name, script) == 0) {
+            return (uint32_t)i;
+        }
+    }
+    return 0;
+}
+
+static uint32_t claim_slot(const char* script)
+{
+    uint32_t slot;
+    int32_t count;
+
+    mutex_lock(&g_lock);
+    slot = find_slot(script);
+    count = atomic32_load(&g_slot_count);
+    if (slot == 0 && count < MEMORY_MAX_SCRIPTS) {
+        safe_strcpy(g_slots[count].name, sizeof(g_slots[count].name), script);
+        atomic32_store(&g_slot_count, count + 1);
+        slot = (uint32_t)count;
+    }
+    mutex_unlock(&g_lock);
+    return slot;
+}
+
+void python_memory_enter(const char* script)
+{
+    if (!g_enabled) {
+        return;
+    }
+    if (script == NULL || script[0] == '\0') {
+        t_slot = 0;
+        return;
+    }
+    if (t_cached_slot == 0 || strcmp(g_slots[t_cached_slot].name, script) != 0) {
+        t_cached_slot = claim_slot(script);
+    }
+    t_slot = t_cached_slot;
+}
+
+void python_memory_reset(const char* script)
+{
+    uint32_t slot;
+
+    if (!g_enabled || script == NULL || (slot = find_slot(script)) == 0) {
+        return;
+    }
+    atomic32_cas(&g_slots[slot].hard, LIMIT_HANDLED, LIMIT_BELOW);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+int python_memory_init(void)
+{
+    const PluginConfig* config = get_config();
+
+    if (g_enabled || !config->memoryAccounting) {
+        return 0;
+    }
+
+#ifdef Py_GIL_DISABLED
+    /* The free-threaded collector finds objects by walking mimalloc's heaps, which a header would hide */
+    log_warning("Memory accounting is not available on free-threaded Python");
+    return 1;
+#else
+    {
+        PyMemAllocatorEx wrapper;
+        PyPreConfig preconfig;
+        PyStatus status;
+        int i;
+
+        if (Py_IsInitialized()) {
+            log_warning("Memory accounting must be set up before Python starts");
+            return 1;
+        }
+
+        /* Started again: blocks left by the last interpreter still carry headers and slots */
+        if (g_installed) {
+            PyMemAllocatorEx current;
+
+            PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &current);
+            if (current.malloc != memory_malloc) {
+                log_error("The Python allocators were replaced; memory accounting stays off");
+                return 1;
+            }
+            g_enabled = 1;
+            log_info("Memory accounting on again (soft limit %u MB, hard limit %u MB per script)",
+                     config->memorySoftLimitMb, config->memoryHardLimitMb);
+            return 0;
+        }
+
+        /* Allocators chosen by pre-initialization (PYTHONMALLOC) are the ones wrapped */
+        PyPreConfig_InitPythonConfig(&preconfig);
+        status = Py_PreInitialize(&preconfig);
+        if (PyStatus_Exception(status)) {
+            log_error("Python pre-initialization failed: %s", status.err_msg);
+            return 1;
+        }
+
+        mutex_init(&g_lock);
+        memset(g_slots, 0, sizeof(g_slots));
+        memset(g_shards, 0, sizeof(g_shards));
+        g_slot_count = 1;
+        g_pending = 0;
+
+        PyMem_GetAllocator(PYMEM_DOMAIN_MEM, &g_original[0]);
+        PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &g_original[1]);
+        for (i = 0; i < 2; i++) {
+            wrapper.ctx = &g_original[i];
+            wrapper.malloc = memory_malloc;
+            wrapper.calloc = memory_calloc;
+            wrapper.realloc = memory_realloc;
+            wrapper.free = memory_free;
+            PyMem_SetAllocator(i == 0 ? PYMEM_DOMAIN_MEM : PYMEM_DOMAIN_OBJ, &wrapper);
+        }
+        g_installed = 1;
+        g_enabled = 1;
+
+        log_info("Memory accounting on (soft limit %u MB, hard limit %u MB per script; 0 means none)",
+                 config->memorySoftLimitMb, config->memoryHardLimitMb);
+        return 0;
+    }
+#endif
+}
+
+int python_memory_enabled(void)
+{
+    return g_enabled;
+}
+
+void python_memory_enforce(void)
+{
+    const PluginConfig* config;
+    char name[SCRIPT_NAME_BUFSIZE];
+    int32_t count;
+    int32_t i;
+
+    if (!g_enabled || atomic32_load(&g_pending) == 0) {
+        return;
+    }
+    atomic32_store(&g_pending, 0);
+
+    config = get_config();
+    count = atomic32_load(&g_slot_count);
+    for (i = 1; i < count; i++) {
+        MemorySlot* slot = &g_slots[i];
+
+        if (atomic32_cas(&slot->soft, LIMIT_PENDING, LIMIT_HANDLED)) {
+            log_warning("Script %s holds %.1f MB, over the soft limit of %u MB", slot->name,
+                        (double)slot_live((uint32_t)i) / MEGABYTE, config->memorySoftLimitMb);
+        }
+        if (atomic32_cas(&slot->hard, LIMIT_PENDING, LIMIT_HANDLED)) {
+            log_error("Script %s holds %.1f MB, over the hard limit of %u MB; unloading it", slot->name,
+                      (double)slot_live((uint32_t)i) / MEGABYTE, config->memoryHardLimitMb);
+            safe_strcpy(name, sizeof(name), slot->name);
+            if (python_engine_unload_script(name) != 0) {
+                log_warning("Could not unload %s: %s", name, python_engine_get_error());
+            }
+        }
+    }
+}
+
+size_t python_memory_get_usage(MemoryUsage* usage, size_t max)
+{
+    int32_t count;
+    size_t n = 0;
+    int32_t i;
+
+    if (!g_enabled) {
+        return 0;
+    }
+
+    count = atomic32_load(&g_slot_count);
+    for (i = 0; i < count && n < max; i++) {
+        MemorySlot* slot = &g_slots[i];
+        MemoryUsage* entry = &usage[n++];
+
+        safe_strcpy(entry->script, sizeof(entry->script), slot->name);
+        entry->liveBytes = slot_live((uint32_t)i);
+        raise_peak(slot, entry->liveBytes);
+        entry->peakBytes = atomic64_load(&slot->peak);
+        entry->overSoftLimit = atomic32_load(&slot->soft) != LIMIT_BELOW;
+        entry->disabled = atomic32_load(&slot->hard) != LIMIT_BELOW;
+    }
+    return n;
+}
+
+void python_memory_shutdown(void)
+{
+    if (!g_enabled) {
+        return;
+    }
+    /* The wrappers keep running: blocks the finalized interpreter kept are freed through them */
+    g_enabled = 0;
+    t_slot = 0;
+    t_cached_slot = 0;
+}
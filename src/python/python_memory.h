@@ -0,0 +1,111 @@
+/**
+ * @file python_memory.h
+ * @brief Per-script memory accounting and limits
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * With [memory] accounting = 1 the engine wraps Python's memory and object
+ * allocators before the interpreter starts. Every block records its size
+ * and the script whose code was running when it was allocated (or last
+ * grown), so /tspy python status can tell which script holds how much
+ * memory. Blocks allocated outside script code, e.g. by the engine or by
+ * imports of shared modules, are counted as unattributed.
+ *
+ * A script over [memory] soft_limit_mb is logged once per crossing; one
+ * over [memory] hard_limit_mb is unloaded. Limits are checked as memory is
+ * allocated but acted on by the next event dispatch, so the allocator never
+ * logs or calls into the engine. With accounting off (the default) nothing
+ * is wrapped and the only cost is a flag test per handler call.
+ */
+
+#ifndef PYTHON_MEMORY_H
+#define PYTHON_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "python_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scripts tracked separately; later ones are counted as unattributed
+ */
+#define MEMORY_MAX_SCRIPTS 64
+
+/**
+ * @brief Counter shards; threads are spread over them so they rarely share a cache line
+ */
+#define MEMORY_SHARDS 8
+
+/**
+ * @brief Bytes a thread allocates between peak and limit checks
+ */
+#define MEMORY_CHECK_BYTES (256 * 1024)
+
+/**
+ * @brief Memory held by one script
+ */
+typedef struct MemoryUsage {
+    char    script[SCRIPT_NAME_BUFSIZE]; /* Empty for unattributed memory */
+    int64_t liveBytes;                   /* Allocated and not yet freed */
+    int64_t peakBytes;                   /* Highest liveBytes seen at a check */
+    int     overSoftLimit;               /* 1 while above [memory] soft_limit_mb */
+    int     disabled;                    /* 1 if unloaded for exceeding [memory] hard_limit_mb */
+} MemoryUsage;
+
+/**
+ * @brief Wrap Python's allocators if [memory] accounting is on
+ * @return 0 on success or if accounting is off, non-zero if it could not be turned on
+ * @note Call before the interpreter is initialized; the setting is read only here
+ */
+int python_memory_init(void);
+
+/**
+ * @brief Whether allocations are being accounted
+ */
+int python_memory_enabled(void);
+
+/**
+ * @brief Attribute the calling thread's allocations to a script
+ * @param script Script name, or NULL outside script code
+ * @note Called by python_engine_enter_script and python_engine_leave_script
+ */
+void python_memory_enter(const char* script);
+
+/**
+ * @brief Let a script that was unloaded for its hard limit be accounted normally again
+ * @param script Script name
+ * @note Called when a script is (re)loaded
+ */
+void python_memory_reset(const char* script);
+
+/**
+ * @brief Log soft limit crossings and unload scripts over their hard limit
+ * @note Call without the GIL from the client thread; does nothing unless a limit was crossed
+ */
+void python_memory_enforce(void);
+
+/**
+ * @brief Copy per-script usage, unattributed memory first
+ * @param usage Receives up to max entries
+ * @param max Capacity of usage
+ * @return Number of entries written
+ * @note Any thread; does not need the GIL
+ */
+size_t python_memory_get_usage(MemoryUsage* usage, size_t max);
+
+/**
+ * @brief Turn accounting off after the interpreter was finalized
+ * @note The wrapped allocators stay installed, since blocks the interpreter did
+ *       not free still carry their header
+ */
+void python_memory_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_MEMORY_H */
@@ -0,0 +1,658 @@
+/**
+ * @file python_outbound.c
+ * @brief Rate-limited outgoing chat message queue implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Queues and token buckets are guarded by g_lock. The sender thread pops a
+ * batch under the lock and sends it without the lock; it only takes the GIL
+ * when the batch carries futures, to register them with python_requests
+ * before the request goes out. Lock order is the same as everywhere else:
+ * the GIL first, then g_lock.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_outbound.h"
+#include "python_engine.h"
+#include "python_loop.h"
+#include "python_requests.h"
+#include "core/plugin_config.h"
+#include "core/plugin_main.h"
+#include "teamspeak/public_errors.h"
+#include "utils/logging.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+typedef struct OutboundMessage {
+    struct OutboundMessage* next;
+    PyObject* future;   /* NULL without an event loop */
+    double    timeout;
+    int       targetMode;
+    size_t    length;
+    char      text[];
+} OutboundMessage;
+
+typedef struct OutboundQueue {
+    OutboundMessage*  head;
+    OutboundMessage** tail;
+} OutboundQueue;
+
+typedef struct OutboundServer {
+    struct OutboundServer* next;
+    uint64        serverConnectionHandlerID;
+    OutboundQueue queues[OUTBOUND_PRIORITIES];
+    size_t        count;
+    int           sending;
+    double        tokens;
+    uint64_t      refilled;   /* clock_monotonic_ns() of the last refill */
+    PyObject*     waiters;    /* Futures from wait_drained(), or NULL */
+} OutboundServer;
+
+typedef struct OutboundBatch {
+    OutboundServer*  server;
+    OutboundMessage* messages;
+    size_t           count;
+    size_t           length;   /* Merged length without the terminator */
+    double           timeout;
+    int              futures;  /* Messages carrying a future */
+} OutboundBatch;
+
+static Mutex           g_lock;
+static CondVar         g_wake;
+static Thread          g_thread;
+static int             g_running = 0;
+static int             g_stopping = 0;
+static OutboundServer* g_servers = NULL;
+static PyObject*       g_waiters = NULL;   /* wait_drained() for all servers */
+static int             g_sending = 0;      /* Batches being sent */
+static double          g_rate = OUTBOUND_DEFAULT_RATE;
+static double          g_burst = OUTBOUND_DEFAULT_BURST;
+static OutboundStats   g_stats;
+
+static OutboundServer* find_server(uint64 serverConnectionHandlerID)
+{
+    OutboundServer* server;
+
+    for (server = g_servers; server != NULL; server = server->next) {
+        if (server->serverConnectionHandlerID == serverConnectionHandlerID) {
+            return server;
+        }
+    }
+    return NULL;
+}
+
+static OutboundServer* add_server(uint64 serverConnectionHandlerID)
+{
+    OutboundServer* server = (OutboundServer*)calloc(1, sizeof(OutboundServer));
+    int i;
+
+    if (server == NULL) {
+        return NULL;
+    }
+    server->serverConnectionHandlerID = serverConnectionHandlerID;
+    for (i = 0; i < OUTBOUND_PRIORITIES; i++) {
+        server->queues[i].tail = &server->queues[i].head;
+    }
+    server->tokens = g_burst;
+    server->refilled = clock_monotonic_ns();
+    server->next = g_servers;
+    g_servers = server;
+    return server;
+}
+
+static void refill(OutboundServer* server, uint64_t now)
+{
+    server->tokens += (double)(now - server->refilled) / 1e9 * g_rate;
+    if (server->tokens > g_burst) {
+        server->tokens = g_burst;
+    }
+    server->refilled = now;
+}
+
+/* A server with queued messages and a token to spend; otherwise the shortest wait */
+static OutboundServer* pick_server(uint64_t now, uint64_t* waitNs)
+{
+    OutboundServer* server;
+
+    *waitNs = UINT64_MAX;
+    for (server = g_servers; server != NULL; server = server->next) {
+        uint64_t wait;
+
+        if (server->count == 0) {
+            continue;
+        }
+        refill(server, now);
+        if (server->tokens >= 1.0) {
+            return server;
+        }
+        wait = (uint64_t)((1.0 - server->tokens) / g_rate * 1e9);
+        if (wait < *waitNs) {
+            *waitNs = wait;
+        }
+    }
+    return NULL;
+}
+
+/* Pop the next message and the run of same-target messages that fit with it */
+static void take_batch(OutboundServer* server, OutboundBatch* batch)
+{
+    OutboundQueue* queue = &server->queues[0];
+    OutboundMessage** link;
+    OutboundMessage* message;
+    int i;
+
+    for (i = 0; i < OUTBOUND_PRIORITIES; i++) {
+        if (server->queues[i].head != NULL) {
+            queue = &server->queues[i];
+            break;
+        }
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->server = server;
+    batch->messages = queue->head;
+
+    link = &queue->head;
+    while ((message = *link) != NULL) {
+        if (batch->count > 0
+            && (message->targetMode != batch->messages->targetMode
+                || batch->length + 1 + message->length > OUTBOUND_MAX_MESSAGE)) {
+            break;
+        }
+        batch->length += (batch->count > 0 ? 1 : 0) + message->length;
+        batch->count++;
+        if (message->timeout > batch->timeout) {
+            batch->timeout = message->timeout;
+        }
+        if (message->future != NULL) {
+            batch->futures++;
+        }
+        link = &message->next;
+    }
+
+    /* Cut the batch off the queue */
+    queue->head = *link;
+    if (queue->head == NULL) {
+        queue->tail = &queue->head;
+    }
+    *link = NULL;
+
+    server->count -= batch->count;
+    g_stats.queued -= batch->count;
+}
+
+static unsigned int send_text(uint64 serverConnectionHandlerID, int targetMode, const char* text,
+                              const char* returnCode)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    unsigned int result = ERROR_not_implemented;
+
+    TRACE_BEGIN(span);
+    if (targetMode == TextMessageTarget_SERVER) {
+        if (ts3Functions != NULL && ts3Functions->requestSendServerTextMsg != NULL) {
+            result = ts3Functions->requestSendServerTextMsg(serverConnectionHandlerID, text, returnCode);
+        }
+    } else if (ts3Functions != NULL && ts3Functions->requestSendChannelTextMsg != NULL) {
+        result = ts3Functions->requestSendChannelTextMsg(serverConnectionHandlerID, text, 0, returnCode);
+    }
+    TRACE_END(span, "outbound", "send");
+
+    if (result != ERROR_ok) {
+        log_warning("Failed to send %s message: error=%u",
+                    targetMode == TextMessageTarget_SERVER ? "server" : "channel", result);
+    }
+    return result;
+}
+
+/* Register the batch's futures under one return code (GIL held) */
+static void track_batch(const OutboundBatch* batch, char* returnCode, size_t size)
+{
+    OutboundMessage* message;
+    PyObject* futures;
+    PyObject* type;
+    PyObject* value;
+    PyObject* traceback;
+
+    returnCode[0] = '\0';
+    futures = PyList_New(0);
+    for (message = batch->messages; futures != NULL && message != NULL; message = message->next) {
+        if (message->future != NULL && PyList_Append(futures, message->future) != 0) {
+            Py_CLEAR(futures);
+        }
+    }
+    if (futures != NULL && python_requests_track(futures, batch->timeout, returnCode, size) == 0) {
+        Py_DECREF(futures);
+        return;
+    }
+    Py_XDECREF(futures);
+
+    /* The message still goes out; its futures get the error instead of an answer */
+    returnCode[0] = '\0';
+    PyErr_Fetch(&type, &value, &traceback);
+    PyErr_NormalizeException(&type, &value, &traceback);
+    for (message = batch->messages; value != NULL && message != NULL; message = message->next) {
+        if (message->future != NULL && python_loop_resolve(message->future, value) != 0) {
+            PyErr_Clear();
+        }
+    }
+    Py_XDECREF(type);
+    Py_XDECREF(value);
+    Py_XDECREF(traceback);
+}
+
+static void free_messages(OutboundMessage* message)
+{
+    while (message != NULL) {
+        OutboundMessage* next = message->next;
+
+        Py_XDECREF(message->future);
+        free(message);
+        message = next;
+    }
+}
+
+/* Resolve stolen wait_drained() futures (GIL held) */
+static void resolve_waiters(PyObject* waiters)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < PyList_GET_SIZE(waiters); i++) {
+        if (python_loop_resolve(PyList_GET_ITEM(waiters, i), Py_None) != 0) {
+            python_engine_report_exception("", "outbound");
+        }
+    }
+    Py_DECREF(waiters);
+}
+
+/* Send one batch; called without g_lock */
+static void send_batch(OutboundBatch* batch, PyThreadState** state)
+{
+    OutboundServer* server = batch->server;
+    OutboundMessage* message;
+    char returnCode[REQUEST_RETURN_CODE_BUFSIZE];
+    char merged[OUTBOUND_MAX_MESSAGE + 1];
+    const char* text = batch->messages->text;
+    PyObject* serverWaiters = NULL;
+    PyObject* allWaiters = NULL;
+    unsigned int result;
+    int gil = 0;
+
+    /* Batches only grow while they fit in one text message */
+    if (batch->count > 1) {
+        char* cursor = merged;
+
+        for (message = batch->messages; message != NULL; message = message->next) {
+            if (cursor != merged) {
+                *cursor++ = '\n';
+            }
+            memcpy(cursor, message->text, message->length);
+            cursor += message->length;
+        }
+        *cursor = '\0';
+        text = merged;
+    }
+
+    /* Track before sending so the answer cannot arrive first */
+    returnCode[0] = '\0';
+    if (batch->futures > 0) {
+        PyEval_RestoreThread(*state);
+        gil = 1;
+        track_batch(batch, returnCode, sizeof(returnCode));
+    }
+
+    result = send_text(server->serverConnectionHandlerID, batch->messages->targetMode, text,
+                       returnCode[0] != '\0' ? returnCode : NULL);
+    if (result != ERROR_ok && returnCode[0] != '\0') {
+        python_requests_fail(returnCode, result);
+    }
+    mutex_lock(&g_lock);
+    server->sending = 0;
+    g_sending--;
+    g_stats.messages += batch->count;
+    g_stats.requests++;
+    if (server->count == 0 && server->waiters != NULL) {
+        serverWaiters = server->waiters;
+        server->waiters = NULL;
+    }
+    if (g_stats.queued == 0 && g_sending == 0 && g_waiters != NULL) {
+        allWaiters = g_waiters;
+        g_waiters = NULL;
+    }
+    mutex_unlock(&g_lock);
+
+    if (!gil && (serverWaiters != NULL || allWaiters != NULL)) {
+        PyEval_RestoreThread(*state);
+        gil = 1;
+    }
+    if (gil) {
+        free_messages(batch->messages);
+        if (serverWaiters != NULL) {
+            resolve_waiters(serverWaiters);
+        }
+        if (allWaiters != NULL) {
+            resolve_waiters(allWaiters);
+        }
+        *state = PyEval_SaveThread();
+    } else {
+        /* No Python objects in the batch */
+        free_messages(batch->messages);
+    }
+}
+
+static void sender_main(void* arg)
+{
+    PyGILState_STATE gil;
+    PyThreadState* state;
+
+    (void)arg; /* Unused parameter */
+
+    trace_set_thread_name("TsPy outbound");
+
+    /* Keep one thread state for the thread's lifetime instead of one per batch */
+    gil = PyGILState_Ensure();
+    state = PyEval_SaveThread();
+
+    mutex_lock(&g_lock);
+    while (!g_stopping) {
+        OutboundServer* server;
+        OutboundBatch batch;
+        uint64_t waitNs;
+
+        server = pick_server(clock_monotonic_ns(), &waitNs);
+        if (server == NULL) {
+            if (g_stats.queued == 0) {
+                cond_wait(&g_wake, &g_lock);
+            } else {
+                g_stats.throttled++;
+                cond_timed_wait(&g_wake, &g_lock, (unsigned int)(waitNs / 1000000) + 1);
+            }
+            continue;
+        }
+
+        server->tokens -= 1.0;
+        take_batch(server, &batch);
+        server->sending = 1;
+        g_sending++;
+        mutex_unlock(&g_lock);
+
+        send_batch(&batch, &state);
+
+        mutex_lock(&g_lock);
+    }
+    mutex_unlock(&g_lock);
+
+    PyEval_RestoreThread(state);
+    PyGILState_Release(gil);
+}
+
+/* ConfigListener: applies [outbound] changes; a rate set by a script stays until the file changes it */
+static void on_config_changed(const PluginConfig* config, const PluginConfig* previous)
+{
+    if (config->outboundRate != previous->outboundRate || config->outboundBurst != previous->outboundBurst) {
+        python_outbound_set_rate(config->outboundRate, config->outboundBurst);
+    }
+}
+
+int python_outbound_init(void)
+{
+    const PluginConfig* config = get_config();
+
+    if (g_running) {
+        return 0;
+    }
+
+    g_rate = config->outboundRate;
+    g_burst = config->outboundBurst;
+    mutex_init(&g_lock);
+    cond_init(&g_wake);
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stopping = 0;
+
+    if (thread_create(&g_thread, sender_main, NULL) != 0) {
+        log_error("Failed to start the outbound message thread");
+        cond_destroy(&g_wake);
+        mutex_destroy(&g_lock);
+        return 1;
+    }
+
+    g_running = 1;
+    add_config_listener(on_config_changed);
+    log_info("Outbound message queue started (%.1f msg/s, burst %.0f)", g_rate, g_burst);
+    return 0;
+}
+
+PyObject* python_outbound_send(uint64 serverConnectionHandlerID, int targetMode, const char* message,
+                               double timeout, OutboundPriority priority)
+{
+    PyObject* loop = python_loop_get();
+    OutboundMessage* entry;
+    OutboundServer* server;
+    OutboundQueue* queue;
+    PyObject* future = NULL;
+    size_t length = strlen(message);
+
+    if (!g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "outbound message queue is not running");
+        return NULL;
+    }
+    if (!(timeout > 0.0 && timeout <= 3600.0)) {
+        PyErr_SetString(PyExc_ValueError, "timeout must be between 0 and 3600 seconds");
+        return NULL;
+    }
+
+    entry = (OutboundMessage*)malloc(sizeof(OutboundMessage) + length + 1);
+    if (entry == NULL) {
+        return PyErr_NoMemory();
+    }
+    entry->next = NULL;
+    entry->future = NULL;
+    entry->timeout = timeout;
+    entry->targetMode = targetMode;
+    entry->length = length;
+    memcpy(entry->text, message, length + 1);
+
+    if (loop != NULL) {
+        entry->future = PyObject_CallMethod(loop, "create_future", NULL);
+        if (entry->future == NULL) {
+            free(entry);
+            return NULL;
+        }
+        /* The queue keeps its own reference until the message is sent */
+        future = entry->future;
+        Py_INCREF(future);
+    }
+
+    mutex_lock(&g_lock);
+    server = find_server(serverConnectionHandlerID);
+    if (server == NULL) {
+        server = add_server(serverConnectionHandlerID);
+    }
+    if (server == NULL) {
+        mutex_unlock(&g_lock);
+        Py_XDECREF(future);
+        Py_XDECREF(entry->future);
+        free(entry);
+        return PyErr_NoMemory();
+    }
+    queue = &server->queues[priority];
+    *queue->tail = entry;
+    queue->tail = &entry->next;
+    server->count++;
+    g_stats.queued++;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+
+    /* Without the main GIL (isolated interpreters) the sender may already have freed entry */
+    if (future != NULL) {
+        return future;
+    }
+    Py_RETURN_NONE;
+}
+
+size_t python_outbound_pending(uint64 serverConnectionHandlerID)
+{
+    OutboundServer* server;
+    size_t count = 0;
+
+    if (!g_running) {
+        return 0;
+    }
+
+    mutex_lock(&g_lock);
+    if (serverConnectionHandlerID == 0) {
+        count = g_stats.queued;
+    } else if ((server = find_server(serverConnectionHandlerID)) != NULL) {
+        count = server->count;
+    }
+    mutex_unlock(&g_lock);
+    return count;
+}
+
+PyObject* python_outbound_wait_drained(uint64 serverConnectionHandlerID)
+{
+    PyObject* loop = python_loop_get();
+    PyObject* future;
+    PyObject* fresh;
+    PyObject** waiters = &g_waiters;
+    OutboundServer* server;
+    int drained;
+    int failed = 0;
+
+    if (loop == NULL || !g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return NULL;
+    }
+
+    /* Allocate before locking: nothing that may run Python code happens under g_lock */
+    future = PyObject_CallMethod(loop, "create_future", NULL);
+    fresh = PyList_New(0);
+    if (future == NULL || fresh == NULL) {
+        Py_XDECREF(future);
+        Py_XDECREF(fresh);
+        return NULL;
+    }
+
+    mutex_lock(&g_lock);
+    if (serverConnectionHandlerID == 0) {
+        drained = g_stats.queued == 0 && g_sending == 0;
+    } else {
+        server = find_server(serverConnectionHandlerID);
+        drained = server == NULL || (server->count == 0 && !server->sending);
+        if (server != NULL) {
+            waiters = &server->waiters;
+        }
+    }
+    if (!drained) {
+        if (*waiters == NULL) {
+            *waiters = fresh;
+            fresh = NULL;
+        }
+        failed = PyList_Append(*waiters, future) != 0;
+    }
+    mutex_unlock(&g_lock);
+    Py_XDECREF(fresh);
+
+    if (failed || (drained && python_loop_resolve(future, Py_None) != 0)) {
+        Py_DECREF(future);
+        return NULL;
+    }
+    return future;
+}
+
+int python_outbound_set_rate(double rate, double burst)
+{
+    OutboundServer* server;
+
+    if (!(rate > 0.0 && rate <= 1000.0) || !(burst >= 1.0 && burst <= 1000.0)) {
+        return -1;
+    }
+
+    if (g_running) {
+        mutex_lock(&g_lock);
+    }
+    g_rate = rate;
+    g_burst = burst;
+    for (server = g_servers; server != NULL; server = server->next) {
+        if (server->tokens > burst) {
+            server->tokens = burst;
+        }
+    }
+    if (g_running) {
+        cond_signal(&g_wake);
+        mutex_unlock(&g_lock);
+    }
+
+    log_info("Outbound rate limit set to %.1f msg/s, burst %.0f", rate, burst);
+    return 0;
+}
+
+void python_outbound_get_stats(OutboundStats* stats)
+{
+    if (!g_running) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    mutex_lock(&g_lock);
+    *stats = g_stats;
+    mutex_unlock(&g_lock);
+}
+
+void python_outbound_stop(void)
+{
+    if (!g_running) {
+        return;
+    }
+
+    remove_config_listener(on_config_changed);
+
+    mutex_lock(&g_lock);
+    g_stopping = 1;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+
+    thread_join(g_thread);
+}
+
+void python_outbound_shutdown(void)
+{
+    OutboundServer* server;
+    size_t dropped;
+    int i;
+
+    if (!g_running) {
+        return;
+    }
+
+    /* The thread is gone, so no lock is needed */
+    dropped = g_stats.queued;
+    while ((server = g_servers) != NULL) {
+        g_servers = server->next;
+        for (i = 0; i < OUTBOUND_PRIORITIES; i++) {
+            free_messages(server->queues[i].head);
+        }
+        Py_XDECREF(server->waiters);
+        free(server);
+    }
+    Py_CLEAR(g_waiters);
+    if (dropped > 0) {
+        log_warning("Dropped %zu unsent message(s)", dropped);
+    }
+
+    cond_destroy(&g_wake);
+    mutex_destroy(&g_lock);
+    g_running = 0;
+    log_debug("Outbound message queue shut down");
+}
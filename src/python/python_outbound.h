@@ -0,0 +1,120 @@
+/**
+ * @file python_outbound.h
+ * @brief Rate-limited outgoing chat message queue
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * ts3api.send_channel_message / send_server_message append to a per-server
+ * queue instead of calling TeamSpeak directly. A sender thread drains the
+ * queues through a token bucket per server so bursts from scripts stay below
+ * the server's anti-flood limits. Consecutive messages to the same target are
+ * merged into one text message, and command replies overtake bulk messages.
+ */
+
+#ifndef PYTHON_OUTBOUND_H
+#define PYTHON_OUTBOUND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default messages per second per server ([outbound] rate in tspy.ini)
+ */
+#define OUTBOUND_DEFAULT_RATE 2.0
+
+/**
+ * @brief Default number of messages sent back to back after a quiet period ([outbound] burst)
+ */
+#define OUTBOUND_DEFAULT_BURST 5.0
+
+/**
+ * @brief Largest merged message in bytes
+ */
+#define OUTBOUND_MAX_MESSAGE TS3_MAX_SIZE_TEXTMESSAGE
+
+/**
+ * @brief Message priority
+ */
+typedef enum OutboundPriority {
+    OUTBOUND_REPLY = 0, /* Sent first, e.g. answers to chat commands */
+    OUTBOUND_BULK,      /* Announcements and other bulk traffic */
+    OUTBOUND_PRIORITIES
+} OutboundPriority;
+
+/**
+ * @brief Sender counters
+ */
+typedef struct OutboundStats {
+    size_t   queued;    /* Messages waiting to be sent */
+    uint64_t messages;  /* Messages sent */
+    uint64_t requests;  /* Text message requests they were merged into */
+    uint64_t throttled; /* Times the sender waited for the rate limit */
+} OutboundStats;
+
+/**
+ * @brief Start the sender thread
+ * @return 0 on success, non-zero on failure
+ */
+int python_outbound_init(void);
+
+/**
+ * @brief Queue a text message (GIL held)
+ * @param serverConnectionHandlerID Server connection handler ID
+ * @param targetMode TextMessageTarget_CHANNEL or TextMessageTarget_SERVER
+ * @param message UTF-8 message
+ * @param timeout Seconds to wait for the server's answer once sent
+ * @param priority Queue to use
+ * @return New reference to a future resolved with the server's error code,
+ *         None without an event loop, or NULL with a Python exception set
+ */
+struct _object* python_outbound_send(uint64 serverConnectionHandlerID, int targetMode, const char* message,
+                                     double timeout, OutboundPriority priority);
+
+/**
+ * @brief Number of queued messages
+ * @param serverConnectionHandlerID Server, or 0 for all servers
+ */
+size_t python_outbound_pending(uint64 serverConnectionHandlerID);
+
+/**
+ * @brief Future resolved once a queue has been sent (GIL held)
+ * @param serverConnectionHandlerID Server, or 0 for all servers
+ * @return New reference to the future, or NULL with a Python exception set
+ */
+struct _object* python_outbound_wait_drained(uint64 serverConnectionHandlerID);
+
+/**
+ * @brief Change the rate limit applied to every server
+ * @param rate Messages per second
+ * @param burst Messages that may be sent back to back
+ * @return 0 on success, -1 if the values are out of range
+ */
+int python_outbound_set_rate(double rate, double burst);
+
+/**
+ * @brief Read the sender counters
+ * @param stats Receives the counters
+ */
+void python_outbound_get_stats(OutboundStats* stats);
+
+/**
+ * @brief Stop the sender thread
+ * @note Must be called without the GIL; a message being sent is finished first
+ */
+void python_outbound_stop(void);
+
+/**
+ * @brief Drop unsent messages and release their futures (GIL held, thread stopped)
+ */
+void python_outbound_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_OUTBOUND_H */
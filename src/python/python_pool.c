@@ -0,0 +1,866 @@
+/**
+ * @file python_pool.c
+ * @brief Handler pool implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Events go to shards, one per routing key: the connection ID for the
+ * connection lane and the lane ID for a named lane. A shard is a FIFO with
+ * sequence numbers and is idle, ready (on a worker's ready ring) or running
+ * (one worker taking batches from it). A shard that receives an event while
+ * idle is put on the ready ring of its home worker (key modulo the worker
+ * count). Workers take shards from their own ring first; an idle worker
+ * steals the longest-waiting shard from the worker with the most ready
+ * shards. A batch of up to POOL_BATCH_MAX events runs under one attachment
+ * of the worker's thread state, after which a shard with more events goes
+ * back to the end of its home ring, so a flooded shard takes turns with the
+ * others instead of starving them.
+ *
+ * The shard table uses open addressing and only grows while the pool lives:
+ * slots are filled with a compare-and-swap, so submitters find their shard
+ * without a lock. When it is full, new keys share the shard their hash
+ * lands on, which keeps each key's order since the table never changes again.
+ *
+ * Locks: g_lock guards g_pool and is held while submitting, so a restart
+ * waits for submitters; a shard's lock guards its queue and counters; a
+ * pool's lock guards the ready rings, the idle flags and stopping. A
+ * shard's lock and the pool's lock are never held together. No Python code
+ * runs while any of them is held.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_pool.h"
+#include "python_engine.h"
+#include "python_subscriptions.h"
+#include "core/plugin_config.h"
+#include "utils/logging.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+typedef enum PoolJobType {
+    POOL_JOB_EVENT,
+    POOL_JOB_CALL
+} PoolJobType;
+
+/* Allocated with the event's strings and freed by the worker */
+typedef struct PoolJob {
+    struct PoolJob* next;
+    PoolJobType     type;
+    uint32_t        lane;       /* Lane to deliver (events) */
+    uint64_t        sequence;   /* Position in its shard, from 1 */
+    uint64_t        queuedNs;
+    PyObject*       callable;   /* Called without arguments (benchmark); borrowed */
+    PythonEvent     event;
+} PoolJob;
+
+typedef enum ShardState {
+    SHARD_IDLE,
+    SHARD_READY,
+    SHARD_RUNNING
+} ShardState;
+
+typedef struct HandlerPool HandlerPool;
+
+typedef struct PoolShard {
+    HandlerPool* pool;
+    uint64_t     connection;    /* 0 for a named lane */
+    uint32_t     lane;
+    unsigned int home;          /* Index of the home worker */
+    Mutex        lock;
+    PoolJob*     head;
+    PoolJob*     tail;
+    size_t       queued;
+    size_t       maxQueued;
+    ShardState   state;
+    int          overflowing;   /* Warned about drops since the queue last emptied */
+    uint64_t     nextSequence;  /* Given to the next event queued */
+    uint64_t     sequence;      /* Last event run */
+    uint64_t     handled;
+    uint64_t     dropped;
+    uint64_t     latencyNs;
+    uint64_t     maxLatencyNs;
+} PoolShard;
+
+typedef struct PoolWorker {
+    HandlerPool* pool;
+    unsigned int index;
+    Thread       thread;
+    CondVar      wake;
+    int          waiting;       /* Asleep in cond_wait */
+    PoolShard*   ready[POOL_MAX_SHARDS];
+    size_t       readyHead;
+    size_t       readyCount;
+    char         threadName[32];
+} PoolWorker;
+
+struct HandlerPool {
+    unsigned int threads;
+    size_t       queueMax;      /* Per shard */
+    int          counted;       /* Adds to the global counters (not the benchmark pool) */
+    Mutex        lock;
+    CondVar      idle;
+    int          stopping;
+    volatile int64_t outstanding;  /* Jobs queued or running */
+    PoolShard* volatile shards[POOL_MAX_SHARDS];
+    PoolWorker   workers[POOL_MAX_THREADS];
+};
+
+static Mutex        g_lock;
+static int          g_lock_ready = 0;
+static int          g_initialized = 0;
+static HandlerPool* g_pool = NULL;
+
+static volatile int64_t g_submitted = 0;
+static volatile int64_t g_handled = 0;
+static volatile int64_t g_dropped = 0;
+static volatile int64_t g_batches = 0;
+static volatile int64_t g_steals = 0;
+
+/* ========================================================================
+ * Shards
+ * ======================================================================== */
+
+static size_t shard_slot(uint64_t connection, uint32_t lane)
+{
+    uint64_t hash = (connection ^ ((uint64_t)lane << 32)) * 0x9E3779B97F4A7C15ull;
+
+    return (size_t)(hash >> 56) % POOL_MAX_SHARDS;
+}
+
+/* Find or add the shard for a key; NULL only if out of memory */
+static PoolShard* shard_get(HandlerPool* pool, uint64_t connection, uint32_t lane)
+{
+    size_t first = shard_slot(connection, lane);
+    size_t i;
+
+    for (i = 0; i < POOL_MAX_SHARDS; i++) {
+        size_t slot = (first + i) % POOL_MAX_SHARDS;
+        PoolShard* shard = (PoolShard*)atomic_ptr_load((void* volatile*)&pool->shards[slot]);
+
+        if (shard == NULL) {
+            PoolShard* created = (PoolShard*)calloc(1, sizeof(PoolShard));
+
+            if (created == NULL) {
+                return NULL;
+            }
+            created->pool = pool;
+            created->connection = connection;
+            created->lane = lane;
+            created->home = (unsigned int)((lane != SUBSCRIPTION_LANE_CONNECTION ? lane : connection) % pool->threads);
+            mutex_init(&created->lock);
+            if (atomic_ptr_cas((void* volatile*)&pool->shards[slot], NULL, created)) {
+                return created;
+            }
+            /* Another submitter filled the slot first */
+            mutex_destroy(&created->lock);
+            free(created);
+            shard = (PoolShard*)atomic_ptr_load((void* volatile*)&pool->shards[slot]);
+        }
+        if (shard->connection == connection && shard->lane == lane) {
+            return shard;
+        }
+    }
+
+    /* Full; the table no longer changes, so this key keeps landing here */
+    return (PoolShard*)atomic_ptr_load((void* volatile*)&pool->shards[first]);
+}
+
+static void shard_name(const PoolShard* shard, char* buffer, size_t size)
+{
+    if (shard->lane == SUBSCRIPTION_LANE_CONNECTION) {
+        snprintf(buffer, size, "server connection %llu", (unsigned long long)shard->connection);
+    } else {
+        snprintf(buffer, size, "lane %08x", shard->lane);
+    }
+}
+
+/* ========================================================================
+ * Workers
+ * ======================================================================== */
+
+/* Put a ready shard on its home ring and wake a worker for it */
+static void schedule_shard(HandlerPool* pool, PoolShard* shard)
+{
+    PoolWorker* home = &pool->workers[shard->home];
+    unsigned int i;
+
+    mutex_lock(&pool->lock);
+    /* A shard is on one ring at most, so the ring cannot overflow */
+    home->ready[(home->readyHead + home->readyCount) % POOL_MAX_SHARDS] = shard;
+    home->readyCount++;
+    if (home->waiting) {
+        cond_signal(&home->wake);
+    } else {
+        /* The home worker is busy; let an idle one steal it */
+        for (i = 0; i < pool->threads; i++) {
+            if (pool->workers[i].waiting) {
+                cond_signal(&pool->workers[i].wake);
+                break;
+            }
+        }
+    }
+    mutex_unlock(&pool->lock);
+}
+
+/* Next shard for a worker, stolen if its own ring is empty; pool lock held */
+static PoolShard* take_shard(PoolWorker* worker, int* stolen)
+{
+    HandlerPool* pool = worker->pool;
+    PoolWorker* victim = NULL;
+    PoolShard* shard;
+    unsigned int i;
+
+    if (worker->readyCount == 0) {
+        for (i = 0; i < pool->threads; i++) {
+            PoolWorker* other = &pool->workers[i];
+
+            if (other != worker && other->readyCount > 0 &&
+                (victim == NULL || other->readyCount > victim->readyCount)) {
+                victim = other;
+            }
+        }
+        if (victim == NULL) {
+            return NULL;
+        }
+        *stolen = 1;
+    } else {
+        victim = worker;
+        *stolen = 0;
+    }
+
+    /* Oldest first: the shard that has waited longest */
+    shard = victim->ready[victim->readyHead];
+    victim->readyHead = (victim->readyHead + 1) % POOL_MAX_SHARDS;
+    victim->readyCount--;
+    return shard;
+}
+
+/* Thread state attached */
+static void run_job(PoolJob* job)
+{
+    PyObject* result;
+
+    switch (job->type) {
+        case POOL_JOB_EVENT:
+            python_events_deliver(&job->event, job->lane);
+            break;
+        case POOL_JOB_CALL:
+            result = PyObject_CallObject(job->callable, NULL);
+            if (result == NULL) {
+                python_engine_report_exception("", "poolbench");
+            }
+            Py_XDECREF(result);
+            break;
+    }
+}
+
+static void pool_finished(HandlerPool* pool, size_t count)
+{
+    if (atomic64_add(&pool->outstanding, -(int64_t)count) == 0) {
+        mutex_lock(&pool->lock);
+        cond_broadcast(&pool->idle);
+        mutex_unlock(&pool->lock);
+    }
+}
+
+/* Run one batch of a shard; returns the number of events run */
+static size_t run_shard(PoolShard* shard, PyThreadState** state)
+{
+    PoolJob* batch;
+    PoolJob* last;
+    uint64_t latencyNs = 0;
+    uint64_t maxLatencyNs = 0;
+    uint64_t sequence;
+    size_t count = 1;
+    int more;
+
+    mutex_lock(&shard->lock);
+    shard->state = SHARD_RUNNING;
+    batch = shard->head;
+    last = batch;
+    while (count < POOL_BATCH_MAX && last->next != NULL) {
+        last = last->next;
+        count++;
+    }
+    shard->head = last->next;
+    if (shard->head == NULL) {
+        shard->tail = NULL;
+        shard->overflowing = 0;
+    }
+    shard->queued -= count;
+    sequence = shard->sequence;
+    mutex_unlock(&shard->lock);
+    last->next = NULL;
+
+    PyEval_RestoreThread(*state);
+    TRACE_BEGIN(span);
+    while (batch != NULL) {
+        PoolJob* job = batch;
+        uint64_t waitedNs = clock_monotonic_ns() - job->queuedNs;
+
+        batch = job->next;
+        /* Jobs leave the shard in the order they were numbered */
+        if (job->sequence != sequence + 1) {
+            log_warning("Handler pool ran event %llu after %llu", (unsigned long long)job->sequence,
+                        (unsigned long long)sequence);
+        }
+        sequence = job->sequence;
+        latencyNs += waitedNs;
+        if (waitedNs > maxLatencyNs) {
+            maxLatencyNs = waitedNs;
+        }
+        run_job(job);
+        free(job);
+    }
+    TRACE_END(span, "pool", "batch");
+    *state = PyEval_SaveThread();
+
+    mutex_lock(&shard->lock);
+    shard->sequence = sequence;
+    shard->handled += count;
+    shard->latencyNs += latencyNs;
+    if (maxLatencyNs > shard->maxLatencyNs) {
+        shard->maxLatencyNs = maxLatencyNs;
+    }
+    more = shard->head != NULL;
+    shard->state = more ? SHARD_READY : SHARD_IDLE;
+    mutex_unlock(&shard->lock);
+
+    /* Back to the end of its ring so the other shards get their turn */
+    if (more) {
+        schedule_shard(shard->pool, shard);
+    }
+    return count;
+}
+
+static void worker_main(void* arg)
+{
+    PoolWorker* worker = (PoolWorker*)arg;
+    HandlerPool* pool = worker->pool;
+    PyGILState_STATE gil;
+    PyThreadState* state;
+
+    trace_set_thread_name(worker->threadName);
+
+    /* Keep one thread state for the thread's lifetime instead of one per batch */
+    gil = PyGILState_Ensure();
+    state = PyEval_SaveThread();
+
+    mutex_lock(&pool->lock);
+    for (;;) {
+        PoolShard* shard;
+        size_t count;
+        int stolen = 0;
+
+        shard = take_shard(worker, &stolen);
+        if (shard == NULL) {
+            /* Stopping runs what is queued first */
+            if (pool->stopping) {
+                break;
+            }
+            worker->waiting = 1;
+            cond_wait(&worker->wake, &pool->lock);
+            worker->waiting = 0;
+            continue;
+        }
+        mutex_unlock(&pool->lock);
+
+        count = run_shard(shard, &state);
+        if (pool->counted) {
+            atomic64_add(&g_handled, (int64_t)count);
+            atomic64_add(&g_batches, 1);
+            if (stolen) {
+                atomic64_add(&g_steals, 1);
+            }
+        }
+        pool_finished(pool, count);
+        mutex_lock(&pool->lock);
+    }
+    mutex_unlock(&pool->lock);
+
+    PyEval_RestoreThread(state);
+    PyGILState_Release(gil);
+}
+
+/* Queue a job on the shard for a key; frees it and returns 1 if dropped */
+static int pool_push(HandlerPool* pool, uint64_t connection, uint32_t lane, PoolJob* job)
+{
+    PoolShard* shard = shard_get(pool, connection, lane);
+    int wasIdle;
+
+    job->next = NULL;
+    if (shard == NULL) {
+        free(job);
+        if (pool->counted) {
+            atomic64_add(&g_dropped, 1);
+        }
+        return 1;
+    }
+
+    mutex_lock(&shard->lock);
+    if (shard->queued >= pool->queueMax) {
+        shard->dropped++;
+        if (!shard->overflowing) {
+            char name[48];
+
+            shard->overflowing = 1;
+            shard_name(shard, name, sizeof(name));
+            log_warning("Handlers for %s are falling behind; dropping events", name);
+        }
+        mutex_unlock(&shard->lock);
+        free(job);
+        if (pool->counted) {
+            atomic64_add(&g_dropped, 1);
+        }
+        return 1;
+    }
+
+    atomic64_add(&pool->outstanding, 1);
+    job->sequence = ++shard->nextSequence;
+    job->queuedNs = clock_monotonic_ns();
+    if (shard->tail != NULL) {
+        shard->tail->next = job;
+    } else {
+        shard->head = job;
+    }
+    shard->tail = job;
+    shard->queued++;
+    if (shard->queued > shard->maxQueued) {
+        shard->maxQueued = shard->queued;
+    }
+    /* A ready or running shard is already on its way to a worker */
+    wasIdle = shard->state == SHARD_IDLE;
+    if (wasIdle) {
+        shard->state = SHARD_READY;
+    }
+    mutex_unlock(&shard->lock);
+
+    if (wasIdle) {
+        schedule_shard(pool, shard);
+    }
+    if (pool->counted) {
+        atomic64_add(&g_submitted, 1);
+    }
+    return 0;
+}
+
+static void pool_wait_idle(HandlerPool* pool)
+{
+    mutex_lock(&pool->lock);
+    while (atomic64_load(&pool->outstanding) > 0) {
+        cond_wait(&pool->idle, &pool->lock);
+    }
+    mutex_unlock(&pool->lock);
+}
+
+/* Let the workers run the queued events, then join them and free the pool (no GIL) */
+static void pool_destroy(HandlerPool* pool)
+{
+    unsigned int i;
+
+    mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    for (i = 0; i < pool->threads; i++) {
+        cond_signal(&pool->workers[i].wake);
+    }
+    mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threads; i++) {
+        thread_join(pool->workers[i].thread);
+    }
+    for (i = 0; i < POOL_MAX_THREADS; i++) {
+        cond_destroy(&pool->workers[i].wake);
+    }
+    for (i = 0; i < POOL_MAX_SHARDS; i++) {
+        PoolShard* shard = pool->shards[i];
+
+        if (shard != NULL) {
+            mutex_destroy(&shard->lock);
+            free(shard);
+        }
+    }
+    cond_destroy(&pool->idle);
+    mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/* Start threads workers (1..POOL_MAX_THREADS); NULL on failure (logged) */
+static HandlerPool* pool_create(unsigned int threads, size_t queueMax, int counted, const char* name)
+{
+    HandlerPool* pool = (HandlerPool*)calloc(1, sizeof(HandlerPool));
+    unsigned int i;
+
+    if (pool == NULL) {
+        log_error("Out of memory starting the handler pool");
+        return NULL;
+    }
+    pool->queueMax = queueMax;
+    pool->counted = counted;
+    mutex_init(&pool->lock);
+    cond_init(&pool->idle);
+    for (i = 0; i < POOL_MAX_THREADS; i++) {
+        cond_init(&pool->workers[i].wake);
+    }
+
+    /* Set first: shards pick their home worker from it */
+    pool->threads = threads;
+    for (i = 0; i < threads; i++) {
+        PoolWorker* worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->index = i;
+        snprintf(worker->threadName, sizeof(worker->threadName), "%s %u", name, i + 1);
+        if (thread_create(&worker->thread, worker_main, worker) != 0) {
+            log_error("Failed to start %s", worker->threadName);
+            break;
+        }
+    }
+
+    if (i < threads) {
+        pool->threads = i;
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* ========================================================================
+ * Running pool
+ * ======================================================================== */
+
+int python_pool_free_threaded(void)
+{
+#ifdef Py_GIL_DISABLED
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Workers wanted for a configuration; 0 runs handlers on the client thread */
+static unsigned int configured_threads(const PluginConfig* config)
+{
+    if (config->handlerThreads > 0) {
+        return config->handlerThreads < POOL_MAX_THREADS ? config->handlerThreads : POOL_MAX_THREADS;
+    }
+    return python_pool_free_threaded() ? POOL_DEFAULT_THREADS : 0;
+}
+
+/* Replace the running pool (no GIL); events already queued finish on the old workers */
+static void pool_restart(unsigned int threads)
+{
+    HandlerPool* pool = NULL;
+    HandlerPool* old;
+
+    if (threads > 0) {
+        pool = pool_create(threads, POOL_QUEUE_MAX, 1, "TsPy handlers");
+        if (pool == NULL) {
+            log_warning("Event handlers run on the client thread");
+        }
+    }
+
+    mutex_lock(&g_lock);
+    old = g_pool;
+    g_pool = pool;
+    mutex_unlock(&g_lock);
+
+    if (old != NULL) {
+        pool_destroy(old);
+    }
+    if (pool != NULL) {
+        log_info("Event handlers run on %u thread(s)%s", threads,
+                 python_pool_free_threaded() ? " without a GIL" : "");
+    } else if (old != NULL) {
+        log_info("Event handlers run on the client thread");
+    }
+}
+
+/* ConfigListener: follow [scripts] handler_threads */
+static void on_config_changed(const PluginConfig* config, const PluginConfig* previous)
+{
+    if (configured_threads(config) != configured_threads(previous)) {
+        pool_restart(configured_threads(config));
+    }
+}
+
+int python_pool_init(void)
+{
+    if (g_initialized) {
+        return 0;
+    }
+
+    /* Kept across shutdown, like the dispatcher's lock that is held while submitting */
+    if (!g_lock_ready) {
+        mutex_init(&g_lock);
+        g_lock_ready = 1;
+    }
+    g_initialized = 1;
+    pool_restart(configured_threads(get_config()));
+    add_config_listener(on_config_changed);
+    return 0;
+}
+
+/* Copy an event into a job for one lane; NULL if out of memory */
+static PoolJob* event_job(const PythonEvent* event, uint32_t lane)
+{
+    PoolJob* job = (PoolJob*)malloc(sizeof(PoolJob) + python_event_copy_size(event));
+
+    if (job != NULL) {
+        memset(job, 0, sizeof(PoolJob));
+        job->type = POOL_JOB_EVENT;
+        job->lane = lane;
+        python_event_copy(&job->event, event, (char*)(job + 1));
+    }
+    return job;
+}
+
+static void submit_lane(HandlerPool* pool, const PythonEvent* event, uint64_t connection, uint32_t lane)
+{
+    PoolJob* job = event_job(event, lane);
+
+    if (job == NULL) {
+        atomic64_add(&g_dropped, 1);
+        return;
+    }
+    pool_push(pool, connection, lane, job);
+}
+
+int python_pool_submit(const PythonEvent* event)
+{
+    uint32_t lanes[SUBSCRIPTION_MAX_LANES];
+    size_t count;
+    size_t i;
+
+    if (!g_initialized) {
+        return 1;
+    }
+
+    mutex_lock(&g_lock);
+    if (g_pool == NULL) {
+        mutex_unlock(&g_lock);
+        return 1;
+    }
+
+    /* One job per lane with handlers; the connection lane also carries the on_* functions */
+    submit_lane(g_pool, event, event->serverConnectionHandlerID, SUBSCRIPTION_LANE_CONNECTION);
+    count = python_subscriptions_lanes(event->type, lanes);
+    for (i = 0; i < count; i++) {
+        submit_lane(g_pool, event, 0, lanes[i]);
+    }
+    mutex_unlock(&g_lock);
+    return 0;
+}
+
+void python_pool_get_stats(PoolStats* stats)
+{
+    unsigned int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->freeThreaded = python_pool_free_threaded();
+    stats->submitted = (uint64_t)atomic64_load(&g_submitted);
+    stats->handled = (uint64_t)atomic64_load(&g_handled);
+    stats->dropped = (uint64_t)atomic64_load(&g_dropped);
+    stats->batches = (uint64_t)atomic64_load(&g_batches);
+    stats->steals = (uint64_t)atomic64_load(&g_steals);
+
+    if (!g_initialized) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    if (g_pool != NULL) {
+        stats->threads = g_pool->threads;
+        for (i = 0; i < POOL_MAX_SHARDS; i++) {
+            PoolShard* shard = (PoolShard*)atomic_ptr_load((void* volatile*)&g_pool->shards[i]);
+
+            if (shard != NULL) {
+                stats->shards++;
+                mutex_lock(&shard->lock);
+                stats->queued += shard->queued;
+                mutex_unlock(&shard->lock);
+            }
+        }
+    }
+    mutex_unlock(&g_lock);
+}
+
+/* qsort: most queued first, then most handled */
+static int compare_shards(const void* a, const void* b)
+{
+    const PoolShardStats* left = (const PoolShardStats*)a;
+    const PoolShardStats* right = (const PoolShardStats*)b;
+
+    if (left->queued != right->queued) {
+        return left->queued > right->queued ? -1 : 1;
+    }
+    if (left->handled != right->handled) {
+        return left->handled > right->handled ? -1 : 1;
+    }
+    return 0;
+}
+
+size_t python_pool_get_shards(PoolShardStats* shards, size_t max)
+{
+    PoolShardStats all[POOL_MAX_SHARDS];
+    size_t count = 0;
+    unsigned int i;
+
+    if (!g_initialized || max == 0) {
+        return 0;
+    }
+    mutex_lock(&g_lock);
+    if (g_pool != NULL) {
+        for (i = 0; i < POOL_MAX_SHARDS; i++) {
+            PoolShard* shard = (PoolShard*)atomic_ptr_load((void* volatile*)&g_pool->shards[i]);
+            PoolShardStats* out = &all[count];
+
+            if (shard == NULL) {
+                continue;
+            }
+            mutex_lock(&shard->lock);
+            out->connection = shard->connection;
+            out->lane = shard->lane;
+            out->home = shard->home + 1;
+            out->queued = shard->queued;
+            out->maxQueued = shard->maxQueued;
+            out->sequence = shard->sequence;
+            out->handled = shard->handled;
+            out->dropped = shard->dropped;
+            out->latencyNs = shard->latencyNs;
+            out->maxLatencyNs = shard->maxLatencyNs;
+            mutex_unlock(&shard->lock);
+            count++;
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    qsort(all, count, sizeof(PoolShardStats), compare_shards);
+    if (count > max) {
+        count = max;
+    }
+    memcpy(shards, all, count * sizeof(PoolShardStats));
+    return count;
+}
+
+void python_pool_stop(void)
+{
+    HandlerPool* pool;
+
+    if (!g_initialized) {
+        return;
+    }
+
+    remove_config_listener(on_config_changed);
+    mutex_lock(&g_lock);
+    pool = g_pool;
+    g_pool = NULL;
+    mutex_unlock(&g_lock);
+    if (pool != NULL) {
+        pool_destroy(pool);
+    }
+    g_initialized = 0;
+}
+
+/* ========================================================================
+ * Benchmark
+ * ======================================================================== */
+
+/* A handler doing a little work per event, as a chat bot parsing a message would */
+static const char* const g_workload =
+    "def handler():\n"
+    "    total = 0\n"
+    "    for i in range(2000):\n"
+    "        total += i * i % 7\n"
+    "    return total\n";
+
+int python_pool_benchmark(unsigned int connections, size_t events, PoolBenchmark* result)
+{
+    PyGILState_STATE gil;
+    PyObject* globals;
+    PyObject* handler = NULL;
+    PyObject* value;
+    HandlerPool* pool;
+    uint64_t startNs;
+    size_t i;
+
+    memset(result, 0, sizeof(*result));
+    if (connections < 1 || connections > 64 || events == 0) {
+        log_error("poolbench needs 1-64 connections and at least one event");
+        return 1;
+    }
+    result->connections = connections;
+    result->events = events;
+    result->freeThreaded = python_pool_free_threaded();
+    result->threads = connections < POOL_MAX_THREADS ? connections : POOL_MAX_THREADS;
+
+    gil = PyGILState_Ensure();
+    globals = PyDict_New();
+    if (globals != NULL && PyDict_SetItemString(globals, "__builtins__", PyEval_GetBuiltins()) == 0) {
+        value = PyRun_String(g_workload, Py_file_input, globals, globals);
+        Py_XDECREF(value);
+        handler = PyDict_GetItemString(globals, "handler");
+        Py_XINCREF(handler);
+    }
+    if (handler == NULL) {
+        python_engine_report_exception("", "poolbench");
+        Py_XDECREF(globals);
+        PyGILState_Release(gil);
+        return 1;
+    }
+
+    startNs = clock_monotonic_ns();
+    for (i = 0; i < events; i++) {
+        value = PyObject_CallObject(handler, NULL);
+        if (value == NULL) {
+            python_engine_report_exception("", "poolbench");
+        }
+        Py_XDECREF(value);
+    }
+    result->inlineNs = clock_monotonic_ns() - startNs;
+    PyGILState_Release(gil);
+
+    /* A pool of its own, so queued script events neither delay nor inflate the measurement */
+    pool = pool_create(result->threads, (size_t)-1, 0, "TsPy poolbench");
+    if (pool == NULL) {
+        gil = PyGILState_Ensure();
+        Py_DECREF(handler);
+        Py_DECREF(globals);
+        PyGILState_Release(gil);
+        return 1;
+    }
+
+    startNs = clock_monotonic_ns();
+    for (i = 0; i < events; i++) {
+        PoolJob* job = (PoolJob*)calloc(1, sizeof(PoolJob));
+
+        if (job == NULL) {
+            continue;
+        }
+        job->type = POOL_JOB_CALL;
+        job->callable = handler;
+        /* Connection IDs start at 1, as TeamSpeak's do */
+        pool_push(pool, (uint64_t)(i % connections) + 1, SUBSCRIPTION_LANE_CONNECTION, job);
+    }
+    pool_wait_idle(pool);
+    result->poolNs = clock_monotonic_ns() - startNs;
+    pool_destroy(pool);
+
+    gil = PyGILState_Ensure();
+    Py_DECREF(handler);
+    Py_DECREF(globals);
+    PyGILState_Release(gil);
+    return 0;
+}
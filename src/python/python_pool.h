@@ -0,0 +1,164 @@
+/**
+ * @file python_pool.h
+ * @brief Handler pool: event handlers on worker threads, in parallel per lane
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * With a pool the dispatcher copies each event and returns at once instead of
+ * running the handlers on the TeamSpeak thread. Events are split into lanes:
+ * the connection lane (the on_* functions and every handler that names no
+ * lane) follows the server connection, and each lane named with
+ * @ts3api.on(..., lane="...") is a lane of its own.
+ *
+ * Every server connection and every named lane has a shard: a queue of its
+ * own with sequence numbers, run by one worker at a time in that order. A
+ * flood on one server therefore only fills that server's shard, and an idle
+ * worker steals waiting shards from busy ones so no shard waits behind
+ * another.
+ *
+ * On free-threaded Python (3.13t and newer) the workers run Python truly in
+ * parallel. With a GIL they take turns, which still keeps the client thread
+ * free and lets handlers that block on I/O overlap.
+ */
+
+#ifndef PYTHON_POOL_H
+#define PYTHON_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "python_events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Most worker threads
+ */
+#define POOL_MAX_THREADS 16
+
+/**
+ * @brief Workers started when [scripts] handler_threads is 0 on free-threaded Python
+ */
+#define POOL_DEFAULT_THREADS 4
+
+/**
+ * @brief Most events queued for one shard; later ones are dropped
+ */
+#define POOL_QUEUE_MAX 4096
+
+/**
+ * @brief Most shards a pool keeps apart; beyond that connections share shards
+ */
+#define POOL_MAX_SHARDS 256
+
+/**
+ * @brief Most events of one shard run per GIL acquisition
+ */
+#define POOL_BATCH_MAX 64
+
+/**
+ * @brief Handler pool counters
+ */
+typedef struct PoolStats {
+    unsigned int threads;       /* Workers running, 0 if handlers run on the client thread */
+    int          freeThreaded;  /* 1 if Python runs without a GIL */
+    size_t       shards;        /* Shards in use */
+    size_t       queued;        /* Jobs waiting, all shards */
+    uint64_t     submitted;     /* Jobs queued since start */
+    uint64_t     handled;       /* Jobs run */
+    uint64_t     dropped;       /* Jobs dropped because a queue was full */
+    uint64_t     batches;       /* Shard batches run */
+    uint64_t     steals;        /* Batches a worker took from another worker */
+} PoolStats;
+
+/**
+ * @brief Counters of one shard
+ */
+typedef struct PoolShardStats {
+    uint64_t     connection;    /* Server connection, 0 for a named lane */
+    uint32_t     lane;          /* SUBSCRIPTION_LANE_CONNECTION or the named lane */
+    unsigned int home;          /* Worker the shard is queued on (1-based) */
+    size_t       queued;        /* Events waiting */
+    size_t       maxQueued;     /* Deepest the queue has been */
+    uint64_t     sequence;      /* Sequence number of the last event handled */
+    uint64_t     handled;       /* Events run */
+    uint64_t     dropped;       /* Events dropped because the queue was full */
+    uint64_t     latencyNs;     /* Queued until handled, summed */
+    uint64_t     maxLatencyNs;  /* Longest wait */
+} PoolShardStats;
+
+/**
+ * @brief Results of python_pool_benchmark
+ */
+typedef struct PoolBenchmark {
+    unsigned int connections;   /* Simulated server connections */
+    unsigned int threads;       /* Workers used */
+    size_t       events;        /* Events per run */
+    int          freeThreaded;  /* 1 if Python runs without a GIL */
+    uint64_t     inlineNs;      /* All events handled on the calling thread */
+    uint64_t     poolNs;        /* The same events spread over the workers */
+} PoolBenchmark;
+
+/**
+ * @brief Whether this Python build runs without a GIL
+ * @return 1 on free-threaded Python, 0 otherwise
+ */
+int python_pool_free_threaded(void);
+
+/**
+ * @brief Start the workers [scripts] handler_threads asks for and follow changes to it
+ * @return 0 on success (also when no workers are wanted), non-zero on failure
+ * @note Call once at engine start; the workers wait for the GIL until it is released
+ */
+int python_pool_init(void);
+
+/**
+ * @brief Queue an event for the workers of its lanes
+ * @param event Event; its strings are copied
+ * @return 0 if queued (or dropped), 1 if there is no pool and the caller must deliver it
+ * @note Any thread; does not need the GIL
+ */
+int python_pool_submit(const PythonEvent* event);
+
+/**
+ * @brief Read the pool counters
+ * @param stats Receives the counters
+ */
+void python_pool_get_stats(PoolStats* stats);
+
+/**
+ * @brief Read the counters of the running pool's shards
+ * @param shards Receives up to max shards, busiest first
+ * @param max Capacity of shards
+ * @return Number of shards written
+ */
+size_t python_pool_get_shards(PoolShardStats* shards, size_t max);
+
+/**
+ * @brief Measure handler throughput with events from several connections
+ *
+ * Runs a small CPU-bound Python handler once per event, first on the calling
+ * thread and then on a temporary pool with one worker per connection (at
+ * most POOL_MAX_THREADS), each connection's events going to its shard.
+ *
+ * @param connections Simulated connections (1-64)
+ * @param events Events per run
+ * @param result Receives the timings
+ * @return 0 on success, non-zero on failure (logged)
+ * @note Call without the GIL; scripts and the running pool are not involved
+ */
+int python_pool_benchmark(unsigned int connections, size_t events, PoolBenchmark* result);
+
+/**
+ * @brief Run the queued events and stop the workers
+ * @note Call without the GIL, before the main thread takes it back for shutdown
+ */
+void python_pool_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_POOL_H */
@@ -0,0 +1,456 @@
+/**
+ * @file python_preload.c
+ * @brief Startup script loading implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Three stages. Reader threads take scripts in manifest order and prefetch
+ * the source and cache file of each. The calling thread compiles them in the
+ * order they arrive, taking the GIL for each batch. Once all are compiled, the
+ * scripts run in dependency order through python_engine_load_script_in, which
+ * then finds the code in the code cache (in memory for the main interpreter,
+ * in the cache file for an isolated one).
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_preload.h"
+#include "python_codecache.h"
+#include "python_engine.h"
+#include "core/plugin_main.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+typedef enum {
+    ITEM_PENDING = 0,   /* Waiting for a reader */
+    ITEM_FETCHED,       /* Read; waiting to be compiled */
+    ITEM_COMPILED,
+    ITEM_LOADED,
+    ITEM_FAILED
+} ItemState;
+
+typedef struct PreloadItem {
+    char          file[SCRIPT_NAME_BUFSIZE];
+    char          path[PATH_BUFSIZE];
+    char          interpreter[SCRIPT_NAME_BUFSIZE];   /* Empty for the main interpreter */
+    char          after[PRELOAD_MAX_DEPENDENCIES][SCRIPT_NAME_BUFSIZE];
+    size_t        afterCount;
+    int           dependencies[PRELOAD_MAX_DEPENDENCIES];
+    size_t        dependencyCount;
+    ItemState     state;
+    CodePrefetch* prefetch;
+} PreloadItem;
+
+typedef struct Preload {
+    PreloadItem* items;
+    size_t       count;
+    Mutex        lock;        /* Guards next, fetched and the PENDING -> FETCHED step */
+    CondVar      fetched;
+    size_t       next;        /* Next item for a reader */
+    size_t       fetchedCount;
+    uint64_t     start;
+} Preload;
+
+static StartupStats g_stats;
+
+/* ========================================================================
+ * Manifest
+ * ======================================================================== */
+
+static char* trim(char* text)
+{
+    char* end;
+
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+/* Script file name as written, with ".py" added if missing */
+static void script_file(char* dest, size_t destSize, const char* name)
+{
+    size_t length = strlen(name);
+
+    if (length >= 3 && strcmp(name + length - 3, ".py") == 0) {
+        safe_strcpy(dest, destSize, name);
+    } else {
+        snprintf(dest, destSize, "%s.py", name);
+    }
+}
+
+static int find_item(const PreloadItem* items, size_t count, const char* file)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(items[i].file, file) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/* Read the manifest into items; -1 if there is none */
+static int read_manifest(const char* manifest_path, const char* scripts_path, PreloadItem* items, size_t* count)
+{
+    char line[1024];
+    char interpreter[SCRIPT_NAME_BUFSIZE] = "";
+    unsigned int line_number = 0;
+    FILE* fp = fopen(manifest_path, "r");
+
+    if (fp == NULL) {
+        return -1;
+    }
+
+    *count = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char file[SCRIPT_NAME_BUFSIZE];
+        char* text = line;
+        char* after;
+        char* token;
+        char* context = NULL;
+        PreloadItem* item;
+
+        line_number++;
+        if (line_number == 1 && (unsigned char)text[0] == 0xEF && (unsigned char)text[1] == 0xBB
+            && (unsigned char)text[2] == 0xBF) {
+            text += 3;
+        }
+        text[strcspn(text, ";#")] = '\0';
+        text = trim(text);
+        if (text[0] == '\0') {
+            continue;
+        }
+        if (text[0] == '[') {
+            /* "[interpreter NAME]" starts a group of isolated scripts; any other section ends it */
+            char* close = strchr(text, ']');
+
+            interpreter[0] = '\0';
+            if (close != NULL && strncmp(text + 1, "interpreter", 11) == 0 && isspace((unsigned char)text[12])) {
+                *close = '\0';
+                safe_strcpy(interpreter, sizeof(interpreter), trim(text + 12));
+            }
+            continue;
+        }
+
+        after = strchr(text, '=');
+        if (after != NULL) {
+            *after++ = '\0';
+        }
+        script_file(file, sizeof(file), trim(text));
+        if (find_item(items, *count, file) >= 0) {
+            log_warning("%s:%u: %s is listed twice", PRELOAD_MANIFEST, line_number, file);
+            continue;
+        }
+        if (*count == PRELOAD_MAX_SCRIPTS) {
+            log_warning("%s:%u: more than %d scripts, ignoring the rest", PRELOAD_MANIFEST, line_number,
+                        PRELOAD_MAX_SCRIPTS);
+            break;
+        }
+
+        item = &items[(*count)++];
+        memset(item, 0, sizeof(*item));
+        safe_strcpy(item->file, sizeof(item->file), file);
+        safe_strcpy(item->interpreter, sizeof(item->interpreter), interpreter);
+        join_path(item->path, sizeof(item->path), scripts_path, file);
+
+#ifdef _WIN32
+        token = after != NULL ? strtok_s(after, ", \t", &context) : NULL;
+#else
+        token = after != NULL ? strtok_r(after, ", \t", &context) : NULL;
+#endif
+        while (token != NULL) {
+            if (item->afterCount == PRELOAD_MAX_DEPENDENCIES) {
+                log_warning("%s:%u: more than %d dependencies", PRELOAD_MANIFEST, line_number,
+                            PRELOAD_MAX_DEPENDENCIES);
+                break;
+            }
+            script_file(item->after[item->afterCount++], SCRIPT_NAME_BUFSIZE, token);
+#ifdef _WIN32
+            token = strtok_s(NULL, ", \t", &context);
+#else
+            token = strtok_r(NULL, ", \t", &context);
+#endif
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* Turn dependency names into indices; names missing from the manifest are ignored */
+static void resolve_dependencies(PreloadItem* items, size_t count)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < items[i].afterCount; j++) {
+            int index = find_item(items, count, items[i].after[j]);
+
+            if (index < 0) {
+                log_warning("%s: %s depends on %s, which is not listed", PRELOAD_MANIFEST, items[i].file,
+                            items[i].after[j]);
+            } else if ((size_t)index != i) {
+                items[i].dependencies[items[i].dependencyCount++] = index;
+            }
+        }
+    }
+}
+
+/* Run order with every script after its dependencies, otherwise in manifest order; returns how many fit */
+static size_t order_scripts(const PreloadItem* items, size_t count, int* order)
+{
+    unsigned char placed[PRELOAD_MAX_SCRIPTS];
+    size_t ordered = 0;
+    size_t i;
+    size_t j;
+
+    memset(placed, 0, sizeof(placed));
+    while (ordered < count) {
+        /* Earliest listed script whose dependencies are all placed */
+        for (i = 0; i < count; i++) {
+            if (placed[i]) {
+                continue;
+            }
+            for (j = 0; j < items[i].dependencyCount && placed[items[i].dependencies[j]]; j++) {
+            }
+            if (j == items[i].dependencyCount) {
+                break;
+            }
+        }
+        if (i == count) {
+            break;   /* The rest depend on each other */
+        }
+        placed[i] = 1;
+        order[ordered++] = (int)i;
+    }
+    return ordered;
+}
+
+/* ========================================================================
+ * Stages
+ * ======================================================================== */
+
+static void reader_main(void* arg)
+{
+    Preload* preload = (Preload*)arg;
+
+    for (;;) {
+        CodePrefetch* prefetch;
+        size_t index;
+
+        mutex_lock(&preload->lock);
+        index = preload->next < preload->count ? preload->next++ : preload->count;
+        mutex_unlock(&preload->lock);
+        if (index == preload->count) {
+            break;
+        }
+
+        TRACE_BEGIN(span);
+        prefetch = python_codecache_prefetch(preload->items[index].path);
+        TRACE_END(span, "script", "prefetch");
+
+        mutex_lock(&preload->lock);
+        preload->items[index].prefetch = prefetch;
+        preload->items[index].state = ITEM_FETCHED;
+        if (++preload->fetchedCount == preload->count) {
+            g_stats.readNs = clock_monotonic_ns() - preload->start;
+        }
+        cond_broadcast(&preload->fetched);
+        mutex_unlock(&preload->lock);
+    }
+}
+
+/* Compile scripts as readers deliver them; returns when all are compiled */
+static void compile_scripts(Preload* preload)
+{
+    size_t compiled = 0;
+    size_t fetched = 0;
+
+    while (compiled < preload->count) {
+        PyGILState_STATE gil;
+        uint64_t begin;
+        size_t i;
+
+        mutex_lock(&preload->lock);
+        while (preload->fetchedCount == fetched) {
+            cond_wait(&preload->fetched, &preload->lock);
+        }
+        fetched = preload->fetchedCount;
+        mutex_unlock(&preload->lock);
+
+        /* Items only move from FETCHED under the GIL, by this thread */
+        begin = clock_monotonic_ns();
+        gil = PyGILState_Ensure();
+        for (i = 0; i < preload->count; i++) {
+            PreloadItem* item = &preload->items[i];
+            uint32_t checksum;
+            PyObject* code;
+            int ready;
+
+            mutex_lock(&preload->lock);
+            ready = item->state == ITEM_FETCHED;
+            mutex_unlock(&preload->lock);
+            if (!ready) {
+                continue;
+            }
+
+            /* A failure is reported when the script is loaded, which compiles it again */
+            code = item->prefetch != NULL ? python_codecache_compile(item->prefetch, &checksum) : NULL;
+            if (code == NULL) {
+                PyErr_Clear();
+            }
+            Py_XDECREF(code);
+            python_codecache_prefetch_free(item->prefetch);
+            item->prefetch = NULL;
+            item->state = ITEM_COMPILED;
+            compiled++;
+        }
+        PyGILState_Release(gil);
+        g_stats.compileNs += clock_monotonic_ns() - begin;
+    }
+}
+
+/* Run scripts in dependency order; a script whose dependency failed is skipped */
+static void run_scripts(PreloadItem* items, size_t count)
+{
+    int order[PRELOAD_MAX_SCRIPTS];
+    size_t ordered = order_scripts(items, count, order);
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < ordered; i++) {
+        PreloadItem* item = &items[order[i]];
+        const PreloadItem* missing = NULL;
+        uint64_t begin;
+
+        for (j = 0; j < item->dependencyCount && missing == NULL; j++) {
+            if (items[item->dependencies[j]].state != ITEM_LOADED) {
+                missing = &items[item->dependencies[j]];
+            }
+        }
+        if (missing != NULL) {
+            log_warning("Not loading %s: %s did not load", item->file, missing->file);
+            item->state = ITEM_FAILED;
+            continue;
+        }
+
+        begin = clock_monotonic_ns();
+        item->state = python_engine_load_script_in(item->path, item->interpreter) == 0 ? ITEM_LOADED : ITEM_FAILED;
+        g_stats.runNs += clock_monotonic_ns() - begin;
+        if (item->state == ITEM_LOADED) {
+            log_info("Auto-loaded: %s", item->file);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (items[i].state == ITEM_COMPILED) {
+            log_error("Not loading %s: its dependencies form a cycle", items[i].file);
+            items[i].state = ITEM_FAILED;
+        }
+    }
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+int python_preload_run(const char* scripts_path)
+{
+    Thread threads[PRELOAD_THREADS];
+    char manifest_path[PATH_BUFSIZE];
+    Preload preload;
+    unsigned int started = 0;
+    FILE* fp;
+    size_t i;
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    memset(&preload, 0, sizeof(preload));
+    preload.start = clock_monotonic_ns();
+    preload.items = (PreloadItem*)calloc(PRELOAD_MAX_SCRIPTS, sizeof(PreloadItem));
+    if (preload.items == NULL) {
+        log_error("Out of memory loading startup scripts");
+        return 1;
+    }
+
+    join_path(manifest_path, sizeof(manifest_path), scripts_path, PRELOAD_MANIFEST);
+    if (read_manifest(manifest_path, scripts_path, preload.items, &preload.count) != 0) {
+        /* No manifest: the init script alone, if there is one */
+        safe_strcpy(preload.items[0].file, sizeof(preload.items[0].file), PRELOAD_DEFAULT_SCRIPT);
+        join_path(preload.items[0].path, sizeof(preload.items[0].path), scripts_path, PRELOAD_DEFAULT_SCRIPT);
+        fp = fopen(preload.items[0].path, "r");
+        if (fp != NULL) {
+            fclose(fp);
+            preload.count = 1;
+        } else {
+            preload.count = 0;
+            log_info("No %s or %s; use /tspy python load <script> to load scripts", PRELOAD_MANIFEST,
+                     PRELOAD_DEFAULT_SCRIPT);
+        }
+    }
+    resolve_dependencies(preload.items, preload.count);
+    g_stats.scripts = preload.count;
+
+    if (preload.count > 0) {
+        mutex_init(&preload.lock);
+        cond_init(&preload.fetched);
+
+        while (started < PRELOAD_THREADS && started < preload.count
+               && thread_create(&threads[started], reader_main, &preload) == 0) {
+            started++;
+        }
+        if (started == 0) {
+            reader_main(&preload);   /* No threads: read everything here first */
+        }
+        g_stats.threads = started;
+
+        compile_scripts(&preload);
+        for (i = 0; i < started; i++) {
+            thread_join(threads[i]);
+        }
+        cond_destroy(&preload.fetched);
+        mutex_destroy(&preload.lock);
+
+        run_scripts(preload.items, preload.count);
+    }
+
+    for (i = 0; i < preload.count; i++) {
+        if (preload.items[i].state == ITEM_LOADED) {
+            g_stats.loaded++;
+        } else {
+            g_stats.failed++;
+        }
+    }
+    free(preload.items);
+
+    g_stats.totalNs = clock_monotonic_ns() - preload.start;
+    log_info("Startup: %zu of %zu scripts ready in %.1f ms", g_stats.loaded, g_stats.scripts,
+             g_stats.totalNs / 1e6);
+    return (int)g_stats.failed;
+}
+
+void python_preload_get_stats(StartupStats* stats)
+{
+    *stats = g_stats;
+}
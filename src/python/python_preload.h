@@ -0,0 +1,90 @@
+/**
+ * @file python_preload.h
+ * @brief Startup loading of the scripts listed in the manifest
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * The manifest (tspy_scripts.ini in the scripts folder) lists the scripts to
+ * load at startup and what each depends on:
+ *
+ *     tspy_init.py
+ *     greeter.py = tspy_init.py
+ *     stats.py   = greeter.py, helpers.py
+ *
+ * Scripts and their cache files are read on a few threads, compiled as they
+ * arrive, and finally run one at a time with every script after the scripts it
+ * depends on. Without a manifest only tspy_init.py is loaded.
+ *
+ * Scripts listed under an "[interpreter NAME]" section run in that isolated
+ * interpreter (see python_interpreters.h); any other section header returns
+ * to the main interpreter.
+ */
+
+#ifndef PYTHON_PRELOAD_H
+#define PYTHON_PRELOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Manifest file name inside the scripts folder
+ */
+#define PRELOAD_MANIFEST "tspy_scripts.ini"
+
+/**
+ * @brief Script loaded when there is no manifest
+ */
+#define PRELOAD_DEFAULT_SCRIPT "tspy_init.py"
+
+/**
+ * @brief Most scripts a manifest may list
+ */
+#define PRELOAD_MAX_SCRIPTS 256
+
+/**
+ * @brief Most dependencies of one script
+ */
+#define PRELOAD_MAX_DEPENDENCIES 16
+
+/**
+ * @brief Most threads reading scripts
+ */
+#define PRELOAD_THREADS 4
+
+/**
+ * @brief Timings of the last startup load
+ */
+typedef struct StartupStats {
+    size_t       scripts;     /* Scripts in the manifest */
+    size_t       loaded;      /* Scripts that loaded */
+    size_t       failed;      /* Scripts that failed or were skipped */
+    unsigned int threads;     /* Threads that read scripts */
+    uint64_t     readNs;      /* Until the last script was read */
+    uint64_t     compileNs;   /* Compiling (or unmarshalling), summed */
+    uint64_t     runNs;       /* Running the module bodies, summed */
+    uint64_t     totalNs;     /* Until all scripts were ready */
+} StartupStats;
+
+/**
+ * @brief Load the startup scripts
+ * @param scripts_path Scripts folder
+ * @return Number of scripts that failed or were skipped
+ * @note Call without the GIL, after the engine and event dispatcher are up
+ */
+int python_preload_run(const char* scripts_path);
+
+/**
+ * @brief Read the timings of the last python_preload_run
+ * @param stats Receives the timings
+ */
+void python_preload_get_stats(StartupStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_PRELOAD_H */
@@ -0,0 +1,574 @@
+/**
+ * @file python_profile.c
+ * @brief Sampling profiler implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Threads register in a small table the first time they enter script code
+ * while profiling; the slot holds the thread's state while it is inside
+ * and NULL otherwise. Both only change with the GIL held, so once the
+ * sampler holds it every registered thread is parked with a stable frame
+ * stack, the same guarantee sys._current_frames() relies on. Without any
+ * registered thread inside script code the sampler does not touch the GIL.
+ *
+ * The call tree holds a strong reference to each code object in it, so
+ * names and file names are only looked up when the profile is written.
+ * Only the sampler thread changes the tree until python_profile_stop has
+ * joined it.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+/* Python.h declares PyFrame_GetBack() only from 3.11 on */
+#if PY_VERSION_HEX < 0x030B0000
+#include <frameobject.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_profile.h"
+#include "python_engine.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/trace.h"
+
+typedef struct ProfileThread {
+    PyThreadState* volatile state;   /* Set while the thread runs script code */
+} ProfileThread;
+
+/* Node 0 is the root; children are a singly linked sibling list */
+typedef struct ProfileNode {
+    PyObject* code;
+    uint32_t  parent;
+    uint32_t  child;
+    uint32_t  sibling;
+    uint64_t  self;      /* Samples whose innermost frame is this node */
+} ProfileNode;
+
+static volatile int32_t g_active = 0;
+static int              g_running = 0;
+static int              g_stopping = 0;
+static Thread           g_thread;
+static Mutex            g_lock;      /* Guards g_stats and the sampler's wake-up */
+static CondVar          g_wake;
+static ProfileStats     g_stats;
+static uint64_t         g_start_ns = 0;
+
+static ProfileThread    g_threads[PROFILE_MAX_THREADS];
+static volatile int32_t g_thread_count = 0;
+static volatile int32_t g_inside = 0;    /* Registered threads in script code */
+
+/* Sampler thread only while running */
+static ProfileNode* g_nodes = NULL;
+static size_t       g_node_count = 0;
+static size_t       g_node_capacity = 0;
+
+static THREAD_LOCAL int            t_depth = 0;
+static THREAD_LOCAL ProfileThread* t_thread = NULL;
+
+/* ========================================================================
+ * Thread registry
+ * ======================================================================== */
+
+void python_profile_enter(void)
+{
+    int32_t index;
+
+    if (++t_depth != 1 || atomic32_load(&g_active) == 0 || !python_engine_in_main_interpreter()) {
+        return;
+    }
+    if (t_thread == NULL) {
+        index = atomic32_add(&g_thread_count, 1) - 1;
+        if (index >= PROFILE_MAX_THREADS) {
+            atomic32_store(&g_thread_count, PROFILE_MAX_THREADS);
+            return;
+        }
+        t_thread = &g_threads[index];
+    }
+    atomic_ptr_store((void* volatile*)&t_thread->state, PyThreadState_Get());
+    atomic32_add(&g_inside, 1);
+}
+
+void python_profile_leave(void)
+{
+    if (t_depth > 0) {
+        t_depth--;
+    }
+    if (t_depth == 0 && t_thread != NULL && atomic_ptr_load((void* volatile*)&t_thread->state) != NULL) {
+        atomic_ptr_store((void* volatile*)&t_thread->state, NULL);
+        atomic32_add(&g_inside, -1);
+    }
+}
+
+/* ========================================================================
+ * Call tree
+ * ======================================================================== */
+
+static void free_nodes(void)
+{
+    size_t i;
+
+    for (i = 0; i < g_node_count; i++) {
+        Py_XDECREF(g_nodes[i].code);
+    }
+    free(g_nodes);
+    g_nodes = NULL;
+    g_node_count = 0;
+    g_node_capacity = 0;
+}
+
+/* Child of parent for code, added if missing; parent itself if the tree is full (GIL held) */
+static uint32_t child_node(uint32_t parent, PyObject* code, int* full)
+{
+    uint32_t index;
+    ProfileNode* node;
+
+    for (index = g_nodes[parent].child; index != 0; index = g_nodes[index].sibling) {
+        if (g_nodes[index].code == code) {
+            return index;
+        }
+    }
+
+    if (g_node_count == g_node_capacity) {
+        size_t capacity = g_node_capacity * 2;
+        ProfileNode* nodes;
+
+        if (capacity > PROFILE_MAX_NODES) {
+            capacity = PROFILE_MAX_NODES;
+        }
+        nodes = capacity > g_node_capacity ? (ProfileNode*)realloc(g_nodes, capacity * sizeof(ProfileNode)) : NULL;
+        if (nodes == NULL) {
+            *full = 1;
+            return parent;
+        }
+        g_nodes = nodes;
+        g_node_capacity = capacity;
+    }
+
+    index = (uint32_t)g_node_count++;
+    node = &g_nodes[index];
+    Py_INCREF(code);
+    node->code = code;
+    node->parent = parent;
+    node->child = 0;
+    node->self = 0;
+    node->sibling = g_nodes[parent].child;
+    g_nodes[parent].child = index;
+    return index;
+}
+
+/* Count one stack of a suspended thread; returns 1 if it was cut short (GIL held) */
+static int sample_thread(PyThreadState* state)
+{
+    PyObject* codes[PROFILE_MAX_DEPTH];
+    PyFrameObject* frame = PyThreadState_GetFrame(state);
+    uint32_t node = 0;
+    int depth = 0;
+    int truncated = 0;
+    int i;
+
+    while (frame != NULL) {
+        PyFrameObject* back;
+
+        if (depth == PROFILE_MAX_DEPTH) {
+            truncated = 1;
+            Py_DECREF(frame);
+            break;
+        }
+        codes[depth++] = (PyObject*)PyFrame_GetCode(frame);
+        back = PyFrame_GetBack(frame);
+        Py_DECREF(frame);
+        frame = back;
+    }
+
+    /* Outermost first; a full tree keeps the sample at the deepest node it has */
+    for (i = depth - 1; i >= 0; i--) {
+        if (!truncated) {
+            node = child_node(node, codes[i], &truncated);
+        }
+        Py_DECREF(codes[i]);
+    }
+    g_nodes[node].self++;
+    return truncated;
+}
+
+/* ========================================================================
+ * Sampler thread
+ * ======================================================================== */
+
+/*
+ * A thread holding the GIL gives it up to a waiter when it is done or after
+ * the switch interval (5 ms by default), whichever comes first, so a handler
+ * shorter than the interval is almost never caught running: the sampler
+ * gets the GIL as the handler returns. While profiling the interval is a
+ * tenth of the sampling period. Returns the previous interval, or 0 if it
+ * was left alone (GIL held).
+ */
+static double shorten_switch_interval(unsigned int hz)
+{
+    PyObject* sys = PyImport_ImportModule("sys");
+    PyObject* result = sys != NULL ? PyObject_CallMethod(sys, "getswitchinterval", NULL) : NULL;
+    double previous = result != NULL ? PyFloat_AsDouble(result) : 0.0;
+    double interval = 0.1 / hz;
+
+    Py_XDECREF(result);
+    result = NULL;
+    if (previous > interval) {
+        result = PyObject_CallMethod(sys, "setswitchinterval", "d", interval);
+    }
+    if (result == NULL) {
+        previous = 0.0;
+    }
+    Py_XDECREF(result);
+    Py_XDECREF(sys);
+    PyErr_Clear();
+    return previous;
+}
+
+static void restore_switch_interval(double previous)
+{
+    PyObject* sys;
+    PyObject* result;
+
+    if (previous <= 0.0 || (sys = PyImport_ImportModule("sys")) == NULL) {
+        PyErr_Clear();
+        return;
+    }
+    result = PyObject_CallMethod(sys, "setswitchinterval", "d", previous);
+    Py_XDECREF(result);
+    Py_DECREF(sys);
+    PyErr_Clear();
+}
+
+static void sample_tick(PyThreadState** sampler)
+{
+    uint64_t waitStart;
+    uint64_t heldStart;
+    uint64_t samples = 0;
+    uint64_t truncated = 0;
+    int32_t count;
+    int32_t i;
+
+    if (atomic32_load(&g_inside) == 0) {
+        mutex_lock(&g_lock);
+        g_stats.ticks++;
+        mutex_unlock(&g_lock);
+        return;
+    }
+
+    waitStart = clock_monotonic_ns();
+    PyEval_RestoreThread(*sampler);
+    heldStart = clock_monotonic_ns();
+
+    count = atomic32_load(&g_thread_count);
+    if (count > PROFILE_MAX_THREADS) {
+        count = PROFILE_MAX_THREADS;
+    }
+    for (i = 0; i < count; i++) {
+        PyThreadState* state = (PyThreadState*)atomic_ptr_load((void* volatile*)&g_threads[i].state);
+
+        if (state != NULL) {
+            truncated += (uint64_t)sample_thread(state);
+            samples++;
+        }
+    }
+
+    *sampler = PyEval_SaveThread();
+
+    mutex_lock(&g_lock);
+    g_stats.ticks++;
+    if (samples > 0) {
+        g_stats.busyTicks++;
+    }
+    g_stats.samples += samples;
+    g_stats.truncated += truncated;
+    g_stats.nodes = g_node_count;
+    g_stats.gilWaitNs += heldStart - waitStart;
+    g_stats.gilHeldNs += clock_monotonic_ns() - heldStart;
+    mutex_unlock(&g_lock);
+}
+
+static void sampler_main(void* arg)
+{
+    PyGILState_STATE gil;
+    PyThreadState* sampler;
+    double switchInterval;
+    uint64_t intervalNs = 1000000000ull / g_stats.hz;
+    uint64_t next = clock_monotonic_ns() + intervalNs;
+
+    (void)arg; /* Unused parameter */
+
+    trace_set_thread_name("TsPy profiler");
+
+    /* Keep one thread state for the whole run instead of one per sample */
+    gil = PyGILState_Ensure();
+    switchInterval = shorten_switch_interval(g_stats.hz);
+    sampler = PyEval_SaveThread();
+
+    mutex_lock(&g_lock);
+    while (!g_stopping) {
+        uint64_t now = clock_monotonic_ns();
+
+        if (now < next) {
+            unsigned int waitMs = (unsigned int)((next - now + 999999) / 1000000);
+
+            cond_timed_wait(&g_wake, &g_lock, waitMs);
+            continue;
+        }
+        /* After a long GIL wait, skip the missed ticks instead of catching up */
+        next = now - (now - next) % intervalNs + intervalNs;
+
+        mutex_unlock(&g_lock);
+        sample_tick(&sampler);
+        mutex_lock(&g_lock);
+    }
+    mutex_unlock(&g_lock);
+
+    PyEval_RestoreThread(sampler);
+    restore_switch_interval(switchInterval);
+    PyGILState_Release(gil);
+}
+
+/* ========================================================================
+ * Output (GIL held)
+ * ======================================================================== */
+
+/* "qualname (file.py:line)", without the ';' that separates frames */
+static void code_label(PyObject* code, char* label, size_t size)
+{
+#if PY_VERSION_HEX >= 0x030B0000
+    PyObject* name = PyObject_GetAttrString(code, "co_qualname");
+#else
+    PyObject* name = PyObject_GetAttrString(code, "co_name");
+#endif
+    PyObject* file = PyObject_GetAttrString(code, "co_filename");
+    PyObject* line = PyObject_GetAttrString(code, "co_firstlineno");
+    const char* nameText = name != NULL && PyUnicode_Check(name) ? PyUnicode_AsUTF8(name) : NULL;
+    const char* fileText = file != NULL && PyUnicode_Check(file) ? PyUnicode_AsUTF8(file) : NULL;
+    const char* base = fileText;
+    const char* p;
+    char* q;
+
+    for (p = fileText; p != NULL && *p != '\0'; p++) {
+        if (*p == '/' || *p == '\\') {
+            base = p + 1;
+        }
+    }
+    snprintf(label, size, "%s (%s:%ld)", nameText != NULL ? nameText : "?", base != NULL ? base : "?",
+             line != NULL && PyLong_Check(line) ? PyLong_AsLong(line) : 0L);
+    for (q = label; *q != '\0'; q++) {
+        if (*q == ';' || *q == '\n' || *q == '\r') {
+            *q = '_';
+        }
+    }
+    Py_XDECREF(name);
+    Py_XDECREF(file);
+    Py_XDECREF(line);
+    PyErr_Clear();
+}
+
+static long write_collapsed(const char* path)
+{
+    uint32_t path_nodes[PROFILE_MAX_DEPTH];
+    char label[160];
+    FILE* fp;
+    long stacks = 0;
+    size_t i;
+
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+    for (i = 1; i < g_node_count; i++) {
+        uint32_t node = (uint32_t)i;
+        int depth = 0;
+
+        if (g_nodes[i].self == 0) {
+            continue;
+        }
+        while (node != 0 && depth < PROFILE_MAX_DEPTH) {
+            path_nodes[depth++] = node;
+            node = g_nodes[node].parent;
+        }
+        while (depth > 0) {
+            code_label(g_nodes[path_nodes[--depth]].code, label, sizeof(label));
+            fputs(label, fp);
+            fputc(depth > 0 ? ';' : ' ', fp);
+        }
+        fprintf(fp, "%llu\n", (unsigned long long)g_nodes[i].self);
+        stacks++;
+    }
+    if (fclose(fp) != 0) {
+        return -1;
+    }
+    return stacks;
+}
+
+static int compare_code(const void* a, const void* b)
+{
+    const ProfileNode* x = (const ProfileNode*)a;
+    const ProfileNode* y = (const ProfileNode*)b;
+
+    return x->code < y->code ? -1 : x->code > y->code ? 1 : 0;
+}
+
+/* Functions with the most samples ending in them, summed over all their call paths */
+static void find_hotspots(ProfileStats* stats)
+{
+    ProfileNode* sorted;
+    size_t i = 1;
+
+    stats->hotspots = 0;
+    if (g_node_count < 2 || (sorted = (ProfileNode*)malloc(g_node_count * sizeof(ProfileNode))) == NULL) {
+        return;
+    }
+    memcpy(sorted, g_nodes, g_node_count * sizeof(ProfileNode));
+    qsort(sorted + 1, g_node_count - 1, sizeof(ProfileNode), compare_code);
+
+    while (i < g_node_count) {
+        PyObject* code = sorted[i].code;
+        uint64_t samples = 0;
+        size_t slot;
+
+        for (; i < g_node_count && sorted[i].code == code; i++) {
+            samples += sorted[i].self;
+        }
+        if (samples == 0) {
+            continue;
+        }
+        /* Insertion into the short descending list */
+        slot = stats->hotspots < PROFILE_TOP ? stats->hotspots++ : PROFILE_TOP;
+        while (slot > 0 && stats->top[slot - 1].samples < samples) {
+            if (slot < PROFILE_TOP) {
+                stats->top[slot] = stats->top[slot - 1];
+            }
+            slot--;
+        }
+        if (slot < PROFILE_TOP) {
+            code_label(code, stats->top[slot].function, sizeof(stats->top[slot].function));
+            stats->top[slot].samples = samples;
+        }
+    }
+    free(sorted);
+}
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+int python_profile_start(unsigned int hz)
+{
+    if (g_running) {
+        return 1;
+    }
+#ifdef Py_GIL_DISABLED
+    (void)hz; /* Unused parameter */
+    log_warning("The profiler needs the GIL to read other threads' frames; not available on free-threaded Python");
+    return -1;
+#else
+    if (!python_engine_is_initialized()) {
+        return -1;
+    }
+
+    g_nodes = (ProfileNode*)calloc(1024, sizeof(ProfileNode));
+    if (g_nodes == NULL) {
+        return -1;
+    }
+    g_node_count = 1;
+    g_node_capacity = 1024;
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.hz = hz == 0 ? PROFILE_DEFAULT_HZ : hz > PROFILE_MAX_HZ ? PROFILE_MAX_HZ : hz;
+    g_stats.nodes = 1;
+    g_start_ns = clock_monotonic_ns();
+    mutex_init(&g_lock);
+    cond_init(&g_wake);
+    g_stopping = 0;
+
+    if (thread_create(&g_thread, sampler_main, NULL) != 0) {
+        log_error("Failed to start the profiler thread");
+        cond_destroy(&g_wake);
+        mutex_destroy(&g_lock);
+        free(g_nodes);
+        g_nodes = NULL;
+        g_node_count = 0;
+        g_node_capacity = 0;
+        return -1;
+    }
+    g_running = 1;
+    atomic32_store(&g_active, 1);
+    log_info("Profiling script code at %u Hz", g_stats.hz);
+    return 0;
+#endif
+}
+
+long python_profile_stop(const char* path, ProfileStats* stats)
+{
+    PyGILState_STATE gil;
+    long stacks = 0;
+
+    if (!g_running) {
+        return -1;
+    }
+
+    /* Threads still inside keep their slot until they leave; the sampler just stops reading */
+    atomic32_store(&g_active, 0);
+    mutex_lock(&g_lock);
+    g_stopping = 1;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+    thread_join(g_thread);
+    g_running = 0;
+    g_stats.elapsedNs = clock_monotonic_ns() - g_start_ns;
+
+    gil = PyGILState_Ensure();
+    if (path != NULL) {
+        stacks = write_collapsed(path);
+        if (stacks < 0) {
+            log_error("Failed to write profile: %s", path);
+        } else {
+            log_info("Profile written (%llu samples, %ld stacks): %s", (unsigned long long)g_stats.samples, stacks,
+                     path);
+        }
+    }
+    if (stats != NULL) {
+        *stats = g_stats;
+        find_hotspots(stats);
+    }
+    free_nodes();
+    PyGILState_Release(gil);
+
+    cond_destroy(&g_wake);
+    mutex_destroy(&g_lock);
+    return stacks;
+}
+
+int python_profile_is_running(void)
+{
+    return g_running;
+}
+
+void python_profile_get_stats(ProfileStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!g_running) {
+        return;
+    }
+    mutex_lock(&g_lock);
+    *stats = g_stats;
+    mutex_unlock(&g_lock);
+    stats->running = 1;
+    stats->elapsedNs = clock_monotonic_ns() - g_start_ns;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file python_profile.h
+ * @brief Sampling profiler for script code
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * While running, a sampler thread wakes up to 1000 times a second. If any
+ * thread of the main interpreter is inside script code (a handler, timer
+ * callback or module body) it takes the GIL just long enough to walk those
+ * threads' Python frames and count each stack in a call tree. The
+ * profile is wall-clock: a handler blocked in a call counts as much as one
+ * computing. Stopping writes one line per distinct stack in the collapsed
+ * format of flamegraph.pl ("outer;inner;leaf count").
+ *
+ * Start and stop with /tspy python profile. Free-threaded builds are not
+ * supported: walking another thread's frames there needs it stopped.
+ */
+
+#ifndef PYTHON_PROFILE_H
+#define PYTHON_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Samples per second when none is given
+ */
+#define PROFILE_DEFAULT_HZ 1000
+
+/**
+ * @brief Highest sampling rate (the sampler sleeps in whole milliseconds)
+ */
+#define PROFILE_MAX_HZ 1000
+
+/**
+ * @brief Threads that can be sampled; later ones are not profiled
+ */
+#define PROFILE_MAX_THREADS 64
+
+/**
+ * @brief Innermost frames kept per stack
+ */
+#define PROFILE_MAX_DEPTH 128
+
+/**
+ * @brief Call tree size; samples that would grow it further stop at the deepest known frame
+ */
+#define PROFILE_MAX_NODES 65536
+
+/**
+ * @brief Functions reported by python_profile_stop
+ */
+#define PROFILE_TOP 5
+
+/**
+ * @brief A function and the samples that ended in it
+ */
+typedef struct ProfileHotspot {
+    char     function[160];   /* "qualname (file.py:line)" */
+    uint64_t samples;
+} ProfileHotspot;
+
+/**
+ * @brief Profiler counters
+ */
+typedef struct ProfileStats {
+    int            running;
+    unsigned int   hz;
+    uint64_t       ticks;        /* Sampler wake-ups */
+    uint64_t       busyTicks;    /* Wake-ups that found script code running */
+    uint64_t       samples;      /* Stacks counted, one per thread in script code per busy tick */
+    uint64_t       truncated;    /* Stacks cut short by PROFILE_MAX_DEPTH or PROFILE_MAX_NODES */
+    size_t         nodes;        /* Call tree nodes */
+    uint64_t       elapsedNs;    /* Since start */
+    uint64_t       gilWaitNs;    /* Sampler waiting for the GIL */
+    uint64_t       gilHeldNs;    /* Sampler holding the GIL */
+    size_t         hotspots;     /* Entries in top, filled by python_profile_stop */
+    ProfileHotspot top[PROFILE_TOP];
+} ProfileStats;
+
+/**
+ * @brief Start sampling
+ * @param hz Samples per second (1..PROFILE_MAX_HZ), 0 for PROFILE_DEFAULT_HZ
+ * @return 0 on success, 1 if already running, -1 if it could not start
+ * @note Call without the GIL
+ */
+int python_profile_start(unsigned int hz);
+
+/**
+ * @brief Stop sampling and write the collapsed stacks
+ * @param path File to write, or NULL to discard the profile
+ * @param stats Receives the final counters and the functions with most samples (may be NULL)
+ * @return Stacks written, or -1 if not running or the file could not be written
+ * @note Call without the GIL
+ */
+long python_profile_stop(const char* path, ProfileStats* stats);
+
+/**
+ * @brief Whether the sampler is running
+ */
+int python_profile_is_running(void);
+
+/**
+ * @brief Read the counters of the running profile
+ * @param stats Receives the counters (hotspots are left empty)
+ */
+void python_profile_get_stats(ProfileStats* stats);
+
+/**
+ * @brief Note that the calling thread enters script code (GIL held)
+ * @note Called by python_engine_enter_script; one thread-local increment while not profiling
+ */
+void python_profile_enter(void);
+
+/**
+ * @brief Note that the calling thread leaves script code (GIL held)
+ * @note Called by python_engine_leave_script
+ */
+void python_profile_leave(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_PROFILE_H */
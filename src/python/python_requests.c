@@ -0,0 +1,354 @@
+/**
+ * @file python_requests.c
+ * @brief Awaitable TeamSpeak request implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * All state is guarded by the GIL (and the engine state lock). Futures belong to the plugin's event
+ * loop, so they are resolved on the loop thread through
+ * python_loop_resolve(); a burst of answers costs one loop wake-up. While
+ * requests are in flight a plugin-owned periodic timer advances the timeout
+ * wheel; it is cancelled again once the table is empty.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_requests.h"
+#include "python_engine.h"
+#include "python_loop.h"
+#include "python_timers.h"
+#include "core/plugin_main.h"
+#include "utils/hash.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/timer_wheel.h"
+
+#define TICK_NS ((uint64_t)REQUEST_TICK_MS * 1000000ULL)
+
+typedef struct PendingRequest {
+    TimerNode node;       /* Timeout */
+    uint64_t  hash;
+    PyObject* futures;    /* One future, or a list for merged requests */
+    char      returnCode[REQUEST_RETURN_CODE_BUFSIZE];
+} PendingRequest;
+
+#define REQUEST_FROM_NODE(n) ((PendingRequest*)((char*)(n) - offsetof(PendingRequest, node)))
+
+/* Open addressing with linear probing; capacity is a power of two */
+static PendingRequest** g_slots = NULL;
+static size_t           g_capacity = 0;
+static size_t           g_count = 0;
+
+static TimerWheel g_wheel;
+static PyObject*  g_expiry_timer = NULL;
+static PyObject*  g_expire = NULL;
+
+static volatile int64_t g_in_flight = 0;
+static volatile int64_t g_sent = 0;
+static volatile int64_t g_completed = 0;
+static volatile int64_t g_timed_out = 0;
+
+static uint64_t current_tick(void)
+{
+    return clock_monotonic_ns() / TICK_NS;
+}
+
+static uint64_t code_hash(const char* returnCode)
+{
+    return hash_mix64(hash_fnv1a64(HASH_FNV1A64_INIT, returnCode, strlen(returnCode)));
+}
+
+static size_t find_slot(const char* returnCode, uint64_t hash)
+{
+    size_t mask = g_capacity - 1;
+    size_t i = (size_t)hash & mask;
+
+    while (g_slots[i] != NULL
+           && (g_slots[i]->hash != hash || strcmp(g_slots[i]->returnCode, returnCode) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int table_grow(void)
+{
+    size_t capacity = g_capacity > 0 ? g_capacity * 2 : 64;
+    PendingRequest** slots = (PendingRequest**)calloc(capacity, sizeof(PendingRequest*));
+    PendingRequest** old = g_slots;
+    size_t oldCapacity = g_capacity;
+    size_t i;
+
+    if (slots == NULL) {
+        return -1;
+    }
+    g_slots = slots;
+    g_capacity = capacity;
+    for (i = 0; i < oldCapacity; i++) {
+        if (old[i] != NULL) {
+            g_slots[find_slot(old[i]->returnCode, old[i]->hash)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static PendingRequest* table_lookup(const char* returnCode)
+{
+    if (g_count == 0) {
+        return NULL;
+    }
+    return g_slots[find_slot(returnCode, code_hash(returnCode))];
+}
+
+/* Remove by backward shifting, so probe chains never need tombstones */
+static void table_remove(const PendingRequest* request)
+{
+    size_t mask = g_capacity - 1;
+    size_t i = find_slot(request->returnCode, request->hash);
+    size_t j = i;
+
+    for (;;) {
+        size_t home;
+
+        j = (j + 1) & mask;
+        if (g_slots[j] == NULL) {
+            break;
+        }
+        home = (size_t)g_slots[j]->hash & mask;
+        /* Move the entry at j into the hole unless its home lies cyclically in (i, j] */
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            g_slots[i] = g_slots[j];
+            i = j;
+        }
+    }
+    g_slots[i] = NULL;
+    g_count--;
+}
+
+/* Resolve the futures on the loop thread and free the request */
+static void finish(PendingRequest* request, PyObject* value)
+{
+    Py_ssize_t i;
+
+    table_remove(request);
+    timer_wheel_cancel(&g_wheel, &request->node);
+    atomic64_add(&g_in_flight, -1);
+
+    if (value == NULL) {
+        python_engine_report_exception("", "request");
+    } else if (PyList_Check(request->futures)) {
+        for (i = 0; i < PyList_GET_SIZE(request->futures); i++) {
+            if (python_loop_resolve(PyList_GET_ITEM(request->futures, i), value) != 0) {
+                python_engine_report_exception("", "request");
+            }
+        }
+    } else if (python_loop_resolve(request->futures, value) != 0) {
+        python_engine_report_exception("", "request");
+    }
+    Py_XDECREF(value);
+    Py_DECREF(request->futures);
+    free(request);
+
+    /* Nothing left to time out: stop the expiry timer */
+    if (g_count == 0 && g_expiry_timer != NULL) {
+        PyObject* result = PyObject_CallMethod(g_expiry_timer, "cancel", NULL);
+        if (result == NULL) {
+            PyErr_Clear();
+        }
+        Py_XDECREF(result);
+        Py_CLEAR(g_expiry_timer);
+    }
+}
+
+/* Periodic timer callback: give up on requests past their deadline */
+static PyObject* requests_expire(PyObject* self, PyObject* unused)
+{
+    TimerNode* expired;
+
+    (void)self;   /* Unused parameter */
+    (void)unused; /* Unused parameter */
+
+    python_engine_lock_state();
+    expired = timer_wheel_advance(&g_wheel, current_tick());
+    while (expired != NULL) {
+        PendingRequest* request = REQUEST_FROM_NODE(expired);
+
+        expired = expired->next;
+        log_debug("Request %s timed out", request->returnCode);
+        atomic64_add(&g_timed_out, 1);
+        finish(request, PyObject_CallFunction(PyExc_TimeoutError, "s", "no answer from the server"));
+    }
+    python_engine_unlock_state();
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef ExpireDef = {"_expire_requests", requests_expire, METH_NOARGS, NULL};
+
+static int track_locked(PyObject* futures, double timeout, char* returnCode, size_t size)
+{
+    struct TS3Functions* ts3Functions = get_ts3_functions();
+    PendingRequest* request;
+    uint64_t now = current_tick();
+
+    if (ts3Functions == NULL || ts3Functions->createReturnCode == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "createReturnCode function not available");
+        return -1;
+    }
+    if (!(timeout > 0.0 && timeout <= 3600.0)) {
+        PyErr_SetString(PyExc_ValueError, "timeout must be between 0 and 3600 seconds");
+        return -1;
+    }
+
+    if (g_expire == NULL) {
+        g_expire = PyCFunction_New(&ExpireDef, NULL);
+        if (g_expire == NULL) {
+            return -1;
+        }
+        timer_wheel_init(&g_wheel, now);
+    }
+    if ((g_count + 1) * 2 > g_capacity && table_grow() != 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    /* The expiry timer runs only while something is in flight */
+    if (g_expiry_timer == NULL) {
+        PyObject* noArgs = PyTuple_New(0);
+        if (noArgs != NULL) {
+            g_expiry_timer = python_timers_schedule(g_expire, noArgs, REQUEST_TICK_MS / 1000.0,
+                                                    REQUEST_TICK_MS / 1000.0, "", 0);
+            Py_DECREF(noArgs);
+        }
+        if (g_expiry_timer == NULL) {
+            return -1;
+        }
+    }
+
+    request = (PendingRequest*)calloc(1, sizeof(PendingRequest));
+    if (request == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    ts3Functions->createReturnCode(get_plugin_id(), request->returnCode, sizeof(request->returnCode));
+    request->hash = code_hash(request->returnCode);
+    request->futures = futures;
+    Py_INCREF(futures);
+
+    if (g_count == 0) {
+        timer_wheel_advance(&g_wheel, now);
+    }
+    timer_wheel_add(&g_wheel, &request->node, now + (uint64_t)ceil(timeout * 1000.0 / REQUEST_TICK_MS));
+    g_slots[find_slot(request->returnCode, request->hash)] = request;
+    g_count++;
+    atomic64_add(&g_in_flight, 1);
+    atomic64_add(&g_sent, 1);
+
+    safe_strcpy(returnCode, size, request->returnCode);
+    return 0;
+}
+
+int python_requests_track(PyObject* futures, double timeout, char* returnCode, size_t size)
+{
+    int result;
+
+    python_engine_lock_state();
+    result = track_locked(futures, timeout, returnCode, size);
+    python_engine_unlock_state();
+    return result;
+}
+
+PyObject* python_requests_begin(double timeout, char* returnCode, size_t size)
+{
+    PyObject* loop = python_loop_get();
+    PyObject* future;
+
+    if (loop == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "asyncio event loop is not running");
+        return NULL;
+    }
+
+    future = PyObject_CallMethod(loop, "create_future", NULL);
+    if (future != NULL && python_requests_track(future, timeout, returnCode, size) != 0) {
+        Py_CLEAR(future);
+    }
+    return future;
+}
+
+void python_requests_fail(const char* returnCode, unsigned int error)
+{
+    PendingRequest* request;
+
+    python_engine_lock_state();
+    request = table_lookup(returnCode);
+    if (request != NULL) {
+        atomic64_add(&g_completed, 1);
+        finish(request, PyLong_FromUnsignedLong(error));
+    }
+    python_engine_unlock_state();
+}
+
+int python_requests_complete(const char* returnCode, unsigned int error)
+{
+    PyGILState_STATE gil;
+    PendingRequest* request;
+
+    if (returnCode == NULL || returnCode[0] == '\0' || atomic64_load(&g_in_flight) == 0
+        || !python_engine_is_initialized()) {
+        return 0;
+    }
+
+    gil = PyGILState_Ensure();
+    python_engine_lock_state();
+    request = table_lookup(returnCode);
+    if (request != NULL) {
+        atomic64_add(&g_completed, 1);
+        finish(request, PyLong_FromUnsignedLong(error));
+    }
+    python_engine_unlock_state();
+    PyGILState_Release(gil);
+
+    return request != NULL;
+}
+
+void python_requests_get_stats(RequestStats* stats)
+{
+    stats->inFlight = (size_t)atomic64_load(&g_in_flight);
+    stats->sent = (uint64_t)atomic64_load(&g_sent);
+    stats->completed = (uint64_t)atomic64_load(&g_completed);
+    stats->timedOut = (uint64_t)atomic64_load(&g_timed_out);
+}
+
+void python_requests_shutdown(void)
+{
+    size_t i;
+
+    for (i = 0; i < g_capacity; i++) {
+        if (g_slots[i] != NULL) {
+            Py_DECREF(g_slots[i]->futures);
+            free(g_slots[i]);
+        }
+    }
+    free(g_slots);
+    g_slots = NULL;
+    g_capacity = 0;
+    g_count = 0;
+    atomic64_store(&g_in_flight, 0);
+
+    Py_CLEAR(g_expiry_timer);
+    Py_CLEAR(g_expire);
+}
@@ -0,0 +1,99 @@
+/**
+ * @file python_requests.h
+ * @brief Awaitable TeamSpeak requests correlated by return code
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Every tracked request gets a return code from createReturnCode and an
+ * asyncio future. The server answers each return code with exactly one
+ * onServerErrorEvent, which resolves the future with the error code
+ * (ERROR_ok on success). In-flight requests are kept in a hash table keyed
+ * by return code and expire through a timing wheel, so scripts can issue
+ * many requests back to back and await them together.
+ */
+
+#ifndef PYTHON_REQUESTS_H
+#define PYTHON_REQUESTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Buffer size for a return code
+ */
+#define REQUEST_RETURN_CODE_BUFSIZE 64
+
+/**
+ * @brief Seconds to wait for the server before a request times out ([requests] timeout)
+ */
+#define REQUEST_DEFAULT_TIMEOUT 10.0
+
+/**
+ * @brief Timeout resolution in milliseconds
+ */
+#define REQUEST_TICK_MS 100
+
+/**
+ * @brief Request counters
+ */
+typedef struct RequestStats {
+    size_t   inFlight;  /* Awaiting an answer */
+    uint64_t sent;      /* Requests started */
+    uint64_t completed; /* Answered by the server */
+    uint64_t timedOut;  /* Given up on */
+} RequestStats;
+
+/**
+ * @brief Start tracking a request (GIL held)
+ * @param timeout Seconds to wait for the answer
+ * @param returnCode Receives the return code to pass to the request function
+ * @param size Size of returnCode, at least REQUEST_RETURN_CODE_BUFSIZE
+ * @return New reference to the future, or NULL with a Python exception set
+ */
+struct _object* python_requests_begin(double timeout, char* returnCode, size_t size);
+
+/**
+ * @brief Track a request for futures created earlier (GIL held)
+ * @param futures Future, or list of futures answered together (PyObject*); a reference is taken
+ * @param timeout Seconds to wait for the answer
+ * @param returnCode Receives the return code to pass to the request function
+ * @param size Size of returnCode, at least REQUEST_RETURN_CODE_BUFSIZE
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_requests_track(struct _object* futures, double timeout, char* returnCode, size_t size);
+
+/**
+ * @brief Resolve a request whose function call failed locally (GIL held)
+ * @param returnCode Return code from python_requests_begin
+ * @param error Error returned by the request function
+ */
+void python_requests_fail(const char* returnCode, unsigned int error);
+
+/**
+ * @brief Resolve the request an onServerErrorEvent answers (GIL not held)
+ * @param returnCode Return code from the event (may be NULL or empty)
+ * @param error Error code from the event
+ * @return 1 if it belonged to a tracked request, 0 otherwise
+ */
+int python_requests_complete(const char* returnCode, unsigned int error);
+
+/**
+ * @brief Read the request counters
+ * @param stats Receives the counters
+ */
+void python_requests_get_stats(RequestStats* stats);
+
+/**
+ * @brief Drop all in-flight requests (GIL held, event loop stopped)
+ */
+void python_requests_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_REQUESTS_H */
@@ -0,0 +1,575 @@
+/**
+ * @file python_store.c
+ * @brief ts3api.store implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Values carry a one-byte tag: 'b' raw bytes, 's' UTF-8 text, 'p' a pickle.
+ * Store operations run with the GIL held and never call back into Python
+ * while the store is locked, except to allocate the destination buffer.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdio.h>
+#include <string.h>
+
+#include "python_store.h"
+#include "python_engine.h"
+#include "core/plugin_config.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+
+#define TAG_BYTES  'b'
+#define TAG_TEXT   's'
+#define TAG_PICKLE 'p'
+
+typedef struct PyStore {
+    PyObject_HEAD
+} PyStore;
+
+static KvStore*      g_store = NULL;
+static PyTypeObject* g_store_type = NULL;
+static PyObject*     g_dumps = NULL;
+static PyObject*     g_loads = NULL;
+
+static int check_open(void)
+{
+    if (g_store == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "ts3api.store is not available");
+        return -1;
+    }
+    return 0;
+}
+
+static const char* key_bytes(PyObject* key, Py_ssize_t* length)
+{
+    const char* bytes;
+
+    if (!PyUnicode_Check(key)) {
+        PyErr_Format(PyExc_TypeError, "store keys must be str, not %.100s", Py_TYPE(key)->tp_name);
+        return NULL;
+    }
+    bytes = PyUnicode_AsUTF8AndSize(key, length);
+    if (bytes != NULL && (*length == 0 || *length > KV_STORE_MAX_KEY)) {
+        PyErr_Format(PyExc_ValueError, "store keys must be 1 to %d bytes", KV_STORE_MAX_KEY);
+        return NULL;
+    }
+    return bytes;
+}
+
+/* Tagged value as a new bytes object */
+static PyObject* encode_value(PyObject* value)
+{
+    PyObject* pickled = NULL;
+    PyObject* encoded;
+    const char* data;
+    Py_ssize_t length;
+    char tag;
+
+    if (PyBytes_Check(value)) {
+        tag = TAG_BYTES;
+        data = PyBytes_AS_STRING(value);
+        length = PyBytes_GET_SIZE(value);
+    } else if (PyUnicode_Check(value)) {
+        tag = TAG_TEXT;
+        data = PyUnicode_AsUTF8AndSize(value, &length);
+        if (data == NULL) {
+            return NULL;
+        }
+    } else {
+        tag = TAG_PICKLE;
+        pickled = PyObject_CallFunctionObjArgs(g_dumps, value, NULL);
+        if (pickled == NULL) {
+            return NULL;
+        }
+        data = PyBytes_AS_STRING(pickled);
+        length = PyBytes_GET_SIZE(pickled);
+    }
+
+    if ((size_t)length + 1 > KV_STORE_MAX_VALUE) {
+        Py_XDECREF(pickled);
+        PyErr_Format(PyExc_ValueError, "store values are limited to %u bytes", KV_STORE_MAX_VALUE - 1);
+        return NULL;
+    }
+
+    encoded = PyBytes_FromStringAndSize(NULL, length + 1);
+    if (encoded != NULL) {
+        PyBytes_AS_STRING(encoded)[0] = tag;
+        memcpy(PyBytes_AS_STRING(encoded) + 1, data, (size_t)length);
+    }
+    Py_XDECREF(pickled);
+    return encoded;
+}
+
+static PyObject* decode_value(const char* data, size_t length)
+{
+    PyObject* view;
+    PyObject* value;
+
+    if (length == 0) {
+        PyErr_SetString(PyExc_ValueError, "corrupt store value");
+        return NULL;
+    }
+
+    switch (data[0]) {
+        case TAG_BYTES:
+            return PyBytes_FromStringAndSize(data + 1, (Py_ssize_t)length - 1);
+        case TAG_TEXT:
+            return PyUnicode_DecodeUTF8(data + 1, (Py_ssize_t)length - 1, "strict");
+        case TAG_PICKLE:
+            view = PyMemoryView_FromMemory((char*)data + 1, (Py_ssize_t)length - 1, PyBUF_READ);
+            if (view == NULL) {
+                return NULL;
+            }
+            value = PyObject_CallFunctionObjArgs(g_loads, view, NULL);
+            Py_DECREF(view);
+            return value;
+        default:
+            PyErr_SetString(PyExc_ValueError, "corrupt store value");
+            return NULL;
+    }
+}
+
+/* Destination of a kv_store_get, owned by the caller */
+typedef struct StoreValue {
+    char*  data;
+    size_t length;
+} StoreValue;
+
+/* Buffer of length-prefixed keys collected by kv_store_keys */
+typedef struct KeyList {
+    char*       data;
+    size_t      size;
+    size_t      capacity;
+    const char* prefix;
+    size_t      prefixLength;
+    int         failed;
+} KeyList;
+
+/* KvStoreAlloc: PyMem_Malloc never runs Python code, so it is safe under the store lock */
+static void* alloc_value(void* context, size_t length)
+{
+    StoreValue* value = (StoreValue*)context;
+
+    value->data = (char*)PyMem_Malloc(length > 0 ? length : 1);
+    value->length = length;
+    return value->data;
+}
+
+/* KvStoreVisit: copies matching keys out; Python objects are built after the store is unlocked */
+static int collect_key(void* context, const char* key, size_t length)
+{
+    KeyList* list = (KeyList*)context;
+    size_t needed;
+
+    if (length < list->prefixLength || memcmp(key, list->prefix, list->prefixLength) != 0) {
+        return 0;
+    }
+
+    needed = list->size + sizeof(size_t) + length;
+    if (needed > list->capacity) {
+        size_t capacity = list->capacity > 0 ? list->capacity * 2 : 4096;
+        char* data;
+
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        data = (char*)PyMem_Realloc(list->data, capacity);
+        if (data == NULL) {
+            list->failed = 1;
+            return 1;
+        }
+        list->data = data;
+        list->capacity = capacity;
+    }
+
+    memcpy(list->data + list->size, &length, sizeof(size_t));
+    memcpy(list->data + list->size + sizeof(size_t), key, length);
+    list->size = needed;
+    return 0;
+}
+
+/* 1 with *result set, 0 if missing, -1 with an exception set */
+static int lookup(PyObject* key, PyObject** result)
+{
+    StoreValue value = {NULL, 0};
+    const char* bytes;
+    Py_ssize_t length;
+    int found;
+
+    if (check_open() != 0 || (bytes = key_bytes(key, &length)) == NULL) {
+        return -1;
+    }
+
+    found = kv_store_get(g_store, bytes, (size_t)length, alloc_value, &value);
+    if (found < 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (found == 0) {
+        return 0;
+    }
+
+    *result = decode_value(value.data, value.length);
+    PyMem_Free(value.data);
+    return *result != NULL ? 1 : -1;
+}
+
+static int store_set(PyObject* key, PyObject* value)
+{
+    const char* bytes;
+    Py_ssize_t length;
+    PyObject* encoded;
+    int result;
+
+    if (check_open() != 0 || (bytes = key_bytes(key, &length)) == NULL) {
+        return -1;
+    }
+
+    encoded = encode_value(value);
+    if (encoded == NULL) {
+        return -1;
+    }
+    result = kv_store_put(g_store, bytes, (size_t)length,
+                          PyBytes_AS_STRING(encoded), (size_t)PyBytes_GET_SIZE(encoded));
+    Py_DECREF(encoded);
+
+    if (result != 0) {
+        PyErr_SetString(PyExc_OSError, "store write failed; the store is read-only until restart");
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 if removed, 0 if missing, -1 with an exception set */
+static int store_remove(PyObject* key)
+{
+    const char* bytes;
+    Py_ssize_t length;
+    int result;
+
+    if (check_open() != 0 || (bytes = key_bytes(key, &length)) == NULL) {
+        return -1;
+    }
+
+    result = kv_store_delete(g_store, bytes, (size_t)length);
+    if (result < 0) {
+        PyErr_SetString(PyExc_OSError, "store write failed; the store is read-only until restart");
+    }
+    return result;
+}
+
+/* ============================================================================
+ * Store type
+ * ============================================================================ */
+
+static PyObject* store_subscript(PyObject* self, PyObject* key)
+{
+    PyObject* value = NULL;
+    int found;
+
+    (void)self; /* Unused parameter */
+
+    found = lookup(key, &value);
+    if (found == 0) {
+        PyErr_SetObject(PyExc_KeyError, key);
+    }
+    return value;
+}
+
+static int store_ass_subscript(PyObject* self, PyObject* key, PyObject* value)
+{
+    int removed;
+
+    (void)self; /* Unused parameter */
+
+    if (value != NULL) {
+        return store_set(key, value);
+    }
+
+    removed = store_remove(key);
+    if (removed == 0) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return -1;
+    }
+    return removed < 0 ? -1 : 0;
+}
+
+static Py_ssize_t store_length(PyObject* self)
+{
+    (void)self; /* Unused parameter */
+
+    if (check_open() != 0) {
+        return -1;
+    }
+    return (Py_ssize_t)kv_store_count(g_store);
+}
+
+static int store_contains(PyObject* self, PyObject* key)
+{
+    const char* bytes;
+    Py_ssize_t length;
+
+    (void)self; /* Unused parameter */
+
+    if (check_open() != 0) {
+        return -1;
+    }
+    if (!PyUnicode_Check(key)) {
+        return 0;
+    }
+    bytes = PyUnicode_AsUTF8AndSize(key, &length);
+    if (bytes == NULL) {
+        return -1;
+    }
+    if (length == 0 || length > KV_STORE_MAX_KEY) {
+        return 0;
+    }
+    return kv_store_contains(g_store, bytes, (size_t)length);
+}
+
+static PyObject* store_get(PyObject* self, PyObject* args)
+{
+    PyObject* key;
+    PyObject* fallback = Py_None;
+    PyObject* value = NULL;
+    int found;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTuple(args, "O|O:get", &key, &fallback)) {
+        return NULL;
+    }
+
+    found = lookup(key, &value);
+    if (found == 0) {
+        Py_INCREF(fallback);
+        return fallback;
+    }
+    return value;
+}
+
+static PyObject* store_keys(PyObject* self, PyObject* args, PyObject* kwargs)
+{
+    static char* kwlist[] = {"prefix", NULL};
+    KeyList list;
+    const char* prefix = "";
+    PyObject* result;
+    size_t position;
+
+    (void)self; /* Unused parameter */
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|s:keys", kwlist, &prefix)) {
+        return NULL;
+    }
+    if (check_open() != 0) {
+        return NULL;
+    }
+
+    memset(&list, 0, sizeof(list));
+    list.prefix = prefix;
+    list.prefixLength = strlen(prefix);
+    kv_store_keys(g_store, collect_key, &list);
+    if (list.failed) {
+        PyMem_Free(list.data);
+        return PyErr_NoMemory();
+    }
+
+    result = PyList_New(0);
+    for (position = 0; result != NULL && position < list.size;) {
+        PyObject* key;
+        size_t length;
+
+        memcpy(&length, list.data + position, sizeof(size_t));
+        position += sizeof(size_t);
+        key = PyUnicode_DecodeUTF8(list.data + position, (Py_ssize_t)length, "replace");
+        position += length;
+        if (key == NULL || PyList_Append(result, key) != 0) {
+            Py_XDECREF(key);
+            Py_CLEAR(result);
+            break;
+        }
+        Py_DECREF(key);
+    }
+    PyMem_Free(list.data);
+
+    if (result != NULL && PyList_Sort(result) != 0) {
+        Py_CLEAR(result);
+    }
+    return result;
+}
+
+static PyObject* store_sync(PyObject* self, PyObject* unused)
+{
+    int result;
+
+    (void)self;   /* Unused parameter */
+    (void)unused; /* Unused parameter */
+
+    if (check_open() != 0) {
+        return NULL;
+    }
+
+    /* Waits for the commit thread's fsync */
+    Py_BEGIN_ALLOW_THREADS
+    result = kv_store_sync(g_store);
+    Py_END_ALLOW_THREADS
+
+    if (result != 0) {
+        PyErr_SetString(PyExc_OSError, "store write failed; the store is read-only until restart");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef StoreMethods[] = {
+    {"get", store_get, METH_VARARGS,
+     "get(key, default=None) - Value for key, or default if it is missing"},
+    {"keys", (PyCFunction)(void(*)(void))store_keys, METH_VARARGS | METH_KEYWORDS,
+     "keys(prefix='') - Sorted list of keys starting with prefix"},
+    {"sync", store_sync, METH_NOARGS,
+     "sync() - Block until every write so far is on disk"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot StoreSlots[] = {
+    {Py_mp_subscript, (void*)store_subscript},
+    {Py_mp_ass_subscript, (void*)store_ass_subscript},
+    {Py_mp_length, (void*)store_length},
+    {Py_sq_contains, (void*)store_contains},
+    {Py_tp_methods, StoreMethods},
+    {Py_tp_doc, (void*)"Persistent key-value store shared by all scripts (ts3api.store)"},
+    {0, NULL}
+};
+
+static PyType_Spec StoreSpec = {
+    "ts3api.Store",
+    sizeof(PyStore),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    StoreSlots
+};
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+/* ConfigListener: runs on the reloading thread, which never holds the GIL */
+static void on_config_changed(const PluginConfig* config, const PluginConfig* previous)
+{
+    if (config->storeCommitMs != previous->storeCommitMs) {
+        kv_store_set_commit_window(g_store, config->storeCommitMs);
+    }
+}
+
+int python_store_init(void)
+{
+    char path[512];
+    PyObject* pickle;
+
+    if (g_store != NULL) {
+        return 0;
+    }
+    if (get_config_path()[0] == '\0') {
+        log_warning("No config path; ts3api.store is disabled");
+        return -1;
+    }
+
+    if (g_dumps == NULL) {
+        pickle = PyImport_ImportModule("pickle");
+        if (pickle == NULL) {
+            python_engine_report_exception("", "store");
+            return -1;
+        }
+        g_dumps = PyObject_GetAttrString(pickle, "dumps");
+        g_loads = PyObject_GetAttrString(pickle, "loads");
+        Py_DECREF(pickle);
+        if (g_dumps == NULL || g_loads == NULL) {
+            python_engine_report_exception("", "store");
+            Py_CLEAR(g_dumps);
+            Py_CLEAR(g_loads);
+            return -1;
+        }
+    }
+
+    join_path(path, sizeof(path), get_config_path(), STORE_FILENAME);
+
+    /* Recovery reads the whole log; other threads may run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    g_store = kv_store_open(path);
+    Py_END_ALLOW_THREADS
+
+    if (g_store == NULL) {
+        log_error("Failed to open store %s; ts3api.store is disabled", path);
+        return -1;
+    }
+    kv_store_set_commit_window(g_store, get_config()->storeCommitMs);
+    add_config_listener(on_config_changed);
+    return 0;
+}
+
+int python_store_add_types(PyObject* module)
+{
+    PyObject* store;
+    int result;
+
+    if (g_store_type == NULL) {
+        g_store_type = (PyTypeObject*)PyType_FromSpec(&StoreSpec);
+        if (g_store_type == NULL) {
+            return -1;
+        }
+    }
+    if (PyModule_AddObjectRef(module, "Store", (PyObject*)g_store_type) != 0) {
+        return -1;
+    }
+
+    store = (PyObject*)PyObject_New(PyStore, g_store_type);
+    if (store == NULL) {
+        return -1;
+    }
+    result = PyModule_AddObjectRef(module, "store", store);
+    Py_DECREF(store);
+    return result;
+}
+
+int python_store_get_stats(KvStoreStats* stats)
+{
+    if (g_store == NULL) {
+        return -1;
+    }
+    kv_store_get_stats(g_store, stats);
+    return 0;
+}
+
+void python_store_shutdown(void)
+{
+    KvStore* store = g_store;
+
+    if (store == NULL) {
+        Py_CLEAR(g_store_type);
+        return;
+    }
+    /* No listener call is running once this returns */
+    remove_config_listener(on_config_changed);
+    g_store = NULL;
+
+    /* Waits for the final commit */
+    Py_BEGIN_ALLOW_THREADS
+    kv_store_close(store);
+    Py_END_ALLOW_THREADS
+
+    Py_CLEAR(g_dumps);
+    Py_CLEAR(g_loads);
+    Py_CLEAR(g_store_type);
+    log_info("Store closed");
+}
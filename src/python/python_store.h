@@ -0,0 +1,55 @@
+/**
+ * @file python_store.h
+ * @brief ts3api.store: persistent key-value storage for scripts
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * A dict-like object backed by a kv_store log in the TeamSpeak config
+ * directory, so script state survives reloads and restarts. Keys are strings;
+ * bytes and str values are stored as they are, anything else is pickled.
+ */
+
+#ifndef PYTHON_STORE_H
+#define PYTHON_STORE_H
+
+#include "utils/kv_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Store file name inside the config directory
+ */
+#define STORE_FILENAME "tspy_store.log"
+
+/**
+ * @brief Open the store (GIL held)
+ * @return 0 on success, non-zero if scripts will run without a store
+ */
+int python_store_init(void);
+
+/**
+ * @brief Register the ts3api.Store type and the ts3api.store object
+ * @param module The ts3api module (PyObject*)
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_store_add_types(struct _object* module);
+
+/**
+ * @brief Read the store counters
+ * @param stats Receives the counters
+ * @return 0 on success, -1 if no store is open
+ */
+int python_store_get_stats(KvStoreStats* stats);
+
+/**
+ * @brief Commit pending writes and close the store
+ */
+void python_store_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_STORE_H */
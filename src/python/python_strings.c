@@ -0,0 +1,348 @@
+/**
+ * @file python_strings.c
+ * @brief Cache of decoded nicknames and unique identifiers
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include "python_strings.h"
+#include "python_engine.h"
+#include "utils/hash.h"
+#include "utils/logging.h"
+#include "utils/threading.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENTRY_MASK (STRING_CACHE_ENTRIES - 1)
+
+/* Hits counted before the shared counters are updated */
+#define HIT_BATCH 64
+
+typedef struct StringEntry {
+    PyObject*        value;       /* NULL while unused */
+    uint64_t         hash;
+    size_t           length;
+    size_t           objectBytes; /* Size of value, counted as saved by each hit */
+    int32_t          next;        /* Next entry in the bucket, -1 at the end */
+    int              referenced;  /* Set by hits, cleared by the CLOCK hand */
+    volatile int64_t owner;       /* STRING_OWNER, read by invalidation without the GIL */
+    volatile int32_t stale;
+    char             bytes[STRING_CACHE_MAX_BYTES];
+} StringEntry;
+
+/* Entries, buckets and pending counts are changed with the GIL held; counters are read by any thread */
+typedef struct StringCache {
+    StringEntry      entries[STRING_CACHE_ENTRIES];
+    int32_t          buckets[STRING_CACHE_ENTRIES];
+    size_t           count;
+    size_t           hand;
+    int64_t          pendingHits;
+    int64_t          pendingBytes;
+    volatile int64_t lookups;
+    volatile int64_t hits;
+    volatile int64_t decodes;
+    volatile int64_t evictions;
+    volatile int64_t invalidations;
+    volatile int64_t savedBytes;
+} StringCache;
+
+static StringCache       g_cache;
+static volatile int32_t  g_ready = 0;
+
+static void cache_init(StringCache* cache)
+{
+    size_t i;
+
+    memset(cache, 0, sizeof(*cache));
+    for (i = 0; i < STRING_CACHE_ENTRIES; i++) {
+        cache->buckets[i] = -1;
+    }
+}
+
+static void cache_clear(StringCache* cache)
+{
+    size_t i;
+
+    for (i = 0; i < cache->count; i++) {
+        Py_CLEAR(cache->entries[i].value);
+    }
+    for (i = 0; i < STRING_CACHE_ENTRIES; i++) {
+        cache->buckets[i] = -1;
+    }
+    cache->count = 0;
+    cache->hand = 0;
+}
+
+/* What sys.getsizeof reports for a new str, without its UTF-8 copy */
+static size_t str_object_size(PyObject* value)
+{
+    size_t length = (size_t)PyUnicode_GET_LENGTH(value);
+
+    if (PyUnicode_IS_COMPACT_ASCII(value)) {
+        return sizeof(PyASCIIObject) + length + 1;
+    }
+    return sizeof(PyCompactUnicodeObject) + (length + 1) * (size_t)PyUnicode_KIND(value);
+}
+
+static PyObject* decode(StringCache* cache, const char* text, size_t length)
+{
+    atomic64_add(&cache->decodes, 1);
+    return PyUnicode_DecodeUTF8(text, (Py_ssize_t)length, "replace");
+}
+
+static void flush_hits(StringCache* cache)
+{
+    if (cache->pendingHits > 0) {
+        atomic64_add(&cache->lookups, cache->pendingHits);
+        atomic64_add(&cache->hits, cache->pendingHits);
+        atomic64_add(&cache->savedBytes, cache->pendingBytes);
+        cache->pendingHits = 0;
+        cache->pendingBytes = 0;
+    }
+}
+
+static void bucket_unlink(StringCache* cache, int32_t index)
+{
+    int32_t* link = &cache->buckets[cache->entries[index].hash & ENTRY_MASK];
+
+    while (*link != index) {
+        link = &cache->entries[*link].next;
+    }
+    *link = cache->entries[index].next;
+}
+
+/* A free entry, or the first one the CLOCK hand finds unused since its last pass */
+static int32_t take_entry(StringCache* cache)
+{
+    if (cache->count < STRING_CACHE_ENTRIES) {
+        return (int32_t)cache->count++;
+    }
+    for (;;) {
+        int32_t index = (int32_t)cache->hand;
+        StringEntry* entry = &cache->entries[index];
+
+        cache->hand = (cache->hand + 1) & ENTRY_MASK;
+        if (entry->referenced && !atomic32_load(&entry->stale)) {
+            entry->referenced = 0;
+            continue;
+        }
+        bucket_unlink(cache, index);
+        Py_CLEAR(entry->value);
+        atomic64_add(&cache->evictions, 1);
+        return index;
+    }
+}
+
+static PyObject* cache_get(StringCache* cache, const char* text, size_t length, int64_t owner)
+{
+    uint64_t hash = hash_mix64(hash_fnv1a64(HASH_FNV1A64_INIT, text, length));
+    int32_t* bucket = &cache->buckets[hash & ENTRY_MASK];
+    StringEntry* entry;
+    PyObject* value;
+    int32_t index;
+
+    for (index = *bucket; index >= 0; index = entry->next) {
+        entry = &cache->entries[index];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->bytes, text, length) == 0) {
+            entry->referenced = 1;
+            if (owner != STRING_OWNER_NONE && atomic64_load(&entry->owner) != owner) {
+                atomic64_store(&entry->owner, owner);
+            }
+            if (atomic32_load(&entry->stale)) {
+                atomic32_store(&entry->stale, 0);
+            }
+            /* Hits are the common case; they are published in batches */
+            cache->pendingBytes += (int64_t)entry->objectBytes;
+            if (++cache->pendingHits >= HIT_BATCH) {
+                flush_hits(cache);
+            }
+            return Py_NewRef(entry->value);
+        }
+    }
+
+    flush_hits(cache);
+    atomic64_add(&cache->lookups, 1);
+    value = decode(cache, text, length);
+    if (value == NULL) {
+        return NULL;
+    }
+
+    index = take_entry(cache);
+    entry = &cache->entries[index];
+    entry->value = Py_NewRef(value);
+    entry->hash = hash;
+    entry->length = length;
+    entry->objectBytes = str_object_size(value);
+    entry->referenced = 0;
+    memcpy(entry->bytes, text, length);
+    atomic64_store(&entry->owner, owner);
+    atomic32_store(&entry->stale, 0);
+    /* The bucket may have lost an entry to the hand */
+    entry->next = *bucket;
+    *bucket = index;
+    return value;
+}
+
+PyObject* python_strings_get(const char* text, int64_t owner)
+{
+    size_t length;
+
+    if (text == NULL) {
+        text = "";
+    }
+    length = strlen(text);
+
+#ifndef Py_GIL_DISABLED
+    /* Cached objects must not cross into another interpreter */
+    if (length <= STRING_CACHE_MAX_BYTES && python_engine_in_main_interpreter()) {
+        if (!g_ready) {
+            cache_init(&g_cache);
+            atomic32_store(&g_ready, 1);
+        }
+        return cache_get(&g_cache, text, length, owner);
+    }
+#else
+    (void)owner; /* Unused parameter */
+#endif
+    return decode(&g_cache, text, length);
+}
+
+void python_strings_invalidate_client(uint64 serverConnectionHandlerID, anyID clientID)
+{
+    int64_t owner = STRING_OWNER(serverConnectionHandlerID, clientID);
+    size_t i;
+
+    if (!atomic32_load(&g_ready)) {
+        return;
+    }
+    /* An entry reused meanwhile may be marked by mistake; that only costs it its place */
+    for (i = 0; i < STRING_CACHE_ENTRIES; i++) {
+        StringEntry* entry = &g_cache.entries[i];
+
+        if (atomic64_load(&entry->owner) == owner && !atomic32_load(&entry->stale)) {
+            atomic32_store(&entry->stale, 1);
+            atomic64_add(&g_cache.invalidations, 1);
+        }
+    }
+}
+
+static void cache_get_stats(StringCache* cache, StringCacheStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->entries = cache->count;
+    stats->lookups = (uint64_t)atomic64_load(&cache->lookups);
+    stats->hits = (uint64_t)atomic64_load(&cache->hits);
+    stats->decodes = (uint64_t)atomic64_load(&cache->decodes);
+    stats->evictions = (uint64_t)atomic64_load(&cache->evictions);
+    stats->invalidations = (uint64_t)atomic64_load(&cache->invalidations);
+    stats->savedBytes = (uint64_t)atomic64_load(&cache->savedBytes);
+}
+
+void python_strings_get_stats(StringCacheStats* stats)
+{
+    cache_get_stats(&g_cache, stats);
+}
+
+/* Benchmark draws: a few names most of the time, as in a busy channel */
+static size_t pick_name(uint64_t* state, size_t names)
+{
+    double r;
+
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    r = (double)(*state >> 11) / 9007199254740992.0;
+    return (size_t)(r * r * (double)names);
+}
+
+int python_strings_benchmark(size_t names, size_t lookups, StringCacheBenchmark* result)
+{
+    PyGILState_STATE gil;
+    StringCache* cache;
+    StringCacheStats stats;
+    char (*texts)[48];
+    uint64_t startNs;
+    uint64_t state;
+    size_t i;
+    int failed = 0;
+
+    memset(result, 0, sizeof(*result));
+    if (names < 1 || names > 64 * STRING_CACHE_ENTRIES || lookups == 0) {
+        log_error("strbench needs 1-%d names and at least one lookup", 64 * STRING_CACHE_ENTRIES);
+        return 1;
+    }
+    result->names = names;
+    result->lookups = lookups;
+
+    cache = (StringCache*)malloc(sizeof(StringCache));
+    texts = (char (*)[48])malloc(names * sizeof(*texts));
+    if (cache == NULL || texts == NULL) {
+        free(cache);
+        free(texts);
+        return 1;
+    }
+    cache_init(cache);
+    /* Nicknames and UIDs alike: mostly ASCII, some not */
+    for (i = 0; i < names; i++) {
+        snprintf(texts[i], sizeof(texts[i]), (i % 4) == 3 ? "Jörg-%zu \xe2\x98\x85" : "Operator%zu", i);
+    }
+
+    gil = PyGILState_Ensure();
+
+    /* Strings are dropped right away, as a handler's arguments are */
+    state = 1;
+    startNs = clock_monotonic_ns();
+    for (i = 0; i < lookups && !failed; i++) {
+        const char* text = texts[pick_name(&state, names)];
+        PyObject* value = PyUnicode_DecodeUTF8(text, (Py_ssize_t)strlen(text), "replace");
+
+        failed = value == NULL;
+        Py_XDECREF(value);
+    }
+    result->decodeNs = clock_monotonic_ns() - startNs;
+
+    state = 1;
+    startNs = clock_monotonic_ns();
+    for (i = 0; i < lookups && !failed; i++) {
+        const char* text = texts[pick_name(&state, names)];
+        PyObject* value = cache_get(cache, text, strlen(text), STRING_OWNER_NONE);
+
+        failed = value == NULL;
+        Py_XDECREF(value);
+    }
+    result->cacheNs = clock_monotonic_ns() - startNs;
+
+    if (failed) {
+        python_engine_report_exception("", "strbench");
+    }
+    flush_hits(cache);
+    cache_clear(cache);
+    PyGILState_Release(gil);
+
+    cache_get_stats(cache, &stats);
+    result->decodes = stats.decodes;
+    result->savedBytes = stats.savedBytes;
+    result->evictions = stats.evictions;
+    free(cache);
+    free(texts);
+    return failed;
+}
+
+void python_strings_shutdown(void)
+{
+    if (!g_ready) {
+        return;
+    }
+    cache_clear(&g_cache);
+    log_debug("String cache shut down");
+}
@@ -0,0 +1,123 @@
+/**
+ * @file python_strings.h
+ * @brief Cache of decoded nicknames and unique identifiers
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * The same few hundred nicknames and unique identifiers are decoded into
+ * new str objects for every text message and get_client_name call. The
+ * cache keeps up to STRING_CACHE_ENTRIES of them, keyed by their UTF-8
+ * bytes, and hands out the same object each time. When it is full, a CLOCK
+ * hand evicts entries that were not used since it last passed.
+ *
+ * Entries remember the client they came from. When TeamSpeak reports that a
+ * client changed or left, its entries are marked stale so the hand takes
+ * them first; a stale entry that is looked up again becomes live again.
+ *
+ * The cache belongs to the main interpreter. Isolated interpreters and
+ * free-threaded builds decode every string.
+ */
+
+#ifndef PYTHON_STRINGS_H
+#define PYTHON_STRINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "teamspeak/public_definitions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Strings kept; a power of two
+ */
+#define STRING_CACHE_ENTRIES 1024
+
+/**
+ * @brief Longest string cached, in UTF-8 bytes; longer ones are decoded every time
+ */
+#define STRING_CACHE_MAX_BYTES 128
+
+/**
+ * @brief Owner tag for strings that belong to a client
+ */
+#define STRING_OWNER(serverConnectionHandlerID, clientID) \
+    ((int64_t)(((uint64_t)(serverConnectionHandlerID) << 16) | (uint64_t)(clientID)))
+
+/**
+ * @brief Owner tag for strings that belong to no client
+ */
+#define STRING_OWNER_NONE 0
+
+/**
+ * @brief Cache counters
+ */
+typedef struct StringCacheStats {
+    size_t   entries;        /* Strings held */
+    uint64_t lookups;
+    uint64_t hits;           /* Lookups answered with a cached object */
+    uint64_t decodes;        /* str objects created, cached or not */
+    uint64_t evictions;
+    uint64_t invalidations;  /* Entries marked stale by client updates */
+    uint64_t savedBytes;     /* Size of the str objects the hits did not allocate */
+} StringCacheStats;
+
+/**
+ * @brief Results of python_strings_benchmark
+ */
+typedef struct StringCacheBenchmark {
+    size_t   names;          /* Distinct strings */
+    size_t   lookups;        /* Strings produced by each run */
+    uint64_t decodeNs;       /* Decoding every time */
+    uint64_t cacheNs;        /* Through a fresh cache */
+    uint64_t decodes;        /* str objects the cached run created */
+    uint64_t evictions;      /* Entries the cached run evicted */
+    uint64_t savedBytes;     /* Allocation the cached run avoided */
+} StringCacheBenchmark;
+
+/**
+ * @brief A str for UTF-8 text, shared with earlier lookups of the same bytes (GIL held)
+ * @param text UTF-8 text, NULL for ""
+ * @param owner STRING_OWNER of the client the text belongs to, or STRING_OWNER_NONE
+ * @return New reference (PyObject*), or NULL with a Python exception set
+ * @note Invalid UTF-8 is decoded with replacement characters
+ */
+struct _object* python_strings_get(const char* text, int64_t owner);
+
+/**
+ * @brief Mark a client's strings stale after it changed or left
+ * @param serverConnectionHandlerID Server connection handler ID
+ * @param clientID Client ID
+ * @note Any thread; does not need the GIL
+ */
+void python_strings_invalidate_client(uint64 serverConnectionHandlerID, anyID clientID);
+
+/**
+ * @brief Read the cache counters
+ * @param stats Receives the counters
+ * @note Any thread; does not need the GIL. Hits are added in batches, so up to 63 may be missing
+ */
+void python_strings_get_stats(StringCacheStats* stats);
+
+/**
+ * @brief Time decoding a set of nicknames against looking them up in a fresh cache
+ * @param names Distinct strings (1..64 * STRING_CACHE_ENTRIES); more than the cache holds measures eviction
+ * @param lookups Strings produced per run
+ * @param result Receives the timings
+ * @return 0 on success, non-zero if the arguments are out of range or Python failed
+ * @note Call without the GIL; the live cache is not touched
+ */
+int python_strings_benchmark(size_t names, size_t lookups, StringCacheBenchmark* result);
+
+/**
+ * @brief Drop the cached strings (GIL held)
+ * @note Call before the interpreter is finalized
+ */
+void python_strings_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_STRINGS_H */
@@ -0,0 +1,457 @@
+/**
+ * @file python_subscriptions.c
+ * @brief Filtered event subscriptions implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_subscriptions.h"
+#include "python_event_object.h"
+#include "core/plugin_main.h"
+#include "utils/hash.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+
+/* Current snapshot per event; replaced (never mutated) on change. GIL (state lock) guarded. */
+static SubscriptionList* g_lists[PYTHON_EVENT_COUNT];
+static int g_next_id = 1;
+
+/* Named lanes of each snapshot, for the dispatcher to read without the GIL */
+static Mutex    g_lane_lock;
+static uint32_t g_lanes[PYTHON_EVENT_COUNT][SUBSCRIPTION_MAX_LANES];
+static size_t   g_lane_counts[PYTHON_EVENT_COUNT];
+
+static void subscription_release(Subscription* subscription)
+{
+    if (atomic32_add(&subscription->refcount, -1) == 0) {
+        Py_DECREF((PyObject*)subscription->callable);
+        free(subscription);
+    }
+}
+
+static SubscriptionList* list_create(size_t count)
+{
+    size_t size = offsetof(SubscriptionList, items) + (count > 0 ? count : 1) * sizeof(Subscription*);
+    SubscriptionList* list = (SubscriptionList*)malloc(size);
+
+    if (list != NULL) {
+        list->refcount = 1;
+        list->count = 0;
+    }
+    return list;
+}
+
+/* Add a lane to a set unless present; returns 0 if the set is full */
+static int lane_insert(uint32_t* lanes, size_t* count, uint32_t lane)
+{
+    size_t i;
+
+    for (i = 0; i < *count; i++) {
+        if (lanes[i] == lane) {
+            return 1;
+        }
+    }
+    if (*count == SUBSCRIPTION_MAX_LANES) {
+        return 0;
+    }
+    lanes[(*count)++] = lane;
+    return 1;
+}
+
+/* Install a new snapshot, dropping the table's reference to the old one */
+static void list_publish(PythonEventType type, SubscriptionList* list)
+{
+    SubscriptionList* old = g_lists[type];
+    uint32_t lanes[SUBSCRIPTION_MAX_LANES];
+    size_t count = 0;
+    size_t i;
+
+    if (list != NULL && list->count == 0) {
+        python_subscriptions_release(list);
+        list = NULL;
+    }
+    for (i = 0; list != NULL && i < list->count; i++) {
+        if (list->items[i]->lane != SUBSCRIPTION_LANE_CONNECTION) {
+            lane_insert(lanes, &count, list->items[i]->lane);
+        }
+    }
+
+    mutex_lock(&g_lane_lock);
+    memcpy(g_lanes[type], lanes, count * sizeof(uint32_t));
+    g_lane_counts[type] = count;
+    mutex_unlock(&g_lane_lock);
+
+    g_lists[type] = list;
+    python_subscriptions_release(old);
+}
+
+/* Rebuild a snapshot without the entries the predicate selects */
+static int list_remove_if(PythonEventType type, int (*predicate)(const Subscription*, const void*), const void* context)
+{
+    SubscriptionList* old = g_lists[type];
+    SubscriptionList* list;
+    size_t i;
+    int removed = 0;
+
+    if (old == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < old->count; i++) {
+        if (predicate(old->items[i], context)) {
+            removed++;
+        }
+    }
+    if (removed == 0) {
+        return 0;
+    }
+
+    list = list_create(old->count - (size_t)removed);
+    if (list == NULL) {
+        log_error("Out of memory removing subscriptions");
+        return 0;
+    }
+    for (i = 0; i < old->count; i++) {
+        if (!predicate(old->items[i], context)) {
+            atomic32_add(&old->items[i]->refcount, 1);
+            list->items[list->count++] = old->items[i];
+        }
+    }
+
+    list_publish(type, list);
+    return removed;
+}
+
+void python_subscriptions_init(void)
+{
+    mutex_init(&g_lane_lock);
+}
+
+uint32_t python_subscriptions_lane(const char* name)
+{
+    /* Never SUBSCRIPTION_LANE_CONNECTION or EVENT_LANE_ALL */
+    return (uint32_t)(hash_mix64(hash_fnv1a64(HASH_FNV1A64_INIT, name, strlen(name))) % 0xFFFFFFFEu) + 1;
+}
+
+size_t python_subscriptions_lanes(PythonEventType type, uint32_t* lanes)
+{
+    size_t count;
+
+    if (type < 0 || type >= PYTHON_EVENT_COUNT) {
+        return 0;
+    }
+
+    mutex_lock(&g_lane_lock);
+    count = g_lane_counts[type];
+    memcpy(lanes, g_lanes[type], count * sizeof(uint32_t));
+    mutex_unlock(&g_lane_lock);
+    return count;
+}
+
+unsigned int python_subscriptions_supported_filters(PythonEventType type)
+{
+    switch (type) {
+        case PYTHON_EVENT_CLIENT_MOVE:
+        case PYTHON_EVENT_TALK_STATUS_CHANGE:
+            return FILTER_SERVER | FILTER_CHANNEL | FILTER_IGNORE_SELF;
+        case PYTHON_EVENT_TEXT_MESSAGE:
+            return FILTER_SERVER | FILTER_CHANNEL | FILTER_TARGET_MODE | FILTER_CONTAINS | FILTER_IGNORE_SELF;
+        case PYTHON_EVENT_TRIGGER:
+            return FILTER_SERVER | FILTER_TARGET_MODE | FILTER_CONTAINS | FILTER_IGNORE_SELF;
+        case PYTHON_EVENT_CONNECT:
+        case PYTHON_EVENT_DISCONNECT:
+        case PYTHON_EVENT_COMMAND:
+            return FILTER_SERVER;
+        default:
+            return 0;
+    }
+}
+
+int python_subscriptions_add(PythonEventType type, const SubscriptionFilter* filter, struct _object* callable,
+                             const char* script, unsigned int generation, uint32_t lane)
+{
+    SubscriptionList* old;
+    SubscriptionList* list;
+    Subscription* subscription;
+    uint32_t lanes[SUBSCRIPTION_MAX_LANES];
+    size_t laneCount;
+    size_t count;
+    size_t i;
+    int id;
+
+    if (type < 0 || type >= PYTHON_EVENT_COUNT || filter == NULL || callable == NULL) {
+        return -1;
+    }
+
+    python_engine_lock_state();
+    laneCount = g_lane_counts[type];
+    memcpy(lanes, g_lanes[type], laneCount * sizeof(uint32_t));
+    if (lane != SUBSCRIPTION_LANE_CONNECTION && !lane_insert(lanes, &laneCount, lane)) {
+        python_engine_unlock_state();
+        return -2;
+    }
+
+    subscription = (Subscription*)calloc(1, sizeof(Subscription));
+    if (subscription == NULL) {
+        python_engine_unlock_state();
+        return -1;
+    }
+
+    old = g_lists[type];
+    count = old != NULL ? old->count : 0;
+    list = list_create(count + 1);
+    if (list == NULL) {
+        free(subscription);
+        python_engine_unlock_state();
+        return -1;
+    }
+
+    subscription->refcount = 1;
+    subscription->id = g_next_id++;
+    subscription->type = type;
+    subscription->filter = *filter;
+    subscription->callable = callable;
+    subscription->generation = generation;
+    subscription->lane = lane;
+    subscription->takesEvent = python_event_object_takes_event(callable, type);
+    safe_strcpy(subscription->script, sizeof(subscription->script), script != NULL ? script : "");
+    Py_INCREF((PyObject*)callable);
+
+    for (i = 0; i < count; i++) {
+        atomic32_add(&old->items[i]->refcount, 1);
+        list->items[list->count++] = old->items[i];
+    }
+    list->items[list->count++] = subscription;
+
+    id = subscription->id;
+    list_publish(type, list);
+    python_engine_unlock_state();
+    return id;
+}
+
+static int match_callable(const Subscription* subscription, const void* callable)
+{
+    return subscription->callable == callable;
+}
+
+int python_subscriptions_remove_callable(struct _object* callable)
+{
+    int type;
+    int removed = 0;
+
+    python_engine_lock_state();
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        removed += list_remove_if((PythonEventType)type, match_callable, callable);
+    }
+    python_engine_unlock_state();
+    return removed;
+}
+
+typedef struct ScriptRange {
+    const char*  script;
+    unsigned int minGeneration;
+    unsigned int maxGeneration;
+} ScriptRange;
+
+static int match_script_range(const Subscription* subscription, const void* context)
+{
+    const ScriptRange* range = (const ScriptRange*)context;
+
+    return strcmp(subscription->script, range->script) == 0
+        && subscription->generation >= range->minGeneration
+        && subscription->generation <= range->maxGeneration;
+}
+
+void python_subscriptions_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    ScriptRange range;
+    int type;
+    int removed = 0;
+
+    range.script = script;
+    range.minGeneration = minGeneration;
+    range.maxGeneration = maxGeneration;
+
+    python_engine_lock_state();
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        removed += list_remove_if((PythonEventType)type, match_script_range, &range);
+    }
+    python_engine_unlock_state();
+    if (removed > 0) {
+        log_debug("Removed %d subscription(s) of %s", removed, script);
+    }
+}
+
+int python_subscriptions_count_for_script(const char* script)
+{
+    int type;
+    size_t i;
+    int count = 0;
+
+    python_engine_lock_state();
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        SubscriptionList* list = g_lists[type];
+        for (i = 0; list != NULL && i < list->count; i++) {
+            if (strcmp(list->items[i]->script, script) == 0) {
+                count++;
+            }
+        }
+    }
+    python_engine_unlock_state();
+    return count;
+}
+
+SubscriptionList* python_subscriptions_acquire(PythonEventType type)
+{
+    SubscriptionList* list;
+
+    if (type < 0 || type >= PYTHON_EVENT_COUNT) {
+        return NULL;
+    }
+
+    python_engine_lock_state();
+    list = g_lists[type];
+    if (list != NULL) {
+        atomic32_add(&list->refcount, 1);
+    }
+    python_engine_unlock_state();
+    return list;
+}
+
+void python_subscriptions_release(SubscriptionList* list)
+{
+    size_t i;
+
+    if (list == NULL || atomic32_add(&list->refcount, -1) != 0) {
+        return;
+    }
+    for (i = 0; i < list->count; i++) {
+        subscription_release(list->items[i]);
+    }
+    free(list);
+}
+
+/* ASCII case-insensitive search; needle is already lower-case */
+static int contains_folded(const char* haystack, const char* needle, size_t needleLength)
+{
+    const char* p;
+    size_t i;
+
+    if (needleLength == 0) {
+        return 1;
+    }
+
+    for (p = haystack; *p != '\0'; p++) {
+        for (i = 0; i < needleLength; i++) {
+            char c = p[i];
+            if (c >= 'A' && c <= 'Z') {
+                c = (char)(c - 'A' + 'a');
+            }
+            if (c != needle[i]) {
+                break;
+            }
+        }
+        if (i == needleLength) {
+            return 1;
+        }
+        if (p[i] == '\0') {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int resolve_own_client(const PythonEvent* event, SubscriptionCache* cache)
+{
+    if (!cache->ownClientResolved) {
+        struct TS3Functions* ts3Functions = get_ts3_functions();
+        cache->ownClientResolved = 1;
+        cache->ownClientID = 0;
+        if (ts3Functions->getClientID == NULL
+            || ts3Functions->getClientID(event->serverConnectionHandlerID, &cache->ownClientID) != ERROR_ok) {
+            cache->ownClientID = 0;
+        }
+    }
+    return cache->ownClientID != 0;
+}
+
+/* Channel an event happened in: the talker's channel, or ours for channel chat */
+static uint64 resolve_event_channel(const PythonEvent* event, SubscriptionCache* cache)
+{
+    if (!cache->channelResolved) {
+        struct TS3Functions* ts3Functions = get_ts3_functions();
+        anyID client = event->clientID;
+
+        cache->channelResolved = 1;
+        cache->channelID = 0;
+        if (event->type == PYTHON_EVENT_TEXT_MESSAGE) {
+            client = resolve_own_client(event, cache) ? cache->ownClientID : 0;
+        }
+        if (client != 0 && ts3Functions->getChannelOfClient != NULL) {
+            if (ts3Functions->getChannelOfClient(event->serverConnectionHandlerID, client, &cache->channelID) != ERROR_ok) {
+                cache->channelID = 0;
+            }
+        }
+    }
+    return cache->channelID;
+}
+
+int python_subscription_matches(const Subscription* subscription, const PythonEvent* event, SubscriptionCache* cache)
+{
+    const SubscriptionFilter* filter = &subscription->filter;
+
+    /* Cheapest predicates first; the TeamSpeak lookups are cached per event */
+    if ((filter->flags & FILTER_SERVER) && event->serverConnectionHandlerID != filter->serverConnectionHandlerID) {
+        return 0;
+    }
+    if ((filter->flags & FILTER_TARGET_MODE) && event->targetMode != (anyID)filter->targetMode) {
+        return 0;
+    }
+    if ((filter->flags & FILTER_CONTAINS)
+        && (event->message == NULL || !contains_folded(event->message, filter->contains, filter->containsLength))) {
+        return 0;
+    }
+    if (filter->flags & FILTER_CHANNEL) {
+        if (event->type == PYTHON_EVENT_CLIENT_MOVE) {
+            if (event->oldChannelID != filter->channelID && event->newChannelID != filter->channelID) {
+                return 0;
+            }
+        } else if (event->type == PYTHON_EVENT_TEXT_MESSAGE && event->targetMode != TextMessageTarget_CHANNEL) {
+            return 0;
+        } else if (resolve_event_channel(event, cache) != filter->channelID) {
+            return 0;
+        }
+    }
+    if ((filter->flags & FILTER_IGNORE_SELF) && resolve_own_client(event, cache) && event->clientID == cache->ownClientID) {
+        return 0;
+    }
+
+    return 1;
+}
+
+void python_subscriptions_shutdown(void)
+{
+    int type;
+
+    python_engine_lock_state();
+    for (type = 0; type < PYTHON_EVENT_COUNT; type++) {
+        list_publish((PythonEventType)type, NULL);
+    }
+    python_engine_unlock_state();
+    mutex_destroy(&g_lane_lock);
+}
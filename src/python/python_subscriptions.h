@@ -0,0 +1,196 @@
+/**
+ * @file python_subscriptions.h
+ * @brief Filtered event subscriptions registered via @ts3api.on
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Filters are compiled into plain C structs at registration time so the
+ * dispatcher can reject events before building any Python objects.
+ *
+ * A subscription may name a lane; with a handler pool (python_pool.h) each
+ * lane's handlers run in order on one worker thread, apart from the
+ * connection lane that carries the on_* functions and all other handlers.
+ */
+
+#ifndef PYTHON_SUBSCRIPTIONS_H
+#define PYTHON_SUBSCRIPTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "teamspeak/public_definitions.h"
+#include "python_engine.h"
+#include "python_events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum length of a "contains" filter in bytes
+ */
+#define FILTER_CONTAINS_BUFSIZE 128
+
+/**
+ * @brief Filter predicate flags
+ */
+#define FILTER_SERVER      0x01u /* serverConnectionHandlerID equals */
+#define FILTER_CHANNEL     0x02u /* event concerns the given channel */
+#define FILTER_TARGET_MODE 0x04u /* text message target mode equals */
+#define FILTER_CONTAINS    0x08u /* message contains text (ASCII case-insensitive) */
+#define FILTER_IGNORE_SELF 0x10u /* event is not caused by our own client */
+
+/**
+ * @brief Lane of handlers that did not name one; follows the server connection
+ */
+#define SUBSCRIPTION_LANE_CONNECTION 0u
+
+/**
+ * @brief Most distinct lanes among one event's subscriptions
+ */
+#define SUBSCRIPTION_MAX_LANES 16
+
+/**
+ * @brief Compiled filter predicates; all set flags must match
+ */
+typedef struct SubscriptionFilter {
+    unsigned int flags;
+    uint64       serverConnectionHandlerID;
+    uint64       channelID;
+    int          targetMode;
+    char         contains[FILTER_CONTAINS_BUFSIZE]; /* Lower-cased */
+    size_t       containsLength;
+} SubscriptionFilter;
+
+/**
+ * @brief A registered handler and its filter
+ */
+typedef struct Subscription {
+    volatile int32_t   refcount;
+    int                id;
+    PythonEventType    type;
+    SubscriptionFilter filter;
+    struct _object*    callable; /* PyObject*, strong reference */
+    char               script[SCRIPT_NAME_BUFSIZE];
+    unsigned int       generation;
+    uint32_t           lane;     /* From python_subscriptions_lane, or SUBSCRIPTION_LANE_CONNECTION */
+    int                takesEvent; /* Called with a ts3api.Event instead of positional arguments */
+} Subscription;
+
+/**
+ * @brief Immutable snapshot of one event's subscriptions
+ *
+ * Registration replaces the snapshot instead of mutating it, so a handler
+ * may subscribe or unsubscribe while the dispatcher iterates.
+ */
+typedef struct SubscriptionList {
+    volatile int32_t refcount;
+    size_t           count;
+    Subscription*    items[1]; /* count entries */
+} SubscriptionList;
+
+/**
+ * @brief Per-event cache of values looked up from TeamSpeak while matching
+ */
+typedef struct SubscriptionCache {
+    int    ownClientResolved;
+    anyID  ownClientID;
+    int    channelResolved;
+    uint64 channelID;
+} SubscriptionCache;
+
+/**
+ * @brief Check which filter flags an event type supports
+ * @param type Event type
+ * @return Bitmask of FILTER_* flags
+ */
+unsigned int python_subscriptions_supported_filters(PythonEventType type);
+
+/**
+ * @brief Prepare the lane table (before any subscription is added)
+ */
+void python_subscriptions_init(void);
+
+/**
+ * @brief Lane ID for a lane name
+ * @param name Lane name as given to ts3api.on(lane=...)
+ * @return Non-zero ID; the same name always gives the same ID
+ */
+uint32_t python_subscriptions_lane(const char* name);
+
+/**
+ * @brief Register a handler (requires the GIL)
+ * @param type Event type
+ * @param filter Compiled filter (copied)
+ * @param callable Python callable (a new reference is taken)
+ * @param script Owning script name, or NULL if not owned by a script
+ * @param generation Load generation of the owning script
+ * @param lane Lane ID, or SUBSCRIPTION_LANE_CONNECTION
+ * @return Subscription ID, -1 if out of memory, or -2 if the event already
+ *         has SUBSCRIPTION_MAX_LANES other lanes
+ */
+int python_subscriptions_add(PythonEventType type, const SubscriptionFilter* filter, struct _object* callable,
+                             const char* script, unsigned int generation, uint32_t lane);
+
+/**
+ * @brief Distinct named lanes among an event's subscriptions
+ * @param type Event type
+ * @param lanes Receives up to SUBSCRIPTION_MAX_LANES lane IDs
+ * @return Number of lanes written
+ * @note Any thread; does not need the GIL
+ */
+size_t python_subscriptions_lanes(PythonEventType type, uint32_t* lanes);
+
+/**
+ * @brief Remove every subscription of a callable (requires the GIL)
+ * @param callable Python callable
+ * @return Number of subscriptions removed
+ */
+int python_subscriptions_remove_callable(struct _object* callable);
+
+/**
+ * @brief Remove a script's subscriptions within a generation range (requires the GIL)
+ * @param script Script name
+ * @param minGeneration Lowest generation to remove
+ * @param maxGeneration Highest generation to remove
+ */
+void python_subscriptions_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration);
+
+/**
+ * @brief Count a script's subscriptions
+ * @param script Script name
+ * @return Number of subscriptions
+ */
+int python_subscriptions_count_for_script(const char* script);
+
+/**
+ * @brief Take a reference to the current snapshot for an event
+ * @param type Event type
+ * @return Snapshot, or NULL if there are no subscriptions
+ */
+SubscriptionList* python_subscriptions_acquire(PythonEventType type);
+
+/**
+ * @brief Drop a snapshot reference (requires the GIL)
+ * @param list Snapshot from python_subscriptions_acquire, may be NULL
+ */
+void python_subscriptions_release(SubscriptionList* list);
+
+/**
+ * @brief Evaluate a subscription's filter against an event
+ * @param subscription Subscription to test
+ * @param event Event data
+ * @param cache Lookup cache shared across subscriptions of one event
+ * @return 1 if the handler should be called, 0 otherwise
+ */
+int python_subscription_matches(const Subscription* subscription, const PythonEvent* event, SubscriptionCache* cache);
+
+/**
+ * @brief Drop all subscriptions (requires the GIL)
+ */
+void python_subscriptions_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_SUBSCRIPTIONS_H */
@@ -0,0 +1,573 @@
+/**
+ * @file python_timers.c
+ * @brief Script timer scheduler implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Locking: g_lock guards the wheel, the registry, timer states and the
+ * counters. It is always taken after the GIL, never before, and is never
+ * held while waiting for the GIL. The cancelled flag is only written with
+ * the GIL held, so the scheduler reads it under the GIL alone; free-threaded
+ * builds read it under g_lock.
+ */
+
+/* Undefine _DEBUG to use release Python library */
+#ifdef _DEBUG
+#undef _DEBUG
+#include <Python.h>
+#define _DEBUG
+#else
+#include <Python.h>
+#endif
+
+#define PY_SSIZE_T_CLEAN
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_timers.h"
+#include "python_engine.h"
+#include "python_loop.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+#include "utils/timer_wheel.h"
+#include "utils/trace.h"
+
+#define TICK_NS ((uint64_t)TIMER_TICK_MS * 1000000ULL)
+
+/* Longest accepted delay or interval, in seconds (about 31 years) */
+#define MAX_SECONDS 1e9
+
+typedef enum {
+    TIMER_PENDING = 0, /* In the wheel */
+    TIMER_RUNNING,     /* Collected into the current batch */
+    TIMER_DONE         /* Fired (one-shot) or cancelled; out of the registry */
+} TimerState;
+
+/* A ts3api.Timer; the registry holds a reference until the timer is done */
+typedef struct PyTimer {
+    PyObject_HEAD
+    TimerNode       node;
+    TimerState      state;
+    int             cancelled;
+    uint64_t        intervalTicks; /* 0 for one-shot timers */
+    PyObject*       callable;
+    PyObject*       args;
+    char            script[SCRIPT_NAME_BUFSIZE];
+    unsigned int    generation;
+    struct PyTimer* prev;          /* Registry links */
+    struct PyTimer* next;
+} PyTimer;
+
+#define TIMER_FROM_NODE(n) ((PyTimer*)((char*)(n) - offsetof(PyTimer, node)))
+
+static PyTypeObject* g_timer_type = NULL;
+
+static Mutex      g_lock;
+static CondVar    g_wake;
+static Thread     g_thread;
+static int        g_running = 0;
+static int        g_stopping = 0;
+static TimerWheel g_wheel;
+static PyTimer*   g_registry = NULL;
+static TimerStats g_stats;
+
+/* Owned by the scheduler thread */
+static PyTimer**  g_batch = NULL;
+static size_t     g_batch_capacity = 0;
+
+static uint64_t current_tick(void)
+{
+    return clock_monotonic_ns() / TICK_NS;
+}
+
+static uint64_t seconds_to_ticks(double seconds)
+{
+    return (uint64_t)ceil(seconds * 1000.0 / TIMER_TICK_MS);
+}
+
+static void registry_link(PyTimer* timer)
+{
+    timer->prev = NULL;
+    timer->next = g_registry;
+    if (g_registry != NULL) {
+        g_registry->prev = timer;
+    }
+    g_registry = timer;
+}
+
+static void registry_unlink(PyTimer* timer)
+{
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        g_registry = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+/*
+ * Cancel under g_lock with the GIL held. Returns 1 if the timer was done as
+ * a result and the caller must drop the registry reference after unlocking.
+ */
+static int cancel_locked(PyTimer* timer)
+{
+    timer->cancelled = 1;
+    if (timer->state != TIMER_PENDING) {
+        /* Running timers are finished by the scheduler after the batch */
+        return 0;
+    }
+    timer_wheel_cancel(&g_wheel, &timer->node);
+    registry_unlink(timer);
+    timer->state = TIMER_DONE;
+    g_stats.active--;
+    return 1;
+}
+
+/* ========================================================================
+ * ts3api.Timer
+ * ======================================================================== */
+
+static void timer_dealloc(PyObject* self)
+{
+    PyTimer* timer = (PyTimer*)self;
+    PyTypeObject* type = Py_TYPE(self);
+
+    Py_XDECREF(timer->callable);
+    Py_XDECREF(timer->args);
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+static PyObject* timer_cancel(PyObject* self, PyObject* unused)
+{
+    PyTimer* timer = (PyTimer*)self;
+    int prevented;
+    int release;
+
+    (void)unused; /* Unused parameter */
+
+    mutex_lock(&g_lock);
+    /* A running one-shot has already fired; a running periodic timer stops repeating */
+    prevented = !timer->cancelled
+                && (timer->state == TIMER_PENDING || (timer->state == TIMER_RUNNING && timer->intervalTicks > 0));
+    release = cancel_locked(timer);
+    mutex_unlock(&g_lock);
+
+    if (release) {
+        Py_DECREF(self);
+    }
+    return PyBool_FromLong(prevented);
+}
+
+static PyObject* timer_get_active(PyObject* self, void* closure)
+{
+    PyTimer* timer = (PyTimer*)self;
+    int active;
+
+    (void)closure; /* Unused parameter */
+
+    mutex_lock(&g_lock);
+    active = timer->state != TIMER_DONE && !timer->cancelled;
+    mutex_unlock(&g_lock);
+
+    return PyBool_FromLong(active);
+}
+
+static PyMethodDef TimerMethods[] = {
+    {"cancel", timer_cancel, METH_NOARGS,
+     "Stop the timer; returns True if a future call was prevented"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef TimerGetSet[] = {
+    {"active", timer_get_active, NULL, "True while the timer will still fire", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyType_Slot TimerSlots[] = {
+    {Py_tp_dealloc, (void*)timer_dealloc},
+    {Py_tp_methods, TimerMethods},
+    {Py_tp_getset, TimerGetSet},
+    {Py_tp_doc, (void*)"Handle returned by ts3api.call_later() and ts3api.every()"},
+    {0, NULL}
+};
+
+static PyType_Spec TimerSpec = {
+    "ts3api.Timer",
+    sizeof(PyTimer),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    TimerSlots
+};
+
+int python_timers_add_types(PyObject* module)
+{
+    if (g_timer_type == NULL) {
+        g_timer_type = (PyTypeObject*)PyType_FromSpec(&TimerSpec);
+        if (g_timer_type == NULL) {
+            return -1;
+        }
+    }
+    return PyModule_AddObjectRef(module, "Timer", (PyObject*)g_timer_type);
+}
+
+PyObject* python_timers_schedule(PyObject* callable, PyObject* args, double delay, double interval,
+                                 const char* script, unsigned int generation)
+{
+    PyTimer* timer;
+    uint64_t now;
+
+    if (!g_running) {
+        PyErr_SetString(PyExc_RuntimeError, "timer scheduler is not running");
+        return NULL;
+    }
+    if (!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (!(delay >= 0.0 && delay <= MAX_SECONDS) || !(interval >= 0.0 && interval <= MAX_SECONDS)) {
+        PyErr_SetString(PyExc_ValueError, "delay and interval must be between 0 and 1e9 seconds");
+        return NULL;
+    }
+
+    timer = PyObject_New(PyTimer, g_timer_type);
+    if (timer == NULL) {
+        return NULL;
+    }
+    timer->node.next = NULL;
+    timer->node.prev = NULL;
+    timer->cancelled = 0;
+    timer->intervalTicks = 0;
+    if (interval > 0.0) {
+        timer->intervalTicks = seconds_to_ticks(interval);
+        if (timer->intervalTicks == 0) {
+            timer->intervalTicks = 1;
+        }
+    }
+    Py_INCREF(callable);
+    timer->callable = callable;
+    Py_INCREF(args);
+    timer->args = args;
+    safe_strcpy(timer->script, sizeof(timer->script), script != NULL ? script : "");
+    timer->generation = generation;
+    timer->prev = NULL;
+    timer->next = NULL;
+
+    /* The registry's reference */
+    Py_INCREF(timer);
+
+    now = current_tick();
+    mutex_lock(&g_lock);
+    /* An idle wheel stops advancing; bring it up to date before placing */
+    if (g_wheel.count == 0) {
+        timer_wheel_advance(&g_wheel, now);
+    }
+    timer->state = TIMER_PENDING;
+    timer_wheel_add(&g_wheel, &timer->node, now + seconds_to_ticks(delay));
+    registry_link(timer);
+    g_stats.active++;
+    g_stats.scheduled++;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+
+    return (PyObject*)timer;
+}
+
+void python_timers_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    PyTimer* released = NULL;
+    PyTimer* timer;
+    PyTimer* next;
+    int removed = 0;
+
+    if (!g_running) {
+        return;
+    }
+
+    mutex_lock(&g_lock);
+    for (timer = g_registry; timer != NULL; timer = next) {
+        next = timer->next;
+        if (timer->cancelled || strcmp(timer->script, script) != 0
+            || timer->generation < minGeneration || timer->generation > maxGeneration) {
+            continue;
+        }
+        removed++;
+        if (cancel_locked(timer)) {
+            /* Unlinked from the registry, so the links are free to reuse */
+            timer->next = released;
+            released = timer;
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    while (released != NULL) {
+        timer = released;
+        released = timer->next;
+        timer->next = NULL;
+        Py_DECREF(timer);
+    }
+    if (removed > 0) {
+        log_debug("Cancelled %d timer(s) of %s", removed, script);
+    }
+}
+
+/* ========================================================================
+ * Scheduler thread
+ * ======================================================================== */
+
+/* Move due timers into g_batch; g_lock held. Returns the batch size. */
+static size_t collect_due(TimerNode* expired)
+{
+    size_t count = 0;
+
+    while (expired != NULL) {
+        TimerNode* node = expired;
+        PyTimer* timer = TIMER_FROM_NODE(node);
+
+        expired = node->next;
+        node->next = NULL;
+
+        if (count == g_batch_capacity) {
+            size_t capacity = g_batch_capacity > 0 ? g_batch_capacity * 2 : 64;
+            PyTimer** batch = (PyTimer**)realloc(g_batch, capacity * sizeof(PyTimer*));
+            if (batch == NULL) {
+                /* Try again on the next tick */
+                timer_wheel_add(&g_wheel, node, g_wheel.now + 1);
+                continue;
+            }
+            g_batch = batch;
+            g_batch_capacity = capacity;
+        }
+        timer->state = TIMER_RUNNING;
+        g_batch[count++] = timer;
+    }
+    return count;
+}
+
+static int timer_cancelled(PyTimer* timer)
+{
+#ifdef Py_GIL_DISABLED
+    int cancelled;
+
+    mutex_lock(&g_lock);
+    cancelled = timer->cancelled;
+    mutex_unlock(&g_lock);
+    return cancelled;
+#else
+    return timer->cancelled;
+#endif
+}
+
+/* Run a batch; GIL held, g_lock not held. Returns the number of callbacks run. */
+static size_t run_batch(size_t count, uint64_t* maxLagNs)
+{
+    size_t fired = 0;
+    size_t i;
+
+    *maxLagNs = 0;
+
+    TRACE_BEGIN(span);
+    for (i = 0; i < count; i++) {
+        PyTimer* timer = g_batch[i];
+        uint64_t dueNs = timer->node.expires * TICK_NS;
+        uint64_t startNs;
+        ScriptContext previous;
+        PyObject* result;
+
+        if (timer_cancelled(timer)) {
+            continue;
+        }
+
+        startNs = clock_monotonic_ns();
+        if (startNs > dueNs && startNs - dueNs > *maxLagNs) {
+            *maxLagNs = startNs - dueNs;
+        }
+        fired++;
+
+        previous = python_engine_enter_script(timer->script, timer->generation);
+        result = PyObject_Call(timer->callable, timer->args, NULL);
+        python_engine_leave_script(previous);
+
+        if (result == NULL
+            || (python_loop_is_coroutine(result) && python_loop_submit(result, timer->script, timer->generation) != 0)) {
+            python_engine_report_exception(timer->script, "timer");
+        }
+        Py_XDECREF(result);
+    }
+    TRACE_END(span, "timers", "batch");
+
+    return fired;
+}
+
+/* Re-arm periodic timers and retire the rest; GIL held */
+static void finish_batch(size_t count, size_t fired, uint64_t maxLagNs)
+{
+    uint64_t now = current_tick();
+    size_t released = 0;
+    size_t i;
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < count; i++) {
+        PyTimer* timer = g_batch[i];
+
+        if (!timer->cancelled && timer->intervalTicks > 0) {
+            uint64_t next = timer->node.expires + timer->intervalTicks;
+
+            /* Skip periods missed while the callback or the GIL was slow */
+            if (next <= now) {
+                next = now + timer->intervalTicks - (now - timer->node.expires) % timer->intervalTicks;
+            }
+            timer->state = TIMER_PENDING;
+            timer_wheel_add(&g_wheel, &timer->node, next);
+        } else {
+            timer->state = TIMER_DONE;
+            registry_unlink(timer);
+            g_stats.active--;
+            g_batch[released++] = timer;
+        }
+    }
+    g_stats.fired += fired;
+    g_stats.batches++;
+    if (count > g_stats.maxBatch) {
+        g_stats.maxBatch = count;
+    }
+    if (maxLagNs / 1000 > g_stats.maxLagUs) {
+        g_stats.maxLagUs = maxLagNs / 1000;
+    }
+    mutex_unlock(&g_lock);
+
+    for (i = 0; i < released; i++) {
+        Py_DECREF(g_batch[i]);
+    }
+}
+
+static void scheduler_main(void* arg)
+{
+    PyGILState_STATE gil;
+    PyThreadState* state;
+
+    (void)arg; /* Unused parameter */
+
+    trace_set_thread_name("TsPy timers");
+
+    /* Keep one thread state for the thread's lifetime instead of one per batch */
+    gil = PyGILState_Ensure();
+    state = PyEval_SaveThread();
+
+    mutex_lock(&g_lock);
+    while (!g_stopping) {
+        TimerNode* expired = timer_wheel_advance(&g_wheel, current_tick());
+        size_t count;
+        size_t fired;
+        uint64_t maxLagNs;
+
+        if (expired == NULL) {
+            if (g_wheel.count == 0) {
+                cond_wait(&g_wake, &g_lock);
+            } else {
+                cond_timed_wait(&g_wake, &g_lock, TIMER_TICK_MS);
+            }
+            continue;
+        }
+
+        count = collect_due(expired);
+        mutex_unlock(&g_lock);
+
+        /* One GIL acquisition for everything that came due together */
+        PyEval_RestoreThread(state);
+        fired = run_batch(count, &maxLagNs);
+        finish_batch(count, fired, maxLagNs);
+        state = PyEval_SaveThread();
+
+        mutex_lock(&g_lock);
+    }
+    mutex_unlock(&g_lock);
+
+    PyEval_RestoreThread(state);
+    PyGILState_Release(gil);
+}
+
+int python_timers_init(void)
+{
+    if (g_running) {
+        return 0;
+    }
+
+    mutex_init(&g_lock);
+    cond_init(&g_wake);
+    timer_wheel_init(&g_wheel, current_tick());
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stopping = 0;
+
+    if (thread_create(&g_thread, scheduler_main, NULL) != 0) {
+        log_error("Failed to start the timer thread");
+        cond_destroy(&g_wake);
+        mutex_destroy(&g_lock);
+        return 1;
+    }
+
+    g_running = 1;
+    log_info("Timer scheduler started (%d ms tick)", TIMER_TICK_MS);
+    return 0;
+}
+
+void python_timers_get_stats(TimerStats* stats)
+{
+    if (!g_running) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    mutex_lock(&g_lock);
+    *stats = g_stats;
+    mutex_unlock(&g_lock);
+}
+
+void python_timers_stop(void)
+{
+    if (!g_running) {
+        return;
+    }
+
+    mutex_lock(&g_lock);
+    g_stopping = 1;
+    cond_signal(&g_wake);
+    mutex_unlock(&g_lock);
+
+    thread_join(g_thread);
+}
+
+void python_timers_shutdown(void)
+{
+    PyTimer* timer;
+
+    if (!g_running) {
+        return;
+    }
+
+    /* The thread is gone, so nothing is running and no lock is needed */
+    while ((timer = g_registry) != NULL) {
+        timer->cancelled = 1;
+        timer_wheel_cancel(&g_wheel, &timer->node);
+        registry_unlink(timer);
+        timer->state = TIMER_DONE;
+        Py_DECREF(timer);
+    }
+
+    free(g_batch);
+    g_batch = NULL;
+    g_batch_capacity = 0;
+    Py_CLEAR(g_timer_type);
+
+    cond_destroy(&g_wake);
+    mutex_destroy(&g_lock);
+    g_running = 0;
+    log_debug("Timer scheduler shut down");
+}
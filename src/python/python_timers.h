@@ -0,0 +1,97 @@
+/**
+ * @file python_timers.h
+ * @brief Script timers scheduled via ts3api.call_later / ts3api.every
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Timers live in a hierarchical timing wheel driven by one scheduler
+ * thread. The thread sleeps without the GIL and takes it once per batch of
+ * due timers, so idle timers cost nothing and many timers expiring together
+ * cost a single GIL hand-over.
+ */
+
+#ifndef PYTHON_TIMERS_H
+#define PYTHON_TIMERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Scheduler resolution in milliseconds
+ */
+#define TIMER_TICK_MS 10
+
+/**
+ * @brief Scheduler counters
+ */
+typedef struct TimerStats {
+    size_t   active;    /* Pending or running timers */
+    uint64_t scheduled; /* Timers created */
+    uint64_t fired;     /* Callbacks run */
+    uint64_t batches;   /* GIL acquisitions by the scheduler */
+    size_t   maxBatch;  /* Most callbacks run in one batch */
+    uint64_t maxLagUs;  /* Worst delay between due time and callback start */
+} TimerStats;
+
+/**
+ * @brief Start the scheduler thread
+ * @return 0 on success, non-zero on failure
+ * @note Python must be initialized; the thread waits for the GIL to be released
+ */
+int python_timers_init(void);
+
+/**
+ * @brief Register the ts3api.Timer type on the module
+ * @param module The ts3api module (PyObject*)
+ * @return 0 on success, -1 with a Python exception set
+ */
+int python_timers_add_types(struct _object* module);
+
+/**
+ * @brief Schedule a callable (GIL held)
+ * @param callable Callable (PyObject*)
+ * @param args Positional arguments tuple (PyObject*)
+ * @param delay Seconds until the first call
+ * @param interval Seconds between calls, or 0 for a one-shot timer
+ * @param script Owning script, cancelled with it (empty for plugin-internal timers)
+ * @param generation Load generation of the owning script
+ * @return New reference to a ts3api.Timer, or NULL with a Python exception set
+ */
+struct _object* python_timers_schedule(struct _object* callable, struct _object* args,
+                                       double delay, double interval,
+                                       const char* script, unsigned int generation);
+
+/**
+ * @brief Cancel every timer a script created within a generation range (GIL held)
+ * @param script Script name
+ * @param minGeneration Lowest generation to cancel
+ * @param maxGeneration Highest generation to cancel
+ */
+void python_timers_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration);
+
+/**
+ * @brief Read the scheduler counters
+ * @param stats Receives the counters
+ */
+void python_timers_get_stats(TimerStats* stats);
+
+/**
+ * @brief Stop the scheduler thread
+ * @note Must be called without the GIL; a running batch is allowed to finish
+ */
+void python_timers_stop(void);
+
+/**
+ * @brief Cancel all timers and release their callables (GIL held, thread stopped)
+ */
+void python_timers_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_TIMERS_H */
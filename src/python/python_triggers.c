@@ -0,0 +1,402 @@
+/**
+ * @file python_triggers.c
+ * @brief Native chat trigger engine implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "python_triggers.h"
+#include "ham/callsign.h"
+#include "utils/aho_corasick.h"
+#include "utils/arena.h"
+#include "utils/logging.h"
+#include "utils/string_utils.h"
+#include "utils/threading.h"
+
+typedef struct Trigger {
+    int          id;
+    TriggerKind  kind;
+    int          wholeWord;
+    char         script[SCRIPT_NAME_BUFSIZE];
+    unsigned int generation;
+} Trigger;
+
+typedef struct ScanContext {
+    const char* text;       /* Message as sent; callsigns depend on its case */
+    const char* folded;
+    size_t      length;
+    TriggerHit* hits;
+    size_t      count;
+    size_t      max;
+} ScanContext;
+
+static const char* const g_pattern_names[TRIGGER_KIND_COUNT] = {
+    NULL, "callsign", "url"
+};
+
+/* Sorted by ID: IDs only grow and removal keeps the order */
+static Trigger*     g_triggers = NULL;
+static size_t       g_trigger_count = 0;
+static size_t       g_trigger_capacity = 0;
+static size_t       g_kind_counts[TRIGGER_KIND_COUNT];
+static AhoCorasick* g_automaton = NULL;
+static int          g_next_id = 1;
+static Mutex        g_lock;
+
+static Trigger* find_trigger(int id)
+{
+    size_t low = 0;
+    size_t high = g_trigger_count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (g_triggers[mid].id == id) {
+            return &g_triggers[mid];
+        }
+        if (g_triggers[mid].id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return NULL;
+}
+
+static Trigger* append_trigger(TriggerKind kind, int wholeWord, const char* script, unsigned int generation)
+{
+    Trigger* trigger;
+
+    if (g_trigger_count == g_trigger_capacity) {
+        size_t capacity = g_trigger_capacity > 0 ? g_trigger_capacity * 2 : 16;
+        Trigger* triggers = (Trigger*)realloc(g_triggers, capacity * sizeof(Trigger));
+        if (triggers == NULL) {
+            return NULL;
+        }
+        g_triggers = triggers;
+        g_trigger_capacity = capacity;
+    }
+
+    trigger = &g_triggers[g_trigger_count];
+    trigger->id = g_next_id;
+    trigger->kind = kind;
+    trigger->wholeWord = wholeWord;
+    trigger->generation = generation;
+    safe_strcpy(trigger->script, sizeof(trigger->script), script != NULL ? script : "");
+    return trigger;
+}
+
+/* Commit a trigger filled in by append_trigger() */
+static int commit_trigger(const Trigger* trigger)
+{
+    g_trigger_count++;
+    g_kind_counts[trigger->kind]++;
+    g_next_id++;
+    return trigger->id;
+}
+
+TriggerKind python_triggers_find_pattern(const char* name)
+{
+    int kind;
+
+    for (kind = TRIGGER_KEYWORD + 1; kind < TRIGGER_KIND_COUNT; kind++) {
+        if (name != NULL && strcmp(name, g_pattern_names[kind]) == 0) {
+            return (TriggerKind)kind;
+        }
+    }
+    return TRIGGER_KIND_COUNT;
+}
+
+int python_triggers_add_keyword(const char* keyword, int wholeWord, const char* script, unsigned int generation)
+{
+    char folded[TRIGGER_KEYWORD_MAX + 1];
+    Trigger* trigger;
+    size_t length;
+
+    int id = -1;
+
+    if (keyword == NULL || (length = strlen(keyword)) == 0 || length > TRIGGER_KEYWORD_MAX) {
+        return -1;
+    }
+    utf8_casefold(folded, keyword, length);
+
+    mutex_lock(&g_lock);
+    if (g_automaton == NULL) {
+        g_automaton = ac_create();
+    }
+    if (g_automaton != NULL) {
+        trigger = append_trigger(TRIGGER_KEYWORD, wholeWord, script, generation);
+        if (trigger != NULL && ac_add(g_automaton, folded, length, trigger->id) == 0) {
+            id = commit_trigger(trigger);
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    return id;
+}
+
+int python_triggers_add_pattern(TriggerKind kind, const char* script, unsigned int generation)
+{
+    Trigger* trigger;
+    int id = -1;
+
+    if (kind <= TRIGGER_KEYWORD || kind >= TRIGGER_KIND_COUNT) {
+        return -1;
+    }
+
+    mutex_lock(&g_lock);
+    trigger = append_trigger(kind, 0, script, generation);
+    if (trigger != NULL) {
+        id = commit_trigger(trigger);
+    }
+    mutex_unlock(&g_lock);
+
+    return id;
+}
+
+static void remove_at(size_t index)
+{
+    const Trigger* trigger = &g_triggers[index];
+
+    if (trigger->kind == TRIGGER_KEYWORD) {
+        ac_remove(g_automaton, trigger->id);
+    }
+    g_kind_counts[trigger->kind]--;
+
+    memmove(&g_triggers[index], &g_triggers[index + 1], (g_trigger_count - index - 1) * sizeof(Trigger));
+    g_trigger_count--;
+}
+
+int python_triggers_remove(int id)
+{
+    Trigger* trigger;
+    int removed = 0;
+
+    mutex_lock(&g_lock);
+    trigger = find_trigger(id);
+    if (trigger != NULL) {
+        remove_at((size_t)(trigger - g_triggers));
+        removed = 1;
+    }
+    mutex_unlock(&g_lock);
+
+    return removed;
+}
+
+void python_triggers_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration)
+{
+    size_t i = 0;
+    int removed = 0;
+
+    mutex_lock(&g_lock);
+    while (i < g_trigger_count) {
+        const Trigger* trigger = &g_triggers[i];
+
+        if (strcmp(trigger->script, script) == 0
+            && trigger->generation >= minGeneration && trigger->generation <= maxGeneration) {
+            remove_at(i);
+            removed++;
+        } else {
+            i++;
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    if (removed > 0) {
+        log_debug("Removed %d trigger(s) of %s", removed, script);
+    }
+}
+
+int python_triggers_count_for_script(const char* script)
+{
+    size_t i;
+    int count = 0;
+
+    mutex_lock(&g_lock);
+    for (i = 0; i < g_trigger_count; i++) {
+        if (strcmp(g_triggers[i].script, script) == 0) {
+            count++;
+        }
+    }
+    mutex_unlock(&g_lock);
+
+    return count;
+}
+
+/* Letters, digits, underscore and any non-ASCII byte count as word characters */
+static int is_word_byte(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static void push_hit(ScanContext* scan, const Trigger* trigger, size_t start, size_t length)
+{
+    TriggerHit* hit;
+    size_t i;
+
+    for (i = 0; i < scan->count; i++) {
+        hit = &scan->hits[i];
+        if (hit->id == trigger->id && hit->length == length
+            && memcmp(scan->folded + hit->start, scan->folded + start, length) == 0) {
+            return;
+        }
+    }
+    if (scan->count == scan->max) {
+        return;
+    }
+
+    hit = &scan->hits[scan->count++];
+    hit->id = trigger->id;
+    hit->start = start;
+    hit->length = length;
+    hit->generation = trigger->generation;
+    safe_strcpy(hit->script, sizeof(hit->script), trigger->script);
+}
+
+static void push_pattern_hits(ScanContext* scan, TriggerKind kind, size_t start, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < g_trigger_count; i++) {
+        if (g_triggers[i].kind == kind) {
+            push_hit(scan, &g_triggers[i], start, length);
+        }
+    }
+}
+
+static int on_keyword_match(void* context, int id, size_t start, size_t length)
+{
+    ScanContext* scan = (ScanContext*)context;
+    const Trigger* trigger = find_trigger(id);
+    size_t end = start + length;
+
+    if (trigger == NULL) {
+        return 0;
+    }
+    if (trigger->wholeWord
+        && ((start > 0 && is_word_byte((unsigned char)scan->folded[start - 1]))
+            || (end < scan->length && is_word_byte((unsigned char)scan->folded[end])))) {
+        return 0;
+    }
+
+    push_hit(scan, trigger, start, length);
+    return scan->count == scan->max;
+}
+
+static void scan_callsigns(ScanContext* scan)
+{
+    Callsign calls[TRIGGER_MAX_HITS];
+    size_t count = callsign_scan(scan->text, scan->length, calls, TRIGGER_MAX_HITS);
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        push_pattern_hits(scan, TRIGGER_PATTERN_CALLSIGN, calls[i].start, calls[i].length);
+    }
+}
+
+static size_t url_prefix_length(const char* text, size_t length)
+{
+    static const char* const prefixes[] = {"https://", "http://", "www."};
+    size_t i;
+
+    for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+        size_t prefix = strlen(prefixes[i]);
+        if (length > prefix && memcmp(text, prefixes[i], prefix) == 0) {
+            return prefix;
+        }
+    }
+    return 0;
+}
+
+static void scan_urls(ScanContext* scan)
+{
+    size_t i;
+
+    for (i = 0; i < scan->length; i++) {
+        size_t prefix;
+        size_t end;
+
+        if (i > 0 && is_word_byte((unsigned char)scan->folded[i - 1])) {
+            continue;
+        }
+        prefix = url_prefix_length(scan->folded + i, scan->length - i);
+        if (prefix == 0) {
+            continue;
+        }
+
+        end = i;
+        while (end < scan->length && (unsigned char)scan->folded[end] > ' '
+               && scan->folded[end] != '"' && scan->folded[end] != '<' && scan->folded[end] != '>') {
+            end++;
+        }
+        /* Trailing punctuation usually belongs to the sentence */
+        while (end > i + prefix && strchr(".,;:!?)]}'", scan->folded[end - 1]) != NULL) {
+            end--;
+        }
+        if (end > i + prefix) {
+            push_pattern_hits(scan, TRIGGER_PATTERN_URL, i, end - i);
+        }
+        i = end;
+    }
+}
+
+size_t python_triggers_scan(const char* message, TriggerHit* hits, size_t maxHits)
+{
+    ArenaMark mark;
+    ScanContext scan;
+    char* folded = NULL;
+
+    if (message == NULL || hits == NULL || maxHits == 0) {
+        return 0;
+    }
+
+    scan.length = strlen(message);
+    scan.text = message;
+    scan.hits = hits;
+    scan.count = 0;
+    scan.max = maxHits;
+
+    /* The folded copy is scratch memory of any length, given back before returning */
+    mark = arena_begin();
+    mutex_lock(&g_lock);
+    if (g_trigger_count > 0) {
+        folded = (char*)arena_alloc(arena_thread(), scan.length + 1);
+    }
+    if (folded != NULL) {
+        utf8_casefold(folded, message, scan.length);
+        scan.folded = folded;
+
+        if (g_kind_counts[TRIGGER_KEYWORD] > 0) {
+            ac_search(g_automaton, folded, scan.length, on_keyword_match, &scan);
+        }
+        if (g_kind_counts[TRIGGER_PATTERN_CALLSIGN] > 0) {
+            scan_callsigns(&scan);
+        }
+        if (g_kind_counts[TRIGGER_PATTERN_URL] > 0) {
+            scan_urls(&scan);
+        }
+    }
+    mutex_unlock(&g_lock);
+    arena_end(mark);
+
+    return scan.count;
+}
+
+void python_triggers_init(void)
+{
+    mutex_init(&g_lock);
+}
+
+void python_triggers_shutdown(void)
+{
+    ac_destroy(g_automaton);
+    g_automaton = NULL;
+    free(g_triggers);
+    g_triggers = NULL;
+    g_trigger_count = 0;
+    g_trigger_capacity = 0;
+    memset(g_kind_counts, 0, sizeof(g_kind_counts));
+    mutex_destroy(&g_lock);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file python_triggers.h
+ * @brief Native chat trigger engine
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Scripts register literal keywords and built-in patterns; every incoming
+ * text message is scanned once in C and only hits are delivered to Python
+ * as on_trigger events. Keywords share one case-folded Aho-Corasick
+ * automaton. The registry has its own lock, so messages are scanned without
+ * holding the GIL while scripts on other threads add or remove triggers.
+ */
+
+#ifndef PYTHON_TRIGGERS_H
+#define PYTHON_TRIGGERS_H
+
+#include <stddef.h>
+#include "python_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of hits reported for one message
+ */
+#define TRIGGER_MAX_HITS 16
+
+/**
+ * @brief Maximum keyword length in bytes
+ */
+#define TRIGGER_KEYWORD_MAX 256
+
+/**
+ * @brief Trigger kinds
+ */
+typedef enum {
+    TRIGGER_KEYWORD = 0,      /* Literal text, case-insensitive */
+    TRIGGER_PATTERN_CALLSIGN, /* Amateur radio callsign */
+    TRIGGER_PATTERN_URL,      /* http(s):// or www. link */
+    TRIGGER_KIND_COUNT
+} TriggerKind;
+
+/**
+ * @brief One trigger occurrence in a message
+ */
+typedef struct TriggerHit {
+    int          id;
+    size_t       start;  /* Byte offset in the message */
+    size_t       length; /* Match length in bytes */
+    char         script[SCRIPT_NAME_BUFSIZE];
+    unsigned int generation;
+} TriggerHit;
+
+/**
+ * @brief Look up a built-in pattern by name
+ * @param name Pattern name ("callsign" or "url")
+ * @return Trigger kind, or TRIGGER_KIND_COUNT if unknown
+ */
+TriggerKind python_triggers_find_pattern(const char* name);
+
+/**
+ * @brief Register a keyword trigger
+ * @param keyword UTF-8 keyword, matched case-insensitively
+ * @param wholeWord Non-zero to only match at word boundaries
+ * @param script Owning script name, or NULL
+ * @param generation Load generation of the owning script
+ * @return Trigger ID, or -1 on failure
+ */
+int python_triggers_add_keyword(const char* keyword, int wholeWord, const char* script, unsigned int generation);
+
+/**
+ * @brief Register a built-in pattern trigger
+ * @param kind Pattern kind (not TRIGGER_KEYWORD)
+ * @param script Owning script name, or NULL
+ * @param generation Load generation of the owning script
+ * @return Trigger ID, or -1 on failure
+ */
+int python_triggers_add_pattern(TriggerKind kind, const char* script, unsigned int generation);
+
+/**
+ * @brief Unregister a trigger
+ * @param id Trigger ID
+ * @return 1 if removed, 0 if not found
+ */
+int python_triggers_remove(int id);
+
+/**
+ * @brief Remove a script's triggers within a generation range
+ * @param script Script name
+ * @param minGeneration Lowest generation to remove
+ * @param maxGeneration Highest generation to remove
+ */
+void python_triggers_remove_script(const char* script, unsigned int minGeneration, unsigned int maxGeneration);
+
+/**
+ * @brief Count a script's triggers
+ * @param script Script name
+ * @return Number of triggers
+ */
+int python_triggers_count_for_script(const char* script);
+
+/**
+ * @brief Scan a message for trigger hits
+ *
+ * Each trigger is reported at most once per distinct matched text.
+ *
+ * @param message UTF-8 message
+ * @param hits Output array
+ * @param maxHits Capacity of hits
+ * @return Number of hits written
+ */
+size_t python_triggers_scan(const char* message, TriggerHit* hits, size_t maxHits);
+
+/**
+ * @brief Initialise the trigger registry
+ */
+void python_triggers_init(void);
+
+/**
+ * @brief Drop all triggers
+ */
+void python_triggers_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PYTHON_TRIGGERS_H */
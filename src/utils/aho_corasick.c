@@ -0,0 +1,350 @@
+/**
+ * @file aho_corasick.c
+ * @brief Multi-pattern byte string matcher implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho_corasick.h"
+
+#define AC_ROOT 0
+#define AC_NONE (-1)
+
+/* Compact once more than half of the trie belongs to removed patterns */
+#define AC_COMPACT_MIN_NODES 64
+
+typedef struct AcNode {
+    int32_t       child;   /* First child */
+    int32_t       sibling; /* Next child of the same parent */
+    int32_t       fail;    /* Longest proper suffix that is also a trie path */
+    int32_t       dict;    /* Nearest node on the failure chain with outputs */
+    int32_t       output;  /* First pattern ending here */
+    unsigned char byte;
+} AcNode;
+
+typedef struct AcOutput {
+    int     id;
+    int32_t node;          /* AC_NONE while the slot is free */
+    int32_t next;          /* Next output of the node, or next free slot */
+    size_t  length;
+    char*   pattern;       /* Kept for compaction */
+} AcOutput;
+
+struct AhoCorasick {
+    AcNode*   nodes;
+    size_t    node_count;
+    size_t    node_capacity;
+    AcOutput* outputs;
+    size_t    output_count;
+    size_t    output_capacity;
+    int32_t   free_output;
+    size_t    pattern_count;
+    size_t    pattern_bytes;
+    int       dirty;
+    int32_t   root_next[256]; /* Dense root row, valid when not dirty */
+};
+
+static int32_t new_node(AhoCorasick* ac, unsigned char byte)
+{
+    AcNode* node;
+
+    if (ac->node_count == ac->node_capacity) {
+        size_t capacity = ac->node_capacity > 0 ? ac->node_capacity * 2 : 64;
+        AcNode* nodes = (AcNode*)realloc(ac->nodes, capacity * sizeof(AcNode));
+        if (nodes == NULL) {
+            return AC_NONE;
+        }
+        ac->nodes = nodes;
+        ac->node_capacity = capacity;
+    }
+
+    node = &ac->nodes[ac->node_count];
+    node->child = AC_NONE;
+    node->sibling = AC_NONE;
+    node->fail = AC_ROOT;
+    node->dict = AC_NONE;
+    node->output = AC_NONE;
+    node->byte = byte;
+    return (int32_t)ac->node_count++;
+}
+
+static int32_t find_child(const AhoCorasick* ac, int32_t node, unsigned char byte)
+{
+    int32_t child;
+
+    for (child = ac->nodes[node].child; child != AC_NONE; child = ac->nodes[child].sibling) {
+        if (ac->nodes[child].byte == byte) {
+            return child;
+        }
+    }
+    return AC_NONE;
+}
+
+AhoCorasick* ac_create(void)
+{
+    AhoCorasick* ac = (AhoCorasick*)calloc(1, sizeof(AhoCorasick));
+
+    if (ac == NULL) {
+        return NULL;
+    }
+    ac->free_output = AC_NONE;
+    ac->dirty = 1;
+    if (new_node(ac, 0) != AC_ROOT) {
+        free(ac);
+        return NULL;
+    }
+    return ac;
+}
+
+static void free_contents(AhoCorasick* ac)
+{
+    size_t i;
+
+    for (i = 0; i < ac->output_count; i++) {
+        free(ac->outputs[i].pattern);
+    }
+    free(ac->outputs);
+    free(ac->nodes);
+}
+
+void ac_destroy(AhoCorasick* ac)
+{
+    if (ac == NULL) {
+        return;
+    }
+    free_contents(ac);
+    free(ac);
+}
+
+int ac_add(AhoCorasick* ac, const char* pattern, size_t length, int id)
+{
+    AcOutput* output;
+    int32_t node = AC_ROOT;
+    int32_t slot;
+    char* copy;
+    size_t i;
+
+    if (ac == NULL || pattern == NULL || length == 0) {
+        return -1;
+    }
+
+    copy = (char*)malloc(length);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, pattern, length);
+
+    if (ac->free_output != AC_NONE) {
+        slot = ac->free_output;
+        ac->free_output = ac->outputs[slot].next;
+    } else {
+        if (ac->output_count == ac->output_capacity) {
+            size_t capacity = ac->output_capacity > 0 ? ac->output_capacity * 2 : 16;
+            AcOutput* outputs = (AcOutput*)realloc(ac->outputs, capacity * sizeof(AcOutput));
+            if (outputs == NULL) {
+                free(copy);
+                return -1;
+            }
+            ac->outputs = outputs;
+            ac->output_capacity = capacity;
+        }
+        slot = (int32_t)ac->output_count++;
+    }
+
+    /* Extend the trie; nodes added before a failure stay as harmless dead ends */
+    for (i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)pattern[i];
+        int32_t child = find_child(ac, node, byte);
+
+        if (child == AC_NONE) {
+            child = new_node(ac, byte);
+            if (child == AC_NONE) {
+                ac->outputs[slot].node = AC_NONE;
+                ac->outputs[slot].pattern = NULL;
+                ac->outputs[slot].next = ac->free_output;
+                ac->free_output = slot;
+                free(copy);
+                return -1;
+            }
+            ac->nodes[child].sibling = ac->nodes[node].child;
+            ac->nodes[node].child = child;
+        }
+        node = child;
+    }
+
+    output = &ac->outputs[slot];
+    output->id = id;
+    output->node = node;
+    output->length = length;
+    output->pattern = copy;
+    output->next = ac->nodes[node].output;
+    ac->nodes[node].output = slot;
+
+    ac->pattern_count++;
+    ac->pattern_bytes += length;
+    ac->dirty = 1;
+    return 0;
+}
+
+/* Rebuild the trie from the live patterns, dropping dead branches */
+static void compact(AhoCorasick* ac)
+{
+    AhoCorasick* fresh = ac_create();
+    size_t i;
+
+    if (fresh == NULL) {
+        return;
+    }
+
+    for (i = 0; i < ac->output_count; i++) {
+        const AcOutput* output = &ac->outputs[i];
+        if (output->node != AC_NONE && ac_add(fresh, output->pattern, output->length, output->id) != 0) {
+            ac_destroy(fresh); /* Keep the uncompacted trie; it is still correct */
+            return;
+        }
+    }
+
+    free_contents(ac);
+    *ac = *fresh;
+    free(fresh);
+}
+
+int ac_remove(AhoCorasick* ac, int id)
+{
+    size_t i;
+
+    if (ac == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < ac->output_count; i++) {
+        AcOutput* output = &ac->outputs[i];
+        int32_t* link;
+
+        if (output->node == AC_NONE || output->id != id) {
+            continue;
+        }
+
+        for (link = &ac->nodes[output->node].output; *link != (int32_t)i; link = &ac->outputs[*link].next) {
+        }
+        *link = output->next;
+
+        ac->pattern_count--;
+        ac->pattern_bytes -= output->length;
+        free(output->pattern);
+        output->pattern = NULL;
+        output->node = AC_NONE;
+        output->next = ac->free_output;
+        ac->free_output = (int32_t)i;
+        ac->dirty = 1;
+
+        if (ac->node_count > AC_COMPACT_MIN_NODES && ac->node_count > 2 * (ac->pattern_bytes + 1)) {
+            compact(ac);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+size_t ac_pattern_count(const AhoCorasick* ac)
+{
+    return ac != NULL ? ac->pattern_count : 0;
+}
+
+/* Breadth-first pass computing failure and dictionary links */
+static int build_links(AhoCorasick* ac)
+{
+    int32_t* queue;
+    size_t head = 0;
+    size_t tail = 0;
+    int32_t child;
+    int b;
+
+    queue = (int32_t*)malloc(ac->node_count * sizeof(int32_t));
+    if (queue == NULL) {
+        return -1;
+    }
+
+    for (b = 0; b < 256; b++) {
+        ac->root_next[b] = AC_ROOT;
+    }
+    for (child = ac->nodes[AC_ROOT].child; child != AC_NONE; child = ac->nodes[child].sibling) {
+        ac->root_next[ac->nodes[child].byte] = child;
+        ac->nodes[child].fail = AC_ROOT;
+        ac->nodes[child].dict = AC_NONE;
+        queue[tail++] = child;
+    }
+
+    while (head < tail) {
+        int32_t node = queue[head++];
+
+        for (child = ac->nodes[node].child; child != AC_NONE; child = ac->nodes[child].sibling) {
+            unsigned char byte = ac->nodes[child].byte;
+            int32_t fail = ac->nodes[node].fail;
+            int32_t target = AC_NONE;
+
+            while (fail != AC_ROOT && (target = find_child(ac, fail, byte)) == AC_NONE) {
+                fail = ac->nodes[fail].fail;
+            }
+            if (fail == AC_ROOT) {
+                target = ac->root_next[byte];
+            }
+
+            ac->nodes[child].fail = target;
+            ac->nodes[child].dict = ac->nodes[target].output != AC_NONE ? target : ac->nodes[target].dict;
+            queue[tail++] = child;
+        }
+    }
+
+    free(queue);
+    ac->dirty = 0;
+    return 0;
+}
+
+void ac_search(AhoCorasick* ac, const char* text, size_t length, AcMatchCallback callback, void* context)
+{
+    int32_t state = AC_ROOT;
+    size_t i;
+
+    if (ac == NULL || text == NULL || callback == NULL || ac->pattern_count == 0) {
+        return;
+    }
+    if (ac->dirty && build_links(ac) != 0) {
+        return;
+    }
+
+    for (i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char)text[i];
+        int32_t node;
+
+        /* Follow failure links until the byte can be consumed */
+        for (;;) {
+            int32_t next;
+            if (state == AC_ROOT) {
+                state = ac->root_next[byte];
+                break;
+            }
+            next = find_child(ac, state, byte);
+            if (next != AC_NONE) {
+                state = next;
+                break;
+            }
+            state = ac->nodes[state].fail;
+        }
+
+        node = ac->nodes[state].output != AC_NONE ? state : ac->nodes[state].dict;
+        for (; node != AC_NONE; node = ac->nodes[node].dict) {
+            int32_t slot;
+            for (slot = ac->nodes[node].output; slot != AC_NONE; slot = ac->outputs[slot].next) {
+                const AcOutput* output = &ac->outputs[slot];
+                if (callback(context, output->id, i + 1 - output->length, output->length) != 0) {
+                    return;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/**
+ * @file aho_corasick.h
+ * @brief Multi-pattern byte string matcher
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Aho-Corasick automaton over raw bytes. Patterns are added and removed one
+ * at a time; the trie is edited in place and the failure links are
+ * recomputed lazily on the next search, so a script registering many
+ * keywords pays for a single link pass. Not thread-safe.
+ */
+
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct AhoCorasick AhoCorasick;
+
+/**
+ * @brief Match callback
+ * @param context User context passed to ac_search
+ * @param id Pattern ID
+ * @param start Byte offset of the match in the text
+ * @param length Match length in bytes
+ * @return 0 to continue searching, non-zero to stop
+ */
+typedef int (*AcMatchCallback)(void* context, int id, size_t start, size_t length);
+
+/**
+ * @brief Create an empty automaton
+ * @return Automaton, or NULL if out of memory
+ */
+AhoCorasick* ac_create(void);
+
+/**
+ * @brief Destroy an automaton
+ * @param ac Automaton, may be NULL
+ */
+void ac_destroy(AhoCorasick* ac);
+
+/**
+ * @brief Add a pattern
+ * @param ac Automaton
+ * @param pattern Pattern bytes
+ * @param length Pattern length (must be > 0)
+ * @param id Caller-chosen pattern ID; several patterns may share bytes
+ * @return 0 on success, -1 on failure
+ */
+int ac_add(AhoCorasick* ac, const char* pattern, size_t length, int id);
+
+/**
+ * @brief Remove a pattern
+ * @param ac Automaton
+ * @param id Pattern ID given to ac_add
+ * @return 1 if removed, 0 if not found
+ */
+int ac_remove(AhoCorasick* ac, int id);
+
+/**
+ * @brief Number of patterns in the automaton
+ * @param ac Automaton
+ * @return Pattern count
+ */
+size_t ac_pattern_count(const AhoCorasick* ac);
+
+/**
+ * @brief Report every pattern occurrence in a text
+ *
+ * Matches are reported in order of their end offset.
+ *
+ * @param ac Automaton
+ * @param text Text to search
+ * @param length Text length in bytes
+ * @param callback Called once per occurrence
+ * @param context Passed to callback
+ */
+void ac_search(AhoCorasick* ac, const char* text, size_t length, AcMatchCallback callback, void* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* AHO_CORASICK_H */
@@ -0,0 +1,243 @@
+/**
+ * @file arena.c
+ * @brief Per-thread bump allocator for scratch memory
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include "arena.h"
+#include "threading.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ArenaBlock {
+    ArenaBlock* next;
+    size_t      size;    /* Usable bytes after the header */
+    size_t      used;
+};
+
+/* The header is padded so block data starts aligned */
+#define BLOCK_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define BLOCK_DATA(block) ((char*)(block) + BLOCK_HEADER)
+
+static THREAD_LOCAL Arena* t_arena = NULL;
+static THREAD_LOCAL int    t_attached = 0;   /* Thread calls arena_thread_free before it exits */
+
+static ArenaBlock* block_create(size_t size)
+{
+    ArenaBlock* block = (ArenaBlock*)malloc(BLOCK_HEADER + size);
+
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
+
+Arena* arena_thread(void)
+{
+    Arena* arena = t_arena;
+
+    if (arena != NULL) {
+        return arena;
+    }
+    arena = (Arena*)calloc(1, sizeof(Arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->first = block_create(ARENA_BLOCK_SIZE);
+    if (arena->first == NULL) {
+        free(arena);
+        return NULL;
+    }
+    arena->current = arena->first;
+    arena->reserved = ARENA_BLOCK_SIZE;
+    t_arena = arena;
+    return arena;
+}
+
+/* Bytes in use up to and including the current block */
+static size_t arena_used(const Arena* arena)
+{
+    const ArenaBlock* block;
+    size_t used = 0;
+
+    for (block = arena->first; block != arena->current; block = block->next) {
+        used += block->used;
+    }
+    return used + arena->current->used;
+}
+
+void* arena_alloc(Arena* arena, size_t size)
+{
+    ArenaBlock* block;
+    size_t aligned;
+    void* memory;
+
+    if (arena == NULL) {
+        return NULL;
+    }
+    aligned = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (aligned < size) {
+        return NULL;
+    }
+
+    block = arena->current;
+    if (block->size - block->used < aligned) {
+        /* Blocks after the current one were kept from earlier scopes and are empty */
+        while (block->next != NULL && block->next->size < aligned) {
+            ArenaBlock* small = block->next;
+
+            block->next = small->next;
+            arena->reserved -= small->size;
+            free(small);
+        }
+        if (block->next == NULL) {
+            ArenaBlock* overflow = block_create(aligned > ARENA_BLOCK_SIZE ? aligned : ARENA_BLOCK_SIZE);
+
+            if (overflow == NULL) {
+                return NULL;
+            }
+            block->next = overflow;
+            arena->reserved += overflow->size;
+            arena->overflows++;
+        }
+        block = block->next;
+        block->used = 0;
+        arena->current = block;
+    }
+
+    memory = BLOCK_DATA(block) + block->used;
+    block->used += aligned;
+    return memory;
+}
+
+char* arena_strdup(Arena* arena, const char* text)
+{
+    size_t length;
+    char* copy;
+
+    if (text == NULL) {
+        text = "";
+    }
+    length = strlen(text);
+    copy = (char*)arena_alloc(arena, length + 1);
+    if (copy != NULL) {
+        memcpy(copy, text, length + 1);
+    }
+    return copy;
+}
+
+char* arena_vprintf(Arena* arena, const char* format, va_list args)
+{
+    va_list copy;
+    char* text;
+    int length;
+
+    va_copy(copy, args);
+    length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length < 0) {
+        return NULL;
+    }
+
+    text = (char*)arena_alloc(arena, (size_t)length + 1);
+    if (text != NULL) {
+        vsnprintf(text, (size_t)length + 1, format, args);
+    }
+    return text;
+}
+
+char* arena_printf(Arena* arena, const char* format, ...)
+{
+    va_list args;
+    char* text;
+
+    va_start(args, format);
+    text = arena_vprintf(arena, format, args);
+    va_end(args);
+    return text;
+}
+
+ArenaMark arena_begin(void)
+{
+    Arena* arena = arena_thread();
+    ArenaMark mark = {NULL, 0};
+
+    if (arena != NULL) {
+        mark.block = arena->current;
+        mark.used = arena->current->used;
+        arena->depth++;
+    }
+    return mark;
+}
+
+void arena_end(ArenaMark mark)
+{
+    Arena* arena = t_arena;
+    ArenaBlock* block;
+    size_t kept;
+    size_t used;
+
+    if (arena == NULL || mark.block == NULL) {
+        return;
+    }
+    used = arena_used(arena);
+    if (used > arena->peak) {
+        arena->peak = used;
+    }
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+    arena->depth--;
+    if (arena->depth > 0) {
+        return;
+    }
+
+    /* Nothing would free a foreign thread's arena when it exits, so it goes now */
+    if (!t_attached) {
+        arena_thread_free();
+        return;
+    }
+
+    /* Outermost scope: keep what a typical event needs, free the rest */
+    kept = arena->first->size;
+    for (block = arena->first; block->next != NULL;) {
+        ArenaBlock* next = block->next;
+
+        if (kept + next->size > ARENA_RETAIN_BYTES) {
+            block->next = next->next;
+            arena->reserved -= next->size;
+            free(next);
+            continue;
+        }
+        kept += next->size;
+        block = next;
+    }
+}
+
+void arena_thread_attach(void)
+{
+    t_attached = 1;
+}
+
+void arena_thread_free(void)
+{
+    Arena* arena = t_arena;
+    ArenaBlock* block;
+
+    t_attached = 0;
+    if (arena == NULL) {
+        return;
+    }
+    t_arena = NULL;
+    block = arena->first;
+    while (block != NULL) {
+        ArenaBlock* next = block->next;
+
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
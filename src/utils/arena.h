@@ -0,0 +1,130 @@
+/**
+ * @file arena.h
+ * @brief Per-thread bump allocator for scratch memory
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Each thread gets an arena of chained blocks. Allocating moves a pointer
+ * forward, and a whole event's or command's scratch memory is given back at
+ * once by returning to a mark taken before it started. A request that does
+ * not fit the current block continues in the next block, which is allocated
+ * with malloc the first time only: blocks are kept for the thread's later
+ * events, up to ARENA_RETAIN_BYTES. Only threads attached with
+ * arena_thread_attach keep blocks between scopes; any other thread, such as
+ * one a script started, frees its arena when its outermost scope ends.
+ * Memory from an arena must never be freed, kept past the scope that
+ * allocated it, or handed to another thread.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Size of a thread's first block and the smallest overflow block
+ */
+#define ARENA_BLOCK_SIZE (16 * 1024)
+
+/**
+ * @brief Blocks kept once a thread's outermost scope ends; larger overflow is freed
+ */
+#define ARENA_RETAIN_BYTES (256 * 1024)
+
+/**
+ * @brief Alignment of every allocation
+ */
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * @brief A thread's arena
+ */
+typedef struct Arena {
+    ArenaBlock* first;
+    ArenaBlock* current;
+    size_t      depth;        /* Open scopes */
+    size_t      reserved;     /* Bytes in all blocks */
+    size_t      peak;         /* Most bytes in use at once */
+    size_t      overflows;    /* Blocks allocated after the first */
+} Arena;
+
+/**
+ * @brief Position to return to with arena_end
+ */
+typedef struct ArenaMark {
+    ArenaBlock* block;
+    size_t      used;
+} ArenaMark;
+
+/**
+ * @brief The calling thread's arena, created on first use
+ * @return Arena, or NULL if the first block could not be allocated
+ */
+Arena* arena_thread(void);
+
+/**
+ * @brief Open a scope on the calling thread's arena
+ * @return Mark for arena_end
+ */
+ArenaMark arena_begin(void);
+
+/**
+ * @brief Give back everything allocated since the matching arena_begin
+ * @param mark Mark returned by arena_begin
+ */
+void arena_end(ArenaMark mark);
+
+/**
+ * @brief Allocate scratch memory
+ * @param arena Arena from arena_thread, inside a scope opened with arena_begin
+ * @param size Bytes
+ * @return ARENA_ALIGNMENT-aligned memory, or NULL if out of memory
+ */
+void* arena_alloc(Arena* arena, size_t size);
+
+/**
+ * @brief Copy a string into the arena
+ * @param arena Arena from arena_thread
+ * @param text String to copy (NULL gives "")
+ * @return Copy, or NULL if out of memory
+ */
+char* arena_strdup(Arena* arena, const char* text);
+
+/**
+ * @brief Format a string of any length into the arena
+ * @param arena Arena from arena_thread
+ * @param format printf format
+ * @return Formatted string, or NULL if out of memory
+ */
+char* arena_printf(Arena* arena, const char* format, ...);
+
+/**
+ * @brief arena_printf with a va_list
+ */
+char* arena_vprintf(Arena* arena, const char* format, va_list args);
+
+/**
+ * @brief Keep the calling thread's arena between scopes
+ * @note Only for threads that call arena_thread_free before they exit: threads
+ *       started with thread_create and the client thread at plugin init
+ */
+void arena_thread_attach(void);
+
+/**
+ * @brief Free the calling thread's arena and detach it
+ * @note Called when a plugin thread exits and at plugin shutdown
+ */
+void arena_thread_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARENA_H */
@@ -0,0 +1,43 @@
+/**
+ * @file crc32.c
+ * @brief CRC-32 (IEEE 802.3) implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include "crc32.h"
+
+static uint32_t g_table[256];
+static volatile int g_table_ready = 0;
+
+static void build_table(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < 256; i++) {
+        uint32_t c = i;
+        int k;
+        for (k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        g_table[i] = c;
+    }
+    /* Racing builders write identical values, so no lock is needed */
+    g_table_ready = 1;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i;
+
+    if (!g_table_ready) {
+        build_table();
+    }
+
+    crc = ~crc;
+    for (i = 0; i < length; i++) {
+        crc = g_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
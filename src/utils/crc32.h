@@ -0,0 +1,31 @@
+/**
+ * @file crc32.h
+ * @brief CRC-32 (IEEE 802.3) checksums
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Update a CRC-32 with more data
+ * @param crc Previous value, 0 to start
+ * @param data Data to add
+ * @param length Data length in bytes
+ * @return Updated CRC-32
+ */
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC32_H */
@@ -0,0 +1,579 @@
+/**
+ * @file file_watch.c
+ * @brief Notification when files change on disk implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Changed names are collected until the directory has been quiet for
+ * FILE_WATCH_SETTLE_MS, so an editor's truncate-then-write or
+ * write-then-rename produces one callback per file rather than several.
+ * Where the platform does not say which file changed, the directory is
+ * scanned and each file's size and modification time compared.
+ */
+
+#if !defined(_WIN32)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#else
+#include <dirent.h>
+#endif
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_watch.h"
+#include "logging.h"
+#include "string_utils.h"
+#include "threading.h"
+#include "trace.h"
+
+#define WATCH_PATH_BUFSIZE 1024
+
+#if !defined(__linux__)
+/* Identifies one version of a file */
+typedef struct FileSignature {
+    uint64_t modified;
+    uint64_t size;
+    uint64_t id;
+} FileSignature;
+
+typedef struct WatchedFile {
+    char*         name;
+    FileSignature signature;
+} WatchedFile;
+#endif
+
+struct FileWatch {
+    char*             directory;
+    char*             name;            /* Only this file, or NULL */
+    char*             suffix;          /* Otherwise files ending in this */
+    FileWatchCallback callback;
+    void*             context;
+    Thread            thread;
+    char**            pending;         /* Changed since the last callbacks */
+    size_t            pendingCount;
+    size_t            pendingCapacity;
+#if defined(_WIN32)
+    HANDLE            change;
+    HANDLE            stop;
+#elif defined(__linux__)
+    int               inotify;
+    int               stopPipe[2];
+#else
+    Mutex             lock;
+    CondVar           wake;
+    int               stopping;
+#endif
+#if !defined(__linux__)
+    WatchedFile*      files;           /* Last seen version of each file */
+    size_t            fileCount;
+    size_t            fileCapacity;
+#endif
+};
+
+static char* copy_string(const char* text, size_t length)
+{
+    char* copy = (char*)malloc(length + 1);
+
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+static int name_matches(const FileWatch* watch, const char* name)
+{
+    size_t length;
+    size_t suffixLength;
+
+    if (watch->name != NULL) {
+        return strcmp(name, watch->name) == 0;
+    }
+    length = strlen(name);
+    suffixLength = strlen(watch->suffix);
+    return length > suffixLength && strcmp(name + length - suffixLength, watch->suffix) == 0;
+}
+
+static void add_pending(FileWatch* watch, const char* name)
+{
+    size_t i;
+    char* copy;
+
+    for (i = 0; i < watch->pendingCount; i++) {
+        if (strcmp(watch->pending[i], name) == 0) {
+            return;
+        }
+    }
+    if (watch->pendingCount == watch->pendingCapacity) {
+        size_t capacity = watch->pendingCapacity > 0 ? watch->pendingCapacity * 2 : 8;
+        char** pending = (char**)realloc(watch->pending, capacity * sizeof(char*));
+        if (pending == NULL) {
+            return;
+        }
+        watch->pending = pending;
+        watch->pendingCapacity = capacity;
+    }
+    copy = copy_string(name, strlen(name));
+    if (copy != NULL) {
+        watch->pending[watch->pendingCount++] = copy;
+    }
+}
+
+static void fire_pending(FileWatch* watch)
+{
+    size_t i;
+
+    for (i = 0; i < watch->pendingCount; i++) {
+        TRACE_BEGIN(span);
+        watch->callback(watch->context, watch->pending[i]);
+        TRACE_END(span, "file_watch", "changed");
+        free(watch->pending[i]);
+    }
+    watch->pendingCount = 0;
+}
+
+#if !defined(__linux__)
+/* Records the version of a file; a new or different one is pending unless this is the first scan */
+static void note_file(FileWatch* watch, const char* name, const FileSignature* signature, int initial)
+{
+    WatchedFile* file = NULL;
+    size_t i;
+
+    for (i = 0; i < watch->fileCount; i++) {
+        if (strcmp(watch->files[i].name, name) == 0) {
+            file = &watch->files[i];
+            break;
+        }
+    }
+
+    if (file == NULL) {
+        if (watch->fileCount == watch->fileCapacity) {
+            size_t capacity = watch->fileCapacity > 0 ? watch->fileCapacity * 2 : 16;
+            WatchedFile* files = (WatchedFile*)realloc(watch->files, capacity * sizeof(WatchedFile));
+            if (files == NULL) {
+                return;
+            }
+            watch->files = files;
+            watch->fileCapacity = capacity;
+        }
+        file = &watch->files[watch->fileCount];
+        file->name = copy_string(name, strlen(name));
+        if (file->name == NULL) {
+            return;
+        }
+        watch->fileCount++;
+    } else if (memcmp(&file->signature, signature, sizeof(FileSignature)) == 0) {
+        return;
+    }
+
+    file->signature = *signature;
+    if (!initial) {
+        add_pending(watch, name);
+    }
+}
+
+/* A deleted file is not a new version; the next save is */
+static void scan(FileWatch* watch, int initial)
+{
+    char path[WATCH_PATH_BUFSIZE];
+    FileSignature signature;
+
+    memset(&signature, 0, sizeof(signature));
+
+#ifdef _WIN32
+    if (watch->name != NULL) {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+
+        join_path(path, sizeof(path), watch->directory, watch->name);
+        if (GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+            signature.modified = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32)
+                               | data.ftLastWriteTime.dwLowDateTime;
+            signature.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            note_file(watch, watch->name, &signature, initial);
+        }
+    } else {
+        WIN32_FIND_DATAA data;
+        HANDLE find;
+
+        join_path(path, sizeof(path), watch->directory, "*");
+        find = FindFirstFileA(path, &data);
+        if (find == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        do {
+            if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 || !name_matches(watch, data.cFileName)) {
+                continue;
+            }
+            signature.modified = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32)
+                               | data.ftLastWriteTime.dwLowDateTime;
+            signature.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+            note_file(watch, data.cFileName, &signature, initial);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    {
+        struct stat info;
+        DIR* directory;
+        struct dirent* entry;
+
+        if (watch->name != NULL) {
+            join_path(path, sizeof(path), watch->directory, watch->name);
+            if (stat(path, &info) == 0) {
+                signature.modified = (uint64_t)info.st_mtime;
+                signature.size = (uint64_t)info.st_size;
+                signature.id = (uint64_t)info.st_ino;
+                note_file(watch, watch->name, &signature, initial);
+            }
+            return;
+        }
+
+        directory = opendir(watch->directory);
+        if (directory == NULL) {
+            return;
+        }
+        while ((entry = readdir(directory)) != NULL) {
+            if (!name_matches(watch, entry->d_name)) {
+                continue;
+            }
+            join_path(path, sizeof(path), watch->directory, entry->d_name);
+            if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) {
+                continue;
+            }
+            signature.modified = (uint64_t)info.st_mtime;
+            signature.size = (uint64_t)info.st_size;
+            signature.id = (uint64_t)info.st_ino;
+            note_file(watch, entry->d_name, &signature, initial);
+        }
+        closedir(directory);
+    }
+#endif
+}
+#endif
+
+/* ========================================================================
+ * Platform watch loops
+ * ======================================================================== */
+
+#if defined(_WIN32)
+
+static void watch_main(void* arg)
+{
+    FileWatch* watch = (FileWatch*)arg;
+    HANDLE handles[2];
+
+    trace_set_thread_name("TsPy file watch");
+    handles[0] = watch->stop;
+    handles[1] = watch->change;
+
+    for (;;) {
+        if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            break;
+        }
+        /* Let the writer finish; everything until the re-arm folds into one scan */
+        if (WaitForSingleObject(watch->stop, FILE_WATCH_SETTLE_MS) == WAIT_OBJECT_0) {
+            break;
+        }
+        if (!FindNextChangeNotification(watch->change)) {
+            log_error("Watching %s failed (error %lu)", watch->directory, GetLastError());
+            break;
+        }
+        /* Notifications do not say which file changed */
+        scan(watch, 0);
+        fire_pending(watch);
+    }
+}
+
+static int watch_open(FileWatch* watch)
+{
+    watch->change = FindFirstChangeNotificationA(watch->directory, FALSE,
+                                                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE
+                                                 | FILE_NOTIFY_CHANGE_SIZE);
+    if (watch->change == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    watch->stop = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (watch->stop == NULL) {
+        FindCloseChangeNotification(watch->change);
+        return -1;
+    }
+    scan(watch, 1);
+    return 0;
+}
+
+static void watch_signal_stop(FileWatch* watch)
+{
+    SetEvent(watch->stop);
+}
+
+static void watch_close(FileWatch* watch)
+{
+    FindCloseChangeNotification(watch->change);
+    CloseHandle(watch->stop);
+}
+
+#elif defined(__linux__)
+
+/* Reads all queued events; returns 1 if any concerned a watched file */
+static int drain_events(FileWatch* watch)
+{
+    union {
+        struct inotify_event event;
+        char                 bytes[4096];
+    } buffer;
+    int matched = 0;
+
+    for (;;) {
+        ssize_t length = read(watch->inotify, buffer.bytes, sizeof(buffer.bytes));
+        ssize_t offset = 0;
+
+        if (length <= 0) {
+            break;
+        }
+        while (offset < length) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer.bytes + offset);
+
+            if (event->len > 0 && name_matches(watch, event->name)) {
+                add_pending(watch, event->name);
+                matched = 1;
+            }
+            offset += (ssize_t)(sizeof(struct inotify_event) + event->len);
+        }
+    }
+    return matched;
+}
+
+static void watch_main(void* arg)
+{
+    FileWatch* watch = (FileWatch*)arg;
+    struct pollfd fds[2];
+    uint64_t deadline = 0;
+
+    trace_set_thread_name("TsPy file watch");
+    fds[0].fd = watch->inotify;
+    fds[0].events = POLLIN;
+    fds[1].fd = watch->stopPipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        int timeout = -1;
+        int ready;
+
+        /* Events for unrelated files must not push the deadline back */
+        if (deadline != 0) {
+            uint64_t now = clock_monotonic_ns();
+            timeout = now >= deadline ? 0 : (int)((deadline - now + 999999) / 1000000);
+        }
+
+        ready = poll(fds, 2, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("Watching %s failed: %s", watch->directory, strerror(errno));
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN) != 0) {
+            if (drain_events(watch)) {
+                deadline = clock_monotonic_ns() + (uint64_t)FILE_WATCH_SETTLE_MS * 1000000ULL;
+            }
+            continue;
+        }
+        if (deadline != 0 && clock_monotonic_ns() >= deadline) {
+            deadline = 0;
+            fire_pending(watch);
+        }
+    }
+}
+
+static int watch_open(FileWatch* watch)
+{
+    watch->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->inotify < 0) {
+        return -1;
+    }
+    /* Written in place, or saved elsewhere and renamed over it */
+    if (inotify_add_watch(watch->inotify, watch->directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+        || pipe2(watch->stopPipe, O_CLOEXEC) != 0) {
+        close(watch->inotify);
+        return -1;
+    }
+    return 0;
+}
+
+static void watch_signal_stop(FileWatch* watch)
+{
+    char byte = 0;
+
+    while (write(watch->stopPipe[1], &byte, 1) < 0 && errno == EINTR) {
+    }
+}
+
+static void watch_close(FileWatch* watch)
+{
+    close(watch->inotify);
+    close(watch->stopPipe[0]);
+    close(watch->stopPipe[1]);
+}
+
+#else
+
+static void watch_main(void* arg)
+{
+    FileWatch* watch = (FileWatch*)arg;
+
+    trace_set_thread_name("TsPy file watch");
+
+    mutex_lock(&watch->lock);
+    while (!watch->stopping) {
+        cond_timed_wait(&watch->wake, &watch->lock, FILE_WATCH_POLL_MS);
+        if (watch->stopping) {
+            break;
+        }
+        mutex_unlock(&watch->lock);
+        scan(watch, 0);
+        fire_pending(watch);
+        mutex_lock(&watch->lock);
+    }
+    mutex_unlock(&watch->lock);
+}
+
+static int watch_open(FileWatch* watch)
+{
+    mutex_init(&watch->lock);
+    cond_init(&watch->wake);
+    watch->stopping = 0;
+    scan(watch, 1);
+    return 0;
+}
+
+static void watch_signal_stop(FileWatch* watch)
+{
+    mutex_lock(&watch->lock);
+    watch->stopping = 1;
+    cond_signal(&watch->wake);
+    mutex_unlock(&watch->lock);
+}
+
+static void watch_close(FileWatch* watch)
+{
+    cond_destroy(&watch->wake);
+    mutex_destroy(&watch->lock);
+}
+
+#endif
+
+/* ========================================================================
+ * Public API
+ * ======================================================================== */
+
+static void free_watch(FileWatch* watch)
+{
+    size_t i;
+
+    for (i = 0; i < watch->pendingCount; i++) {
+        free(watch->pending[i]);
+    }
+    free(watch->pending);
+#if !defined(__linux__)
+    for (i = 0; i < watch->fileCount; i++) {
+        free(watch->files[i].name);
+    }
+    free(watch->files);
+#endif
+    free(watch->suffix);
+    free(watch->name);
+    free(watch->directory);
+    free(watch);
+}
+
+static FileWatch* start_watch(const char* directory, size_t directoryLength, const char* name, const char* suffix,
+                              FileWatchCallback callback, void* context)
+{
+    FileWatch* watch = (FileWatch*)calloc(1, sizeof(FileWatch));
+
+    if (watch == NULL) {
+        return NULL;
+    }
+    watch->directory = copy_string(directory, directoryLength);
+    watch->name = name != NULL ? copy_string(name, strlen(name)) : NULL;
+    watch->suffix = suffix != NULL ? copy_string(suffix, strlen(suffix)) : NULL;
+    watch->callback = callback;
+    watch->context = context;
+
+    if (watch->directory == NULL || (watch->name == NULL && watch->suffix == NULL)) {
+        free_watch(watch);
+        return NULL;
+    }
+    if (watch_open(watch) != 0) {
+        log_error("Cannot watch %s for changes", watch->directory);
+        free_watch(watch);
+        return NULL;
+    }
+    if (thread_create(&watch->thread, watch_main, watch) != 0) {
+        log_error("Failed to start the file watch thread for %s", watch->directory);
+        watch_close(watch);
+        free_watch(watch);
+        return NULL;
+    }
+    return watch;
+}
+
+FileWatch* file_watch_start(const char* path, FileWatchCallback callback, void* context)
+{
+    const char* separator;
+
+    if (path == NULL || callback == NULL) {
+        return NULL;
+    }
+
+    separator = strrchr(path, '/');
+#ifdef _WIN32
+    {
+        const char* backslash = strrchr(path, '\\');
+        if (separator == NULL || (backslash != NULL && backslash > separator)) {
+            separator = backslash;
+        }
+    }
+#endif
+    if (separator == NULL) {
+        return start_watch(".", 1, path, NULL, callback, context);
+    }
+    return start_watch(path, separator > path ? (size_t)(separator - path) : 1, separator + 1, NULL,
+                       callback, context);
+}
+
+FileWatch* file_watch_directory(const char* directory, const char* suffix, FileWatchCallback callback,
+                                void* context)
+{
+    if (directory == NULL || suffix == NULL || callback == NULL) {
+        return NULL;
+    }
+    return start_watch(directory, strlen(directory), NULL, suffix, callback, context);
+}
+
+void file_watch_stop(FileWatch* watch)
+{
+    if (watch == NULL) {
+        return;
+    }
+
+    watch_signal_stop(watch);
+    thread_join(watch->thread);
+    watch_close(watch);
+    free_watch(watch);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file file_watch.h
+ * @brief Notification when files change on disk
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Watches a directory (inotify on Linux, change notifications on Windows, a
+ * once-a-second scan elsewhere), either for one file in it or for every file
+ * with a given suffix. Editors that save by writing a temporary file and
+ * renaming it over the original are seen as well.
+ */
+
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Quiet period after the last change before the callback runs
+ */
+#define FILE_WATCH_SETTLE_MS 100
+
+/**
+ * @brief Poll interval where no notification API is available
+ */
+#define FILE_WATCH_POLL_MS 1000
+
+typedef struct FileWatch FileWatch;
+
+/**
+ * @brief Called on the watch thread after a file was written, created or replaced
+ * @param context Caller context
+ * @param name Name of the file within the watched directory
+ * @note A burst of saves to one file gives one call; several files changed
+ *       together give one call each
+ */
+typedef void (*FileWatchCallback)(void* context, const char* name);
+
+/**
+ * @brief Start watching a file
+ * @param path File to watch (need not exist yet; its directory must)
+ * @param callback Change callback
+ * @param context Passed to callback
+ * @return Watch, or NULL on failure (logged)
+ */
+FileWatch* file_watch_start(const char* path, FileWatchCallback callback, void* context);
+
+/**
+ * @brief Start watching every file in a directory whose name ends in suffix
+ * @param directory Directory to watch
+ * @param suffix Name suffix such as ".py"
+ * @param callback Change callback, once per changed file
+ * @param context Passed to callback
+ * @return Watch, or NULL on failure (logged)
+ */
+FileWatch* file_watch_directory(const char* directory, const char* suffix, FileWatchCallback callback,
+                                void* context);
+
+/**
+ * @brief Stop watching and join the watch thread
+ * @param watch Watch (may be NULL)
+ * @note Must not be called from the callback
+ */
+void file_watch_stop(FileWatch* watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FILE_WATCH_H */
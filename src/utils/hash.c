@@ -0,0 +1,31 @@
+/**
+ * @file hash.c
+ * @brief Non-cryptographic hashing implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include "hash.h"
+
+uint64_t hash_fnv1a64(uint64_t hash, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64_t hash_mix64(uint64_t hash)
+{
+    /* splitmix64 finaliser */
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file hash.h
+ * @brief Non-cryptographic hashing for in-memory tables
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initial value for hash_fnv1a64
+ */
+#define HASH_FNV1A64_INIT 0xCBF29CE484222325ULL
+
+/**
+ * @brief 64-bit FNV-1a; chain calls to hash several fields
+ * @param hash Previous value, HASH_FNV1A64_INIT to start
+ * @param data Data to add
+ * @param length Data length in bytes
+ * @return Updated hash
+ */
+uint64_t hash_fnv1a64(uint64_t hash, const void* data, size_t length);
+
+/**
+ * @brief Finalise a hash so its low bits are usable as a table index
+ * @param hash Hash value
+ * @return Mixed hash
+ */
+uint64_t hash_mix64(uint64_t hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HASH_H */
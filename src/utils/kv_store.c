@@ -0,0 +1,1018 @@
+/**
+ * @file kv_store.c
+ * @brief Log-structured persistent key-value store implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * File layout: the 8-byte magic "TSPYKV01", then records of
+ *   u32 CRC-32 of the rest of the record (little-endian)
+ *   u32 key length
+ *   u32 value length, 0xFFFFFFFF for a deletion
+ *   key bytes, value bytes
+ *
+ * Offsets are positions in the log as if every buffered record had already
+ * been written: [0, flushed) is in the file, then the buffer being committed,
+ * then the buffer taking new writes. The index stores only a key's hash and
+ * record offset; keys are compared against the record itself.
+ */
+
+#if !defined(_WIN32)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kv_store.h"
+#include "crc32.h"
+#include "hash.h"
+#include "logging.h"
+#include "threading.h"
+#include "trace.h"
+
+#define KV_MAGIC        "TSPYKV01"
+#define KV_MAGIC_SIZE   8
+#define KV_HEADER_SIZE  12
+#define KV_TOMBSTONE    0xFFFFFFFFu
+#define KV_COPY_BUFSIZE (1024u * 1024u)
+
+#ifdef _WIN32
+typedef HANDLE KvFile;
+#define KV_NO_FILE INVALID_HANDLE_VALUE
+#else
+typedef int KvFile;
+#define KV_NO_FILE (-1)
+#endif
+
+typedef struct KvEntry {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t keyLength;    /* 0 marks an empty slot */
+    uint32_t valueLength;
+} KvEntry;
+
+typedef struct KvBuffer {
+    char*  data;
+    size_t length;
+    size_t capacity;
+} KvBuffer;
+
+/* A live record copied by compaction */
+typedef struct KvMove {
+    uint64_t hash;
+    uint64_t from;
+    uint64_t to;
+    uint64_t size;
+} KvMove;
+
+struct KvStore {
+    char*       path;
+    KvFile      file;
+    const char* map;
+    size_t      mapped;
+    uint64_t    flushed;       /* Bytes in the file */
+    KvBuffer    active;        /* Takes new writes */
+    KvBuffer    committing;    /* Being written by the thread */
+
+    KvEntry*    slots;         /* Open addressing; capacity is a power of two */
+    size_t      capacity;
+    size_t      count;
+    uint64_t    live;          /* Bytes of indexed records */
+
+    uint64_t    appended;      /* Bytes ever appended, never rebased */
+    uint64_t    durable;       /* Part of appended known to be on disk */
+    unsigned int commitMs;     /* Group commit window */
+    int         commitNow;
+    int         stopping;
+    int         failed;
+
+    uint64_t    writes;
+    uint64_t    commits;
+    uint64_t    compactions;
+
+    Mutex       lock;
+    CondVar     wake;          /* Signals the thread */
+    CondVar     committed;     /* Signals kv_store_sync() */
+    Thread      thread;
+};
+
+/* ========================================================================
+ * File access
+ * ======================================================================== */
+
+#ifdef _WIN32
+
+static KvFile file_open(const char* path)
+{
+    return CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                       OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void file_close(KvFile file)
+{
+    CloseHandle(file);
+}
+
+static int file_size(KvFile file, uint64_t* size)
+{
+    LARGE_INTEGER value;
+
+    if (!GetFileSizeEx(file, &value)) {
+        return -1;
+    }
+    *size = (uint64_t)value.QuadPart;
+    return 0;
+}
+
+static int file_append(KvFile file, const void* data, size_t length)
+{
+    LARGE_INTEGER zero;
+    const char* cursor = (const char*)data;
+
+    zero.QuadPart = 0;
+    if (!SetFilePointerEx(file, zero, NULL, FILE_END)) {
+        return -1;
+    }
+    while (length > 0) {
+        DWORD chunk = length > 0x40000000u ? 0x40000000u : (DWORD)length;
+        DWORD written = 0;
+
+        if (!WriteFile(file, cursor, chunk, &written, NULL) || written == 0) {
+            return -1;
+        }
+        cursor += written;
+        length -= written;
+    }
+    return 0;
+}
+
+static int file_sync(KvFile file)
+{
+    return FlushFileBuffers(file) ? 0 : -1;
+}
+
+static int file_truncate(KvFile file, uint64_t length)
+{
+    LARGE_INTEGER position;
+
+    position.QuadPart = (LONGLONG)length;
+    return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file) ? 0 : -1;
+}
+
+static const char* file_map(KvFile file, size_t length)
+{
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const char* view;
+
+    if (mapping == NULL) {
+        return NULL;
+    }
+    /* The view keeps the mapping object alive */
+    view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, length);
+    CloseHandle(mapping);
+    return view;
+}
+
+static void file_unmap(const char* view, size_t length)
+{
+    (void)length; /* Unused parameter */
+    UnmapViewOfFile(view);
+}
+
+static int file_replace(const char* from, const char* to)
+{
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+}
+
+#else
+
+static KvFile file_open(const char* path)
+{
+    return open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+static void file_close(KvFile file)
+{
+    close(file);
+}
+
+static int file_size(KvFile file, uint64_t* size)
+{
+    struct stat info;
+
+    if (fstat(file, &info) != 0) {
+        return -1;
+    }
+    *size = (uint64_t)info.st_size;
+    return 0;
+}
+
+static int file_append(KvFile file, const void* data, size_t length)
+{
+    const char* cursor = (const char*)data;
+
+    while (length > 0) {
+        ssize_t written = write(file, cursor, length);
+
+        if (written <= 0) {
+            return -1;
+        }
+        cursor += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+static int file_sync(KvFile file)
+{
+    return fsync(file);
+}
+
+static int file_truncate(KvFile file, uint64_t length)
+{
+    return ftruncate(file, (off_t)length);
+}
+
+static const char* file_map(KvFile file, size_t length)
+{
+    void* view = mmap(NULL, length, PROT_READ, MAP_SHARED, file, 0);
+    return view != MAP_FAILED ? (const char*)view : NULL;
+}
+
+static void file_unmap(const char* view, size_t length)
+{
+    munmap((void*)view, length);
+}
+
+static int file_replace(const char* from, const char* to)
+{
+    return rename(from, to);
+}
+
+#endif
+
+/* ========================================================================
+ * Records and buffers
+ * ======================================================================== */
+
+static void put_u32(char* out, uint32_t value)
+{
+    out[0] = (char)(value & 0xFF);
+    out[1] = (char)((value >> 8) & 0xFF);
+    out[2] = (char)((value >> 16) & 0xFF);
+    out[3] = (char)((value >> 24) & 0xFF);
+}
+
+static uint32_t get_u32(const char* in)
+{
+    const unsigned char* bytes = (const unsigned char*)in;
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t record_size(uint32_t keyLength, uint32_t valueLength)
+{
+    return KV_HEADER_SIZE + (uint64_t)keyLength + (valueLength != KV_TOMBSTONE ? valueLength : 0);
+}
+
+static uint64_t key_hash(const void* key, size_t length)
+{
+    return hash_mix64(hash_fnv1a64(HASH_FNV1A64_INIT, key, length));
+}
+
+static int buffer_reserve(KvBuffer* buffer, size_t extra)
+{
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 65536;
+    char* data;
+
+    if (buffer->length + extra <= buffer->capacity) {
+        return 0;
+    }
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    data = (char*)realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/* Append a record to the active buffer; returns its offset */
+static int append_record(KvStore* store, const void* key, uint32_t keyLength, const void* value,
+                         uint32_t valueLength, uint64_t* offset)
+{
+    size_t size = (size_t)record_size(keyLength, valueLength);
+    size_t dataLength = valueLength != KV_TOMBSTONE ? valueLength : 0;
+    char* record;
+
+    if (buffer_reserve(&store->active, size) != 0) {
+        return -1;
+    }
+
+    record = store->active.data + store->active.length;
+    put_u32(record + 4, keyLength);
+    put_u32(record + 8, valueLength);
+    memcpy(record + KV_HEADER_SIZE, key, keyLength);
+    if (dataLength > 0) {
+        memcpy(record + KV_HEADER_SIZE + keyLength, value, dataLength);
+    }
+    put_u32(record, crc32_update(0, record + 4, size - 4));
+
+    *offset = store->flushed + store->committing.length + store->active.length;
+    store->active.length += size;
+    store->appended += size;
+    store->writes++;
+
+    /* The first write after a commit starts the commit window */
+    if (store->active.length == size || store->active.length >= KV_STORE_FLUSH_BYTES) {
+        cond_signal(&store->wake);
+    }
+    return 0;
+}
+
+static void unmap(KvStore* store)
+{
+    if (store->map != NULL) {
+        file_unmap(store->map, store->mapped);
+        store->map = NULL;
+        store->mapped = 0;
+    }
+}
+
+static int remap(KvStore* store)
+{
+    unmap(store);
+    store->map = file_map(store->file, (size_t)store->flushed);
+    if (store->map == NULL) {
+        log_error("Store %s: cannot map %llu bytes", store->path, (unsigned long long)store->flushed);
+        return -1;
+    }
+    store->mapped = (size_t)store->flushed;
+    return 0;
+}
+
+/* Bytes at a log offset, wherever they currently live (store locked) */
+static const char* locate(KvStore* store, uint64_t offset, uint64_t length)
+{
+    uint64_t committingEnd = store->flushed + store->committing.length;
+
+    if (offset < store->flushed) {
+        if (offset + length > store->mapped && remap(store) != 0) {
+            return NULL;
+        }
+        return store->map + offset;
+    }
+    if (offset < committingEnd) {
+        return store->committing.data + (offset - store->flushed);
+    }
+    return store->active.data + (offset - committingEnd);
+}
+
+/* ========================================================================
+ * Index
+ * ======================================================================== */
+
+/* Slot holding the key, or the empty slot where it belongs */
+static size_t find_slot(KvStore* store, const void* key, uint32_t keyLength, uint64_t hash)
+{
+    size_t mask = store->capacity - 1;
+    size_t i = (size_t)hash & mask;
+
+    for (;;) {
+        KvEntry* entry = &store->slots[i];
+
+        if (entry->keyLength == 0) {
+            return i;
+        }
+        if (entry->hash == hash && entry->keyLength == keyLength) {
+            const char* stored = locate(store, entry->offset + KV_HEADER_SIZE, keyLength);
+            if (stored != NULL && memcmp(stored, key, keyLength) == 0) {
+                return i;
+            }
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static int index_grow(KvStore* store)
+{
+    size_t capacity = store->capacity > 0 ? store->capacity * 2 : 1024;
+    KvEntry* slots = (KvEntry*)calloc(capacity, sizeof(KvEntry));
+    KvEntry* old = store->slots;
+    size_t oldCapacity = store->capacity;
+    size_t i;
+
+    if (slots == NULL) {
+        return -1;
+    }
+    store->slots = slots;
+    store->capacity = capacity;
+
+    /* Keys are unique, so only an empty slot is needed */
+    for (i = 0; i < oldCapacity; i++) {
+        if (old[i].keyLength != 0) {
+            size_t j = (size_t)old[i].hash & (capacity - 1);
+            while (slots[j].keyLength != 0) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/* Remove by backward shifting, so probe chains never need tombstones */
+static void index_remove(KvStore* store, size_t i)
+{
+    size_t mask = store->capacity - 1;
+    size_t j = i;
+
+    for (;;) {
+        size_t home;
+
+        j = (j + 1) & mask;
+        if (store->slots[j].keyLength == 0) {
+            break;
+        }
+        home = (size_t)store->slots[j].hash & mask;
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            store->slots[i] = store->slots[j];
+            i = j;
+        }
+    }
+    memset(&store->slots[i], 0, sizeof(KvEntry));
+    store->count--;
+}
+
+/* Point a key at a record, or remove it for a deletion (store locked) */
+static int index_apply(KvStore* store, const void* key, uint32_t keyLength, uint32_t valueLength, uint64_t offset)
+{
+    uint64_t hash = key_hash(key, keyLength);
+    size_t i;
+    KvEntry* entry;
+
+    if ((store->count + 1) * 2 > store->capacity && index_grow(store) != 0) {
+        return -1;
+    }
+
+    i = find_slot(store, key, keyLength, hash);
+    entry = &store->slots[i];
+    if (entry->keyLength != 0) {
+        store->live -= record_size(entry->keyLength, entry->valueLength);
+        if (valueLength == KV_TOMBSTONE) {
+            index_remove(store, i);
+            return 0;
+        }
+    } else if (valueLength == KV_TOMBSTONE) {
+        return 0;
+    } else {
+        entry->hash = hash;
+        entry->keyLength = keyLength;
+        store->count++;
+    }
+    entry->offset = offset;
+    entry->valueLength = valueLength;
+    store->live += record_size(keyLength, valueLength);
+    return 0;
+}
+
+/* ========================================================================
+ * Compaction
+ * ======================================================================== */
+
+static int compare_moves(const void* a, const void* b)
+{
+    uint64_t x = ((const KvMove*)a)->from;
+    uint64_t y = ((const KvMove*)b)->from;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Write the live records to path.compact; returns its size or 0 on failure */
+static uint64_t write_compacted(KvStore* store, const char* path, KvMove* moves, size_t count)
+{
+    KvFile out;
+    KvBuffer buffer = {NULL, 0, 0};
+    uint64_t size = KV_MAGIC_SIZE;
+    size_t i;
+    int ok;
+
+    remove(path);
+    out = file_open(path);
+    if (out == KV_NO_FILE) {
+        return 0;
+    }
+
+    ok = buffer_reserve(&buffer, KV_COPY_BUFSIZE) == 0;
+    if (ok) {
+        memcpy(buffer.data, KV_MAGIC, KV_MAGIC_SIZE);
+        buffer.length = KV_MAGIC_SIZE;
+    }
+    for (i = 0; ok && i < count; i++) {
+        /* The mapped part of the log is immutable while the thread compacts */
+        if (buffer.length + moves[i].size > buffer.capacity) {
+            ok = file_append(out, buffer.data, buffer.length) == 0 && buffer_reserve(&buffer, (size_t)moves[i].size) == 0;
+            buffer.length = 0;
+        }
+        if (ok) {
+            memcpy(buffer.data + buffer.length, store->map + moves[i].from, (size_t)moves[i].size);
+            buffer.length += (size_t)moves[i].size;
+            moves[i].to = size;
+            size += moves[i].size;
+        }
+    }
+    ok = ok && file_append(out, buffer.data, buffer.length) == 0 && file_sync(out) == 0;
+
+    free(buffer.data);
+    file_close(out);
+    if (!ok) {
+        remove(path);
+        return 0;
+    }
+    return size;
+}
+
+/* Rewrite the log without dead records (store locked; the lock is dropped while copying) */
+static void compact(KvStore* store)
+{
+    char* path;
+    KvMove* moves;
+    size_t count = 0;
+    size_t i;
+    uint64_t oldFlushed;
+    uint64_t newSize;
+    uint64_t startNs = clock_monotonic_ns();
+
+    path = (char*)malloc(strlen(store->path) + sizeof(".compact"));
+    moves = (KvMove*)malloc((store->count > 0 ? store->count : 1) * sizeof(KvMove));
+    if (path == NULL || moves == NULL || (store->flushed > store->mapped && remap(store) != 0)) {
+        free(path);
+        free(moves);
+        return;
+    }
+    snprintf(path, strlen(store->path) + sizeof(".compact"), "%s.compact", store->path);
+
+    /* Records still in the buffers are not copied; they are rebased afterwards */
+    oldFlushed = store->flushed;
+    for (i = 0; i < store->capacity; i++) {
+        KvEntry* entry = &store->slots[i];
+
+        if (entry->keyLength != 0 && entry->offset < oldFlushed) {
+            moves[count].hash = entry->hash;
+            moves[count].from = entry->offset;
+            moves[count].size = record_size(entry->keyLength, entry->valueLength);
+            count++;
+        }
+    }
+    mutex_unlock(&store->lock);
+
+    qsort(moves, count, sizeof(KvMove), compare_moves);
+    newSize = write_compacted(store, path, moves, count);
+
+    mutex_lock(&store->lock);
+    if (newSize == 0) {
+        log_error("Store %s: compaction failed", store->path);
+        free(path);
+        free(moves);
+        return;
+    }
+
+    /* Windows cannot replace a file that is still open or mapped */
+    unmap(store);
+    file_close(store->file);
+    if (file_replace(path, store->path) != 0) {
+        log_error("Store %s: cannot replace the log with its compacted copy", store->path);
+        remove(path);
+        store->file = file_open(store->path);
+        store->flushed = oldFlushed;
+        if (store->file == KV_NO_FILE || remap(store) != 0) {
+            store->failed = 1;
+        }
+        free(path);
+        free(moves);
+        return;
+    }
+
+    /* Entries not rewritten since the snapshot move to the new file... */
+    for (i = 0; i < count; i++) {
+        size_t mask = store->capacity - 1;
+        size_t j = (size_t)moves[i].hash & mask;
+
+        for (; store->slots[j].keyLength != 0; j = (j + 1) & mask) {
+            if (store->slots[j].hash == moves[i].hash && store->slots[j].offset == moves[i].from) {
+                store->slots[j].offset = moves[i].to;
+                break;
+            }
+        }
+    }
+    /* ...and everything buffered shifts with the end of the file */
+    for (i = 0; i < store->capacity; i++) {
+        if (store->slots[i].keyLength != 0 && store->slots[i].offset >= oldFlushed) {
+            store->slots[i].offset = store->slots[i].offset - oldFlushed + newSize;
+        }
+    }
+
+    store->file = file_open(store->path);
+    store->flushed = newSize;
+    if (store->file == KV_NO_FILE || remap(store) != 0) {
+        store->failed = 1;
+    }
+
+    store->compactions++;
+    log_debug("Store %s: compacted %llu to %llu bytes (%zu keys) in %.1f ms", store->path,
+              (unsigned long long)oldFlushed, (unsigned long long)newSize, store->count,
+              (clock_monotonic_ns() - startNs) / 1e6);
+
+    free(path);
+    free(moves);
+}
+
+static int should_compact(const KvStore* store)
+{
+    uint64_t total = store->flushed + store->committing.length + store->active.length;
+    return store->flushed >= KV_STORE_COMPACT_MIN && total - store->live > total / 2;
+}
+
+/* ========================================================================
+ * Commit thread
+ * ======================================================================== */
+
+static void commit_main(void* arg)
+{
+    KvStore* store = (KvStore*)arg;
+
+    trace_set_thread_name("TsPy store");
+
+    mutex_lock(&store->lock);
+    for (;;) {
+        KvBuffer swap;
+        int ok;
+
+        while (store->active.length == 0 && !store->stopping) {
+            cond_wait(&store->wake, &store->lock);
+        }
+        if (store->active.length == 0 || store->failed) {
+            if (store->stopping) {
+                break;
+            }
+            cond_wait(&store->wake, &store->lock);
+            continue;
+        }
+
+        /* Let more writes join this commit unless someone is waiting for it */
+        if (!store->commitNow && !store->stopping && store->commitMs > 0
+            && store->active.length < KV_STORE_FLUSH_BYTES) {
+            cond_timed_wait(&store->wake, &store->lock, store->commitMs);
+        }
+        store->commitNow = 0;
+
+        swap = store->committing;
+        store->committing = store->active;
+        store->active = swap;
+        store->active.length = 0;
+        mutex_unlock(&store->lock);
+
+        TRACE_BEGIN(span);
+        ok = file_append(store->file, store->committing.data, store->committing.length) == 0
+             && file_sync(store->file) == 0;
+        TRACE_END(span, "store", "commit");
+
+        mutex_lock(&store->lock);
+        if (!ok) {
+            /* Keep the records readable from memory, but stop accepting writes */
+            log_error("Store %s: write failed, the store is now read-only", store->path);
+            store->failed = 1;
+            cond_broadcast(&store->committed);
+            continue;
+        }
+        store->flushed += store->committing.length;
+        store->durable += store->committing.length;
+        store->committing.length = 0;
+        store->commits++;
+        cond_broadcast(&store->committed);
+
+        if (!store->stopping && should_compact(store)) {
+            compact(store);
+        }
+    }
+    cond_broadcast(&store->committed);
+    mutex_unlock(&store->lock);
+}
+
+/* ========================================================================
+ * Open and recovery
+ * ======================================================================== */
+
+/* Build the index from the log and cut off a torn tail (store not yet shared) */
+static int recover(KvStore* store, uint64_t size)
+{
+    uint64_t position = KV_MAGIC_SIZE;
+
+    store->flushed = size;
+    if (remap(store) != 0) {
+        return -1;
+    }
+    if (memcmp(store->map, KV_MAGIC, KV_MAGIC_SIZE) != 0) {
+        log_error("Store %s: not a TsPy store", store->path);
+        return -1;
+    }
+
+    while (position + KV_HEADER_SIZE <= size) {
+        const char* record = store->map + position;
+        uint32_t keyLength = get_u32(record + 4);
+        uint32_t valueLength = get_u32(record + 8);
+        uint64_t length = record_size(keyLength, valueLength);
+
+        if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY
+            || (valueLength != KV_TOMBSTONE && valueLength > KV_STORE_MAX_VALUE)
+            || position + length > size
+            || crc32_update(0, record + 4, (size_t)length - 4) != get_u32(record)) {
+            break;
+        }
+        if (index_apply(store, record + KV_HEADER_SIZE, keyLength, valueLength, position) != 0) {
+            log_error("Store %s: out of memory while loading", store->path);
+            return -1;
+        }
+        position += length;
+    }
+
+    if (position < size) {
+        log_warning("Store %s: discarding %llu bytes after the last intact record", store->path,
+                    (unsigned long long)(size - position));
+        unmap(store);
+        if (file_truncate(store->file, position) != 0 || file_sync(store->file) != 0) {
+            log_error("Store %s: cannot truncate the log", store->path);
+            return -1;
+        }
+        store->flushed = position;
+        if (remap(store) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void free_store(KvStore* store)
+{
+    unmap(store);
+    if (store->file != KV_NO_FILE) {
+        file_close(store->file);
+    }
+    free(store->active.data);
+    free(store->committing.data);
+    free(store->slots);
+    free(store->path);
+    free(store);
+}
+
+KvStore* kv_store_open(const char* path)
+{
+    KvStore* store = (KvStore*)calloc(1, sizeof(KvStore));
+    char* leftover;
+    uint64_t size = 0;
+    uint64_t startNs = clock_monotonic_ns();
+
+    if (store == NULL) {
+        return NULL;
+    }
+    store->file = KV_NO_FILE;
+    store->commitMs = KV_STORE_COMMIT_MS;
+    store->path = (char*)malloc(strlen(path) + 1);
+    leftover = (char*)malloc(strlen(path) + sizeof(".compact"));
+    if (store->path == NULL || leftover == NULL) {
+        free(leftover);
+        free_store(store);
+        return NULL;
+    }
+    strcpy(store->path, path);
+
+    /* A compaction interrupted by a crash leaves its copy behind; the log itself is intact */
+    snprintf(leftover, strlen(path) + sizeof(".compact"), "%s.compact", path);
+    remove(leftover);
+    free(leftover);
+
+    store->file = file_open(path);
+    if (store->file == KV_NO_FILE || file_size(store->file, &size) != 0) {
+        log_error("Store %s: cannot open", path);
+        free_store(store);
+        return NULL;
+    }
+    if (size < KV_MAGIC_SIZE) {
+        if (file_truncate(store->file, 0) != 0 || file_append(store->file, KV_MAGIC, KV_MAGIC_SIZE) != 0
+            || file_sync(store->file) != 0) {
+            log_error("Store %s: cannot initialise", path);
+            free_store(store);
+            return NULL;
+        }
+        size = KV_MAGIC_SIZE;
+    }
+    if (index_grow(store) != 0 || recover(store, size) != 0) {
+        free_store(store);
+        return NULL;
+    }
+
+    mutex_init(&store->lock);
+    cond_init(&store->wake);
+    cond_init(&store->committed);
+    if (thread_create(&store->thread, commit_main, store) != 0) {
+        log_error("Store %s: cannot start the commit thread", path);
+        cond_destroy(&store->committed);
+        cond_destroy(&store->wake);
+        mutex_destroy(&store->lock);
+        free_store(store);
+        return NULL;
+    }
+
+    log_info("Store opened: %s (%zu keys, %llu bytes, %.1f ms)", path, store->count,
+             (unsigned long long)store->flushed, (clock_monotonic_ns() - startNs) / 1e6);
+    return store;
+}
+
+void kv_store_close(KvStore* store)
+{
+    if (store == NULL) {
+        return;
+    }
+
+    /* The thread commits what is buffered before it exits */
+    mutex_lock(&store->lock);
+    store->stopping = 1;
+    cond_signal(&store->wake);
+    mutex_unlock(&store->lock);
+    thread_join(store->thread);
+
+    if (store->active.length > 0) {
+        log_error("Store %s: %zu bytes could not be written", store->path, store->active.length);
+    }
+
+    cond_destroy(&store->committed);
+    cond_destroy(&store->wake);
+    mutex_destroy(&store->lock);
+    free_store(store);
+}
+
+/* ========================================================================
+ * Operations
+ * ======================================================================== */
+
+int kv_store_put(KvStore* store, const void* key, size_t keyLength, const void* value, size_t valueLength)
+{
+    uint64_t offset;
+    int result = -1;
+
+    if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY || valueLength > KV_STORE_MAX_VALUE) {
+        return -1;
+    }
+
+    mutex_lock(&store->lock);
+    if (!store->failed
+        && append_record(store, key, (uint32_t)keyLength, value, (uint32_t)valueLength, &offset) == 0) {
+        result = index_apply(store, key, (uint32_t)keyLength, (uint32_t)valueLength, offset);
+    }
+    mutex_unlock(&store->lock);
+    return result;
+}
+
+int kv_store_delete(KvStore* store, const void* key, size_t keyLength)
+{
+    uint64_t offset;
+    size_t i;
+    int result = 0;
+
+    if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY) {
+        return 0;
+    }
+
+    mutex_lock(&store->lock);
+    i = find_slot(store, key, (uint32_t)keyLength, key_hash(key, keyLength));
+    if (store->slots[i].keyLength != 0) {
+        result = -1;
+        if (!store->failed && append_record(store, key, (uint32_t)keyLength, NULL, KV_TOMBSTONE, &offset) == 0) {
+            store->live -= record_size(store->slots[i].keyLength, store->slots[i].valueLength);
+            index_remove(store, i);
+            result = 1;
+        }
+    }
+    mutex_unlock(&store->lock);
+    return result;
+}
+
+int kv_store_get(KvStore* store, const void* key, size_t keyLength, KvStoreAlloc alloc, void* context)
+{
+    const KvEntry* entry;
+    const char* value;
+    void* destination;
+    int result = 0;
+
+    if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY) {
+        return 0;
+    }
+
+    mutex_lock(&store->lock);
+    entry = &store->slots[find_slot(store, key, (uint32_t)keyLength, key_hash(key, keyLength))];
+    if (entry->keyLength != 0) {
+        value = locate(store, entry->offset + KV_HEADER_SIZE + entry->keyLength, entry->valueLength);
+        destination = value != NULL ? alloc(context, entry->valueLength) : NULL;
+        if (destination != NULL) {
+            memcpy(destination, value, entry->valueLength);
+            result = 1;
+        } else {
+            result = -1;
+        }
+    }
+    mutex_unlock(&store->lock);
+    return result;
+}
+
+int kv_store_contains(KvStore* store, const void* key, size_t keyLength)
+{
+    int found;
+
+    if (keyLength == 0 || keyLength > KV_STORE_MAX_KEY) {
+        return 0;
+    }
+
+    mutex_lock(&store->lock);
+    found = store->slots[find_slot(store, key, (uint32_t)keyLength, key_hash(key, keyLength))].keyLength != 0;
+    mutex_unlock(&store->lock);
+    return found;
+}
+
+int kv_store_keys(KvStore* store, KvStoreVisit visit, void* context)
+{
+    size_t i;
+    int result = 0;
+
+    mutex_lock(&store->lock);
+    for (i = 0; i < store->capacity && result == 0; i++) {
+        const KvEntry* entry = &store->slots[i];
+        const char* key;
+
+        if (entry->keyLength == 0) {
+            continue;
+        }
+        key = locate(store, entry->offset + KV_HEADER_SIZE, entry->keyLength);
+        if (key != NULL) {
+            result = visit(context, key, entry->keyLength);
+        }
+    }
+    mutex_unlock(&store->lock);
+    return result;
+}
+
+size_t kv_store_count(KvStore* store)
+{
+    size_t count;
+
+    mutex_lock(&store->lock);
+    count = store->count;
+    mutex_unlock(&store->lock);
+    return count;
+}
+
+int kv_store_sync(KvStore* store)
+{
+    uint64_t target;
+    int result;
+
+    mutex_lock(&store->lock);
+    target = store->appended;
+    if (store->durable < target && !store->failed) {
+        store->commitNow = 1;
+        cond_signal(&store->wake);
+    }
+    while (store->durable < target && !store->failed && !store->stopping) {
+        cond_wait(&store->committed, &store->lock);
+    }
+    result = store->durable >= target ? 0 : -1;
+    mutex_unlock(&store->lock);
+    return result;
+}
+
+void kv_store_set_commit_window(KvStore* store, unsigned int milliseconds)
+{
+    mutex_lock(&store->lock);
+    store->commitMs = milliseconds;
+    mutex_unlock(&store->lock);
+}
+
+void kv_store_get_stats(KvStore* store, KvStoreStats* stats)
+{
+    mutex_lock(&store->lock);
+    stats->keys = store->count;
+    stats->logBytes = store->flushed + store->committing.length + store->active.length;
+    stats->liveBytes = store->live + KV_MAGIC_SIZE;
+    stats->writes = store->writes;
+    stats->commits = store->commits;
+    stats->compactions = store->compactions;
+    mutex_unlock(&store->lock);
+}
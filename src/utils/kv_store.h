@@ -0,0 +1,152 @@
+/**
+ * @file kv_store.h
+ * @brief Log-structured persistent key-value store
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Every write is appended to a log file; an in-memory hash index maps each
+ * key to its latest record. Appends are collected in memory and written by a
+ * background thread with a single fsync per batch (group commit). Reads come
+ * from the write buffers or a read-only mapping of the file. Once most of the
+ * log is dead records, the same thread rewrites it with only the live ones.
+ */
+
+#ifndef KV_STORE_H
+#define KV_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Longest key in bytes
+ */
+#define KV_STORE_MAX_KEY 1024
+
+/**
+ * @brief Longest value in bytes
+ */
+#define KV_STORE_MAX_VALUE (16u * 1024u * 1024u)
+
+/**
+ * @brief Default milliseconds writes are collected before they are committed
+ */
+#define KV_STORE_COMMIT_MS 5
+
+/**
+ * @brief Buffered bytes that trigger a commit without waiting
+ */
+#define KV_STORE_FLUSH_BYTES (4u * 1024u * 1024u)
+
+/**
+ * @brief Smallest log worth compacting, in bytes
+ */
+#define KV_STORE_COMPACT_MIN (4u * 1024u * 1024u)
+
+typedef struct KvStore KvStore;
+
+/**
+ * @brief Store counters
+ */
+typedef struct KvStoreStats {
+    size_t   keys;        /* Live keys */
+    uint64_t logBytes;    /* Log size including buffered writes */
+    uint64_t liveBytes;   /* Bytes of records still referenced */
+    uint64_t writes;      /* Puts and deletes */
+    uint64_t commits;     /* Group commits (one fsync each) */
+    uint64_t compactions; /* Log rewrites */
+} KvStoreStats;
+
+/**
+ * @brief Destination for a value read by kv_store_get
+ * @param context Caller context
+ * @param length Value length
+ * @return Buffer of at least length bytes, or NULL to abort
+ * @note Called with the store locked; must not call back into the store
+ */
+typedef void* (*KvStoreAlloc)(void* context, size_t length);
+
+/**
+ * @brief Visitor for kv_store_keys
+ * @return 0 to continue, non-zero to stop
+ * @note Called with the store locked; must not call back into the store
+ */
+typedef int (*KvStoreVisit)(void* context, const char* key, size_t length);
+
+/**
+ * @brief Open or create a store and start its commit thread
+ * @param path Log file path
+ * @return Store, or NULL on failure (logged)
+ * @note A torn record at the end of the log, left by a crash, is discarded
+ */
+KvStore* kv_store_open(const char* path);
+
+/**
+ * @brief Commit pending writes, stop the thread and close the store
+ * @param store Store (may be NULL)
+ */
+void kv_store_close(KvStore* store);
+
+/**
+ * @brief Set a key
+ * @return 0 on success, -1 if the store has failed or is out of memory
+ */
+int kv_store_put(KvStore* store, const void* key, size_t keyLength, const void* value, size_t valueLength);
+
+/**
+ * @brief Remove a key
+ * @return 1 if removed, 0 if missing, -1 if the store has failed or is out of memory
+ */
+int kv_store_delete(KvStore* store, const void* key, size_t keyLength);
+
+/**
+ * @brief Read a value
+ * @param alloc Provides the destination buffer
+ * @param context Passed to alloc
+ * @return 1 if found, 0 if missing, -1 if alloc returned NULL
+ */
+int kv_store_get(KvStore* store, const void* key, size_t keyLength, KvStoreAlloc alloc, void* context);
+
+/**
+ * @brief Check whether a key exists
+ * @return 1 if present, 0 otherwise
+ */
+int kv_store_contains(KvStore* store, const void* key, size_t keyLength);
+
+/**
+ * @brief Visit every key in unspecified order
+ * @return 0 if all keys were visited, otherwise the visitor's stop value
+ */
+int kv_store_keys(KvStore* store, KvStoreVisit visit, void* context);
+
+/**
+ * @brief Number of live keys
+ */
+size_t kv_store_count(KvStore* store);
+
+/**
+ * @brief Wait until every write made so far is on disk
+ * @return 0 on success, -1 if the store has failed
+ */
+int kv_store_sync(KvStore* store);
+
+/**
+ * @brief Change how long writes are collected before a commit
+ * @param milliseconds Window; 0 commits as soon as the thread wakes
+ */
+void kv_store_set_commit_window(KvStore* store, unsigned int milliseconds);
+
+/**
+ * @brief Read the store counters
+ * @param stats Receives the counters
+ */
+void kv_store_get_stats(KvStore* store, KvStoreStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KV_STORE_H */
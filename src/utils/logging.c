@@ -10,6 +10,8 @@
 #include <time.h>
 
 #include "logging.h"
+#include "trace.h"
+#include "core/plugin_config.h"
 #include "core/plugin_main.h"
 #include "teamlog/logtypes.h"
 
@@ -27,7 +29,14 @@ static const char* get_log_level_string(LogLevel level)
 static void log_message(LogLevel level, const char* format, va_list args)
 {
     char buffer[1024];
-    
+
+    /* Checked before formatting so filtered messages cost one pointer load */
+    if (level < get_config()->logLevel) {
+        return;
+    }
+
+    TRACE_BEGIN(span);
+
     vsnprintf(buffer, sizeof(buffer), format, args);
     buffer[sizeof(buffer) - 1] = '\0';
 
@@ -57,6 +66,8 @@ static void log_message(LogLevel level, const char* format, va_list args)
         }
         ts3Functions->logMessage(buffer, ts3LogLevel, "TsPy Plugin", 0);
     }
+
+    TRACE_END(span, "log", "flush");
 }
 
 void log_debug(const char* format, ...)
@@ -5,6 +5,7 @@
  * @version 1.2.0
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,6 +29,74 @@ void safe_strcpy(char* dest, size_t destSize, const char* src)
 #endif
 }
 
+void join_path(char* dest, size_t destSize, const char* dir, const char* name)
+{
+    size_t len;
+
+    if (dest == NULL || dir == NULL || name == NULL || destSize == 0) {
+        return;
+    }
+
+    len = strlen(dir);
+    if (len > 0 && (dir[len - 1] == '/' || dir[len - 1] == '\\')) {
+        snprintf(dest, destSize, "%s%s", dir, name);
+    } else {
+#ifdef _WIN32
+        snprintf(dest, destSize, "%s\\%s", dir, name);
+#else
+        snprintf(dest, destSize, "%s/%s", dir, name);
+#endif
+    }
+}
+
+/* Lower-case mapping for the two-byte code points utf8_casefold() handles */
+static unsigned int fold_codepoint(unsigned int cp)
+{
+    if ((cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) || (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2)) {
+        return cp + 0x20;   /* Latin-1, Greek */
+    }
+    if (cp >= 0x410 && cp <= 0x42F) {
+        return cp + 0x20;   /* Cyrillic */
+    }
+    if (cp >= 0x400 && cp <= 0x40F) {
+        return cp + 0x50;   /* Cyrillic with diacritics */
+    }
+    if ((cp >= 0x100 && cp <= 0x12F) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) {
+        return cp | 1;      /* Latin Extended-A, even capitals */
+    }
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) {
+        return (cp & 1) ? cp + 1 : cp; /* Latin Extended-A, odd capitals */
+    }
+    return cp;
+}
+
+void utf8_casefold(char* dest, const char* src, size_t length)
+{
+    size_t i = 0;
+
+    if (dest == NULL || src == NULL) {
+        return;
+    }
+
+    while (i < length) {
+        unsigned char c = (unsigned char)src[i];
+
+        if (c >= 'A' && c <= 'Z') {
+            dest[i] = (char)(c + ('a' - 'A'));
+            i++;
+        } else if (c >= 0xC2 && c <= 0xDF && i + 1 < length && ((unsigned char)src[i + 1] & 0xC0) == 0x80) {
+            unsigned int cp = fold_codepoint(((unsigned int)(c & 0x1F) << 6) | ((unsigned char)src[i + 1] & 0x3F));
+            dest[i] = (char)(0xC0 | (cp >> 6));
+            dest[i + 1] = (char)(0x80 | (cp & 0x3F));
+            i += 2;
+        } else {
+            dest[i] = (char)c;
+            i++;
+        }
+    }
+    dest[length] = '\0';
+}
+
 #ifdef _WIN32
 int wchar_to_utf8(const wchar_t* str, char** result)
 {
@@ -20,6 +20,28 @@ extern "C" {
  */
 void safe_strcpy(char* dest, size_t destSize, const char* src);
 
+/**
+ * @brief Join a directory and a file name with the platform separator
+ * @param dest Destination buffer
+ * @param destSize Size of destination buffer
+ * @param dir Directory (may already end with a separator)
+ * @param name File name
+ */
+void join_path(char* dest, size_t destSize, const char* dir, const char* name);
+
+/**
+ * @brief Case-fold UTF-8 text for matching
+ *
+ * Folds ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic capitals.
+ * Every folded character keeps its encoded length, so byte offsets in the
+ * output are valid in the input. Invalid sequences are copied unchanged.
+ *
+ * @param dest Destination buffer of at least length + 1 bytes (may equal src)
+ * @param src Source text
+ * @param length Number of bytes to fold
+ */
+void utf8_casefold(char* dest, const char* src, size_t length);
+
 #ifdef _WIN32
 /**
  * @brief Convert wchar_t to UTF-8 encoded string
@@ -0,0 +1,274 @@
+/**
+ * @file threading.c
+ * @brief Portable thread and clock helpers implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#if !defined(_WIN32)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <stdlib.h>
+
+#include "arena.h"
+#include "threading.h"
+
+typedef struct ThreadStart {
+    ThreadFunction function;
+    void*          arg;
+} ThreadStart;
+
+#ifdef _WIN32
+
+uint32_t thread_current_id(void)
+{
+    return (uint32_t)GetCurrentThreadId();
+}
+
+void thread_sleep_ms(unsigned int milliseconds)
+{
+    Sleep(milliseconds);
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    static LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+
+    /* Split to avoid overflowing 64 bits at high counter frequencies */
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+         + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+}
+
+void mutex_init(Mutex* mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void mutex_destroy(Mutex* mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+void mutex_lock(Mutex* mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void mutex_unlock(Mutex* mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+void cond_init(CondVar* cond)
+{
+    InitializeConditionVariable(cond);
+}
+
+void cond_destroy(CondVar* cond)
+{
+    (void)cond; /* Nothing to release */
+}
+
+void cond_wait(CondVar* cond, Mutex* mutex)
+{
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+int cond_timed_wait(CondVar* cond, Mutex* mutex, unsigned int milliseconds)
+{
+    if (!SleepConditionVariableCS(cond, mutex, milliseconds)) {
+        return GetLastError() == ERROR_TIMEOUT ? 1 : 0;
+    }
+    return 0;
+}
+
+void cond_signal(CondVar* cond)
+{
+    WakeConditionVariable(cond);
+}
+
+void cond_broadcast(CondVar* cond)
+{
+    WakeAllConditionVariable(cond);
+}
+
+static DWORD WINAPI thread_trampoline(LPVOID param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    arena_thread_attach();
+    start.function(start.arg);
+    arena_thread_free();
+    return 0;
+}
+
+int thread_create(Thread* thread, ThreadFunction function, void* arg)
+{
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+
+    if (start == NULL) {
+        return -1;
+    }
+    start->function = function;
+    start->arg = arg;
+
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(Thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+#else
+
+uint32_t thread_current_id(void)
+{
+#if defined(__linux__)
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    return (uint32_t)(uintptr_t)pthread_self();
+#endif
+}
+
+void thread_sleep_ms(unsigned int milliseconds)
+{
+    struct timespec ts;
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+uint64_t clock_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void mutex_init(Mutex* mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void mutex_destroy(Mutex* mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+void mutex_lock(Mutex* mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void mutex_unlock(Mutex* mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+void cond_init(CondVar* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+#if !defined(__APPLE__)
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void cond_destroy(CondVar* cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+void cond_wait(CondVar* cond, Mutex* mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+int cond_timed_wait(CondVar* cond, Mutex* mutex, unsigned int milliseconds)
+{
+    struct timespec deadline;
+
+#if defined(__APPLE__)
+    clock_gettime(CLOCK_REALTIME, &deadline);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+#endif
+    deadline.tv_sec += milliseconds / 1000;
+    deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_cond_timedwait(cond, mutex, &deadline) == ETIMEDOUT ? 1 : 0;
+}
+
+void cond_signal(CondVar* cond)
+{
+    pthread_cond_signal(cond);
+}
+
+void cond_broadcast(CondVar* cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
+static void* thread_trampoline(void* param)
+{
+    ThreadStart start = *(ThreadStart*)param;
+    free(param);
+    arena_thread_attach();
+    start.function(start.arg);
+    arena_thread_free();
+    return NULL;
+}
+
+int thread_create(Thread* thread, ThreadFunction function, void* arg)
+{
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+
+    if (start == NULL) {
+        return -1;
+    }
+    start->function = function;
+    start->arg = arg;
+
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#endif
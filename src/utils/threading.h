@@ -0,0 +1,251 @@
+/**
+ * @file threading.h
+ * @brief Portable atomics, thread-local storage and clock helpers
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Thin wrappers over the Win32 Interlocked API and the GCC/Clang __atomic
+ * builtins so the rest of the plugin can stay plain C11 on both platforms.
+ */
+
+#ifndef THREADING_H
+#define THREADING_H
+
+#include <stdint.h>
+
+#if defined(WIN32) || defined(__WIN32__) || defined(_WIN32)
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Thread-local storage specifier
+ */
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+/* ========================================================================
+ * Atomics (sequentially consistent)
+ * ======================================================================== */
+
+#ifdef _WIN32
+
+static __inline int32_t atomic32_load(volatile int32_t* p)
+{
+    return (int32_t)InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+}
+
+static __inline void atomic32_store(volatile int32_t* p, int32_t v)
+{
+    InterlockedExchange((volatile LONG*)p, (LONG)v);
+}
+
+static __inline int32_t atomic32_add(volatile int32_t* p, int32_t v)
+{
+    return (int32_t)InterlockedExchangeAdd((volatile LONG*)p, (LONG)v) + v;
+}
+
+static __inline int atomic32_cas(volatile int32_t* p, int32_t expected, int32_t desired)
+{
+    return InterlockedCompareExchange((volatile LONG*)p, (LONG)desired, (LONG)expected) == (LONG)expected;
+}
+
+static __inline int64_t atomic64_load(volatile int64_t* p)
+{
+    return (int64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0);
+}
+
+static __inline void atomic64_store(volatile int64_t* p, int64_t v)
+{
+    InterlockedExchange64((volatile LONG64*)p, (LONG64)v);
+}
+
+static __inline int64_t atomic64_add(volatile int64_t* p, int64_t v)
+{
+    return (int64_t)InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)v) + v;
+}
+
+static __inline int atomic64_cas(volatile int64_t* p, int64_t expected, int64_t desired)
+{
+    return InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)desired, (LONG64)expected) == (LONG64)expected;
+}
+
+static __inline void* atomic_ptr_load(void* volatile* p)
+{
+    return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+static __inline void atomic_ptr_store(void* volatile* p, void* v)
+{
+    InterlockedExchangePointer(p, v);
+}
+
+static __inline int atomic_ptr_cas(void* volatile* p, void* expected, void* desired)
+{
+    return InterlockedCompareExchangePointer(p, desired, expected) == expected;
+}
+
+#else
+
+static inline int32_t atomic32_load(volatile int32_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic32_store(volatile int32_t* p, int32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int32_t atomic32_add(volatile int32_t* p, int32_t v)
+{
+    return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic32_cas(volatile int32_t* p, int32_t expected, int32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t atomic64_load(volatile int64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic64_store(volatile int64_t* p, int64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t atomic64_add(volatile int64_t* p, int64_t v)
+{
+    return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic64_cas(volatile int64_t* p, int64_t expected, int64_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void* atomic_ptr_load(void* volatile* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_ptr_store(void* volatile* p, void* v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_ptr_cas(void* volatile* p, void* expected, void* desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+/* ========================================================================
+ * Threads and clocks
+ * ======================================================================== */
+
+/**
+ * @brief Get a numeric identifier for the calling thread
+ * @return OS thread ID
+ */
+uint32_t thread_current_id(void);
+
+/**
+ * @brief Sleep the calling thread
+ * @param milliseconds Time to sleep
+ */
+void thread_sleep_ms(unsigned int milliseconds);
+
+/**
+ * @brief Read the monotonic clock
+ * @return Nanoseconds since an arbitrary fixed point
+ */
+uint64_t clock_monotonic_ns(void);
+
+/* ========================================================================
+ * Mutexes, condition variables and threads
+ * ======================================================================== */
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION   Mutex;
+typedef CONDITION_VARIABLE CondVar;
+typedef HANDLE             Thread;
+#else
+typedef pthread_mutex_t    Mutex;
+typedef pthread_cond_t     CondVar;
+typedef pthread_t          Thread;
+#endif
+
+/**
+ * @brief Thread entry point
+ */
+typedef void (*ThreadFunction)(void* arg);
+
+void mutex_init(Mutex* mutex);
+
+void mutex_destroy(Mutex* mutex);
+
+void mutex_lock(Mutex* mutex);
+
+void mutex_unlock(Mutex* mutex);
+
+/**
+ * @brief Initialise a condition variable (timed waits use the monotonic clock)
+ * @param cond Condition variable
+ */
+void cond_init(CondVar* cond);
+
+void cond_destroy(CondVar* cond);
+
+/**
+ * @brief Wait for a signal; the mutex must be held and is held again on return
+ * @param cond Condition variable
+ * @param mutex Mutex
+ */
+void cond_wait(CondVar* cond, Mutex* mutex);
+
+/**
+ * @brief Wait for a signal or a timeout; the mutex must be held
+ * @param cond Condition variable
+ * @param mutex Mutex
+ * @param milliseconds Timeout
+ * @return 0 if signalled (or woken spuriously), 1 on timeout
+ */
+int cond_timed_wait(CondVar* cond, Mutex* mutex, unsigned int milliseconds);
+
+void cond_signal(CondVar* cond);
+
+void cond_broadcast(CondVar* cond);
+
+/**
+ * @brief Start a thread
+ * @param thread Receives the thread handle
+ * @param function Entry point
+ * @param arg Argument for the entry point
+ * @return 0 on success, -1 on failure
+ */
+int thread_create(Thread* thread, ThreadFunction function, void* arg);
+
+/**
+ * @brief Wait for a thread to finish and release its handle
+ * @param thread Thread handle from thread_create
+ */
+void thread_join(Thread thread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* THREADING_H */
@@ -0,0 +1,145 @@
+/**
+ * @file timer_wheel.c
+ * @brief Hierarchical timing wheel implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include "timer_wheel.h"
+
+#define SLOT_MASK ((uint64_t)(TIMER_WHEEL_SLOTS - 1))
+
+/* Largest delta the top level can represent */
+#define MAX_DELTA ((1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+static void list_append(TimerNode* head, TimerNode* node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_unlink(TimerNode* node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+}
+
+void timer_wheel_init(TimerWheel* wheel, uint64_t now)
+{
+    int level;
+    int slot;
+
+    wheel->now = now;
+    wheel->count = 0;
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+}
+
+/* Place a node by its distance from now; does not touch count */
+static void place(TimerWheel* wheel, TimerNode* node)
+{
+    uint64_t expires = node->expires > wheel->now ? node->expires : wheel->now + 1;
+    uint64_t delta = expires - wheel->now;
+    int level;
+
+    if (delta > MAX_DELTA) {
+        /* Park at the far end of the top level; re-placed when cascaded */
+        expires = wheel->now + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+
+    list_append(&wheel->slots[level][(expires >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK], node);
+}
+
+void timer_wheel_add(TimerWheel* wheel, TimerNode* node, uint64_t expires)
+{
+    node->expires = expires;
+    place(wheel, node);
+    wheel->count++;
+}
+
+int timer_wheel_cancel(TimerWheel* wheel, TimerNode* node)
+{
+    if (node->prev == NULL) {
+        return 0;
+    }
+    list_unlink(node);
+    wheel->count--;
+    return 1;
+}
+
+int timer_node_is_pending(const TimerNode* node)
+{
+    return node->prev != NULL;
+}
+
+/* Move every node of a higher-level slot down to where it now belongs */
+static void cascade(TimerWheel* wheel, int level, uint64_t slot)
+{
+    TimerNode* head = &wheel->slots[level][slot];
+
+    while (head->next != head) {
+        TimerNode* node = head->next;
+        list_unlink(node);
+        place(wheel, node);
+    }
+}
+
+TimerNode* timer_wheel_advance(TimerWheel* wheel, uint64_t now)
+{
+    TimerNode* expired = NULL;
+    TimerNode** tail = &expired;
+
+    /* Nothing can fire in between, so jump straight to now */
+    if (wheel->count == 0) {
+        if (now > wheel->now) {
+            wheel->now = now;
+        }
+        return NULL;
+    }
+
+    while (wheel->now < now) {
+        TimerNode* head;
+        int level;
+
+        wheel->now++;
+
+        /* At each level boundary, pull the next slot of the level above down */
+        for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((wheel->now & ((1ULL << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(wheel, level, (wheel->now >> (TIMER_WHEEL_BITS * level)) & SLOT_MASK);
+        }
+
+        head = &wheel->slots[0][wheel->now & SLOT_MASK];
+        while (head->next != head) {
+            TimerNode* node = head->next;
+            list_unlink(node);
+            wheel->count--;
+            *tail = node;
+            tail = &node->next;
+        }
+        *tail = NULL;
+
+        if (wheel->count == 0) {
+            wheel->now = now;
+        }
+    }
+
+    return expired;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timing wheel
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Four levels of 64 slots; level n covers 64^(n+1) ticks. Timers are
+ * intrusive nodes in per-slot doubly linked lists, so adding and cancelling
+ * are O(1); a timer is moved down one level at a time as its expiry
+ * approaches. Not thread-safe: callers serialise access.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * @brief Timer node; embed in the owning structure
+ */
+typedef struct TimerNode {
+    struct TimerNode* next;
+    struct TimerNode* prev;    /* NULL while not scheduled */
+    uint64_t          expires; /* Tick at which the timer is due */
+} TimerNode;
+
+/**
+ * @brief Timing wheel
+ */
+typedef struct TimerWheel {
+    uint64_t  now;   /* Last tick processed */
+    size_t    count; /* Scheduled timers */
+    TimerNode slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; /* List heads */
+} TimerWheel;
+
+/**
+ * @brief Initialise an empty wheel
+ * @param wheel Wheel
+ * @param now Current tick
+ */
+void timer_wheel_init(TimerWheel* wheel, uint64_t now);
+
+/**
+ * @brief Schedule a timer
+ * @param wheel Wheel
+ * @param node Unscheduled timer node
+ * @param expires Due tick; ticks in the past fire on the next advance
+ */
+void timer_wheel_add(TimerWheel* wheel, TimerNode* node, uint64_t expires);
+
+/**
+ * @brief Unschedule a timer
+ * @param wheel Wheel
+ * @param node Timer node
+ * @return 1 if it was scheduled, 0 otherwise
+ */
+int timer_wheel_cancel(TimerWheel* wheel, TimerNode* node);
+
+/**
+ * @brief Check whether a timer is scheduled
+ * @param node Timer node
+ * @return 1 if scheduled, 0 otherwise
+ */
+int timer_node_is_pending(const TimerNode* node);
+
+/**
+ * @brief Advance the wheel and collect due timers
+ * @param wheel Wheel
+ * @param now Current tick
+ * @return Due timers linked through next (NULL-terminated, unscheduled), or NULL
+ */
+TimerNode* timer_wheel_advance(TimerWheel* wheel, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,261 @@
+/**
+ * @file trace.c
+ * @brief Span tracing implementation
+ * @author TsPy Team
+ * @version 1.4.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "threading.h"
+#include "logging.h"
+
+typedef struct TraceRecord {
+    const char* category;
+    const char* name;
+    uint64_t    start_ns;
+    uint64_t    duration_ns;
+} TraceRecord;
+
+/* One ring per thread; only the owning thread writes records and head */
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;
+    uint32_t            thread_id;
+    char                thread_name[TRACE_THREAD_NAME_BUFSIZE]; /* Outlives the thread, so a copy */
+    volatile int32_t    session;
+    volatile int32_t    busy;
+    volatile int64_t    head;
+    size_t              capacity;
+    TraceRecord*        records;
+} TraceBuffer;
+
+static void* volatile   g_buffers = NULL;
+static volatile int32_t g_generation = 0;
+static volatile int32_t g_enabled = 0;
+static volatile int32_t g_session = 0;
+static volatile int64_t g_capacity = TRACE_DEFAULT_CAPACITY;
+static uint64_t         g_session_start_ns = 0;
+
+static THREAD_LOCAL TraceBuffer* t_buffer = NULL;
+static THREAD_LOCAL int32_t      t_generation = 0;
+static THREAD_LOCAL char         t_thread_name[TRACE_THREAD_NAME_BUFSIZE];
+
+static TraceBuffer* get_thread_buffer(void)
+{
+    TraceBuffer* buffer = t_buffer;
+    void* head;
+
+    /* trace_shutdown() bumps the generation, invalidating cached pointers */
+    if (buffer == NULL || t_generation != atomic32_load(&g_generation)) {
+        buffer = (TraceBuffer*)calloc(1, sizeof(TraceBuffer));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        buffer->thread_id = thread_current_id();
+        memcpy(buffer->thread_name, t_thread_name, sizeof(buffer->thread_name));
+        buffer->session = -1;
+
+        /* Lock-free push onto the global buffer list */
+        do {
+            head = atomic_ptr_load(&g_buffers);
+            buffer->next = (TraceBuffer*)head;
+        } while (!atomic_ptr_cas(&g_buffers, head, buffer));
+
+        t_buffer = buffer;
+        t_generation = atomic32_load(&g_generation);
+    }
+
+    return buffer;
+}
+
+/* First record of a new session: reset (and resize) the ring. Caller is busy. */
+static int reset_for_session(TraceBuffer* buffer)
+{
+    size_t capacity = (size_t)atomic64_load(&g_capacity);
+
+    if (buffer->capacity != capacity) {
+        TraceRecord* records = (TraceRecord*)realloc(buffer->records, capacity * sizeof(TraceRecord));
+        if (records == NULL) {
+            return 1;
+        }
+        buffer->records = records;
+        buffer->capacity = capacity;
+    }
+    atomic64_store(&buffer->head, 0);
+    buffer->session = g_session;
+    return 0;
+}
+
+int trace_start(size_t capacity)
+{
+    if (atomic32_load(&g_enabled)) {
+        return 1;
+    }
+
+    atomic64_store(&g_capacity, (int64_t)(capacity > 0 ? capacity : TRACE_DEFAULT_CAPACITY));
+    atomic32_add(&g_session, 1);
+    g_session_start_ns = clock_monotonic_ns();
+    atomic32_store(&g_enabled, 1);
+
+    log_info("Tracing started (%lld spans per thread)", (long long)atomic64_load(&g_capacity));
+    return 0;
+}
+
+int trace_is_enabled(void)
+{
+    return g_enabled != 0;
+}
+
+uint64_t trace_begin(void)
+{
+    /* Plain volatile read: a stale value only costs one span at the edges */
+    if (!g_enabled) {
+        return 0;
+    }
+    return clock_monotonic_ns();
+}
+
+void trace_end(const char* category, const char* name, uint64_t start)
+{
+    TraceBuffer* buffer;
+    TraceRecord* record;
+    int64_t head;
+    uint64_t now = clock_monotonic_ns();
+
+    buffer = get_thread_buffer();
+    if (buffer == NULL) {
+        return;
+    }
+
+    /* Mark busy before re-checking the flag so trace_stop() can wait us out */
+    atomic32_store(&buffer->busy, 1);
+    if (atomic32_load(&g_enabled) && start >= g_session_start_ns
+        && (buffer->session == g_session || reset_for_session(buffer) == 0)) {
+        head = buffer->head;
+        record = &buffer->records[(size_t)head % buffer->capacity];
+        record->category = category;
+        record->name = name;
+        record->start_ns = start;
+        record->duration_ns = now - start;
+        atomic64_store(&buffer->head, head + 1);
+    }
+    atomic32_store(&buffer->busy, 0);
+}
+
+void trace_set_thread_name(const char* name)
+{
+    snprintf(t_thread_name, sizeof(t_thread_name), "%s", name != NULL ? name : "");
+    if (t_buffer != NULL) {
+        memcpy(t_buffer->thread_name, t_thread_name, sizeof(t_buffer->thread_name));
+    }
+}
+
+static void write_json_string(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (; str != NULL && *str != '\0'; str++) {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', fp);
+            fputc(*str, fp);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc(*str, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+long trace_stop(const char* output_path)
+{
+    TraceBuffer* buffer;
+    FILE* fp;
+    long written = 0;
+    long long overwritten = 0;
+    int first = 1;
+
+    if (!atomic32_load(&g_enabled)) {
+        return -1;
+    }
+
+    /* Keep tracing if there is nowhere to write, so the caller can retry */
+    fp = fopen(output_path, "w");
+    if (fp == NULL) {
+        log_error("Failed to open trace output: %s", output_path);
+        return -1;
+    }
+    atomic32_store(&g_enabled, 0);
+
+    /* Wait for writers that saw the flag before we cleared it */
+    for (buffer = (TraceBuffer*)atomic_ptr_load(&g_buffers); buffer != NULL; buffer = buffer->next) {
+        while (atomic32_load(&buffer->busy)) {
+            thread_sleep_ms(0);
+        }
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+
+    for (buffer = (TraceBuffer*)atomic_ptr_load(&g_buffers); buffer != NULL; buffer = buffer->next) {
+        int64_t head = atomic64_load(&buffer->head);
+        int64_t i = head > (int64_t)buffer->capacity ? head - (int64_t)buffer->capacity : 0;
+
+        if (buffer->session != g_session || head == 0) {
+            continue;
+        }
+        overwritten += i;
+
+        if (buffer->thread_name[0] != '\0') {
+            fprintf(fp, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+                    first ? "" : ",\n", buffer->thread_id);
+            write_json_string(fp, buffer->thread_name);
+            fputs("}}", fp);
+            first = 0;
+        }
+
+        for (; i < head; i++) {
+            const TraceRecord* record = &buffer->records[(size_t)i % buffer->capacity];
+            fprintf(fp, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":",
+                    first ? "" : ",\n", buffer->thread_id,
+                    (double)(record->start_ns - g_session_start_ns) / 1000.0,
+                    (double)record->duration_ns / 1000.0);
+            write_json_string(fp, record->category);
+            fputs(",\"name\":", fp);
+            write_json_string(fp, record->name);
+            fputc('}', fp);
+            first = 0;
+            written++;
+        }
+    }
+
+    fputs("\n]}\n", fp);
+    fclose(fp);
+
+    log_info("Tracing stopped: %ld spans written to %s", written, output_path);
+    if (overwritten > 0) {
+        log_warning("Trace ring buffers wrapped; %lld oldest spans were overwritten", overwritten);
+    }
+    return written;
+}
+
+void trace_shutdown(void)
+{
+    TraceBuffer* buffer;
+
+    atomic32_store(&g_enabled, 0);
+    atomic32_add(&g_generation, 1);
+    buffer = (TraceBuffer*)atomic_ptr_load(&g_buffers);
+    atomic_ptr_store(&g_buffers, NULL);
+
+    while (buffer != NULL) {
+        TraceBuffer* next = buffer->next;
+        while (atomic32_load(&buffer->busy)) {
+            thread_sleep_ms(0);
+        }
+        free(buffer->records);
+        free(buffer);
+        buffer = next;
+    }
+}
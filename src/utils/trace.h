@@ -0,0 +1,100 @@
+/**
+ * @file trace.h
+ * @brief Span tracing with Chrome trace-event JSON export
+ * @author TsPy Team
+ * @version 1.4.0
+ *
+ * Records complete ("X") spans into per-thread ring buffers. Each buffer has
+ * exactly one writer, so recording is lock-free; buffers are linked into a
+ * global list with a single CAS the first time a thread records. The output
+ * opens directly in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Default number of span records kept per thread
+ */
+#define TRACE_DEFAULT_CAPACITY 65536
+
+/**
+ * @brief Longest thread name kept in a trace, including the terminator
+ */
+#define TRACE_THREAD_NAME_BUFSIZE 64
+
+/**
+ * @brief Begin a span; declares a local holding the start timestamp
+ *
+ * Category and name passed to TRACE_END must be string literals (or other
+ * storage that outlives the trace session) - only the pointers are recorded.
+ */
+#define TRACE_BEGIN(span) uint64_t span = trace_begin()
+
+/**
+ * @brief End a span started with TRACE_BEGIN
+ */
+#define TRACE_END(span, category, name) \
+    do {                                \
+        if (span != 0) {                \
+            trace_end(category, name, span); \
+        }                               \
+    } while (0)
+
+/**
+ * @brief Start a tracing session, discarding spans from any previous one
+ * @param capacity Records kept per thread (0 = TRACE_DEFAULT_CAPACITY)
+ * @return 0 on success, non-zero if a session is already running
+ */
+int trace_start(size_t capacity);
+
+/**
+ * @brief Stop the running session and write it as trace-event JSON
+ * @param output_path File to write
+ * @return Number of spans written, or -1 on failure (tracing keeps running if the file cannot be opened)
+ */
+long trace_stop(const char* output_path);
+
+/**
+ * @brief Check whether a session is running
+ * @return 1 if tracing, 0 otherwise
+ */
+int trace_is_enabled(void);
+
+/**
+ * @brief Timestamp the start of a span
+ * @return Start time in nanoseconds, or 0 when tracing is off
+ */
+uint64_t trace_begin(void);
+
+/**
+ * @brief Record a span that started at @p start
+ * @param category Span category (static string)
+ * @param name Span name (static string)
+ * @param start Value returned by trace_begin()
+ */
+void trace_end(const char* category, const char* name, uint64_t start);
+
+/**
+ * @brief Name the calling thread in exported traces
+ * @param name Thread name; copied, so it may be freed once this returns
+ */
+void trace_set_thread_name(const char* name);
+
+/**
+ * @brief Release all trace buffers (plugin shutdown only)
+ */
+void trace_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */